@@ -0,0 +1,260 @@
+/********************************************************************************/
+/*										*/
+/*				Command Arena					*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+/* The command arena is a per TPM instance bump allocator for ordinal temporaries.
+
+   An ordinal opts in by initializing a local TPM_SIZED_BUFFER or TPM_STORE_BUFFER with
+   TPM_SizedBuffer_InitArena() or TPM_Sbuffer_InitArena().  Those buffers then allocate and grow
+   from tpm_state->tpm_arena rather than the heap, and their _Delete functions do not free.
+   TPM_Process() calls TPM_Arena_Reset() once the response is complete, which clears and releases
+   everything handed out during the command.
+
+   An arena buffer must never be moved into state that outlives the command, such as keys,
+   sessions, NV, or the saved state.  Copying into such a structure with TPM_SizedBuffer_Copy() or
+   TPM_SizedBuffer_Set() is safe, since the destination allocates from its own arena, which is
+   NULL.
+
+   A NULL arena makes each function behave like its heap equivalent.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tpm_constants.h"
+#include "tpm_debug.h"
+#include "tpm_error.h"
+#include "tpm_memory.h"
+
+#include "tpm_arena.h"
+
+/* arena allocations are rounded up to this, so that each one starts aligned */
+
+#define TPM_ARENA_ALIGN		8
+#define TPM_ARENA_ROUND(size)	(((size) + TPM_ARENA_ALIGN - 1) & ~(TPM_ARENA_ALIGN - 1))
+
+/* TPM_ARENA_OVERFLOW heads a heap allocation that did not fit in the block.  The data follows at
+   TPM_ARENA_HEADER.
+*/
+
+typedef struct tdTPM_ARENA_OVERFLOW {
+    struct tdTPM_ARENA_OVERFLOW *next;
+    uint32_t size;				/* data bytes, cleared at reset */
+} TPM_ARENA_OVERFLOW;
+
+#define TPM_ARENA_HEADER	TPM_ARENA_ROUND(sizeof(TPM_ARENA_OVERFLOW))
+
+/* TPM_Arena_Init() sets an empty arena.  The block is allocated on first use.
+ */
+
+void TPM_Arena_Init(TPM_ARENA *tpm_arena)
+{
+    tpm_arena->buffer = NULL;
+    tpm_arena->used = 0;
+    tpm_arena->last = NULL;
+    tpm_arena->overflow = NULL;
+    return;
+}
+
+/* TPM_Arena_Malloc() is the arena equivalent of TPM_Malloc().  If 'tpm_arena' is NULL, it calls
+   TPM_Malloc().
+
+   The memory is released by TPM_Arena_Reset(), not by the caller.
+*/
+
+TPM_RESULT TPM_Arena_Malloc(TPM_ARENA *tpm_arena,
+			    unsigned char **buffer,
+			    uint32_t size)
+{
+    TPM_RESULT		rc = 0;
+    uint32_t		rounded;
+    TPM_ARENA_OVERFLOW	*overflow;
+
+    if (tpm_arena == NULL) {
+	rc = TPM_Malloc(buffer, size);
+    }
+    else {
+	/* the same assertions as TPM_Malloc() */
+	if (rc == 0) {
+	    if (*buffer != NULL) {
+		printf("TPM_Arena_Malloc: Error (fatal), *buffer %p should be NULL before malloc\n",
+		       *buffer);
+		rc = TPM_FAIL;
+	    }
+	}
+	if (rc == 0) {
+	    if (size > TPM_ALLOC_MAX) {
+		printf("TPM_Arena_Malloc: Error, size %u greater than maximum allowed\n", size);
+		rc = TPM_SIZE;
+	    }
+	}
+	if (rc == 0) {
+	    if (size == 0) {
+		printf("TPM_Arena_Malloc: Error (fatal), size is zero\n");
+		rc = TPM_FAIL;
+	    }
+	}
+	if ((rc == 0) && (tpm_arena->buffer == NULL)) {
+	    rc = TPM_Malloc(&(tpm_arena->buffer), TPM_ARENA_SIZE);
+	}
+	if (rc == 0) {
+	    rounded = TPM_ARENA_ROUND(size);
+	    /* bump allocate from the block */
+	    if (rounded <= (TPM_ARENA_SIZE - tpm_arena->used)) {
+		*buffer = tpm_arena->buffer + tpm_arena->used;
+		tpm_arena->last = *buffer;
+		tpm_arena->used += rounded;
+	    }
+	    /* if it does not fit, chain a heap allocation */
+	    else {
+		printf("  TPM_Arena_Malloc: Overflow allocating %u bytes\n", size);
+		overflow = malloc(TPM_ARENA_HEADER + size);
+		if (overflow == NULL) {
+		    printf("TPM_Arena_Malloc: Error allocating %u bytes\n", size);
+		    rc = TPM_SIZE;
+		}
+		if (rc == 0) {
+		    overflow->next = tpm_arena->overflow;
+		    overflow->size = size;
+		    tpm_arena->overflow = overflow;
+		    *buffer = (unsigned char *)overflow + TPM_ARENA_HEADER;
+		}
+	    }
+	}
+    }
+    return rc;
+}
+
+/* TPM_Arena_Realloc() is the arena equivalent of TPM_Realloc().  If 'tpm_arena' is NULL, it calls
+   TPM_Realloc().
+
+   'old_size' is the size of the existing '*buffer'.  The most recent block allocation is grown in
+   place.  Otherwise the data is copied to a new allocation and the old one is left for
+   TPM_Arena_Reset().
+*/
+
+TPM_RESULT TPM_Arena_Realloc(TPM_ARENA *tpm_arena,
+			     unsigned char **buffer,
+			     uint32_t old_size,
+			     uint32_t size)
+{
+    TPM_RESULT		rc = 0;
+    uint32_t		offset = 0;	/* of '*buffer' in the block */
+    unsigned char	*new_buffer = NULL;
+
+    if (tpm_arena == NULL) {
+	rc = TPM_Realloc(buffer, size);
+    }
+    else if (*buffer == NULL) {
+	rc = TPM_Arena_Malloc(tpm_arena, buffer, size);
+    }
+    else {
+	if (rc == 0) {
+	    if (size > TPM_ALLOC_MAX) {
+		printf("TPM_Arena_Realloc: Error, size %u greater than maximum allowed\n", size);
+		rc = TPM_SIZE;
+	    }
+	}
+	if (rc == 0) {
+	    /* the last block allocation can grow in place.  It never shrinks 'used', so that
+	       TPM_Arena_Reset() still clears the old tail. */
+	    if (*buffer == tpm_arena->last) {
+		offset = (uint32_t)(*buffer - tpm_arena->buffer);
+	    }
+	    if ((*buffer == tpm_arena->last) &&
+		(TPM_ARENA_ROUND(size) <= (TPM_ARENA_SIZE - offset))) {
+		if ((offset + TPM_ARENA_ROUND(size)) > tpm_arena->used) {
+		    tpm_arena->used = offset + TPM_ARENA_ROUND(size);
+		}
+	    }
+	    else {
+		rc = TPM_Arena_Malloc(tpm_arena, &new_buffer, size);
+		if (rc == 0) {
+		    memcpy(new_buffer, *buffer, (old_size < size) ? old_size : size);
+		    *buffer = new_buffer;
+		}
+	    }
+	}
+    }
+    return rc;
+}
+
+/* TPM_Arena_Free() is the arena equivalent of free().  Arena memory is released by
+   TPM_Arena_Reset(), so this only frees if 'tpm_arena' is NULL.
+*/
+
+void TPM_Arena_Free(TPM_ARENA *tpm_arena,
+		    unsigned char *buffer)
+{
+    if (tpm_arena == NULL) {
+	free(buffer);
+    }
+    return;
+}
+
+/* TPM_Arena_Reset() clears and releases everything allocated since the last reset.  The block is
+   kept for the next command.
+
+   It is called by TPM_Process() after the response is complete.  No arena buffer may be in use.
+*/
+
+void TPM_Arena_Reset(TPM_ARENA *tpm_arena)
+{
+    TPM_ARENA_OVERFLOW	*overflow;
+
+    /* the temporaries may hold secrets */
+    if (tpm_arena->used > 0) {
+	memset(tpm_arena->buffer, 0, tpm_arena->used);
+    }
+    while (tpm_arena->overflow != NULL) {
+	overflow = tpm_arena->overflow;
+	tpm_arena->overflow = overflow->next;
+	memset((unsigned char *)overflow + TPM_ARENA_HEADER, 0, overflow->size);
+	free(overflow);
+    }
+    tpm_arena->used = 0;
+    tpm_arena->last = NULL;
+    return;
+}
+
+/* TPM_Arena_Delete() releases the arena, including the block, and reinitializes it
+ */
+
+void TPM_Arena_Delete(TPM_ARENA *tpm_arena)
+{
+    TPM_Arena_Reset(tpm_arena);
+    free(tpm_arena->buffer);
+    TPM_Arena_Init(tpm_arena);
+    return;
+}
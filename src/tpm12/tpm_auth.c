@@ -213,14 +213,24 @@ TPM_RESULT TPM_AuthParams_Set(TPM_STORE_BUFFER *response,
     if (rc == 0) {
 	rc = TPM_Sbuffer_Append(response, &continueAuthSession, sizeof(TPM_BOOL));
     }
-    /* Calculate resAuth using the hmac key */
+    /* Calculate resAuth using the hmac key, cached in the session */
     if (rc == 0) {
-	rc = TPM_Authdata_Generate(resAuth,			/* result */
-				   hmacKey,			/* HMAC key */
-				   outParamDigest,		/* params */
-				   auth_session_data->nonceEven,
-				   nonceOdd,
-				   continueAuthSession);
+	rc = TPM_HmacMidstate_Set(&(auth_session_data->hmacMidstate), hmacKey);
+    }
+    if (rc == 0) {
+	TPM_PrintFour("  TPM_AuthParams_Set: outParamDigest", outParamDigest);
+	TPM_PrintFour("  TPM_AuthParams_Set: usageAuth (key)", hmacKey);
+	TPM_PrintFour("  TPM_AuthParams_Set: nonceEven", auth_session_data->nonceEven);
+	TPM_PrintFour("  TPM_AuthParams_Set: nonceOdd", nonceOdd);
+	printf       ("  TPM_AuthParams_Set: continueSession %02x\n", continueAuthSession);
+	rc = TPM_HMAC_GenerateMidstate(resAuth,
+				       &(auth_session_data->hmacMidstate),	/* key */
+				       TPM_DIGEST_SIZE, outParamDigest,		/* response digest */
+				       TPM_NONCE_SIZE, auth_session_data->nonceEven,	/* 2H */
+				       TPM_NONCE_SIZE, nonceOdd,			/* 3H */
+				       sizeof(TPM_BOOL), &continueAuthSession,	/* 4H */
+				       0, NULL);
+	TPM_PrintFour("  TPM_AuthParams_Set: resAuth", resAuth);
     }
     /* append resAuth */
     if (rc == 0) {
@@ -284,16 +294,21 @@ TPM_RESULT TPM_Authdata_Check(tpm_state_t	*tpm_state,
 	TPM_PrintFour("  TPM_Authdata_Check: nonceEven", tpm_auth_session_data->nonceEven);
 	TPM_PrintFour("  TPM_Authdata_Check: nonceOdd", nonceOdd);
 	printf       ("  TPM_Authdata_Check: continueSession %02x\n", continueSession);
+	/* the HMAC key midstates are cached in the session, the OSAP or DSAP sharedSecret or the
+	   OIAP entity authorization */
+	rc = TPM_HmacMidstate_Set(&(tpm_auth_session_data->hmacMidstate), hmacKey);
+    }
+    if (rc == 0) {
 	/* HMAC the inParamDigest, authLastNonceEven, nonceOdd, continue */
 	/* authLastNonceEven is retrieved from internal authorization session storage */
-	rc = TPM_HMAC_Check(&valid,
-			    usageAuth,					/* expected, from command */
-			    hmacKey,					/* key */
-			    sizeof(TPM_DIGEST), inParamDigest,		/* command digest */
-			    sizeof(TPM_NONCE), tpm_auth_session_data->nonceEven,	/* 2H */
-			    sizeof(TPM_NONCE), nonceOdd,				/* 3H */
-			    sizeof(TPM_BOOL), &continueSession,				/* 4H */
-			    0, NULL);
+	rc = TPM_HMAC_CheckMidstate(&valid,
+				    usageAuth,				/* expected, from command */
+				    &(tpm_auth_session_data->hmacMidstate),	/* key */
+				    sizeof(TPM_DIGEST), inParamDigest,	/* command digest */
+				    sizeof(TPM_NONCE), tpm_auth_session_data->nonceEven,	/* 2H */
+				    sizeof(TPM_NONCE), nonceOdd,			/* 3H */
+				    sizeof(TPM_BOOL), &continueSession,			/* 4H */
+				    0, NULL);
     }
     if (rc == 0) {
 	if (!valid) {
@@ -157,6 +157,12 @@
 
 #define TPM_STORE_BUFFER_INCREMENT (TPM_ALLOC_MAX / 64)
 
+/* This is the size of the per command arena block.  It holds the temporaries of the common
+   ordinals.  Larger commands spill to the heap.
+*/
+
+#define TPM_ARENA_SIZE (TPM_STORE_BUFFER_INCREMENT * 8)
+
 /* This is the maximum value of the TPM input and output packet buffer.  It should be large enough
    to accommodate the largest TPM command or response, currently about 1200 bytes.  It should be
    small enough to accommodate whatever software is driving the TPM.
@@ -193,6 +199,49 @@
 
 #define TPM_SHA1_MAXNUMBYTES    (TPM12_GetBufferSize() - 64)
 
+/* RSA key pool
+
+   Key pairs of this size are pre-generated by the background key pool, see tpm_keypool.c.  The
+   pool depth is set at run time, up to the maximum.
+*/
+
+#ifndef TPM_RSA_KEYPOOL_KEY_LENGTH
+#define TPM_RSA_KEYPOOL_KEY_LENGTH	2048	/* in bits */
+#endif
+
+#ifndef TPM_RSA_KEYPOOL_DEPTH_MAX
+#define TPM_RSA_KEYPOOL_DEPTH_MAX	16
+#endif
+
+/* RSA public key cache
+
+   The number of prepared public key objects kept by the crypto library across commands.  Must be
+   at least 1.
+*/
+
+#ifndef TPM_RSA_PUBLIC_CACHE_SIZE
+#define TPM_RSA_PUBLIC_CACHE_SIZE	8
+#endif
+
+/* random number generator
+
+   TPM_Random() serves requests from an HMAC-SHA1 DRBG, seeded with TPM_DRBG_SEED_SIZE bytes from
+   the crypto library RNG.  The DRBG output is prefetched TPM_DRBG_BUFFER_SIZE bytes at a time, and
+   the DRBG is reseeded from the crypto library after TPM_DRBG_RESEED_INTERVAL prefetches.
+*/
+
+#ifndef TPM_DRBG_SEED_SIZE
+#define TPM_DRBG_SEED_SIZE		48
+#endif
+
+#ifndef TPM_DRBG_BUFFER_SIZE
+#define TPM_DRBG_BUFFER_SIZE		(16 * TPM_DIGEST_SIZE)
+#endif
+
+#ifndef TPM_DRBG_RESEED_INTERVAL
+#define TPM_DRBG_RESEED_INTERVAL	1024
+#endif
+
 /* extra audit status bits for TSC commands outside the normal ordinal range */
 #define TSC_PHYS_PRES_AUDIT     0x01
 #define TSC_RESET_ESTAB_AUDIT   0x02
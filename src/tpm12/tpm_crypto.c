@@ -37,7 +37,15 @@
 /* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
 /********************************************************************************/
 
-/* This is the openSSL implementation */
+/* This is the openSSL implementation
+
+   By default, it uses the low level RSA_* functions.  If TPM_OPENSSL_EVP is defined, RSA uses the
+   OpenSSL 3 EVP_PKEY interface instead, so that the operations go through the provider
+   implementations.
+
+   AES always uses EVP_CIPHER contexts, which have the AES-NI code, with the key schedule kept in
+   the context.  For EVP, the AES ciphers are fetched from the provider.
+*/
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -47,10 +55,21 @@
 #include <openssl/crypto.h>
 #include <openssl/rand.h>
 #include <openssl/sha.h>
+#ifdef TPM_OPENSSL_EVP
+#include <openssl/bn.h>
+#include <openssl/core_names.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/param_build.h>
+#include <openssl/params.h>
+#include <openssl/rsa.h>
+#else
 #include <openssl/engine.h>
+#endif
 
 #include "tpm_cryptoh.h"
 #include "tpm_debug.h"
+#include "tpm_digest.h"
 #include "tpm_error.h"
 #include "tpm_key.h"
 #include "tpm_io.h"
@@ -66,34 +85,107 @@
 static const unsigned char tpm_oaep_pad_str[] = { 'T', 'C', 'P', 'A' };
 
 
+/* TPM_RSA_TOKEN is the prepared RSA key behind the opaque public and private key tokens */
+
+#ifdef TPM_OPENSSL_EVP
+
+/* For EVP, the token holds the key and its operation contexts.  The contexts are initialized once
+   and reused for each operation.
+
+   For a private key, 'sig_ctx' does the PKCS#1 v1.5 SHA-1 signature and 'crypt_ctx' is NULL.  For
+   a public key, 'crypt_ctx' does the raw (unpadded) encrypt and 'sig_ctx' the signature
+   verification.
+
+   The padded contexts are initialized on first use by TPM_RSAToken_GetPadCtx().  'oaep_ctx' and
+   'pkcs1_ctx' decrypt (private key) or encrypt (public key) with the OAEP and PKCS#1 v1.5 type 2
+   pads.  'der_ctx' signs a caller supplied DER encoding with the type 1 pad.
+*/
+
+typedef struct tdTPM_RSA_TOKEN {
+    EVP_PKEY		*pkey;
+    EVP_PKEY_CTX	*crypt_ctx;
+    EVP_PKEY_CTX	*sig_ctx;
+    EVP_PKEY_CTX	*oaep_ctx;
+    EVP_PKEY_CTX	*pkcs1_ctx;
+    EVP_PKEY_CTX	*der_ctx;
+    TPM_BOOL		privateKey;
+    unsigned int	size;		/* modulus size in bytes */
+} TPM_RSA_TOKEN;
+
+#else
+
+/* For the low level API, the token is the OpenSSL RSA object */
+
+typedef RSA TPM_RSA_TOKEN;
+
+#endif
+
 /* local prototypes */
 
 static void       TPM_OpenSSL_PrintError(void);
 
-static TPM_RESULT TPM_RSAGeneratePublicToken(RSA **rsa_pub_key,
+static TPM_RESULT TPM_RSAGeneratePublicToken(TPM_RSA_TOKEN **rsa_pub_key,
 					     unsigned char *narr,
 					     uint32_t nbytes,
 					     unsigned char *earr,
 					     uint32_t ebytes);
-static TPM_RESULT TPM_RSAGeneratePrivateToken(RSA **rsa_pri_key,
+static TPM_RESULT TPM_RSAPublicKeyCache_Get(TPM_RSA_TOKEN **rsa_pub_key,
+					    unsigned char *narr,
+					    uint32_t nbytes,
+					    unsigned char *earr,
+					    uint32_t ebytes);
+static void       TPM_RSAPublicKeyCache_Delete(void);
+static TPM_RESULT TPM_RSAGeneratePrivateToken(TPM_RSA_TOKEN **rsa_pri_key,
 					      unsigned char *narr,
 					      uint32_t nbytes,
 					      unsigned char *earr,
 					      uint32_t ebytes,
 					      unsigned char *darr,
-					      uint32_t dbytes);
+					      uint32_t dbytes,
+					      unsigned char *parr,
+					      uint32_t pbytes,
+					      unsigned char *qarr,
+					      uint32_t qbytes,
+					      unsigned char *dparr,
+					      uint32_t dpbytes,
+					      unsigned char *dqarr,
+					      uint32_t dqbytes,
+					      unsigned char *qinvarr,
+					      uint32_t qinvbytes);
+static void       TPM_RSAToken_Delete(TPM_RSA_TOKEN *rsa_key);
+static unsigned int TPM_RSAToken_Size(TPM_RSA_TOKEN *rsa_key);
+#ifndef TPM_OPENSSL_EVP
+static TPM_RESULT TPM_RSAToken_PrivateRaw(unsigned char *data_out,
+					  const unsigned char *data_in,
+					  uint32_t data_size,
+					  TPM_RSA_TOKEN *rsa_pri_key);
+#endif
+static TPM_RESULT TPM_RSAToken_PublicRaw(unsigned char *data_out,
+					 const unsigned char *data_in,
+					 uint32_t data_size,
+					 TPM_RSA_TOKEN *rsa_pub_key);
+#ifdef TPM_OPENSSL_EVP
+static TPM_RESULT TPM_RSAToken_GetPadCtx(EVP_PKEY_CTX **ctx,
+					 TPM_RSA_TOKEN *rsa_key,
+					 int padding,
+					 TPM_BOOL sign);
+#endif
 static TPM_RESULT TPM_RSASignSHA1(unsigned char *signature,
                                   unsigned int *signature_length,
                                   const unsigned char *message,
                                   size_t message_size,
-                                  RSA *rsa_pri_key);
+                                  TPM_RSA_TOKEN *rsa_pri_key);
 static TPM_RESULT TPM_RSASignDER(unsigned char *signature,
                                  unsigned int *signature_length,
                                  const unsigned char *message,  
                                  size_t message_size,
-                                 RSA *rsa_pri_key);
+                                 TPM_RSA_TOKEN *rsa_pri_key);
 
 static TPM_RESULT TPM_BN_CTX_new(BN_CTX **ctx);
+static TPM_RESULT TPM_BN_MONT_CTX_Get(BN_MONT_CTX **mont,
+				      const BIGNUM *modulus,
+				      BN_CTX *ctx);
+static void       TPM_BN_MONT_CTX_Delete(void);
 
 
 
@@ -130,7 +222,7 @@ static TPM_RESULT TPM_SymmetricKeyData_Crypt(unsigned char *data_out,
 
 /* local prototype and structure for AES */
 
-#include <openssl/aes.h>
+#include <openssl/evp.h>
 
 #if defined(__OpenBSD__)
  # define OPENSSL_OLD_API
@@ -165,19 +257,20 @@ typedef struct tdTPM_SYMMETRIC_KEY_DATA {
     TPM_BOOL fill;
     unsigned char userKey[TPM_AES_BLOCK_SIZE];
     /* For performance, generate these once from userKey */
-    AES_KEY aes_enc_key;
-    AES_KEY aes_dec_key;
+    EVP_CIPHER_CTX *aes_enc_ctx;	/* AES-128-CBC, NULL until keyed */
+    EVP_CIPHER_CTX *aes_dec_ctx;
 } TPM_SYMMETRIC_KEY_DATA;
 
 static TPM_RESULT TPM_SymmetricKeyData_SetKeys(TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data);
-static TPM_RESULT TPM_SymmetricKeyData_SetKey(TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data,
-					      const unsigned char *key_data,
-					      uint32_t key_data_size);
-static TPM_RESULT TPM_AES_ctr128_encrypt(unsigned char *data_out,
-					 const unsigned char *data_in,
-					 uint32_t data_size,
-					 const AES_KEY *aes_enc_key,
-					 unsigned char ctr[TPM_AES_BLOCK_SIZE]);
+static TPM_RESULT TPM_AES_CipherFetch(EVP_CIPHER **cipher,
+				      const char *name);
+static void       TPM_AES_CipherDelete(void);
+static TPM_RESULT TPM_AES_StreamCrypt(unsigned char *data_out,
+				      const unsigned char *data_in,
+				      uint32_t data_size,
+				      const EVP_CIPHER *cipher,
+				      const unsigned char *key,
+				      const unsigned char iv[TPM_AES_BLOCK_SIZE]);
 
 #endif
 
@@ -190,18 +283,30 @@ TPM_RESULT TPM_Crypto_Init()
     TPM_RESULT rc = 0;
 
     printf("TPM_Crypto_Init: OpenSSL library %08lx\n", (unsigned long)OPENSSL_VERSION_NUMBER);
-    /* sanity check that the SHA1 context handling remains portable */
+    /* select the SHA-1 implementation for this CPU */
     if (rc == 0) {
-	if ((sizeof(SHA_LONG) != sizeof(uint32_t)) ||
-	    (sizeof(unsigned int) != sizeof(uint32_t)) ||
-	    (sizeof(SHA_CTX) != (sizeof(uint32_t) * (8 + SHA_LBLOCK)))) {
-	    printf("TPM_Crypto_Init: Error(fatal), SHA_CTX has unexpected structure\n");
-	    rc = TPM_FAIL;
-	}
+	TPM_SHA1Engine_Init();
     }
     return rc;
 }
 
+/* TPM_Crypto_Terminate() frees any crypto library state held across commands
+
+   For OpenSSL, this is the RSA public key cache, the Montgomery context cache,
+   and the AES ciphers.
+*/
+
+void TPM_Crypto_Terminate()
+{
+    printf("TPM_Crypto_Terminate:\n");
+    TPM_RSAPublicKeyCache_Delete();
+    TPM_BN_MONT_CTX_Delete();
+#ifdef TPM_AES
+    TPM_AES_CipherDelete();
+#endif
+    return;
+}
+
 /* TPM_Crypto_TestSpecific() performs any library specific tests
 
    For OpenSSL
@@ -224,6 +329,13 @@ TPM_RESULT TPM_Crypto_TestSpecific()
     TPM_STORE_BUFFER sbuffer;
     const unsigned char *stream;
     uint32_t stream_size;
+#ifndef TPM_OPENSSL_EVP
+    /* the serialized SHA-1 context must remain compatible with the OpenSSL SHA_CTX.  SHA_CTX is
+       not part of the OpenSSL 3 API, so EVP builds skip the comparison. */
+    SHA_CTX	sha_ctx;
+    TPM_SHA1_CONTEXT *tpm_sha_ctx;
+    size_t	i;
+#endif
     
     printf(" TPM_Crypto_TestSpecific: Test 1 - SHA1 two parts\n");
     context1 = NULL;			/* freed @1 */
@@ -231,12 +343,11 @@ TPM_RESULT TPM_Crypto_TestSpecific()
     TPM_Sbuffer_Init(&sbuffer);		/* freed @3 */
     
     if (rc== 0) {
-        rc = TPM_Malloc((unsigned char **)&context1, sizeof(SHA_CTX));	/* freed @1 */
+	rc = TPM_SHA1InitCmd(&context1);				/* freed @1 */
     }
     /* digest the first part of the array */
     if (rc== 0) {
-	SHA1_Init(context1);
-        SHA1_Update(context1, buffer1, 16);
+	rc = TPM_SHA1UpdateCmd(context1, buffer1, 16);
     }
     /* store the SHA1 context */
     if (rc== 0) {
@@ -250,8 +361,11 @@ TPM_RESULT TPM_Crypto_TestSpecific()
     }
     /* digest the rest of the array */
     if (rc== 0) {
-        SHA1_Update(context2, buffer1 + 16, sizeof(buffer1) - 17);
-        SHA1_Final(actual, context2);
+	rc = TPM_SHA1UpdateCmd(context2, buffer1 + 16, sizeof(buffer1) - 17);
+    }
+    /* get the digest result */
+    if (rc== 0) {
+	rc = TPM_SHA1FinalCmd(actual, context2);
     }
     if (rc == 0) {
 	not_equal = memcmp(expect1, actual, TPM_DIGEST_SIZE);
@@ -262,8 +376,32 @@ TPM_RESULT TPM_Crypto_TestSpecific()
 	    rc = TPM_FAILEDSELFTEST;
 	}
     }
-    free(context1);			/* @1 */
-    free(context2);			/* @2 */
+#ifndef TPM_OPENSSL_EVP
+    if (rc == 0) {
+	printf(" TPM_Crypto_TestSpecific: Test 2 - SHA1 context matches SHA_CTX\n");
+	SHA1_Init(&sha_ctx);
+	SHA1_Update(&sha_ctx, buffer1, 16);
+	tpm_sha_ctx = (TPM_SHA1_CONTEXT *)context1;
+	not_equal = (sha_ctx.h0 != tpm_sha_ctx->h[0]) ||
+		    (sha_ctx.h1 != tpm_sha_ctx->h[1]) ||
+		    (sha_ctx.h2 != tpm_sha_ctx->h[2]) ||
+		    (sha_ctx.h3 != tpm_sha_ctx->h[3]) ||
+		    (sha_ctx.h4 != tpm_sha_ctx->h[4]) ||
+		    (sha_ctx.Nl != tpm_sha_ctx->Nl) ||
+		    (sha_ctx.Nh != tpm_sha_ctx->Nh) ||
+		    (sha_ctx.num != tpm_sha_ctx->num);
+	for (i = 0 ; i < SHA_LBLOCK ; i++) {
+	    not_equal |= (sha_ctx.data[i] != tpm_sha_ctx->data[i]);
+	}
+	if (not_equal) {
+	    printf("TPM_Crypto_TestSpecific: Error in test 2\n");
+	    rc = TPM_FAILEDSELFTEST;
+	}
+	memset(&sha_ctx, 0, sizeof(SHA_CTX));
+    }
+#endif
+    TPM_SHA1Delete(&context1);		/* @1 */
+    TPM_SHA1Delete(&context2);		/* @2 */
     TPM_Sbuffer_Delete(&sbuffer);	/* @3 */
     return rc;
 }
@@ -274,14 +412,16 @@ TPM_RESULT TPM_Crypto_TestSpecific()
   Random Number Functions
 */
 
-/* TPM_Random() fills 'buffer' with 'bytes' bytes.
+/* TPM_Entropy_Get() fills 'buffer' with 'bytes' bytes from the crypto library RNG.
+
+   This seeds the TPM_Random() DRBG.
  */
 
-TPM_RESULT TPM_Random(BYTE *buffer, size_t bytes)
+TPM_RESULT TPM_Entropy_Get(BYTE *buffer, size_t bytes)
 {
     TPM_RESULT rc = 0;
 
-    printf(" TPM_Random: Requesting %lu bytes\n", (unsigned long)bytes);
+    printf(" TPM_Entropy_Get: Requesting %lu bytes\n", (unsigned long)bytes);
 
     if (rc == 0) {
             /* openSSL call */
@@ -290,24 +430,27 @@ TPM_RESULT TPM_Random(BYTE *buffer, size_t bytes)
                 rc = 0;
             }
             else {              /* OSSL failure */
-                printf("TPM_Random: Error (fatal) calling RAND_bytes()\n");
+                printf("TPM_Entropy_Get: Error (fatal) calling RAND_bytes()\n");
                 rc = TPM_FAIL;
             }
     }
     return rc;
 }
 
-TPM_RESULT TPM_StirRandomCmd(TPM_SIZED_BUFFER *inData)
+/* TPM_Entropy_Add() mixes 'length' bytes of 'data' into the crypto library RNG
+ */
+
+TPM_RESULT TPM_Entropy_Add(const unsigned char *data, uint32_t length)
 {
     TPM_RESULT rc = 0;
 
-    printf(" TPM_StirRandomCmd:\n");
+    printf(" TPM_Entropy_Add:\n");
     if (rc == 0) {
         /* NOTE: The TPM command does not give an entropy estimate.  This assumes the best case */
         /* openSSL call */
-        RAND_add(inData->buffer,	/* buf mixed into PRNG state*/
-		 inData->size,		/* number of bytes */
-		 inData->size);	/* entropy, the lower bound of an estimate of how much randomness is
+        RAND_add(data,		/* buf mixed into PRNG state*/
+		 length,	/* number of bytes */
+		 length);	/* entropy, the lower bound of an estimate of how much randomness is
 				   contained in buf */
     }
     return rc;
@@ -331,12 +474,21 @@ TPM_RESULT TPM_RSAGenerateKeyPair(unsigned char **n,            /* public key -
                                   uint32_t e_size)
 {
     TPM_RESULT rc = 0;
+#ifdef TPM_OPENSSL_EVP
+    EVP_PKEY_CTX *ctx = NULL;
+    EVP_PKEY *pkey = NULL;
+    BIGNUM *bnn = NULL;
+    BIGNUM *bnp = NULL;
+    BIGNUM *bnq = NULL;
+    BIGNUM *bnd = NULL;
+#else
     RSA *rsa = NULL;
     const BIGNUM *bnn = NULL;
-    BIGNUM *bne = NULL;
     const BIGNUM *bnp = NULL;
     const BIGNUM *bnq = NULL;
     const BIGNUM *bnd = NULL;
+#endif
+    BIGNUM *bne = NULL;
     uint32_t nbytes;
     uint32_t pbytes;
     uint32_t qbytes;
@@ -369,6 +521,39 @@ TPM_RESULT TPM_RSAGenerateKeyPair(unsigned char **n,            /* public key -
     if (rc == 0) {
 	rc = TPM_RSA_exponent_verify(e);
     }
+#ifdef TPM_OPENSSL_EVP
+    if (rc == 0) {
+	ctx = EVP_PKEY_CTX_new_from_name(NULL, "RSA", NULL);	/* freed @1 */
+	if (ctx == NULL) {
+            printf("TPM_RSAGenerateKeyPair: Error in EVP_PKEY_CTX_new_from_name()\n");
+            rc = TPM_SIZE;
+        }
+    }
+    if (rc == 0) {
+        rc = TPM_bin2bn((TPM_BIGNUM *)&bne, earr, e_size);	/* freed @2 */
+    }
+    if (rc == 0) {
+        printf("  TPM_RSAGenerateKeyPair: num_bits %d exponent %08lx\n", num_bits, e);
+	if ((EVP_PKEY_keygen_init(ctx) != 1) ||
+	    (EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, num_bits) != 1) ||
+	    (EVP_PKEY_CTX_set1_rsa_keygen_pubexp(ctx, bne) != 1) ||
+	    (EVP_PKEY_generate(ctx, &pkey) != 1)) {		/* freed @3 */
+            printf("TPM_RSAGenerateKeyPair: Error calling EVP_PKEY_generate()\n");
+	    TPM_OpenSSL_PrintError();
+            rc = TPM_BAD_KEY_PROPERTY;
+	}
+    }
+    /* the parameters are copies, freed @4 */
+    if (rc == 0) {
+	if ((EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_RSA_N, &bnn) != 1) ||
+	    (EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_RSA_FACTOR1, &bnp) != 1) ||
+	    (EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_RSA_FACTOR2, &bnq) != 1) ||
+	    (EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_RSA_D, &bnd) != 1)) {
+            printf("TPM_RSAGenerateKeyPair: Error in EVP_PKEY_get_bn_param()\n");
+            rc = TPM_SIZE;
+	}
+    }
+#else
     if (rc == 0) {
 	rsa = RSA_new();                        	/* freed @1 */
 	if (rsa == NULL) {
@@ -401,6 +586,7 @@ TPM_RESULT TPM_RSAGenerateKeyPair(unsigned char **n,            /* public key -
 	RSA_get0_factors(rsa, &bnp, &bnq);
 #endif
     }
+#endif
     /* load n */
     if (rc == 0) {
         rc = TPM_bn2binMalloc(n, &nbytes, (TPM_BIGNUM)bnn, num_bits/8); /* freed by caller */
@@ -431,19 +617,407 @@ TPM_RESULT TPM_RSAGenerateKeyPair(unsigned char **n,            /* public key -
         *q = NULL;
         *d = NULL;
     }
+#ifdef TPM_OPENSSL_EVP
+    EVP_PKEY_CTX_free(ctx);	/* @1 */
+    EVP_PKEY_free(pkey);	/* @3 */
+    BN_free(bnn);		/* @4 */
+    BN_clear_free(bnp);
+    BN_clear_free(bnq);
+    BN_clear_free(bnd);
+#else
     if (rsa != NULL) {
         RSA_free(rsa);  /* @1 */
     }
+#endif
     if (bne != NULL) {
         BN_free(bne);  	/* @2 */
     }
     return rc;
 }
 
+/*
+  RSA key token primitives
+
+  These functions, and the EVP branches of the encrypt, decrypt and sign functions, are the only
+  code that depends on the RSA key token representation.  The key caches are common to both
+  OpenSSL interfaces.  For EVP, the token contexts do the padding, since the low level padding
+  functions are deprecated.
+*/
+
+#ifdef TPM_OPENSSL_EVP
+
+/* TPM_RSAGenerateEVPToken() constructs the EVP_PKEY from the key parameters and initializes its
+   operation contexts.
+
+   If 'darr' is NULL, the token is a public key token.  Otherwise, the prime factors and CRT
+   parameters are used if 'pbytes' is not zero.
+*/
+
+static TPM_RESULT TPM_RSAGenerateEVPToken(TPM_RSA_TOKEN **rsa_key,	/* freed by caller */
+					  unsigned char *narr,		/* public modulus */
+					  uint32_t nbytes,
+					  unsigned char *earr,		/* public exponent */
+					  uint32_t ebytes,
+					  unsigned char *darr,		/* private exponent */
+					  uint32_t dbytes,
+					  unsigned char *parr,		/* prime factor p */
+					  uint32_t pbytes,
+					  unsigned char *qarr,		/* prime factor q */
+					  uint32_t qbytes,
+					  unsigned char *dparr,		/* d mod (p-1) */
+					  uint32_t dpbytes,
+					  unsigned char *dqarr,		/* d mod (q-1) */
+					  uint32_t dqbytes,
+					  unsigned char *qinvarr,	/* q^-1 mod p */
+					  uint32_t qinvbytes)
+{
+    TPM_RESULT		rc = 0;
+    int			irc;
+    static const char	*names[] = {OSSL_PKEY_PARAM_RSA_N,
+				    OSSL_PKEY_PARAM_RSA_E,
+				    OSSL_PKEY_PARAM_RSA_D,
+				    OSSL_PKEY_PARAM_RSA_FACTOR1,
+				    OSSL_PKEY_PARAM_RSA_FACTOR2,
+				    OSSL_PKEY_PARAM_RSA_EXPONENT1,
+				    OSSL_PKEY_PARAM_RSA_EXPONENT2,
+				    OSSL_PKEY_PARAM_RSA_COEFFICIENT1};
+    unsigned char	*arrs[] = {narr, earr, darr, parr, qarr, dparr, dqarr, qinvarr};
+    uint32_t		bytes[] = {nbytes, ebytes, dbytes, pbytes, qbytes,
+				   dpbytes, dqbytes, qinvbytes};
+    BIGNUM		*bns[] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};	/* freed @1 */
+    size_t		count;
+    size_t		i;
+    TPM_BOOL		privateKey;
+    OSSL_PARAM_BLD	*bld = NULL;		/* freed @2 */
+    OSSL_PARAM		*params = NULL;		/* freed @3 */
+    EVP_PKEY_CTX	*ctx = NULL;		/* freed @4 */
+    OSSL_PARAM		*p;
+
+    /* sanity check for the free */
+    if (rc == 0) {
+	if (*rsa_key != NULL) {
+            printf("TPM_RSAGenerateEVPToken: Error (fatal), token %p should be NULL\n",
+		   *rsa_key);
+            rc = TPM_FAIL;
+	}
+    }
+    if (rc == 0) {
+	privateKey = (darr != NULL);
+	if (!privateKey) {
+	    count = 2;			/* n, e */
+	}
+	else if (pbytes == 0) {
+	    count = 3;			/* n, e, d */
+	}
+	else {
+	    count = sizeof(names) / sizeof(names[0]);
+	}
+	rc = TPM_Malloc((unsigned char **)rsa_key, sizeof(TPM_RSA_TOKEN));	/* freed by caller */
+    }
+    if (rc == 0) {
+	(*rsa_key)->pkey = NULL;
+	(*rsa_key)->crypt_ctx = NULL;
+	(*rsa_key)->sig_ctx = NULL;
+	(*rsa_key)->oaep_ctx = NULL;
+	(*rsa_key)->pkcs1_ctx = NULL;
+	(*rsa_key)->der_ctx = NULL;
+	(*rsa_key)->privateKey = privateKey;
+	(*rsa_key)->size = 0;
+	bld = OSSL_PARAM_BLD_new();			/* freed @2 */
+	if (bld == NULL) {
+            printf("TPM_RSAGenerateEVPToken: Error in OSSL_PARAM_BLD_new()\n");
+            rc = TPM_SIZE;
+	}
+    }
+    /* the builder references the bignums until the parameters are constructed */
+    for (i = 0 ; (rc == 0) && (i < count) ; i++) {
+	rc = TPM_bin2bn((TPM_BIGNUM *)&bns[i], arrs[i], bytes[i]);	/* freed @1 */
+	if (rc == 0) {
+	    irc = OSSL_PARAM_BLD_push_BN(bld, names[i], bns[i]);
+	    if (irc != 1) {
+		printf("TPM_RSAGenerateEVPToken: Error in OSSL_PARAM_BLD_push_BN()\n");
+		rc = TPM_SIZE;
+	    }
+	}
+    }
+    if (rc == 0) {
+	params = OSSL_PARAM_BLD_to_param(bld);		/* freed @3 */
+	if (params == NULL) {
+            printf("TPM_RSAGenerateEVPToken: Error in OSSL_PARAM_BLD_to_param()\n");
+            rc = TPM_SIZE;
+	}
+    }
+    /* construct the key */
+    if (rc == 0) {
+	ctx = EVP_PKEY_CTX_new_from_name(NULL, "RSA", NULL);	/* freed @4 */
+	if ((ctx == NULL) ||
+	    (EVP_PKEY_fromdata_init(ctx) != 1) ||
+	    (EVP_PKEY_fromdata(ctx, &((*rsa_key)->pkey),
+			       privateKey ? EVP_PKEY_KEYPAIR : EVP_PKEY_PUBLIC_KEY,
+			       params) != 1)) {
+            printf("TPM_RSAGenerateEVPToken: Error in EVP_PKEY_fromdata()\n");
+	    TPM_OpenSSL_PrintError();
+            rc = TPM_SIZE;
+	}
+    }
+    if (rc == 0) {
+	(*rsa_key)->size = EVP_PKEY_get_size((*rsa_key)->pkey);
+	if (!privateKey) {
+	    (*rsa_key)->crypt_ctx = EVP_PKEY_CTX_new_from_pkey(NULL, (*rsa_key)->pkey, NULL);
+	}
+	(*rsa_key)->sig_ctx = EVP_PKEY_CTX_new_from_pkey(NULL, (*rsa_key)->pkey, NULL);
+	if ((!privateKey && ((*rsa_key)->crypt_ctx == NULL)) || ((*rsa_key)->sig_ctx == NULL)) {
+            printf("TPM_RSAGenerateEVPToken: Error in EVP_PKEY_CTX_new_from_pkey()\n");
+            rc = TPM_SIZE;
+	}
+    }
+    /* the public key raw encrypt context, used by TPM_RSAPublicEncryptRaw() */
+    if ((rc == 0) && !privateKey) {
+	irc = EVP_PKEY_encrypt_init((*rsa_key)->crypt_ctx);
+	if ((irc != 1) ||
+	    (EVP_PKEY_CTX_set_rsa_padding((*rsa_key)->crypt_ctx, RSA_NO_PADDING) != 1)) {
+            printf("TPM_RSAGenerateEVPToken: Error initializing the crypt context\n");
+	    TPM_OpenSSL_PrintError();
+            rc = TPM_SIZE;
+	}
+    }
+    /* the signature context adds the SHA-1 algorithm identifier and type 1 pad */
+    if (rc == 0) {
+	if (privateKey) {
+	    irc = EVP_PKEY_sign_init((*rsa_key)->sig_ctx);
+	}
+	else {
+	    irc = EVP_PKEY_verify_init((*rsa_key)->sig_ctx);
+	}
+	if ((irc != 1) ||
+	    (EVP_PKEY_CTX_set_rsa_padding((*rsa_key)->sig_ctx, RSA_PKCS1_PADDING) != 1) ||
+	    (EVP_PKEY_CTX_set_signature_md((*rsa_key)->sig_ctx, EVP_sha1()) != 1)) {
+            printf("TPM_RSAGenerateEVPToken: Error initializing the signature context\n");
+	    TPM_OpenSSL_PrintError();
+            rc = TPM_SIZE;
+	}
+    }
+    if ((rc != 0) && (*rsa_key != NULL)) {
+	TPM_RSAToken_Delete(*rsa_key);
+	*rsa_key = NULL;
+    }
+    for (i = 0 ; i < sizeof(bns) / sizeof(bns[0]) ; i++) {
+	BN_clear_free(bns[i]);				/* @1 */
+    }
+    OSSL_PARAM_BLD_free(bld);				/* @2 */
+    /* the parameter array holds copies of the private key, wipe before freeing */
+    for (p = params ; (p != NULL) && (p->key != NULL) ; p++) {
+	if (p->data != NULL) {
+	    OPENSSL_cleanse(p->data, p->data_size);
+	}
+    }
+    OSSL_PARAM_free(params);				/* @3 */
+    EVP_PKEY_CTX_free(ctx);				/* @4 */
+    return rc;
+}
+
+/* TPM_RSAGeneratePublicToken() generates an RSA key token from n and e
+ */
+
+static TPM_RESULT TPM_RSAGeneratePublicToken(TPM_RSA_TOKEN **rsa_pub_key,	/* freed by caller */
+					     unsigned char *narr,      	/* public modulus */
+					     uint32_t nbytes,
+					     unsigned char *earr,      	/* public exponent */
+					     uint32_t ebytes)
+{
+    return TPM_RSAGenerateEVPToken(rsa_pub_key,
+				   narr, nbytes,
+				   earr, ebytes,
+				   NULL, 0,		/* public key */
+				   NULL, 0,
+				   NULL, 0,
+				   NULL, 0,
+				   NULL, 0,
+				   NULL, 0);
+}
+
+/* TPM_RSAGeneratePrivateToken() generates an RSA key token from n,e,d and the optional CRT
+   parameters
+ */
+
+static TPM_RESULT TPM_RSAGeneratePrivateToken(TPM_RSA_TOKEN **rsa_pri_key,	/* freed by caller */
+					      unsigned char *narr,      /* public modulus */
+					      uint32_t nbytes,
+					      unsigned char *earr,      /* public exponent */
+					      uint32_t ebytes,
+					      unsigned char *darr,	/* private exponent */
+					      uint32_t dbytes,
+					      unsigned char *parr,	/* prime factor p, or NULL */
+					      uint32_t pbytes,
+					      unsigned char *qarr,	/* prime factor q */
+					      uint32_t qbytes,
+					      unsigned char *dparr,	/* d mod (p-1) */
+					      uint32_t dpbytes,
+					      unsigned char *dqarr,	/* d mod (q-1) */
+					      uint32_t dqbytes,
+					      unsigned char *qinvarr,	/* q^-1 mod p */
+					      uint32_t qinvbytes)
+{
+    return TPM_RSAGenerateEVPToken(rsa_pri_key,
+				   narr, nbytes,
+				   earr, ebytes,
+				   darr, dbytes,
+				   parr, pbytes,
+				   qarr, qbytes,
+				   dparr, dpbytes,
+				   dqarr, dqbytes,
+				   qinvarr, qinvbytes);
+}
+
+/* TPM_RSAToken_Delete() frees the key and its operation contexts.  No-op if the token is NULL.
+ */
+
+static void TPM_RSAToken_Delete(TPM_RSA_TOKEN *rsa_key)
+{
+    if (rsa_key != NULL) {
+	EVP_PKEY_CTX_free(rsa_key->crypt_ctx);
+	EVP_PKEY_CTX_free(rsa_key->sig_ctx);
+	EVP_PKEY_CTX_free(rsa_key->oaep_ctx);
+	EVP_PKEY_CTX_free(rsa_key->pkcs1_ctx);
+	EVP_PKEY_CTX_free(rsa_key->der_ctx);
+	EVP_PKEY_free(rsa_key->pkey);
+	free(rsa_key);
+    }
+    return;
+}
+
+/* TPM_RSAToken_Size() returns the modulus size in bytes
+ */
+
+static unsigned int TPM_RSAToken_Size(TPM_RSA_TOKEN *rsa_key)
+{
+    return rsa_key->size;
+}
+
+/* TPM_RSAToken_PublicRaw() does a raw public key operation without any padding.
+
+   'data_out' must hold the modulus size.
+*/
+
+static TPM_RESULT TPM_RSAToken_PublicRaw(unsigned char *data_out,
+					 const unsigned char *data_in,
+					 uint32_t data_size,
+					 TPM_RSA_TOKEN *rsa_pub_key)
+{
+    TPM_RESULT	rc = 0;
+    int		irc;
+    size_t	data_out_size = rsa_pub_key->size;
+
+    irc = EVP_PKEY_encrypt(rsa_pub_key->crypt_ctx,
+			   data_out, &data_out_size,
+			   data_in, data_size);
+    if (irc != 1) {
+	printf("TPM_RSAToken_PublicRaw: Error in EVP_PKEY_encrypt()\n");
+	rc = TPM_ENCRYPT_ERROR;
+    }
+    return rc;
+}
+
+/* TPM_RSAToken_GetPadCtx() returns in 'ctx' the token context that does the operation with
+   'padding', initializing it on first use.  The context is owned by the token.
+
+   For a private key, the context decrypts, or if 'sign' is TRUE, signs with the type 1 pad and no
+   algorithm identifier.  For a public key, the context encrypts.  OAEP uses SHA-1 and the TPM
+   encoding parameter.
+*/
+
+static TPM_RESULT TPM_RSAToken_GetPadCtx(EVP_PKEY_CTX **ctx,
+					 TPM_RSA_TOKEN *rsa_key,
+					 int padding,
+					 TPM_BOOL sign)
+{
+    TPM_RESULT		rc = 0;
+    int			irc;
+    EVP_PKEY_CTX	**slot;
+    unsigned char	*label = NULL;		/* freed @1 */
+#ifdef OSSL_ASYM_CIPHER_PARAM_IMPLICIT_REJECTION
+    unsigned int	implicit_rejection = 0;
+    OSSL_PARAM		params[2];
+#endif
+
+    if (sign) {
+	slot = &(rsa_key->der_ctx);
+    }
+    else if (padding == RSA_PKCS1_OAEP_PADDING) {
+	slot = &(rsa_key->oaep_ctx);
+    }
+    else {
+	slot = &(rsa_key->pkcs1_ctx);
+    }
+    if ((rc == 0) && (*slot == NULL)) {
+	*slot = EVP_PKEY_CTX_new_from_pkey(NULL, rsa_key->pkey, NULL);
+	if (*slot == NULL) {
+	    printf("TPM_RSAToken_GetPadCtx: Error in EVP_PKEY_CTX_new_from_pkey()\n");
+	    rc = TPM_SIZE;
+	}
+	if (rc == 0) {
+	    if (sign) {
+		irc = EVP_PKEY_sign_init(*slot);
+	    }
+	    else if (rsa_key->privateKey) {
+		irc = EVP_PKEY_decrypt_init(*slot);
+	    }
+	    else {
+		irc = EVP_PKEY_encrypt_init(*slot);
+	    }
+	    if ((irc != 1) ||
+		(EVP_PKEY_CTX_set_rsa_padding(*slot, padding) != 1)) {
+		printf("TPM_RSAToken_GetPadCtx: Error initializing the context\n");
+		TPM_OpenSSL_PrintError();
+		rc = TPM_SIZE;
+	    }
+	}
+	/* the context takes ownership of the label */
+	if ((rc == 0) && (padding == RSA_PKCS1_OAEP_PADDING)) {
+	    label = OPENSSL_memdup(tpm_oaep_pad_str, sizeof(tpm_oaep_pad_str));	/* freed @1 */
+	    if ((label == NULL) ||
+		(EVP_PKEY_CTX_set_rsa_oaep_md(*slot, EVP_sha1()) != 1) ||
+		(EVP_PKEY_CTX_set_rsa_mgf1_md(*slot, EVP_sha1()) != 1) ||
+		(EVP_PKEY_CTX_set0_rsa_oaep_label(*slot, label, sizeof(tpm_oaep_pad_str)) <= 0)) {
+		printf("TPM_RSAToken_GetPadCtx: Error setting the OAEP parameters\n");
+		TPM_OpenSSL_PrintError();
+		rc = TPM_SIZE;
+	    }
+	    else {
+		label = NULL;
+	    }
+	}
+#ifdef OSSL_ASYM_CIPHER_PARAM_IMPLICIT_REJECTION
+	/* the TPM returns an error for a bad type 2 pad rather than a synthetic message */
+	if ((rc == 0) && (padding == RSA_PKCS1_PADDING) && !sign && rsa_key->privateKey) {
+	    params[0] = OSSL_PARAM_construct_uint(OSSL_ASYM_CIPHER_PARAM_IMPLICIT_REJECTION,
+						  &implicit_rejection);
+	    params[1] = OSSL_PARAM_construct_end();
+	    if (EVP_PKEY_CTX_set_params(*slot, params) != 1) {
+		printf("TPM_RSAToken_GetPadCtx: Error disabling implicit rejection\n");
+		TPM_OpenSSL_PrintError();
+		rc = TPM_SIZE;
+	    }
+	}
+#endif
+	if (rc != 0) {
+	    EVP_PKEY_CTX_free(*slot);
+	    *slot = NULL;
+	}
+    }
+    if (rc == 0) {
+	*ctx = *slot;
+    }
+    OPENSSL_free(label);	/* @1 */
+    return rc;
+}
+
+#else	/* TPM_OPENSSL_EVP */
+
 /* TPM_RSAGeneratePublicToken() generates an RSA key token from n and e
  */
 
-static TPM_RESULT TPM_RSAGeneratePublicToken(RSA **rsa_pub_key,		/* freed by caller */
+static TPM_RESULT TPM_RSAGeneratePublicToken(TPM_RSA_TOKEN **rsa_pub_key,	/* freed by caller */
 					     unsigned char *narr,      	/* public modulus */
 					     uint32_t nbytes,
 					     unsigned char *earr,      	/* public exponent */
@@ -459,7 +1033,7 @@ static TPM_RESULT TPM_RSAGeneratePublicToken(RSA **rsa_pub_key,		/* freed by cal
             printf("TPM_RSAGeneratePublicToken: Error (fatal), token %p should be NULL\n",
 		   *rsa_pub_key );
             rc = TPM_FAIL;
-	    
+
 	}
     }
     /* construct the OpenSSL private key object */
@@ -492,21 +1066,37 @@ static TPM_RESULT TPM_RSAGeneratePublicToken(RSA **rsa_pub_key,		/* freed by cal
     return rc;
 }
 
-/* TPM_RSAGeneratePrivateToken() generates an RSA key token from n,e,d
+/* TPM_RSAGeneratePrivateToken() generates an RSA key token from n,e,d and the optional CRT
+   parameters
  */
 
-static TPM_RESULT TPM_RSAGeneratePrivateToken(RSA **rsa_pri_key,	/* freed by caller */
+static TPM_RESULT TPM_RSAGeneratePrivateToken(TPM_RSA_TOKEN **rsa_pri_key,	/* freed by caller */
 					      unsigned char *narr,      /* public modulus */
 					      uint32_t nbytes,
 					      unsigned char *earr,      /* public exponent */
 					      uint32_t ebytes,
 					      unsigned char *darr,	/* private exponent */
-					      uint32_t dbytes)
+					      uint32_t dbytes,
+					      unsigned char *parr,	/* prime factor p, or NULL */
+					      uint32_t pbytes,
+					      unsigned char *qarr,	/* prime factor q */
+					      uint32_t qbytes,
+					      unsigned char *dparr,	/* d mod (p-1) */
+					      uint32_t dpbytes,
+					      unsigned char *dqarr,	/* d mod (q-1) */
+					      uint32_t dqbytes,
+					      unsigned char *qinvarr,	/* q^-1 mod p */
+					      uint32_t qinvbytes)
 {
     TPM_RESULT  rc = 0;
     BIGNUM *    n = NULL;
     BIGNUM *    e = NULL;
     BIGNUM *    d = NULL;
+    BIGNUM *    p = NULL;
+    BIGNUM *    q = NULL;
+    BIGNUM *    dp = NULL;
+    BIGNUM *    dq = NULL;
+    BIGNUM *    qinv = NULL;
 
     /* sanity check for the free */
     if (rc == 0) {
@@ -514,7 +1104,7 @@ static TPM_RESULT TPM_RSAGeneratePrivateToken(RSA **rsa_pri_key,	/* freed by cal
             printf("TPM_RSAGeneratePrivateToken: Error (fatal), token %p should be NULL\n",
 		   *rsa_pri_key );
             rc = TPM_FAIL;
-	    
+
 	}
     }
     /* construct the OpenSSL private key object */
@@ -546,72 +1136,501 @@ static TPM_RESULT TPM_RSAGeneratePrivateToken(RSA **rsa_pri_key,	/* freed by cal
             rc = TPM_SIZE;
 	}
 #endif
-     }
+    }
+    /* add the prime factors and CRT parameters */
+    if ((rc == 0) && (pbytes != 0)) {
+	if (rc == 0) {
+	    rc = TPM_bin2bn((TPM_BIGNUM *)&p, parr, pbytes);
+	}
+	if (rc == 0) {
+	    rc = TPM_bin2bn((TPM_BIGNUM *)&q, qarr, qbytes);
+	}
+	if (rc == 0) {
+	    rc = TPM_bin2bn((TPM_BIGNUM *)&dp, dparr, dpbytes);
+	}
+	if (rc == 0) {
+	    rc = TPM_bin2bn((TPM_BIGNUM *)&dq, dqarr, dqbytes);
+	}
+	if (rc == 0) {
+	    rc = TPM_bin2bn((TPM_BIGNUM *)&qinv, qinvarr, qinvbytes);
+	}
+	if (rc == 0) {
+#if defined OPENSSL_OLD_API
+	    (*rsa_pri_key)->p = p;
+	    (*rsa_pri_key)->q = q;
+	    (*rsa_pri_key)->dmp1 = dp;
+	    (*rsa_pri_key)->dmq1 = dq;
+	    (*rsa_pri_key)->iqmp = qinv;
+#else
+	    int irc = RSA_set0_factors(*rsa_pri_key, p, q);
+	    if (irc == 1) {
+		p = NULL;		/* now owned by rsa_pri_key */
+		q = NULL;
+		irc = RSA_set0_crt_params(*rsa_pri_key, dp, dq, qinv);
+	    }
+	    if (irc != 1) {
+		printf("TPM_RSAGeneratePrivateToken: Error setting the CRT parameters\n");
+		rc = TPM_SIZE;
+	    }
+#endif
+	}
+	if (rc == 0) {
+	    /* now owned by rsa_pri_key */
+	    p = NULL;
+	    q = NULL;
+	    dp = NULL;
+	    dq = NULL;
+	    qinv = NULL;
+	}
+    }
+    BN_clear_free(p);
+    BN_clear_free(q);
+    BN_clear_free(dp);
+    BN_clear_free(dq);
+    BN_clear_free(qinv);
     return rc;
 }
 
-/* TPM_RSAPrivateDecrypt() decrypts 'encrypt_data' using the private key 'n, e, d'.  The OAEP
-   padding is removed and 'decrypt_data_length' bytes are moved to 'decrypt_data'.
+/* TPM_RSAToken_Delete() frees the RSA object.  No-op if the token is NULL.
+ */
 
-   'decrypt_data_length' is at most 'decrypt_data_size'.
-*/
+static void TPM_RSAToken_Delete(TPM_RSA_TOKEN *rsa_key)
+{
+    if (rsa_key != NULL) {
+	RSA_free(rsa_key);
+    }
+    return;
+}
 
-TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted data */
-                                 uint32_t *decrypt_data_length,	/* length of data put into
-                                                                   decrypt_data */
-                                 size_t decrypt_data_size,      /* size of decrypt_data buffer */
-                                 TPM_ENC_SCHEME encScheme,      /* encryption scheme */
-                                 unsigned char *encrypt_data,   /* encrypted data */
-                                 uint32_t encrypt_data_size,
-                                 unsigned char *narr,           /* public modulus */
-                                 uint32_t nbytes,
-                                 unsigned char *earr,           /* public exponent */
-                                 uint32_t ebytes,
-                                 unsigned char *darr,           /* private exponent */
-                                 uint32_t dbytes)
+/* TPM_RSAToken_Size() returns the modulus size in bytes
+ */
+
+static unsigned int TPM_RSAToken_Size(TPM_RSA_TOKEN *rsa_key)
 {
-    TPM_RESULT  rc = 0;
-    int         irc;
-    RSA *       rsa_pri_key = NULL;	/* freed @1 */
+    return (unsigned int)RSA_size(rsa_key);	/* openSSL returns an int, but never negative */
+}
 
-    unsigned char       *padded_data = NULL;
-    int                 padded_data_size = 0;
-    
-    printf(" TPM_RSAPrivateDecrypt:\n");
-    /* construct the OpenSSL private key object */
-    if (rc == 0) {
-	rc = TPM_RSAGeneratePrivateToken(&rsa_pri_key,	/* freed @1 */
-					 narr,      	/* public modulus */
-					 nbytes,
-					 earr,      	/* public exponent */
-					 ebytes,
-					 darr,		/* private exponent */
-					 dbytes);
+/* TPM_RSAToken_PrivateRaw() does a raw private key operation without any padding.
+
+   'data_out' must hold the modulus size.
+*/
+
+static TPM_RESULT TPM_RSAToken_PrivateRaw(unsigned char *data_out,
+					  const unsigned char *data_in,
+					  uint32_t data_size,
+					  TPM_RSA_TOKEN *rsa_pri_key)
+{
+    TPM_RESULT	rc = 0;
+    int		irc;
+
+    /* returns the size of the decrypted data.  On error, -1 is returned */
+    irc = RSA_private_decrypt(data_size,		/* length */
+			      data_in,			/* from */
+			      data_out,			/* to */
+			      rsa_pri_key,		/* key */
+			      RSA_NO_PADDING);		/* padding */
+    if (irc < 0) {
+	printf("TPM_RSAToken_PrivateRaw: Error in RSA_private_decrypt()\n");
+	rc = TPM_DECRYPT_ERROR;
     }
-    /* intermediate buffer for the decrypted but still padded data */
+    return rc;
+}
+
+/* TPM_RSAToken_PublicRaw() does a raw public key operation without any padding.
+
+   'data_out' must hold the modulus size.
+*/
+
+static TPM_RESULT TPM_RSAToken_PublicRaw(unsigned char *data_out,
+					 const unsigned char *data_in,
+					 uint32_t data_size,
+					 TPM_RSA_TOKEN *rsa_pub_key)
+{
+    TPM_RESULT	rc = 0;
+    int		irc;
+
+    /* returns the size of the encrypted data.  On error, -1 is returned */
+    irc = RSA_public_encrypt(data_size,			/* from length */
+			     data_in,			/* from */
+			     data_out,			/* to */
+			     rsa_pub_key,		/* key */
+			     RSA_NO_PADDING);		/* padding */
+    if (irc < 0) {
+	printf("TPM_RSAToken_PublicRaw: Error in RSA_public_encrypt()\n");
+	rc = TPM_ENCRYPT_ERROR;
+    }
+    return rc;
+}
+
+#endif	/* TPM_OPENSSL_EVP */
+
+/* RSA public key cache
+
+   Public key operations are typically repeated with a few keys, e.g. the SRK, EK, and CMK
+   authority keys.  The OpenSSL key object caches its Montgomery context on first use, so keeping
+   the token reduces a repeated public key operation to the exponentiation.
+
+   The cache is searched by a digest of the public key (n, e).  The digest only filters, a hit
+   also compares the stored n and e, so that a digest collision cannot substitute a different key.
+   When full, the least recently used entry is replaced.  It holds only public data.
+*/
+
+typedef struct tdTPM_RSA_PUBLIC_CACHE_ENTRY {
+    TPM_DIGEST	digest;		/* SHA-1 of nbytes, n, e */
+    unsigned char	*narr;		/* copy of the public modulus */
+    uint32_t	nbytes;
+    unsigned char	*earr;		/* copy of the public exponent */
+    uint32_t	ebytes;
+    TPM_RSA_TOKEN	*rsa_pub_key;	/* NULL if the entry is free */
+    uint32_t	lastUse;	/* value of tpm_rsa_public_cache_clock at last use */
+} TPM_RSA_PUBLIC_CACHE_ENTRY;
+
+static void TPM_RSAPublicKeyCache_DeleteEntry(TPM_RSA_PUBLIC_CACHE_ENTRY *entry);
+
+static TPM_RSA_PUBLIC_CACHE_ENTRY tpm_rsa_public_cache[TPM_RSA_PUBLIC_CACHE_SIZE];
+static uint32_t tpm_rsa_public_cache_clock = 0;
+
+/* TPM_RSAPublicKeyCache_Get() returns an RSA key token for n and e, from the cache if present.
+
+   The token is owned by the cache.  The caller must not free it.
+*/
+
+static TPM_RESULT TPM_RSAPublicKeyCache_Get(TPM_RSA_TOKEN **rsa_pub_key,
+					    unsigned char *narr,      	/* public modulus */
+					    uint32_t nbytes,
+					    unsigned char *earr,      	/* public exponent */
+					    uint32_t ebytes)
+{
+    TPM_RESULT			rc = 0;
+    unsigned char		nbytesarr[sizeof(uint32_t)];
+    TPM_DIGEST			digest;
+    TPM_RSA_PUBLIC_CACHE_ENTRY	*entry = NULL;
+    size_t			i;
+
+    *rsa_pub_key = NULL;
+    /* the size is included so that the boundary between n and e is unambiguous */
+    if (rc == 0) {
+	STORE32(nbytesarr, 0, nbytes);
+	rc = TPM_SHA1(digest,
+		      sizeof(nbytesarr), nbytesarr,
+		      nbytes, narr,
+		      ebytes, earr,
+		      0, NULL);
+    }
+    if (rc == 0) {
+	tpm_rsa_public_cache_clock++;
+	/* search for the key, remembering the least recently used entry as the victim */
+	for (i = 0 ; i < TPM_RSA_PUBLIC_CACHE_SIZE ; i++) {
+	    if ((tpm_rsa_public_cache[i].rsa_pub_key != NULL) &&
+		(memcmp(tpm_rsa_public_cache[i].digest, digest, TPM_DIGEST_SIZE) == 0) &&
+		(tpm_rsa_public_cache[i].nbytes == nbytes) &&
+		(tpm_rsa_public_cache[i].ebytes == ebytes) &&
+		((nbytes == 0) || (memcmp(tpm_rsa_public_cache[i].narr, narr, nbytes) == 0)) &&
+		((ebytes == 0) || (memcmp(tpm_rsa_public_cache[i].earr, earr, ebytes) == 0))) {
+		tpm_rsa_public_cache[i].lastUse = tpm_rsa_public_cache_clock;
+		*rsa_pub_key = tpm_rsa_public_cache[i].rsa_pub_key;
+		break;
+	    }
+	    if ((entry == NULL) ||
+		(tpm_rsa_public_cache[i].rsa_pub_key == NULL) ||
+		((entry->rsa_pub_key != NULL) &&
+		 (tpm_rsa_public_cache[i].lastUse < entry->lastUse))) {
+		entry = &tpm_rsa_public_cache[i];
+	    }
+	}
+    }
+    /* on a miss, replace the victim with a new token */
+    if ((rc == 0) && (*rsa_pub_key == NULL)) {
+	printf("  TPM_RSAPublicKeyCache_Get: Miss, replacing entry %lu\n",
+	       (unsigned long)(entry - tpm_rsa_public_cache));
+	TPM_RSAPublicKeyCache_DeleteEntry(entry);
+	if (nbytes > 0) {
+	    rc = TPM_Malloc(&(entry->narr), nbytes);
+	}
+	if ((rc == 0) && (ebytes > 0)) {
+	    rc = TPM_Malloc(&(entry->earr), ebytes);
+	}
+	if (rc == 0) {
+	    rc = TPM_RSAGeneratePublicToken(&(entry->rsa_pub_key),
+					    narr,      	/* public modulus */
+					    nbytes,
+					    earr,      	/* public exponent */
+					    ebytes);
+	}
+	if (rc == 0) {
+	    TPM_Digest_Copy(entry->digest, digest);
+	    if (nbytes > 0) {
+		memcpy(entry->narr, narr, nbytes);
+	    }
+	    entry->nbytes = nbytes;
+	    if (ebytes > 0) {
+		memcpy(entry->earr, earr, ebytes);
+	    }
+	    entry->ebytes = ebytes;
+	    entry->lastUse = tpm_rsa_public_cache_clock;
+	    *rsa_pub_key = entry->rsa_pub_key;
+	}
+	else {
+	    TPM_RSAPublicKeyCache_DeleteEntry(entry);
+	}
+    }
+    return rc;
+}
+
+/* TPM_RSAPublicKeyCache_DeleteEntry() frees the token and the key copies of a cache entry and
+   marks it free
+*/
+
+static void TPM_RSAPublicKeyCache_DeleteEntry(TPM_RSA_PUBLIC_CACHE_ENTRY *entry)
+{
+    if (entry->rsa_pub_key != NULL) {
+	TPM_RSAToken_Delete(entry->rsa_pub_key);
+	entry->rsa_pub_key = NULL;
+    }
+    free(entry->narr);
+    entry->narr = NULL;
+    entry->nbytes = 0;
+    free(entry->earr);
+    entry->earr = NULL;
+    entry->ebytes = 0;
+    return;
+}
+
+/* TPM_RSAPublicKeyCache_Delete() frees all cached RSA public key tokens
+ */
+
+static void TPM_RSAPublicKeyCache_Delete()
+{
+    size_t	i;
+
+    for (i = 0 ; i < TPM_RSA_PUBLIC_CACHE_SIZE ; i++) {
+	TPM_RSAPublicKeyCache_DeleteEntry(&tpm_rsa_public_cache[i]);
+    }
+    return;
+}
+
+/* TPM_RSAPrivateKeyToken_New() constructs a reusable private key token from n,e,d.
+
+   If the prime factors 'p', 'q' and the CRT parameters 'dp', 'dq', 'qinv' are supplied (pbytes
+   not zero), private key operations use the Chinese Remainder Theorem, about 3 to 4 times faster
+   than the exponentiation with d.  Otherwise they may be NULL with size 0.
+
+   The token holds the prepared OpenSSL key object, so the bignum conversion, Montgomery contexts
+   and blinding are set up once and reused by TPM_RSAPrivateDecryptToken() and TPM_RSASignToken().
+   For EVP, this includes the decrypt and sign operation contexts.
+
+   '*rsa_pri_token' must be NULL on entry.  It must be freed with TPM_RSAPrivateKeyToken_Free().
+*/
+
+TPM_RESULT TPM_RSAPrivateKeyToken_New(void **rsa_pri_token,	/* freed by caller */
+				      unsigned char *narr,	/* public modulus */
+				      uint32_t nbytes,
+				      unsigned char *earr,	/* public exponent */
+				      uint32_t ebytes,
+				      unsigned char *darr,	/* private exponent */
+				      uint32_t dbytes,
+				      unsigned char *parr,	/* prime factor p, or NULL */
+				      uint32_t pbytes,
+				      unsigned char *qarr,	/* prime factor q */
+				      uint32_t qbytes,
+				      unsigned char *dparr,	/* d mod (p-1) */
+				      uint32_t dpbytes,
+				      unsigned char *dqarr,	/* d mod (q-1) */
+				      uint32_t dqbytes,
+				      unsigned char *qinvarr,	/* q^-1 mod p */
+				      uint32_t qinvbytes)
+{
+    TPM_RESULT		rc = 0;
+    TPM_RSA_TOKEN	*rsa_pri_key = NULL;
+
+    printf(" TPM_RSAPrivateKeyToken_New: CRT %s\n", (pbytes != 0) ? "yes" : "no");
+    if (rc == 0) {
+	rc = TPM_RSAGeneratePrivateToken(&rsa_pri_key,
+					 narr,      	/* public modulus */
+					 nbytes,
+					 earr,      	/* public exponent */
+					 ebytes,
+					 darr,		/* private exponent */
+					 dbytes,
+					 parr,		/* CRT parameters */
+					 pbytes,
+					 qarr,
+					 qbytes,
+					 dparr,
+					 dpbytes,
+					 dqarr,
+					 dqbytes,
+					 qinvarr,
+					 qinvbytes);
+    }
+    if (rc == 0) {
+	*rsa_pri_token = rsa_pri_key;
+    }
+    else {
+	TPM_RSAToken_Delete(rsa_pri_key);
+    }
+    return rc;
+}
+
+/* TPM_RSAPrivateKeyToken_Free() frees a token constructed by TPM_RSAPrivateKeyToken_New() and sets
+   it back to NULL.  No-op if the token is NULL.
+*/
+
+void TPM_RSAPrivateKeyToken_Free(void **rsa_pri_token)
+{
+    if (*rsa_pri_token != NULL) {
+	TPM_RSAToken_Delete(*rsa_pri_token);
+	*rsa_pri_token = NULL;
+    }
+    return;
+}
+
+/* TPM_RSAPrivateDecrypt() decrypts 'encrypt_data' using the private key 'n, e, d'.  The OAEP
+   padding is removed and 'decrypt_data_length' bytes are moved to 'decrypt_data'.
+
+   'decrypt_data_length' is at most 'decrypt_data_size'.
+*/
+
+TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted data */
+                                 uint32_t *decrypt_data_length,	/* length of data put into
+                                                                   decrypt_data */
+                                 size_t decrypt_data_size,      /* size of decrypt_data buffer */
+                                 TPM_ENC_SCHEME encScheme,      /* encryption scheme */
+                                 unsigned char *encrypt_data,   /* encrypted data */
+                                 uint32_t encrypt_data_size,
+                                 unsigned char *narr,           /* public modulus */
+                                 uint32_t nbytes,
+                                 unsigned char *earr,           /* public exponent */
+                                 uint32_t ebytes,
+                                 unsigned char *darr,           /* private exponent */
+                                 uint32_t dbytes)
+{
+    TPM_RESULT  rc = 0;
+    void *      rsa_pri_token = NULL;	/* freed @1 */
+
+    printf(" TPM_RSAPrivateDecrypt:\n");
+    /* construct the OpenSSL private key object */
+    if (rc == 0) {
+	rc = TPM_RSAPrivateKeyToken_New(&rsa_pri_token,	/* freed @1 */
+					narr,      	/* public modulus */
+					nbytes,
+					earr,      	/* public exponent */
+					ebytes,
+					darr,		/* private exponent */
+					dbytes,
+					NULL, 0,	/* no CRT parameters */
+					NULL, 0,
+					NULL, 0,
+					NULL, 0,
+					NULL, 0);
+    }
+    if (rc == 0) {
+	rc = TPM_RSAPrivateDecryptToken(decrypt_data,
+					decrypt_data_length,
+					decrypt_data_size,
+					encScheme,
+					encrypt_data,
+					encrypt_data_size,
+					rsa_pri_token);
+    }
+    TPM_RSAPrivateKeyToken_Free(&rsa_pri_token);	/* @1 */
+    return rc;
+}
+
+/* TPM_RSAPrivateDecryptToken() is TPM_RSAPrivateDecrypt() using a private key token constructed by
+   TPM_RSAPrivateKeyToken_New()
+*/
+
+TPM_RESULT TPM_RSAPrivateDecryptToken(unsigned char *decrypt_data,	/* decrypted data */
+				      uint32_t *decrypt_data_length,	/* length of data put into
+									   decrypt_data */
+				      size_t decrypt_data_size,	/* size of decrypt_data buffer */
+				      TPM_ENC_SCHEME encScheme,	/* encryption scheme */
+				      unsigned char *encrypt_data,	/* encrypted data */
+				      uint32_t encrypt_data_size,
+				      void *rsa_pri_token)		/* private key token */
+{
+    TPM_RESULT  rc = 0;
+    int         irc;
+    TPM_RSA_TOKEN *rsa_pri_key = rsa_pri_token;
+
+    /* the decrypted but still padded data is on the stack, unless the key is larger than
+       TPM_RSA_KEY_LENGTH_MAX */
+    unsigned char       padded_buffer[TPM_RSA_KEY_LENGTH_MAX / CHAR_BIT];
+    unsigned char       *padded_alloc = NULL;
+    unsigned char       *padded_data = padded_buffer;
+    int                 padded_data_size = 0;
+#ifdef TPM_OPENSSL_EVP
+    EVP_PKEY_CTX        *ctx = NULL;            /* owned by the token */
+    size_t              recovered_size;
+#endif
+    
+    printf(" TPM_RSAPrivateDecryptToken:\n");
+    if (rc == 0) {
+	if (rsa_pri_key == NULL) {
+	    printf("TPM_RSAPrivateDecryptToken: Error (fatal), NULL token\n");
+	    rc = TPM_FAIL;
+	}
+    }
+    /* intermediate buffer for the decrypted but still padded data */
     if (rc == 0) {
         /* the size of the decrypted data is guaranteed to be less than this */
-        padded_data_size = RSA_size(rsa_pri_key);
-        rc = TPM_Malloc(&padded_data, padded_data_size);
+        padded_data_size = TPM_RSAToken_Size(rsa_pri_key);
+	if ((size_t)padded_data_size > sizeof(padded_buffer)) {
+	    rc = TPM_Malloc(&padded_alloc, padded_data_size);	/* freed @1 */
+	    padded_data = padded_alloc;
+	}
+    }
+#ifdef TPM_OPENSSL_EVP
+    /* the token context decrypts and removes the padding.  The data is recovered to the
+       intermediate buffer, which holds the key size, and then copied to decrypt_data */
+    if (rc == 0) {
+        if (encScheme == TPM_ES_RSAESOAEP_SHA1_MGF1) {
+            rc = TPM_RSAToken_GetPadCtx(&ctx, rsa_pri_key, RSA_PKCS1_OAEP_PADDING, FALSE);
+        }
+        else if (encScheme == TPM_ES_RSAESPKCSv15) {
+            rc = TPM_RSAToken_GetPadCtx(&ctx, rsa_pri_key, RSA_PKCS1_PADDING, FALSE);
+        }
+        else {
+            printf("TPM_RSAPrivateDecryptToken: Error, unknown encryption scheme %04x\n",
+                   encScheme);
+            rc = TPM_INAPPROPRIATE_ENC;
+        }
+    }
+    if (rc == 0) {
+        recovered_size = padded_data_size;
+        irc = EVP_PKEY_decrypt(ctx,
+                               padded_data, &recovered_size,
+                               encrypt_data, encrypt_data_size);
+        if (irc != 1) {
+            printf("TPM_RSAPrivateDecryptToken: Error in EVP_PKEY_decrypt()\n");
+            rc = TPM_DECRYPT_ERROR;
+        }
     }
+    if (rc == 0) {
+        if (recovered_size > decrypt_data_size) {
+            printf("TPM_RSAPrivateDecryptToken: Error, recovered %lu bytes, buffer %lu\n",
+                   (unsigned long)recovered_size, (unsigned long)decrypt_data_size);
+            rc = TPM_DECRYPT_ERROR;
+        }
+    }
+    if (rc == 0) {
+        memcpy(decrypt_data, padded_data, recovered_size);
+        irc = recovered_size;
+    }
+#else
     if (rc == 0) {
         /* decrypt with private key.  Must decrypt first and then remove padding because the decrypt
            call cannot specify an encoding parameter */
-            /* returns the size of the encrypted data.  On error, -1 is returned */
-            irc = RSA_private_decrypt(encrypt_data_size,        /* length */
-                                      encrypt_data,             /* from - the encrypted data */
-                                      padded_data,      /* to - the decrypted but padded data */
-                                      rsa_pri_key,              /* key */
-                                      RSA_NO_PADDING);          /* padding */
-            if (irc < 0) {
-                printf("TPM_RSAPrivateDecrypt: Error in RSA_private_decrypt()\n");
-                rc = TPM_DECRYPT_ERROR;
-            }
+        rc = TPM_RSAToken_PrivateRaw(padded_data,       /* to - the decrypted but padded data */
+                                     encrypt_data,      /* from - the encrypted data */
+                                     encrypt_data_size,
+                                     rsa_pri_key);
     }
     if (rc == 0) {
-        printf("  TPM_RSAPrivateDecrypt: RSA_private_decrypt() success\n");
-        printf("  TPM_RSAPrivateDecrypt: Padded data size %u\n", padded_data_size);
-        TPM_PrintFour("  TPM_RSAPrivateDecrypt: Decrypt padded data", padded_data);
+        printf("  TPM_RSAPrivateDecryptToken: Private key decrypt success\n");
+        printf("  TPM_RSAPrivateDecryptToken: Padded data size %u\n", padded_data_size);
+        TPM_PrintFour("  TPM_RSAPrivateDecryptToken: Decrypt padded data", padded_data);
         if (encScheme == TPM_ES_RSAESOAEP_SHA1_MGF1) {
             /* openSSL expects the padded data to skip the first 0x00 byte, since it expects the
                padded data to come from a bignum via bn2bin. */
@@ -625,7 +1644,7 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted dat
                                                                            */
                                                );
             if (irc < 0) {
-                printf("TPM_RSAPrivateDecrypt: Error in RSA_padding_check_PKCS1_OAEP()\n");
+                printf("TPM_RSAPrivateDecryptToken: Error in RSA_padding_check_PKCS1_OAEP()\n");
                 rc = TPM_DECRYPT_ERROR;
             }
         }
@@ -637,27 +1656,77 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted dat
                                                  encrypt_data_size      /* rsa_len */
                                                  );
             if (irc < 0) {
-                printf("TPM_RSAPrivateDecrypt: Error in RSA_padding_check_PKCS1_type_2()\n");
+                printf("TPM_RSAPrivateDecryptToken: Error in RSA_padding_check_PKCS1_type_2()\n");
                 rc = TPM_DECRYPT_ERROR;
             }
         }
         else {
-            printf("TPM_RSAPrivateDecrypt: Error, unknown encryption scheme %04x\n", encScheme);
+            printf("TPM_RSAPrivateDecryptToken: Error, unknown encryption scheme %04x\n",
+                   encScheme);
             rc = TPM_INAPPROPRIATE_ENC;
         }
     }
+#endif
     if (rc == 0) {
         *decrypt_data_length = irc;
-        printf("  TPM_RSAPrivateDecrypt: RSA_padding_check_PKCS1_OAEP() recovered %d bytes\n", irc);
-        TPM_PrintFour("  TPM_RSAPrivateDecrypt: Decrypt data", decrypt_data);
+        printf("  TPM_RSAPrivateDecryptToken: Recovered %d bytes\n", irc);
+        TPM_PrintFour("  TPM_RSAPrivateDecryptToken: Decrypt data", decrypt_data);
+    }
+    if (padded_data != NULL) {
+	memset(padded_data, 0, padded_data_size);
     }
-    if (rsa_pri_key != NULL) {
-        RSA_free(rsa_pri_key);          /* @1 */
+    free(padded_alloc);                 /* @1 */
+    return rc;
+}
+
+/* TPM_RSAPublicKeyToken_New() constructs a reusable public key token from n,e.
+
+   The token holds the prepared OpenSSL key object, so the bignum conversion and Montgomery context
+   are set up once and reused by TPM_RSAPublicEncryptToken().  Unlike the public key cache entries,
+   the token is owned by the caller and is never evicted.
+
+   '*rsa_pub_token' must be NULL on entry.  It must be freed with TPM_RSAPublicKeyToken_Free().
+*/
+
+TPM_RESULT TPM_RSAPublicKeyToken_New(void **rsa_pub_token,	/* freed by caller */
+				     unsigned char *narr,	/* public modulus */
+				     uint32_t nbytes,
+				     unsigned char *earr,	/* public exponent */
+				     uint32_t ebytes)
+{
+    TPM_RESULT		rc = 0;
+    TPM_RSA_TOKEN	*rsa_pub_key = NULL;
+
+    printf(" TPM_RSAPublicKeyToken_New:\n");
+    if (rc == 0) {
+	rc = TPM_RSAGeneratePublicToken(&rsa_pub_key,
+					narr,      	/* public modulus */
+					nbytes,
+					earr,      	/* public exponent */
+					ebytes);
+    }
+    if (rc == 0) {
+	*rsa_pub_token = rsa_pub_key;
+    }
+    else {
+	TPM_RSAToken_Delete(rsa_pub_key);
     }
-    free(padded_data);                  /* @2 */
     return rc;
 }
 
+/* TPM_RSAPublicKeyToken_Free() frees a token constructed by TPM_RSAPublicKeyToken_New() and sets
+   it back to NULL.  No-op if the token is NULL.
+*/
+
+void TPM_RSAPublicKeyToken_Free(void **rsa_pub_token)
+{
+    if (*rsa_pub_token != NULL) {
+	TPM_RSAToken_Delete(*rsa_pub_token);
+	*rsa_pub_token = NULL;
+    }
+    return;
+}
+
 /* TPM_RSAPublicEncrypt() pads 'decrypt_data' to 'encrypt_data_size' and encrypts using the public
    key 'n, e'.
 */
@@ -673,22 +1742,95 @@ TPM_RESULT TPM_RSAPublicEncrypt(unsigned char* encrypt_data,    /* encrypted dat
                                 uint32_t ebytes)
 {
     TPM_RESULT  rc = 0;
-    int         irc;
-    RSA         *rsa_pub_key = NULL;
-    unsigned char *padded_data = NULL;
+    TPM_RSA_TOKEN *rsa_pub_key = NULL;
     
     printf(" TPM_RSAPublicEncrypt: Input data size %lu\n", (unsigned long)decrypt_data_size);
-    /* intermediate buffer for the decrypted but still padded data */
+    /* get the OpenSSL public key object */
     if (rc == 0) {
-        rc = TPM_Malloc(&padded_data, encrypt_data_size);               /* freed @2 */
+	rc = TPM_RSAPublicKeyCache_Get(&rsa_pub_key,	/* owned by the cache */
+				       narr,      	/* public modulus */
+				       nbytes,
+				       earr,      	/* public exponent */
+				       ebytes);
     }
-    /* construct the OpenSSL public key object */
     if (rc == 0) {
-	rc = TPM_RSAGeneratePublicToken(&rsa_pub_key,	/* freed @1 */
-					narr,      	/* public modulus */
-					nbytes,
-					earr,      	/* public exponent */
-					ebytes);
+	rc = TPM_RSAPublicEncryptToken(encrypt_data,
+				       encrypt_data_size,
+				       encScheme,
+				       decrypt_data,
+				       decrypt_data_size,
+				       rsa_pub_key);
+    }
+    return rc;
+}
+
+/* TPM_RSAPublicEncryptToken() pads 'decrypt_data' to 'encrypt_data_size' and encrypts using the
+   public key token from TPM_RSAPublicKeyToken_New().
+*/
+
+TPM_RESULT TPM_RSAPublicEncryptToken(unsigned char* encrypt_data,	/* encrypted data */
+				     size_t encrypt_data_size,	/* size of encrypted data buffer */
+				     TPM_ENC_SCHEME encScheme,
+				     const unsigned char *decrypt_data,	/* decrypted data */
+				     size_t decrypt_data_size,
+				     void *rsa_pub_token)
+{
+    TPM_RESULT  rc = 0;
+    int         irc;
+    TPM_RSA_TOKEN *rsa_pub_key = rsa_pub_token;
+#ifdef TPM_OPENSSL_EVP
+    EVP_PKEY_CTX  *ctx = NULL;          /* owned by the token */
+    size_t        encrypted_size;
+#else
+    /* the padded data is on the stack, unless the key is larger than TPM_RSA_KEY_LENGTH_MAX */
+    unsigned char padded_buffer[TPM_RSA_KEY_LENGTH_MAX / CHAR_BIT];
+    unsigned char *padded_alloc = NULL;
+    unsigned char *padded_data = padded_buffer;
+#endif
+    
+    printf(" TPM_RSAPublicEncryptToken: Input data size %lu\n", (unsigned long)decrypt_data_size);
+#ifdef TPM_OPENSSL_EVP
+    /* the token context pads and encrypts */
+    if (rc == 0) {
+        if (encScheme == TPM_ES_RSAESOAEP_SHA1_MGF1) {
+            rc = TPM_RSAToken_GetPadCtx(&ctx, rsa_pub_key, RSA_PKCS1_OAEP_PADDING, FALSE);
+        }
+        else if (encScheme == TPM_ES_RSAESPKCSv15) {
+            rc = TPM_RSAToken_GetPadCtx(&ctx, rsa_pub_key, RSA_PKCS1_PADDING, FALSE);
+        }
+        else {
+            printf("TPM_RSAPublicEncryptToken: Error, unknown encryption scheme %04x\n", encScheme);
+            rc = TPM_INAPPROPRIATE_ENC;
+        }
+    }
+    /* the encrypted data is the key size */
+    if (rc == 0) {
+        if (encrypt_data_size != TPM_RSAToken_Size(rsa_pub_key)) {
+            printf("TPM_RSAPublicEncryptToken: Error, buffer %lu is not the key size %u\n",
+                   (unsigned long)encrypt_data_size, TPM_RSAToken_Size(rsa_pub_key));
+            rc = TPM_ENCRYPT_ERROR;
+        }
+    }
+    if (rc == 0) {
+        encrypted_size = encrypt_data_size;
+        irc = EVP_PKEY_encrypt(ctx,
+                               encrypt_data, &encrypted_size,
+                               decrypt_data, decrypt_data_size);
+        if (irc != 1) {
+            printf("TPM_RSAPublicEncryptToken: Error in EVP_PKEY_encrypt()\n");
+            rc = TPM_ENCRYPT_ERROR;
+        }
+    }
+    if (rc == 0) {
+        printf("  TPM_RSAPublicEncryptToken: Public key encrypt success\n");
+    }
+#else
+    /* intermediate buffer for the decrypted but still padded data */
+    if (rc == 0) {
+	if (encrypt_data_size > sizeof(padded_buffer)) {
+	    rc = TPM_Malloc(&padded_alloc, encrypt_data_size);         /* freed @1 */
+	    padded_data = padded_alloc;
+	}
     }
     if (rc == 0) {
         if (encScheme == TPM_ES_RSAESOAEP_SHA1_MGF1) {
@@ -701,11 +1843,11 @@ TPM_RESULT TPM_RSAPublicEncrypt(unsigned char* encrypt_data,    /* encrypted dat
                                                                            */
                                              );
             if (irc != 1) {
-                printf("TPM_RSAPublicEncrypt: Error in RSA_padding_add_PKCS1_OAEP()\n");
+                printf("TPM_RSAPublicEncryptToken: Error in RSA_padding_add_PKCS1_OAEP()\n");
                 rc = TPM_ENCRYPT_ERROR;
             }
             else {
-                printf("  TPM_RSAPublicEncrypt: RSA_padding_add_PKCS1_OAEP() success\n");
+                printf("  TPM_RSAPublicEncryptToken: RSA_padding_add_PKCS1_OAEP() success\n");
             }
         }
         else if (encScheme == TPM_ES_RSAESPKCSv15) {
@@ -714,41 +1856,37 @@ TPM_RESULT TPM_RSAPublicEncrypt(unsigned char* encrypt_data,    /* encrypted dat
                                                decrypt_data,            /* from */
                                                decrypt_data_size);      /* from length */
             if (irc != 1) {
-                printf("TPM_RSAPublicEncrypt: Error in RSA_padding_add_PKCS1_type_2()\n");
+                printf("TPM_RSAPublicEncryptToken: Error in RSA_padding_add_PKCS1_type_2()\n");
                 rc = TPM_ENCRYPT_ERROR;
             }
             else {
-                printf("  TPM_RSAPublicEncrypt: RSA_padding_add_PKCS1_type_2() success\n");
+                printf("  TPM_RSAPublicEncryptToken: RSA_padding_add_PKCS1_type_2() success\n");
             }
         }
         else {
-            printf("TPM_RSAPublicEncrypt: Error, unknown encryption scheme %04x\n", encScheme);
+            printf("TPM_RSAPublicEncryptToken: Error, unknown encryption scheme %04x\n", encScheme);
             rc = TPM_INAPPROPRIATE_ENC;
         }
    }
     if (rc == 0) {
-        printf("  TPM_RSAPublicEncrypt: Padded data size %lu\n", (unsigned long)encrypt_data_size);
-        TPM_PrintFour("  TPM_RSAPublicEncrypt: Padded data", padded_data);
+        printf("  TPM_RSAPublicEncryptToken: Padded data size %lu\n",
+	       (unsigned long)encrypt_data_size);
+        TPM_PrintFour("  TPM_RSAPublicEncryptToken: Padded data", padded_data);
         /* encrypt with public key.  Must pad first and then encrypt because the encrypt
            call cannot specify an encoding parameter */
-            /* returns the size of the encrypted data.  On error, -1 is returned */
-            irc = RSA_public_encrypt(encrypt_data_size,         /* from length */
-                                     padded_data,               /* from - the clear text data */
-                                     encrypt_data,              /* the padded and encrypted data */
-                                     rsa_pub_key,               /* key */
-                                     RSA_NO_PADDING);           /* padding */
-            if (irc < 0) {
-                printf("TPM_RSAPublicEncrypt: Error in RSA_public_encrypt()\n");
-                rc = TPM_ENCRYPT_ERROR;
-            }
+        rc = TPM_RSAToken_PublicRaw(encrypt_data,       /* the padded and encrypted data */
+                                    padded_data,        /* from - the clear text data */
+                                    encrypt_data_size,
+                                    rsa_pub_key);
     }
     if (rc == 0) {
-        printf("  TPM_RSAPublicEncrypt: RSA_public_encrypt() success\n");
+        printf("  TPM_RSAPublicEncryptToken: Public key encrypt success\n");
     }
-    if (rsa_pub_key != NULL) {
-        RSA_free(rsa_pub_key);          /* @1 */
+    if (padded_data != NULL) {
+	memset(padded_data, 0, encrypt_data_size);
     }
-    free(padded_data);                  /* @2 */
+    free(padded_alloc);                 /* @1 */
+#endif
     return rc;
 }
 
@@ -766,8 +1904,7 @@ TPM_RESULT TPM_RSAPublicEncryptRaw(unsigned char *encrypt_data,	/* output */
 				   uint32_t ebytes)
 {
     TPM_RESULT          rc = 0;
-    int                 irc;
-    RSA                 *rsa_pub_key = NULL;
+    TPM_RSA_TOKEN       *rsa_pub_key = NULL;
 
     printf("   TPM_RSAPublicEncryptRaw:\n");
     /* the input data size must equal the public key size */
@@ -786,28 +1923,23 @@ TPM_RESULT TPM_RSAPublicEncryptRaw(unsigned char *encrypt_data,	/* output */
 	    rc = TPM_ENCRYPT_ERROR;
 	}
     }
-    /* construct the OpenSSL public key object */
+    /* get the OpenSSL public key object */
     if (rc == 0) {
-	rc = TPM_RSAGeneratePublicToken(&rsa_pub_key,	/* freed @1 */
-					narr,      	/* public modulus */
-					nbytes,
-					earr,      	/* public exponent */
-					ebytes);
+	rc = TPM_RSAPublicKeyCache_Get(&rsa_pub_key,	/* owned by the cache */
+				       narr,      	/* public modulus */
+				       nbytes,
+				       earr,      	/* public exponent */
+				       ebytes);
     }
     if (rc == 0) {
         TPM_PrintFour("  TPM_RSAPublicEncryptRaw: Public modulus", narr);
         TPM_PrintAll("  TPM_RSAPublicEncryptRaw: Public exponent", earr, ebytes);
         TPM_PrintFour("  TPM_RSAPublicEncryptRaw: Decrypt data", decrypt_data);
         /* encrypt the decrypt_data */
-        irc = RSA_public_encrypt(decrypt_data_size,      	/* from length */
-                                 decrypt_data,     	/* from - the clear text data */
-                                 encrypt_data,         	/* to - the padded and encrypted data */
-                                 rsa_pub_key,           /* key */
-                                 RSA_NO_PADDING);       /* padding */
-        if (irc < 0) {
-            printf("TPM_RSAPublicEncryptRaw: Error in RSA_public_encrypt()\n");
-            rc = TPM_ENCRYPT_ERROR;
-        }
+        rc = TPM_RSAToken_PublicRaw(encrypt_data,       /* to - the padded and encrypted data */
+                                    decrypt_data,       /* from - the clear text data */
+                                    decrypt_data_size,
+                                    rsa_pub_key);
     }
     if (rc == 0) {
         TPM_PrintFour("  TPM_RSAPublicEncryptRaw: Encrypt data", encrypt_data);
@@ -816,9 +1948,6 @@ TPM_RESULT TPM_RSAPublicEncryptRaw(unsigned char *encrypt_data,	/* output */
 		     encrypt_data, encrypt_data_size);
 #endif
     }
-    if (rsa_pub_key != NULL) {
-        RSA_free(rsa_pub_key);          /* @1 */
-    }
     return rc;
 }
 
@@ -843,26 +1972,65 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
                        uint32_t dbytes)
 {
     TPM_RESULT          rc = 0;
-    RSA *               rsa_pri_key = NULL;	/* freed @1 */
-    unsigned int        key_size;
+    void *              rsa_pri_token = NULL;	/* freed @1 */
 
     printf(" TPM_RSASign:\n");
     /* construct the OpenSSL private key object */
     if (rc == 0) {
-	rc = TPM_RSAGeneratePrivateToken(&rsa_pri_key,	/* freed @1 */
-					 narr,      	/* public modulus */
-					 nbytes,
-					 earr,      	/* public exponent */
-					 ebytes,
-					 darr,		/* private exponent */
-					 dbytes);
+	rc = TPM_RSAPrivateKeyToken_New(&rsa_pri_token,	/* freed @1 */
+					narr,      	/* public modulus */
+					nbytes,
+					earr,      	/* public exponent */
+					ebytes,
+					darr,		/* private exponent */
+					dbytes,
+					NULL, 0,	/* no CRT parameters */
+					NULL, 0,
+					NULL, 0,
+					NULL, 0,
+					NULL, 0);
+    }
+    if (rc == 0) {
+	rc = TPM_RSASignToken(signature,
+			      signature_length,
+			      signature_size,
+			      sigScheme,
+			      message,
+			      message_size,
+			      rsa_pri_token);
+    }
+    TPM_RSAPrivateKeyToken_Free(&rsa_pri_token);	/* @1 */
+    return rc;
+}
+
+/* TPM_RSASignToken() is TPM_RSASign() using a private key token constructed by
+   TPM_RSAPrivateKeyToken_New()
+*/
+
+TPM_RESULT TPM_RSASignToken(unsigned char *signature,        /* output */
+			    unsigned int *signature_length,  /* output, size of signature */
+			    unsigned int signature_size,     /* input, size of signature buffer */
+			    TPM_SIG_SCHEME sigScheme,        /* input, type of signature */
+			    const unsigned char *message,    /* input */
+			    size_t message_size,             /* input */
+			    void *rsa_pri_token)		/* private key token */
+{
+    TPM_RESULT          rc = 0;
+    TPM_RSA_TOKEN *     rsa_pri_key = rsa_pri_token;
+    unsigned int        key_size;
+
+    printf(" TPM_RSASignToken:\n");
+    if (rc == 0) {
+	if (rsa_pri_key == NULL) {
+	    printf("TPM_RSASignToken: Error (fatal), NULL token\n");
+	    rc = TPM_FAIL;
+	}
     }
     /* check the size of the output signature buffer */
     if (rc == 0) {
-        key_size = (unsigned int)RSA_size(rsa_pri_key); /* openSSL returns an int, but never
-                                                           negative */
+        key_size = TPM_RSAToken_Size(rsa_pri_key);
         if (signature_size < key_size) {
-            printf("TPM_RSASign: Error (fatal), buffer %u too small for signature %u\n",
+            printf("TPM_RSASignToken: Error (fatal), buffer %u too small for signature %u\n",
                    signature_size, key_size);
             rc = TPM_FAIL;      /* internal error, should never occur */
         }
@@ -871,7 +2039,7 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
     if (rc == 0) {
         switch(sigScheme) {
           case TPM_SS_NONE:
-            printf("TPM_RSASign: Error, sigScheme TPM_SS_NONE\n");
+            printf("TPM_RSASignToken: Error, sigScheme TPM_SS_NONE\n");
             rc = TPM_INVALID_KEYUSAGE;
             break;
           case TPM_SS_RSASSAPKCS1v15_SHA1:
@@ -890,14 +2058,11 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
                                 rsa_pri_key);
             break;
           default:
-            printf("TPM_RSASign: Error, sigScheme %04hx unknown\n", sigScheme);
+            printf("TPM_RSASignToken: Error, sigScheme %04hx unknown\n", sigScheme);
             rc = TPM_INVALID_KEYUSAGE;
             break;
         }
     }
-    if (rsa_pri_key != NULL) {
-        RSA_free(rsa_pri_key);          /* @1 */
-    }
     return rc;
 }
 
@@ -911,7 +2076,7 @@ static TPM_RESULT TPM_RSASignSHA1(unsigned char *signature,             /* outpu
                                   unsigned int *signature_length, /* output, size of signature */
                                   const unsigned char *message,         /* input */
                                   size_t message_size,                  /* input */
-                                  RSA *rsa_pri_key)                     /* signing private key */
+                                  TPM_RSA_TOKEN *rsa_pri_key)           /* signing private key */
 {
     TPM_RESULT  rc = 0;
     int         irc;
@@ -925,6 +2090,24 @@ static TPM_RESULT TPM_RSASignSHA1(unsigned char *signature,             /* outpu
             rc = TPM_DECRYPT_ERROR;
         } 
     }
+#ifdef TPM_OPENSSL_EVP
+    if (rc == 0) {
+        /* the signature context adds the algorithm identifier and type 1 pad.  The caller checked
+           that the signature buffer holds the key size. */
+        size_t sig_length = TPM_RSAToken_Size(rsa_pri_key);
+        irc = EVP_PKEY_sign(rsa_pri_key->sig_ctx,
+                            signature, &sig_length,
+                            message, message_size);
+        /* EVP_PKEY_sign() returns 1 on success */
+        if (irc != 1) {
+            printf("TPM_RSASignSHA1: Error in EVP_PKEY_sign()\n");
+            rc = TPM_DECRYPT_ERROR;
+        }
+        else {
+            *signature_length = (unsigned int)sig_length;
+        }
+    }
+#else
     if (rc == 0) {
         /* type NID_sha1, adds the algorithm identifier and type 1 pad */
         irc = RSA_sign(NID_sha1,                /* type */
@@ -937,6 +2120,7 @@ static TPM_RESULT TPM_RSASignSHA1(unsigned char *signature,             /* outpu
             rc = TPM_DECRYPT_ERROR;
         }
     }
+#endif
     return rc;
 }
 
@@ -952,27 +2136,49 @@ static TPM_RESULT TPM_RSASignDER(unsigned char *signature,              /* outpu
                                  unsigned int *signature_length, /* output, size of signature */
                                  const unsigned char *message,          /* input */
                                  size_t message_size,                   /* input */
-                                 RSA *rsa_pri_key)                      /* signing private key */
+                                 TPM_RSA_TOKEN *rsa_pri_key)            /* signing private key */
 {
     TPM_RESULT  rc = 0;
     int         irc;
-    int         key_size;
+    unsigned int key_size;
+#ifdef TPM_OPENSSL_EVP
+    EVP_PKEY_CTX *ctx = NULL;           /* owned by the token */
+    size_t      sig_length;
+#else
     unsigned char *message_pad;
-    int         int_sig_len;    /* openSSL overloads RSA_private_decrypt return code */
+#endif
     
     printf(" TPM_RSASignDER:\n");
-    message_pad = NULL;         /* freed @1 */
-    /* the padded message size is the same as the key size */
+#ifdef TPM_OPENSSL_EVP
+    /* the token context adds the type 1 pad.  The caller checked that the signature buffer holds
+       the key size. */
     if (rc == 0) {
-        key_size = RSA_size(rsa_pri_key);
-        if (key_size < 0) {
-            printf(" TPM_RSASignDER: Error (fatal), negative key size %d\n", key_size);
-            rc = TPM_FAIL;      /* should never occur */
+        key_size = TPM_RSAToken_Size(rsa_pri_key);
+        printf(" TPM_RSASignDER: key size %u\n", key_size);
+        rc = TPM_RSAToken_GetPadCtx(&ctx, rsa_pri_key, RSA_PKCS1_PADDING, TRUE);
+    }
+    if (rc == 0) {
+        TPM_PrintFour("  TPM_RSASignDER: Input message", message);
+        sig_length = key_size;
+        /* This call checks that the message will fit with the padding */
+        irc = EVP_PKEY_sign(ctx,
+                            signature, &sig_length,
+                            message, message_size);
+        if (irc != 1) {
+            printf("TPM_RSASignDER: Error signing message, size %lu key size %u\n",
+                   (unsigned long)message_size, key_size);
+            rc = TPM_DECRYPT_ERROR;
         }
     }
-    /* allocate memory for the padded message */
     if (rc == 0) {
-        printf(" TPM_RSASignDER: key size %d\n", key_size);
+        *signature_length = (unsigned int)sig_length;
+    }
+#else
+    message_pad = NULL;         /* freed @1 */
+    /* the padded message size is the same as the key size */
+    if (rc == 0) {
+        key_size = TPM_RSAToken_Size(rsa_pri_key);
+        printf(" TPM_RSASignDER: key size %u\n", key_size);
         rc = TPM_Malloc(&message_pad, key_size);                        /* freed @1 */
     }
     /* PKCS1 type 1 pad the message */
@@ -993,26 +2199,23 @@ static TPM_RESULT TPM_RSASignDER(unsigned char *signature,              /* outpu
     }
     /* raw sign with private key */
     if (rc == 0) {
-        printf("  TPM_RSASignDER: Encrypting with private key, message size %d\n", key_size);
+        printf("  TPM_RSASignDER: Encrypting with private key, message size %u\n", key_size);
         TPM_PrintFour("  TPM_RSASignDER: Padded message", message_pad);
-            /* returns the size of the encrypted data.  On error, -1 is returned */
-            int_sig_len = RSA_private_encrypt(key_size,         /* int flen */
-                                              message_pad,      /* unsigned char *from, */
-                                              signature,        /* unsigned char *to, */
-                                              rsa_pri_key,      /* RSA *rsa, */
-                                              RSA_NO_PADDING);  /* int padding); */
-            if (int_sig_len >= 0) {
-                *signature_length = (unsigned int)int_sig_len;
-            }
-            else {
-                printf("TPM_RSASignDER: Error in RSA_private_encrypt()\n");
-                rc = TPM_DECRYPT_ERROR;
-            }
+        rc = TPM_RSAToken_PrivateRaw(signature,         /* to */
+                                     message_pad,       /* from */
+                                     key_size,
+                                     rsa_pri_key);
+    }
+    if (rc == 0) {
+        *signature_length = key_size;
     }
+#endif
     if (rc == 0) {
         TPM_PrintFour("  TPM_RSASignDER: signature", signature);
     }
+#ifndef TPM_OPENSSL_EVP
     free(message_pad);          /* @1 */
+#endif
     return rc;
 }
 
@@ -1035,44 +2238,54 @@ TPM_RESULT TPM_RSAVerifySHA1(unsigned char *signature,		/* input */
 {
     TPM_RESULT  rc = 0;
     TPM_BOOL 	valid;
-    RSA *       rsa_pub_key = NULL;
+    TPM_RSA_TOKEN *rsa_pub_key = NULL;
     
     printf(" TPM_RSAVerifySHA1:\n");
-    /* construct the openSSL public key object from n and e */
+    /* get the openSSL public key object from n and e */
     if (rc == 0) {
-	rc = TPM_RSAGeneratePublicToken(&rsa_pub_key,	/* freed @1 */
-					narr,      	/* public modulus */
-					nbytes,
-					earr,      	/* public exponent */
-					ebytes);
+	rc = TPM_RSAPublicKeyCache_Get(&rsa_pub_key,	/* owned by the cache */
+				       narr,      	/* public modulus */
+				       nbytes,
+				       earr,      	/* public exponent */
+				       ebytes);
     }
     if (rc == 0) {
+#ifdef TPM_OPENSSL_EVP
+        /* EVP_PKEY_verify() returns 1 on successful verification */
+        valid = EVP_PKEY_verify(rsa_pub_key->sig_ctx,
+				signature, signature_size,
+				message, message_size);
+#else
         /* RSA_verify() returns 1 on successful verification, 0 otherwise. */
         valid = RSA_verify(NID_sha1,
 			   message, message_size,
 			   signature, signature_size, rsa_pub_key);
+#endif
 	if (valid != 1) {
 	    printf("TPM_RSAVerifySHA1: Error, bad signature\n");
 	    rc = TPM_BAD_SIGNATURE;
 	}
     }
-    if (rsa_pub_key != NULL) {
-        RSA_free(rsa_pub_key);          /* @1 */
-    }
     return rc;
 }
 
 /* TPM_RSAGetPrivateKey recalculates q (2nd prime factor) and d (private key) from n (public key), e
    (public exponent), and p (1st prime factor)
 
+   It also calculates the CRT parameters dP = d mod (p-1), dQ = d mod (q-1), and qInv = q^-1 mod p,
+   padded to the size of p.
+
    The private key is validated by dividing the RSA product n by the RSA prime p and verifying that
    the remainder is 0.
 
-   'qarr', darr' must be freed by the caller.
+   'qarr', darr', 'dparr', 'dqarr', 'qinvarr' must be freed by the caller.
 */
 
 TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
                                 uint32_t *dbytes, unsigned char **darr,
+                                uint32_t *dpbytes, unsigned char **dparr,
+                                uint32_t *dqbytes, unsigned char **dqarr,
+                                uint32_t *qinvbytes, unsigned char **qinvarr,
                                 uint32_t nbytes, unsigned char *narr,
                                 uint32_t ebytes, unsigned char *earr,
                                 uint32_t pbytes, unsigned char *parr)
@@ -1086,6 +2299,9 @@ TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
     BIGNUM *d = NULL;           	/* private exponent */
     BIGNUM *p = NULL;           	/* secret prime factor */
     BIGNUM *q = NULL;           	/* secret prime factor */
+    BIGNUM *dp = NULL;           	/* CRT exponent d mod (p-1) */
+    BIGNUM *dq = NULL;           	/* CRT exponent d mod (q-1) */
+    BIGNUM *qinv = NULL;           	/* CRT coefficient q^-1 mod p */
     /* temporary variables */
     BN_CTX *ctx = NULL;			/* freed @5, @6 */
     BIGNUM *r0 = NULL;          	/* n/p remainder */
@@ -1096,6 +2312,9 @@ TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
     printf(" TPM_RSAGetPrivateKey:\n");
     *qarr = NULL;
     *darr = NULL;
+    *dparr = NULL;
+    *dqarr = NULL;
+    *qinvarr = NULL;
     /* check input parameters */
     if (rc == 0) {
         if ((narr == NULL) || (nbytes == 0)) {
@@ -1134,10 +2353,20 @@ TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
     }
     /* allocate BIGNUM's for q, d */
     if (rc == 0) {
-        rc = TPM_BN_new((TPM_BIGNUM *)&q);
+        rc = TPM_BN_new((TPM_BIGNUM *)&q);
+    }
+    if (rc == 0) {
+        rc = TPM_BN_new((TPM_BIGNUM *)&d);
+    }
+    /* allocate BIGNUM's for the CRT parameters */
+    if (rc == 0) {
+        rc = TPM_BN_new((TPM_BIGNUM *)&dp);
+    }
+    if (rc == 0) {
+        rc = TPM_BN_new((TPM_BIGNUM *)&dq);
     }
     if (rc == 0) {
-        rc = TPM_BN_new((TPM_BIGNUM *)&d);
+        rc = TPM_BN_new((TPM_BIGNUM *)&qinv);
     }
     /* convert n, e, p to BIGNUM's */
     if (rc == 0) {
@@ -1202,6 +2431,33 @@ TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
             rc = TPM_BAD_PARAMETER;
         }
     }
+    /* calculate dP = d mod (p-1) */
+    if (rc == 0) {
+        irc = BN_mod(dp, d, r0, ctx);
+        if (irc != 1) {         /* 1 is success */
+            printf("TPM_RSAGetPrivateKey: Error in BN_mod()\n");
+            TPM_OpenSSL_PrintError();
+            rc = TPM_BAD_PARAMETER;
+        }
+    }
+    /* calculate dQ = d mod (q-1) */
+    if (rc == 0) {
+        irc = BN_mod(dq, d, r1, ctx);
+        if (irc != 1) {         /* 1 is success */
+            printf("TPM_RSAGetPrivateKey: Error in BN_mod()\n");
+            TPM_OpenSSL_PrintError();
+            rc = TPM_BAD_PARAMETER;
+        }
+    }
+    /* calculate qInv = q^-1 mod p */
+    if (rc == 0) {
+        brc = BN_mod_inverse(qinv, q, p, ctx);
+        if (brc == NULL) {
+            printf("TPM_RSAGetPrivateKey: Error in BN_mod_inverse()\n");
+            TPM_OpenSSL_PrintError();
+            rc = TPM_BAD_PARAMETER;
+        }
+    }
     /* get q as an array */
     if (rc == 0) {
         rc = TPM_bn2binMalloc(qarr, qbytes, (TPM_BIGNUM)q, pbytes);	/* freed by caller */
@@ -1211,6 +2467,16 @@ TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
         TPM_PrintFour("  TPM_RSAGetPrivateKey: Calculated q",  *qarr);
         rc = TPM_bn2binMalloc(darr, dbytes, (TPM_BIGNUM)d, nbytes);	/* freed by caller */
     }
+    /* get the CRT parameters as arrays */
+    if (rc == 0) {
+        rc = TPM_bn2binMalloc(dparr, dpbytes, (TPM_BIGNUM)dp, pbytes);	/* freed by caller */
+    }
+    if (rc == 0) {
+        rc = TPM_bn2binMalloc(dqarr, dqbytes, (TPM_BIGNUM)dq, pbytes);	/* freed by caller */
+    }
+    if (rc == 0) {
+        rc = TPM_bn2binMalloc(qinvarr, qinvbytes, (TPM_BIGNUM)qinv, pbytes);	/* freed by caller */
+    }
     if (rc == 0) {
         TPM_PrintFour("  TPM_RSAGetPrivateKey: Calculated d",  *darr);
         printf("  TPM_RSAGetPrivateKey: length of n,p,q,d = %u / %u / %u / %u\n",
@@ -1221,6 +2487,9 @@ TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
     BN_free(p);         /* @3 */
     BN_free(q);         /* @4 */
     BN_free(d);         /* @3 */
+    BN_clear_free(dp);
+    BN_clear_free(dq);
+    BN_clear_free(qinv);
     BN_CTX_end(ctx);    /* @5 */
     BN_CTX_free(ctx);   /* @6 */
     return rc;
@@ -1243,7 +2512,11 @@ static void TPM_OpenSSL_PrintError()
     const char          *data;
     int                 flags;
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    error = ERR_get_error_all(&file, &line, NULL, &data, &flags);
+#else
     error = ERR_get_error_line_data(&file, &line, &data, &flags);
+#endif
     printf("\terror %08lx file %s line %d data %s flags %08x\n",
            error, file, line, data, flags);
     return;
@@ -1525,6 +2798,7 @@ TPM_RESULT TPM_BN_mod_exp(TPM_BIGNUM rBignum_in,
     BIGNUM	*aBignum = (BIGNUM *)aBignum_in;
     BIGNUM	*pBignum = (BIGNUM *)pBignum_in;
     BIGNUM	*nBignum = (BIGNUM *)nBignum_in;
+    BN_MONT_CTX	*mont = NULL;		/* owned by the cache */
     
     printf(" TPM_BN_mod_exp:\n");
     ctx = NULL;                         /* freed @1 */
@@ -1539,9 +2813,19 @@ TPM_RESULT TPM_BN_mod_exp(TPM_BIGNUM rBignum_in,
 
     1 is returned for success, 0 on error.
     */
+    /* the DAA stages exponentiate modulo the same issuer modulus, so reuse its Montgomery
+       context */
+    if ((rc == 0) && BN_is_odd(nBignum)) {
+	rc = TPM_BN_MONT_CTX_Get(&mont, nBignum, ctx);
+    }
     if (rc == 0) {
         printf("  TPM_BN_mod_exp: Calculate mod_exp\n");
-        irc = BN_mod_exp(rBignum, aBignum, pBignum, nBignum, ctx);
+	if (mont != NULL) {
+	    irc = BN_mod_exp_mont(rBignum, aBignum, pBignum, nBignum, ctx, mont);
+	}
+	else {
+	    irc = BN_mod_exp(rBignum, aBignum, pBignum, nBignum, ctx);
+	}
         if (irc != 1) {
             printf("TPM_BN_mod_exp: Error performing BN_mod_exp()\n");
             TPM_OpenSSL_PrintError();
@@ -1632,6 +2916,71 @@ TPM_RESULT TPM_BN_mod_mul(TPM_BIGNUM rBignum_in,
     return rc;
 }
      
+/* Montgomery context cache
+
+   BN_mod_exp() sets up a Montgomery context for the modulus on every call.  The DAA join and sign
+   stages exponentiate modulo the same issuer modulus, one exponentiation per stage, so the
+   context for the most recent odd modulus is kept.  The modulus is public.
+*/
+
+static BIGNUM *tpm_bn_mont_modulus = NULL;
+static BN_MONT_CTX *tpm_bn_mont_ctx = NULL;
+
+/* TPM_BN_MONT_CTX_Get() returns the Montgomery context for 'modulus', which must be odd.
+
+   The context is owned by the cache.  The caller must not free it.
+*/
+
+static TPM_RESULT TPM_BN_MONT_CTX_Get(BN_MONT_CTX **mont,
+				      const BIGNUM *modulus,
+				      BN_CTX *ctx)
+{
+    TPM_RESULT  rc = 0;
+    int         irc;
+
+    *mont = NULL;
+    if ((tpm_bn_mont_modulus == NULL) || (BN_cmp(tpm_bn_mont_modulus, modulus) != 0)) {
+	printf("  TPM_BN_MONT_CTX_Get: New modulus\n");
+	TPM_BN_MONT_CTX_Delete();
+	if (rc == 0) {
+	    tpm_bn_mont_modulus = BN_dup(modulus);
+	    tpm_bn_mont_ctx = BN_MONT_CTX_new();
+	    if ((tpm_bn_mont_modulus == NULL) || (tpm_bn_mont_ctx == NULL)) {
+		printf("TPM_BN_MONT_CTX_Get: Error allocating the Montgomery context\n");
+		TPM_OpenSSL_PrintError();
+		rc = TPM_SIZE;
+	    }
+	}
+	if (rc == 0) {
+	    irc = BN_MONT_CTX_set(tpm_bn_mont_ctx, tpm_bn_mont_modulus, ctx);
+	    if (irc != 1) {
+		printf("TPM_BN_MONT_CTX_Get: Error performing BN_MONT_CTX_set()\n");
+		TPM_OpenSSL_PrintError();
+		rc = TPM_DAA_WRONG_W;
+	    }
+	}
+	if (rc != 0) {
+	    TPM_BN_MONT_CTX_Delete();
+	}
+    }
+    if (rc == 0) {
+	*mont = tpm_bn_mont_ctx;
+    }
+    return rc;
+}
+
+/* TPM_BN_MONT_CTX_Delete() frees the cached Montgomery context
+ */
+
+static void TPM_BN_MONT_CTX_Delete()
+{
+    BN_MONT_CTX_free(tpm_bn_mont_ctx);
+    BN_free(tpm_bn_mont_modulus);
+    tpm_bn_mont_ctx = NULL;
+    tpm_bn_mont_modulus = NULL;
+    return;
+}
+
 /* TPM_BN_CTX_new() wraps the openSSL function in a TPM error handler */
 
 static TPM_RESULT TPM_BN_CTX_new(BN_CTX **ctx)
@@ -1689,6 +3038,19 @@ void TPM_BN_free(TPM_BIGNUM bn_in)
     return;
 }
 
+/* TPM_BN_clear_free() wraps the openSSL function
+
+   Zeros and frees a bignum holding a secret
+*/
+
+void TPM_BN_clear_free(TPM_BIGNUM bn_in)
+{
+    BIGNUM	*bn = (BIGNUM *)bn_in;
+
+    BN_clear_free(bn);
+    return;
+}
+
 /* TPM_bn2bin wraps the openSSL function in a TPM error handler.
 
    Converts a bignum to char array
@@ -1742,78 +3104,10 @@ TPM_RESULT TPM_bin2bn(TPM_BIGNUM *bn_in, const unsigned char *bin, unsigned int
   Hash Functions
 */
 
-/* for the openSSL version, TPM_SHA1Context is a SHA_CTX structure */
-
-/* TPM_SHA1InitCmd() initializes a platform dependent TPM_SHA1Context structure.
-
-   The structure must be freed using TPM_SHA1Delete()
-*/
-
-TPM_RESULT TPM_SHA1InitCmd(void **context)
-{
-    TPM_RESULT  rc = 0;
-
-    printf(" TPM_SHA1InitCmd:\n");
-    if (rc== 0) {
-        rc = TPM_Malloc((unsigned char **)context, sizeof(SHA_CTX));
-    }
-    if (rc== 0) {
-        SHA1_Init(*context);
-    }
-    return rc;
-}
-
-/* TPM_SHA1UpdateCmd() adds 'data' of 'length' to the SHA-1 context
- */
-
-TPM_RESULT TPM_SHA1UpdateCmd(void *context, const unsigned char *data, uint32_t length)
-{
-    TPM_RESULT  rc = 0;
-    
-    printf(" TPM_SHA1Update: length %u\n", length);
-    if (context != NULL) {
-        SHA1_Update(context, data, length);
-    }
-    else {
-        printf("TPM_SHA1Update: Error, no existing SHA1 thread\n");
-        rc = TPM_SHA_THREAD;
-    }
-    return rc;
-}
-
-/* TPM_SHA1FinalCmd() extracts the SHA-1 digest 'md' from the context
- */
-
-TPM_RESULT TPM_SHA1FinalCmd(unsigned char *md, void *context)
-{
-    TPM_RESULT  rc = 0;
-    
-    printf(" TPM_SHA1FinalCmd:\n");
-    if (context != NULL) {
-        SHA1_Final(md, context);
-    }
-    else {
-        printf("TPM_SHA1FinalCmd: Error, no existing SHA1 thread\n");
-        rc = TPM_SHA_THREAD;
-    }
-    return rc;
-}
-
-/* TPM_SHA1Delete() zeros and frees the SHA1 context */
+/* the SHA-1 functions are implemented by the built-in engine in tpm_sha1.c */
 
-void TPM_SHA1Delete(void **context)
-{
-    if (*context != NULL) {
-        printf(" TPM_SHA1Delete:\n");
-	/* zero because the SHA1 context might have data left from an HMAC */
-        memset(*context, 0, sizeof(SHA_CTX));
-        free(*context);
-        *context = NULL;
-    }
-    return;
-}
-
-/* TPM_Sha1Context_Load() is non-portable code to deserialize the OpenSSL SHA1 context.
+/* TPM_Sha1Context_Load() deserializes a SHA-1 context in the OpenSSL SHA_CTX format, which the
+   TPM_SHA1_CONTEXT fields follow.
 
    If the contextPresent prepended by TPM_Sha1Context_Store() is FALSE, context remains NULL.  If
    TRUE, context is allocated and loaded.
@@ -1825,7 +3119,7 @@ TPM_RESULT TPM_Sha1Context_Load(void **context,
 {
     TPM_RESULT 	rc = 0;
     size_t 	i;
-    SHA_CTX 	*sha_ctx = NULL;	/* initialize to silence hopefully bogus gcc 4.4.4
+    TPM_SHA1_CONTEXT *sha_ctx = NULL;	/* initialize to silence hopefully bogus gcc 4.4.4
 					   warning */
     TPM_BOOL	contextPresent;		/* is there a context to be loaded */
 
@@ -1842,28 +3136,28 @@ TPM_RESULT TPM_Sha1Context_Load(void **context,
 	rc = TPM_CheckTag(TPM_TAG_SHA1CONTEXT_OSSL_V1, stream, stream_size);
     }
     if ((rc== 0) && contextPresent) {
-        rc = TPM_Malloc((unsigned char **)context, sizeof(SHA_CTX));
-	sha_ctx = (SHA_CTX *)*context;
+        rc = TPM_Malloc((unsigned char **)context, sizeof(TPM_SHA1_CONTEXT));
+	sha_ctx = (TPM_SHA1_CONTEXT *)*context;
     }
      /* load h0 */
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Load32(&(sha_ctx->h0), stream, stream_size);
+	rc = TPM_Load32(&(sha_ctx->h[0]), stream, stream_size);
     }
     /* load h1 */
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Load32(&(sha_ctx->h1), stream, stream_size);
+	rc = TPM_Load32(&(sha_ctx->h[1]), stream, stream_size);
     }
     /* load h2 */
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Load32(&(sha_ctx->h2), stream, stream_size);
+	rc = TPM_Load32(&(sha_ctx->h[2]), stream, stream_size);
     }
     /* load h3 */
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Load32(&(sha_ctx->h3), stream, stream_size);
+	rc = TPM_Load32(&(sha_ctx->h[3]), stream, stream_size);
     }
     /* load h4 */
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Load32(&(sha_ctx->h4), stream, stream_size);
+	rc = TPM_Load32(&(sha_ctx->h[4]), stream, stream_size);
     }
     /* load Nl */
     if ((rc== 0) && contextPresent) {
@@ -1874,7 +3168,7 @@ TPM_RESULT TPM_Sha1Context_Load(void **context,
 	rc = TPM_Load32(&(sha_ctx->Nh), stream, stream_size);
     }
     /* load data */
-    for (i = 0 ; (rc == 0) && contextPresent && (i < SHA_LBLOCK) ; i++) {
+    for (i = 0 ; (rc == 0) && contextPresent && (i < TPM_SHA1_LBLOCK) ; i++) {
 	rc = TPM_Load32(&(sha_ctx->data[i]), stream, stream_size);
     }
     /* load num */
@@ -1884,7 +3178,7 @@ TPM_RESULT TPM_Sha1Context_Load(void **context,
     return rc;
 }
 
-/* TPM_Sha1Context_Store() is non-portable code to serialize the OpenSSL SHA1 context.  context is
+/* TPM_Sha1Context_Store() serializes the SHA-1 context in the OpenSSL SHA_CTX format.  context is
    not altered.
 
    It prepends a contextPresent flag to the stream, FALSE if context is NULL, TRUE if not.
@@ -1895,7 +3189,7 @@ TPM_RESULT TPM_Sha1Context_Store(TPM_STORE_BUFFER *sbuffer,
 {
     TPM_RESULT 	rc = 0;
     size_t 	i;
-    SHA_CTX 	*sha_ctx = (SHA_CTX *)context;
+    TPM_SHA1_CONTEXT *sha_ctx = (TPM_SHA1_CONTEXT *)context;
     TPM_BOOL	contextPresent;		/* is there a context to be stored */
 
     printf(" TPM_Sha1Context_Store: OpenSSL\n");
@@ -1916,19 +3210,19 @@ TPM_RESULT TPM_Sha1Context_Store(TPM_STORE_BUFFER *sbuffer,
 	rc = TPM_Sbuffer_Append16(sbuffer, TPM_TAG_SHA1CONTEXT_OSSL_V1);
     }
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->h0);
+	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->h[0]);
     }
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->h1);
+	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->h[1]);
     }
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->h2);
+	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->h[2]);
     }
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->h3);
+	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->h[3]);
     }
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->h4);
+	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->h[4]);
     }
     if ((rc== 0) && contextPresent) {
 	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->Nl);
@@ -1936,7 +3230,7 @@ TPM_RESULT TPM_Sha1Context_Store(TPM_STORE_BUFFER *sbuffer,
     if ((rc== 0) && contextPresent) {
 	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->Nh);
     }
-    for (i = 0 ; (rc == 0) && contextPresent && (i < SHA_LBLOCK) ; i++) {
+    for (i = 0 ; (rc == 0) && contextPresent && (i < TPM_SHA1_LBLOCK) ; i++) {
 	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->data[i]);
     }
     if ((rc== 0) && contextPresent) {
@@ -1961,6 +3255,8 @@ TPM_RESULT TPM_SymmetricKeyData_New(TPM_SYMMETRIC_KEY_TOKEN *tpm_symmetric_key_d
 	rc = TPM_Malloc(tpm_symmetric_key_data, sizeof(TPM_SYMMETRIC_KEY_DATA));
     }
     if (rc == 0) {
+	/* zero first, since Init releases any cipher contexts */
+	memset(*tpm_symmetric_key_data, 0, sizeof(TPM_SYMMETRIC_KEY_DATA));
 	TPM_SymmetricKeyData_Init(*tpm_symmetric_key_data);
     }
     return rc;
@@ -2126,95 +3422,104 @@ TPM_RESULT TPM_SymmetricKeyData_GenerateKey(TPM_SYMMETRIC_KEY_TOKEN tpm_symmetri
     return rc;
 }
 
-/* TPM_SymmetricKeyData_Encrypt() is DES non-portable code to encrypt 'decrypt_data' to
+/* TPM_SymmetricKeyData_EncryptLength() is DES non-portable code to return the length of the
+   encryption of 'decrypt_length' bytes
+
+   The stream is padded as per PKCS#7 / RFC2630, so this is always larger than the input.
+*/
+
+void TPM_SymmetricKeyData_EncryptLength(uint32_t *encrypt_length,
+					uint32_t decrypt_length)
+{
+    *encrypt_length = decrypt_length + TPM_DES_BLOCK_SIZE - (decrypt_length % TPM_DES_BLOCK_SIZE);
+    return;
+}
+
+/* TPM_SymmetricKeyData_EncryptBuffer() is DES non-portable code to encrypt 'decrypt_data' to
    'encrypt_data'
 
    The stream is padded as per PKCS#7 / RFC2630
 
-   'encrypt_data' must be free by the caller
+   'encrypt_data' is preallocated with 'encrypt_size' bytes, at least the
+   TPM_SymmetricKeyData_EncryptLength() of 'decrypt_length'.  It can be the same buffer as
+   'decrypt_data', encrypting in place.
 */
 
-TPM_RESULT TPM_SymmetricKeyData_Encrypt(unsigned char **encrypt_data,   /* output, caller frees */
-                                        uint32_t *encrypt_length,		/* output */
-                                        const unsigned char *decrypt_data,      /* input */
-                                        uint32_t decrypt_length,		/* input */
-                                        const TPM_SYMMETRIC_KEY_TOKEN
-					tpm_symmetric_key_token) 		/* input */
+TPM_RESULT TPM_SymmetricKeyData_EncryptBuffer(unsigned char *encrypt_data,	/* output */
+					      uint32_t *encrypt_length,		/* output */
+					      uint32_t encrypt_size,		/* input */
+					      const unsigned char *decrypt_data,	/* input */
+					      uint32_t decrypt_length,		/* input */
+					      const TPM_SYMMETRIC_KEY_TOKEN
+					      tpm_symmetric_key_token)		/* input */
 {
     TPM_RESULT          rc = 0;
     uint32_t		pad_length;
-    unsigned char       *decrypt_data_pad;
     TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data =
 	(TPM_SYMMETRIC_KEY_DATA *)tpm_symmetric_key_token;
 
-    printf(" TPM_SymmetricKeyData_Encrypt: Length %u\n", decrypt_length);
-    decrypt_data_pad = NULL;    /* freed @1 */
+    printf(" TPM_SymmetricKeyData_EncryptBuffer: Length %u\n", decrypt_length);
     if (rc == 0) {
         /* calculate the pad length and padded data length */
-        pad_length = TPM_DES_BLOCK_SIZE - (decrypt_length % TPM_DES_BLOCK_SIZE);
-        *encrypt_length = decrypt_length + pad_length;
-        printf("  TPM_SymmetricKeyData_Encrypt: Padded length %u pad length %u\n",
+	TPM_SymmetricKeyData_EncryptLength(encrypt_length, decrypt_length);
+        pad_length = *encrypt_length - decrypt_length;
+        printf("  TPM_SymmetricKeyData_EncryptBuffer: Padded length %u pad length %u\n",
                *encrypt_length, pad_length);
-        /* allocate memory for the encrypted response */
-        rc = TPM_Malloc(encrypt_data, *encrypt_length);
-    }
-    /* allocate memory for the padded decrypted data */
-    if (rc == 0) {
-        rc = TPM_Malloc(&decrypt_data_pad, *encrypt_length);
+	if (*encrypt_length > encrypt_size) {
+	    printf("TPM_SymmetricKeyData_EncryptBuffer: Error (fatal), buffer size %u too small\n",
+		   encrypt_size);
+	    rc = TPM_FAIL;	/* should never occur */
+	}
     }
-    /* pad the decrypted clear text data */
+    /* pad the decrypted clear text data in the output */
     if (rc == 0) {
-        /* unpadded original data */
-        memcpy(decrypt_data_pad, decrypt_data, decrypt_length);
+        /* unpadded original data, a no-op in place */
+        memmove(encrypt_data, decrypt_data, decrypt_length);
         /* last gets pad = pad length */
-        memset(decrypt_data_pad + decrypt_length, pad_length, pad_length);
-	/* encrypt the padded input to the output */
-        rc = TPM_SymmetricKeyData_Crypt(*encrypt_data,
-                                        decrypt_data_pad,
+        memset(encrypt_data + decrypt_length, pad_length, pad_length);
+	/* encrypt the padded data in place */
+        rc = TPM_SymmetricKeyData_Crypt(encrypt_data,
+                                        encrypt_data,
                                         *encrypt_length,
                                         tpm_symmetric_key_data,
                                         DES_ENCRYPT,
                                         TPM_ENCRYPT_ERROR);
     }
-    free(decrypt_data_pad);     /* @1 */
     return rc;
 }
 
-/* TPM_SymmetricKeyData_Decrypt() is DES non-portable code to decrypt 'encrypt_data' to
+/* TPM_SymmetricKeyData_DecryptBuffer() is DES non-portable code to decrypt 'encrypt_data' to
    'decrypt_data'
 
    The stream must be padded as per PKCS#7 / RFC2630
 
-   decrypt_data must be free by the caller
+   'decrypt_data' is preallocated with at least 'encrypt_length' bytes.  It can be the same buffer
+   as 'encrypt_data', decrypting in place.
 */
 
-TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,   /* output, caller frees */
-                                        uint32_t *decrypt_length,	/* output */
-                                        const unsigned char *encrypt_data,      /* input */
-                                        uint32_t encrypt_length,		/* input */
-                                        const TPM_SYMMETRIC_KEY_TOKEN
-					tpm_symmetric_key_data) 		/* input */
+TPM_RESULT TPM_SymmetricKeyData_DecryptBuffer(unsigned char *decrypt_data,	/* output */
+					      uint32_t *decrypt_length,		/* output */
+					      const unsigned char *encrypt_data,	/* input */
+					      uint32_t encrypt_length,		/* input */
+					      const TPM_SYMMETRIC_KEY_TOKEN
+					      tpm_symmetric_key_data)		/* input */
 {
     TPM_RESULT  rc = 0;
     uint32_t      pad_length;
     uint32_t      i;
     unsigned char *pad_data;
     
-    printf(" TPM_SymmetricKeyData_Decrypt: Length %u\n", encrypt_length);
+    printf(" TPM_SymmetricKeyData_DecryptBuffer: Length %u\n", encrypt_length);
     /* sanity check encrypted length */
     if (rc == 0) {
         if (encrypt_length < TPM_DES_BLOCK_SIZE) {
-            printf("TPM_SymmetricKeyData_Decrypt: Error, bad length\n");
+            printf("TPM_SymmetricKeyData_DecryptBuffer: Error, bad length\n");
             rc = TPM_DECRYPT_ERROR;
         }
     }
-    /* allocate memory for the padded decrypted data */
-    if (rc == 0) {
-        rc = TPM_Malloc(decrypt_data, encrypt_length);
-    }
     /* decrypt the input to the padded output */
     if (rc == 0) {
-        rc = TPM_SymmetricKeyData_Crypt(*decrypt_data,
+        rc = TPM_SymmetricKeyData_Crypt(decrypt_data,
                                         encrypt_data,
                                         encrypt_length,
                                         tpm_symmetric_key_data,
@@ -2224,12 +3529,12 @@ TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,   /* outpu
     /* get the pad length */
     if (rc == 0) {
         /* get the pad length from the last byte */
-        pad_length = (uint32_t)*(*decrypt_data + encrypt_length - 1);
+        pad_length = (uint32_t)*(decrypt_data + encrypt_length - 1);
         /* sanity check the pad length */
-        printf(" TPM_SymmetricKeyData_Decrypt: Pad length %u\n", pad_length);
+        printf(" TPM_SymmetricKeyData_DecryptBuffer: Pad length %u\n", pad_length);
         if ((pad_length == 0) ||
             (pad_length > TPM_DES_BLOCK_SIZE)) {
-            printf("TPM_SymmetricKeyData_Decrypt: Error, illegal pad length\n");
+            printf("TPM_SymmetricKeyData_DecryptBuffer: Error, illegal pad length\n");
             rc = TPM_DECRYPT_ERROR;
         }
     }
@@ -2237,11 +3542,11 @@ TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,   /* outpu
         /* get the unpadded length */
         *decrypt_length = encrypt_length - pad_length;
         /* pad starting point */
-        pad_data = *decrypt_data + *decrypt_length;
+        pad_data = decrypt_data + *decrypt_length;
         /* sanity check the pad */
         for (i = 0 ; i < pad_length ; i++, pad_data++) {
             if (*pad_data != pad_length) {
-                printf("TPM_SymmetricKeyData_Decrypt: Error, bad pad %02x at index %u\n",
+                printf("TPM_SymmetricKeyData_DecryptBuffer: Error, bad pad %02x at index %u\n",
                        *pad_data, i);
                 rc = TPM_DECRYPT_ERROR;
             }
@@ -2340,6 +3645,9 @@ static TPM_RESULT TPM_SymmetricKeyData_Crypt(unsigned char *data_out,
 /* TPM_SymmetricKeyData_Init() is AES non-portable code to initialize the TPM_SYMMETRIC_KEY_DATA
 
    It depends on the TPM_SYMMETRIC_KEY_DATA declaration.
+
+   It frees the cipher contexts, which wipes the key schedules.  They are recreated when the key is
+   set.
 */
 
 void TPM_SymmetricKeyData_Init(TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token)
@@ -2352,8 +3660,10 @@ void TPM_SymmetricKeyData_Init(TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token)
     tpm_symmetric_key_data->valid = FALSE;
     tpm_symmetric_key_data->fill = 0;
     memset(tpm_symmetric_key_data->userKey, 0, sizeof(tpm_symmetric_key_data->userKey));
-    memset(&(tpm_symmetric_key_data->aes_enc_key), 0, sizeof(tpm_symmetric_key_data->aes_enc_key));
-    memset(&(tpm_symmetric_key_data->aes_dec_key), 0, sizeof(tpm_symmetric_key_data->aes_dec_key));
+    EVP_CIPHER_CTX_free(tpm_symmetric_key_data->aes_enc_ctx);
+    EVP_CIPHER_CTX_free(tpm_symmetric_key_data->aes_dec_ctx);
+    tpm_symmetric_key_data->aes_enc_ctx = NULL;
+    tpm_symmetric_key_data->aes_dec_ctx = NULL;
     return;
 }
 
@@ -2456,207 +3766,235 @@ TPM_RESULT TPM_SymmetricKeyData_GenerateKey(TPM_SYMMETRIC_KEY_TOKEN tpm_symmetri
     return rc;
 }
 
-/* TPM_SymmetricKeyData_SetKey() is AES non-portable code to set a symmetric key from input data
+/* The AES ciphers are looked up once and kept until TPM_Crypto_Terminate().  For EVP, they are
+   fetched from the provider. */
 
-   tpm_symmetric_key_data should be initialized before and after use
+static EVP_CIPHER *tpm_aes_cbc_cipher = NULL;
+static EVP_CIPHER *tpm_aes_ctr_cipher = NULL;
+static EVP_CIPHER *tpm_aes_ofb_cipher = NULL;
+
+/* TPM_AES_CipherFetch() fetches the cipher 'name' into '*cipher' if it is not already present.
+
+   '*cipher' is one of the above static ciphers and must not be freed by the caller.
 */
 
-TPM_RESULT TPM_SymmetricKeyData_SetKey(TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data,
-                                       const unsigned char *key_data,
-                                       uint32_t key_data_size)
+static TPM_RESULT TPM_AES_CipherFetch(EVP_CIPHER **cipher,
+				      const char *name)
 {
     TPM_RESULT rc = 0;
-    
-    printf(" TPM_SymmetricKeyData_SetKey:\n");
-    /* check the input data size, it can be truncated, but cannot be smaller than the AES key */
-    if (rc == 0) {
-        if (sizeof(tpm_symmetric_key_data->userKey) > key_data_size) {
-            printf("TPM_SymmetricKeyData_SetKey: Error (fatal), need %lu bytes, received %u\n",
-                   (unsigned long)sizeof(tpm_symmetric_key_data->userKey), key_data_size);
-            rc = TPM_FAIL;              /* should never occur */
-        }
-    }
-    if (rc == 0) {
-        /* copy the input data into the AES key structure */
-        memcpy(tpm_symmetric_key_data->userKey, key_data, sizeof(tpm_symmetric_key_data->userKey));
-        /* construct the internal AES keys */
-        rc = TPM_SymmetricKeyData_SetKeys(tpm_symmetric_key_data);
-    }
-    if (rc == 0) {
-        tpm_symmetric_key_data->valid = TRUE;
+
+    if (*cipher == NULL) {
+	printf("  TPM_AES_CipherFetch: Fetching %s\n", name);
+#ifdef TPM_OPENSSL_EVP
+	*cipher = EVP_CIPHER_fetch(NULL, name, NULL);
+#else
+	/* a built-in cipher, never freed */
+	*cipher = (EVP_CIPHER *)EVP_get_cipherbyname(name);
+#endif
+	if (*cipher == NULL) {
+	    printf("TPM_AES_CipherFetch: Error (fatal) fetching %s\n", name);
+	    TPM_OpenSSL_PrintError();
+	    rc = TPM_FAIL;
+	}
     }
     return rc;
 }
 
+/* TPM_AES_CipherDelete() frees the fetched AES ciphers
+ */
+
+static void TPM_AES_CipherDelete()
+{
+#ifdef TPM_OPENSSL_EVP
+    EVP_CIPHER_free(tpm_aes_cbc_cipher);
+    EVP_CIPHER_free(tpm_aes_ctr_cipher);
+    EVP_CIPHER_free(tpm_aes_ofb_cipher);
+#endif
+    tpm_aes_cbc_cipher = NULL;
+    tpm_aes_ctr_cipher = NULL;
+    tpm_aes_ofb_cipher = NULL;
+    return;
+}
+
 /* TPM_SymmetricKeyData_SetKeys() is AES non-portable code to construct the internal AES keys from
    the userKey
 
+   These are the CBC encrypt and decrypt contexts.  They are allocated on first use and rekeyed in
+   place afterwards.  Encrypt and decrypt then only reset the IV, so the key schedule is expanded
+   once per key.
+
    tpm_symmetric_key_data should be initialized before and after use
 */
 
 static TPM_RESULT TPM_SymmetricKeyData_SetKeys(TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data)
 {
     TPM_RESULT rc = 0;
-    int irc;
 
     printf(" TPM_SymmetricKeyData_SetKeys:\n");
     if (rc == 0) {
         TPM_PrintFour("  TPM_SymmetricKeyData_SetKeys: userKey", tpm_symmetric_key_data->userKey);
-        irc = AES_set_encrypt_key(tpm_symmetric_key_data->userKey,
-                                  TPM_AES_BITS,
-                                  &(tpm_symmetric_key_data->aes_enc_key));
-        if (irc != 0) {
-            printf("TPM_SymmetricKeyData_SetKeys: Error (fatal) generating enc key\n");
-            TPM_OpenSSL_PrintError();
-            rc = TPM_FAIL;      /* should never occur, null pointers or bad bit size */
-        }
+	rc = TPM_AES_CipherFetch(&tpm_aes_cbc_cipher, "AES-128-CBC");
+    }
+    if ((rc == 0) && (tpm_symmetric_key_data->aes_enc_ctx == NULL)) {
+	tpm_symmetric_key_data->aes_enc_ctx = EVP_CIPHER_CTX_new();
+	if (tpm_symmetric_key_data->aes_enc_ctx == NULL) {
+            printf("TPM_SymmetricKeyData_SetKeys: Error in EVP_CIPHER_CTX_new()\n");
+            rc = TPM_SIZE;
+	}
     }
+    if ((rc == 0) && (tpm_symmetric_key_data->aes_dec_ctx == NULL)) {
+	tpm_symmetric_key_data->aes_dec_ctx = EVP_CIPHER_CTX_new();
+	if (tpm_symmetric_key_data->aes_dec_ctx == NULL) {
+            printf("TPM_SymmetricKeyData_SetKeys: Error in EVP_CIPHER_CTX_new()\n");
+            rc = TPM_SIZE;
+	}
+    }
+    /* the contexts keep the default PKCS#7 padding */
     if (rc == 0) {
-        irc = AES_set_decrypt_key(tpm_symmetric_key_data->userKey,
-                                  TPM_AES_BITS,
-                                  &(tpm_symmetric_key_data->aes_dec_key));
-        if (irc != 0) {
-            printf("TPM_SymmetricKeyData_SetKeys: Error (fatal) generating dec key\n");
+	if ((EVP_EncryptInit_ex(tpm_symmetric_key_data->aes_enc_ctx, tpm_aes_cbc_cipher, NULL,
+				tpm_symmetric_key_data->userKey, NULL) != 1) ||
+	    (EVP_DecryptInit_ex(tpm_symmetric_key_data->aes_dec_ctx, tpm_aes_cbc_cipher, NULL,
+				tpm_symmetric_key_data->userKey, NULL) != 1)) {
+            printf("TPM_SymmetricKeyData_SetKeys: Error (fatal) setting the AES key\n");
             TPM_OpenSSL_PrintError();
-            rc = TPM_FAIL;      /* should never occur, null pointers or bad bit size */
-        }
+            rc = TPM_FAIL;      /* should never occur */
+	}
     }
     return rc;
 }
 
-/* TPM_SymmetricKeyData_Encrypt() is AES non-portable code to encrypt 'decrypt_data' to
+/* TPM_SymmetricKeyData_EncryptLength() is AES non-portable code to return the length of the
+   encryption of 'decrypt_length' bytes
+
+   The stream is padded as per PKCS#7 / RFC2630, so this is always larger than the input.
+*/
+
+void TPM_SymmetricKeyData_EncryptLength(uint32_t *encrypt_length,
+					uint32_t decrypt_length)
+{
+    *encrypt_length = decrypt_length + TPM_AES_BLOCK_SIZE - (decrypt_length % TPM_AES_BLOCK_SIZE);
+    return;
+}
+
+/* TPM_SymmetricKeyData_EncryptBuffer() is AES non-portable code to encrypt 'decrypt_data' to
    'encrypt_data'
 
-   The stream is padded as per PKCS#7 / RFC2630
+   The stream is padded as per PKCS#7 / RFC2630.  Only the last block is padded, the input is not
+   copied.
 
-   'encrypt_data' must be free by the caller
+   'encrypt_data' is preallocated with 'encrypt_size' bytes, at least the
+   TPM_SymmetricKeyData_EncryptLength() of 'decrypt_length'.  It can be the same buffer as
+   'decrypt_data', encrypting in place.
 */
 
-TPM_RESULT TPM_SymmetricKeyData_Encrypt(unsigned char **encrypt_data,   /* output, caller frees */
-                                        uint32_t *encrypt_length,		/* output */
-                                        const unsigned char *decrypt_data,	/* input */
-                                        uint32_t decrypt_length,		/* input */
-                                        const TPM_SYMMETRIC_KEY_TOKEN
-					tpm_symmetric_key_token) 		/* input */
+TPM_RESULT TPM_SymmetricKeyData_EncryptBuffer(unsigned char *encrypt_data,	/* output */
+					      uint32_t *encrypt_length,		/* output */
+					      uint32_t encrypt_size,		/* input */
+					      const unsigned char *decrypt_data,	/* input */
+					      uint32_t decrypt_length,		/* input */
+					      const TPM_SYMMETRIC_KEY_TOKEN
+					      tpm_symmetric_key_token)		/* input */
 {
     TPM_RESULT          rc = 0;
-    uint32_t              pad_length;
-    unsigned char       *decrypt_data_pad;
+    int			update_length;
+    int			final_length;
     unsigned char       ivec[TPM_AES_BLOCK_SIZE];       /* initial chaining vector */
     TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data =
 	(TPM_SYMMETRIC_KEY_DATA *)tpm_symmetric_key_token;
 
-    printf(" TPM_SymmetricKeyData_Encrypt: Length %u\n", decrypt_length);
-    decrypt_data_pad = NULL;    /* freed @1 */
-    if (rc == 0) {
-        /* calculate the pad length and padded data length */
-        pad_length = TPM_AES_BLOCK_SIZE - (decrypt_length % TPM_AES_BLOCK_SIZE);
-        *encrypt_length = decrypt_length + pad_length;
-        printf("  TPM_SymmetricKeyData_Encrypt: Padded length %u pad length %u\n",
-               *encrypt_length, pad_length);
-        /* allocate memory for the encrypted response */
-        rc = TPM_Malloc(encrypt_data, *encrypt_length);
+    printf(" TPM_SymmetricKeyData_EncryptBuffer: Length %u\n", decrypt_length);
+    /* a key that was never set encrypts with the zero userKey */
+    if ((rc == 0) && (tpm_symmetric_key_data->aes_enc_ctx == NULL)) {
+	rc = TPM_SymmetricKeyData_SetKeys(tpm_symmetric_key_data);
     }
-    /* allocate memory for the padded decrypted data */
     if (rc == 0) {
-        rc = TPM_Malloc(&decrypt_data_pad, *encrypt_length);
+        /* calculate the padded data length */
+	TPM_SymmetricKeyData_EncryptLength(encrypt_length, decrypt_length);
+        printf("  TPM_SymmetricKeyData_EncryptBuffer: Padded length %u\n", *encrypt_length);
+	if (*encrypt_length > encrypt_size) {
+	    printf("TPM_SymmetricKeyData_EncryptBuffer: Error (fatal), buffer size %u too small\n",
+		   encrypt_size);
+	    rc = TPM_FAIL;	/* should never occur */
+	}
     }
-    /* pad the decrypted clear text data */
+    /* encrypt and pad the clear text data */
     if (rc == 0) {
-        /* unpadded original data */
-        memcpy(decrypt_data_pad, decrypt_data, decrypt_length);
-        /* last gets pad = pad length */
-        memset(decrypt_data_pad + decrypt_length, pad_length, pad_length);
-        /* set the IV */
+        /* set the IV, the key schedule is kept */
         memset(ivec, 0, sizeof(ivec));
-        /* encrypt the padded input to the output */
-        TPM_PrintFour("  TPM_SymmetricKeyData_Encrypt: Input", decrypt_data_pad);
-        AES_cbc_encrypt(decrypt_data_pad,
-                        *encrypt_data,
-                        *encrypt_length,
-                        &(tpm_symmetric_key_data->aes_enc_key),
-                        ivec,
-                        AES_ENCRYPT);
-        TPM_PrintFour("  TPM_SymmetricKeyData_Encrypt: Output", *encrypt_data);
-    }
-    free(decrypt_data_pad);     /* @1 */
+	if ((EVP_EncryptInit_ex(tpm_symmetric_key_data->aes_enc_ctx, NULL, NULL, NULL,
+				ivec) != 1) ||
+	    (EVP_EncryptUpdate(tpm_symmetric_key_data->aes_enc_ctx,
+			       encrypt_data, &update_length,
+			       decrypt_data, decrypt_length) != 1) ||
+	    (EVP_EncryptFinal_ex(tpm_symmetric_key_data->aes_enc_ctx,
+				 encrypt_data + update_length, &final_length) != 1) ||
+	    ((uint32_t)(update_length + final_length) != *encrypt_length)) {
+            printf("TPM_SymmetricKeyData_EncryptBuffer: Error in AES CBC encrypt\n");
+            TPM_OpenSSL_PrintError();
+            rc = TPM_ENCRYPT_ERROR;
+	}
+    }
+    if (rc == 0) {
+        TPM_PrintFour("  TPM_SymmetricKeyData_EncryptBuffer: Output", encrypt_data);
+    }
     return rc;
 }
 
-/* TPM_SymmetricKeyData_Decrypt() is AES non-portable code to decrypt 'encrypt_data' to
+/* TPM_SymmetricKeyData_DecryptBuffer() is AES non-portable code to decrypt 'encrypt_data' to
    'decrypt_data'
 
    The stream must be padded as per PKCS#7 / RFC2630
 
-   decrypt_data must be free by the caller
+   'decrypt_data' is preallocated with at least 'encrypt_length' bytes.  It can be the same buffer
+   as 'encrypt_data', decrypting in place.
 */
 
-TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,   /* output, caller frees */
-                                        uint32_t *decrypt_length,		/* output */
-                                        const unsigned char *encrypt_data,	/* input */
-                                        uint32_t encrypt_length,		/* input */
-                                        const TPM_SYMMETRIC_KEY_TOKEN
-					tpm_symmetric_key_token) 		/* input */
+TPM_RESULT TPM_SymmetricKeyData_DecryptBuffer(unsigned char *decrypt_data,	/* output */
+					      uint32_t *decrypt_length,		/* output */
+					      const unsigned char *encrypt_data,	/* input */
+					      uint32_t encrypt_length,		/* input */
+					      const TPM_SYMMETRIC_KEY_TOKEN
+					      tpm_symmetric_key_token)		/* input */
 {
     TPM_RESULT          rc = 0;
-    uint32_t		pad_length;
-    uint32_t		i;
-    unsigned char       *pad_data;
+    int			update_length;
+    int			final_length;
     unsigned char       ivec[TPM_AES_BLOCK_SIZE];       /* initial chaining vector */
     TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data =
 	(TPM_SYMMETRIC_KEY_DATA *)tpm_symmetric_key_token;
-    
-    printf(" TPM_SymmetricKeyData_Decrypt: Length %u\n", encrypt_length);
+
+    printf(" TPM_SymmetricKeyData_DecryptBuffer: Length %u\n", encrypt_length);
     /* sanity check encrypted length */
     if (rc == 0) {
         if (encrypt_length < TPM_AES_BLOCK_SIZE) {
-            printf("TPM_SymmetricKeyData_Decrypt: Error, bad length\n");
+            printf("TPM_SymmetricKeyData_DecryptBuffer: Error, bad length\n");
             rc = TPM_DECRYPT_ERROR;
         }
     }
-    /* allocate memory for the padded decrypted data */
-    if (rc == 0) {
-        rc = TPM_Malloc(decrypt_data, encrypt_length);
+    /* a key that was never set decrypts with the zero userKey */
+    if ((rc == 0) && (tpm_symmetric_key_data->aes_dec_ctx == NULL)) {
+	rc = TPM_SymmetricKeyData_SetKeys(tpm_symmetric_key_data);
     }
-    /* decrypt the input to the padded output */
+    /* decrypt the input to the output and check and remove the pad */
     if (rc == 0) {
-        /* set the IV */
+        /* set the IV, the key schedule is kept */
         memset(ivec, 0, sizeof(ivec));
-        /* decrypt the padded input to the output */
-        TPM_PrintFour("  TPM_SymmetricKeyData_Decrypt: Input", encrypt_data);
-        AES_cbc_encrypt(encrypt_data,
-                        *decrypt_data,
-                        encrypt_length,
-                        &(tpm_symmetric_key_data->aes_dec_key),
-                        ivec,
-                        AES_DECRYPT);
-        TPM_PrintFour("  TPM_SymmetricKeyData_Decrypt: Output", *decrypt_data);
-    }
-    /* get the pad length */
-    if (rc == 0) {
-        /* get the pad length from the last byte */
-        pad_length = (uint32_t)*(*decrypt_data + encrypt_length - 1);
-        /* sanity check the pad length */
-        printf(" TPM_SymmetricKeyData_Decrypt: Pad length %u\n", pad_length);
-        if ((pad_length == 0) ||
-            (pad_length > TPM_AES_BLOCK_SIZE)) {
-            printf("TPM_SymmetricKeyData_Decrypt: Error, illegal pad length\n");
+        TPM_PrintFour("  TPM_SymmetricKeyData_DecryptBuffer: Input", encrypt_data);
+	if ((EVP_DecryptInit_ex(tpm_symmetric_key_data->aes_dec_ctx, NULL, NULL, NULL,
+				ivec) != 1) ||
+	    (EVP_DecryptUpdate(tpm_symmetric_key_data->aes_dec_ctx,
+			       decrypt_data, &update_length,
+			       encrypt_data, encrypt_length) != 1) ||
+	    (EVP_DecryptFinal_ex(tpm_symmetric_key_data->aes_dec_ctx,
+				 decrypt_data + update_length, &final_length) != 1)) {
+            printf("TPM_SymmetricKeyData_DecryptBuffer: Error, bad length or pad\n");
             rc = TPM_DECRYPT_ERROR;
-        }
+	}
     }
     if (rc == 0) {
-        /* get the unpadded length */
-        *decrypt_length = encrypt_length - pad_length;
-        /* pad starting point */
-        pad_data = *decrypt_data + *decrypt_length;
-        /* sanity check the pad */
-        for (i = 0 ; i < pad_length ; i++, pad_data++) {
-            if (*pad_data != pad_length) {
-                printf("TPM_SymmetricKeyData_Decrypt: Error, bad pad %02x at index %u\n",
-                       *pad_data, i);
-                rc = TPM_DECRYPT_ERROR;
-            }
-        }
+        *decrypt_length = update_length + final_length;
+        printf(" TPM_SymmetricKeyData_DecryptBuffer: Pad length %u\n",
+	       encrypt_length - *decrypt_length);
     }
     return rc;
 }
@@ -2668,6 +4006,9 @@ TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,   /* outpu
 
    'symmetric key' is the raw key, not converted to a non-portable form
    'ctr_in' is the initial CTR value before possible truncation
+
+   The TPM increments only the low 4 bytes of the counter, while the EVP CTR mode increments the
+   entire counter.  The data is therefore processed in runs that end where the low 4 bytes wrap.
 */
 
 TPM_RESULT TPM_SymmetricKeyData_CtrCrypt(unsigned char *data_out,               /* output */
@@ -2679,20 +4020,18 @@ TPM_RESULT TPM_SymmetricKeyData_CtrCrypt(unsigned char *data_out,
                                          uint32_t ctr_in_size)			/* input */
 {
     TPM_RESULT  rc = 0;
-    TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data = NULL;	/* freed @1 */
     unsigned char ctr[TPM_AES_BLOCK_SIZE];
+    uint64_t	run_size;		/* bytes before the low 4 bytes of the counter wrap */
+    uint32_t	length;
 
     printf(" TPM_SymmetricKeyData_CtrCrypt: data_size %u\n", data_size);
-    /* allocate memory for the key token.  The token is opaque in the API, but at this low level,
-       the code understands the TPM_SYMMETRIC_KEY_DATA structure */
-    if (rc == 0) {
-	rc = TPM_SymmetricKeyData_New((TPM_SYMMETRIC_KEY_TOKEN *)&tpm_symmetric_key_data);
-    }
-    /* convert the raw key to the AES key, truncating as required */
+    /* check the input key size, it can be truncated, but cannot be smaller than the AES key */
     if (rc == 0) {
-        rc = TPM_SymmetricKeyData_SetKey(tpm_symmetric_key_data,
-                                         symmetric_key,
-                                         symmetric_key_size);
+        if (symmetric_key_size < TPM_AES_BLOCK_SIZE) {
+            printf("TPM_SymmetricKeyData_CtrCrypt: Error (fatal), need %u bytes, received %u\n",
+                   TPM_AES_BLOCK_SIZE, symmetric_key_size);
+            rc = TPM_FAIL;              /* should never occur */
+        }
     }
     /* check the input CTR size, it can be truncated, but cannot be smaller than the AES key */
     if (rc == 0) {
@@ -2703,60 +4042,28 @@ TPM_RESULT TPM_SymmetricKeyData_CtrCrypt(unsigned char *data_out,
         }
     }
     if (rc == 0) {
-        /* make a truncated copy of CTR, since AES_ctr128_encrypt alters the value */
+	rc = TPM_AES_CipherFetch(&tpm_aes_ctr_cipher, "AES-128-CTR");
+    }
+    if (rc == 0) {
+        /* make a truncated copy of CTR */
         memcpy(ctr, ctr_in, sizeof(ctr));
         printf("  TPM_SymmetricKeyData_CtrCrypt: Calling AES in CTR mode\n");
         TPM_PrintFour("  TPM_SymmetricKeyData_CtrCrypt: CTR", ctr);
-        rc = TPM_AES_ctr128_encrypt(data_out,
-				    data_in,
-				    data_size,
-				    &(tpm_symmetric_key_data->aes_enc_key),
-				    ctr);
     }
-    TPM_SymmetricKeyData_Free((TPM_SYMMETRIC_KEY_TOKEN *)&tpm_symmetric_key_data);	/* @1 */
-    return rc;
-}
-
-/* TPM_AES_ctr128_encrypt() is a TPM variant of the openSSL AES_ctr128_encrypt() function that
-   increments only the low 4 bytes of the counter.
-
-   openSSL increments the entire CTR array.  The TPM does not follow that convention.
-*/
-
-static TPM_RESULT TPM_AES_ctr128_encrypt(unsigned char *data_out,
-					 const unsigned char *data_in,
-					 uint32_t data_size,
-					 const AES_KEY *aes_enc_key,
-					 unsigned char ctr[TPM_AES_BLOCK_SIZE])
-{
-    TPM_RESULT  rc = 0;
-    uint32_t cint;
-    unsigned char pad_buffer[TPM_AES_BLOCK_SIZE];       /* the XOR pad */
-
-    printf("  TPM_AES_Ctr128_encrypt:\n");
-    while (data_size != 0) {
-        printf("   TPM_AES_Ctr128_encrypt: data_size %lu\n", (unsigned long)data_size);
-        /* get an XOR pad array by encrypting the CTR with the AES key */
-        AES_encrypt(ctr, pad_buffer, aes_enc_key);
-        /* partial or full last data block */
-        if (data_size <= TPM_AES_BLOCK_SIZE) {
-            TPM_XOR(data_out, data_in, pad_buffer, data_size);
-            data_size = 0;
-        }
-        /* full block, not the last block */
-        else {
-            TPM_XOR(data_out, data_in, pad_buffer, TPM_AES_BLOCK_SIZE);
-            data_in += TPM_AES_BLOCK_SIZE;
-            data_out += TPM_AES_BLOCK_SIZE;
-            data_size -= TPM_AES_BLOCK_SIZE;
-        }
-        /* if not the last block, increment CTR, only the low 4 bytes */
-        if (data_size != 0) {
-            /* CTR is a big endian array, so the low 4 bytes are 12-15 */
-            cint = LOAD32(ctr, 12);     /* byte array to uint32_t */
-            cint++;                     /* increment */
-            STORE32(ctr, 12, cint);     /* uint32_t to byte array */
-        }
+    while ((rc == 0) && (data_size != 0)) {
+	run_size = (0x100000000ULL - LOAD32(ctr, 12)) * TPM_AES_BLOCK_SIZE;
+	length = (data_size < run_size) ? data_size : (uint32_t)run_size;
+	rc = TPM_AES_StreamCrypt(data_out,
+				 data_in,
+				 length,
+				 tpm_aes_ctr_cipher,
+				 symmetric_key,
+				 ctr);
+	data_in += length;
+	data_out += length;
+	data_size -= length;
+	/* the low 4 bytes wrapped, the high bytes are not incremented */
+	STORE32(ctr, 12, 0);
     }
     return rc;
 }
@@ -2770,16 +4077,6 @@ static TPM_RESULT TPM_AES_ctr128_encrypt(unsigned char *data_out,
    'ivec_in' is the initial IV value before possible truncation
 */
 
-/* openSSL prototype
-
-   void AES_ofb128_encrypt(const unsigned char *in,
-                           unsigned char *out,
-                           const unsigned long length,
-                           const AES_KEY *key,
-                           unsigned char *ivec,
-                           int *num);
-*/
-
 TPM_RESULT TPM_SymmetricKeyData_OfbCrypt(unsigned char *data_out,       /* output */
                                          const unsigned char *data_in,  /* input */
                                          uint32_t data_size,		/* input */
@@ -2789,45 +4086,77 @@ TPM_RESULT TPM_SymmetricKeyData_OfbCrypt(unsigned char *data_out,       /* outpu
                                          uint32_t ivec_in_size)		/* input */
 {
     TPM_RESULT  rc = 0;
-    TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data = NULL;	/* freed @1 */
-    unsigned char ivec[TPM_AES_BLOCK_SIZE];
-    int num;
 
     printf(" TPM_SymmetricKeyData_OfbCrypt: data_size %u\n", data_size);
-    /* allocate memory for the key token.  The token is opaque in the API, but at this low level,
-       the code understands the TPM_SYMMETRIC_KEY_DATA structure */
-    if (rc == 0) {
-	rc = TPM_SymmetricKeyData_New((TPM_SYMMETRIC_KEY_TOKEN *)&tpm_symmetric_key_data);
-    }
-    /* convert the raw key to the AES key, truncating as required */
+    /* check the input key size, it can be truncated, but cannot be smaller than the AES key */
     if (rc == 0) {
-        rc = TPM_SymmetricKeyData_SetKey(tpm_symmetric_key_data,
-                                         symmetric_key,
-                                         symmetric_key_size);
+        if (symmetric_key_size < TPM_AES_BLOCK_SIZE) {
+            printf("TPM_SymmetricKeyData_OfbCrypt: Error (fatal), need %u bytes, received %u\n",
+                   TPM_AES_BLOCK_SIZE, symmetric_key_size);
+            rc = TPM_FAIL;              /* should never occur */
+        }
     }
     /* check the input OFB size, it can be truncated, but cannot be smaller than the AES key */
     if (rc == 0) {
-        if (ivec_in_size < sizeof(ivec)) {
+        if (ivec_in_size < TPM_AES_BLOCK_SIZE) {
             printf("  TPM_SymmetricKeyData_OfbCrypt: Error (fatal),"
                    "IV size %u too small for AES key\n", ivec_in_size);
             rc = TPM_FAIL;              /* should never occur */
         }
     }
     if (rc == 0) {
-        /* make a truncated copy of IV, since AES_ofb128_encrypt alters the value */
-        memcpy(ivec, ivec_in, sizeof(ivec));
-        num = 0;
+	rc = TPM_AES_CipherFetch(&tpm_aes_ofb_cipher, "AES-128-OFB");
+    }
+    if (rc == 0) {
         printf("  TPM_SymmetricKeyData_OfbCrypt: Calling AES in OFB mode\n");
-        TPM_PrintFour("  TPM_SymmetricKeyData_OfbCrypt: IV", ivec);
-        AES_ofb128_encrypt(data_in,
-                           data_out,
-                           data_size,
-                           &(tpm_symmetric_key_data->aes_enc_key),
-                           ivec,
-                           &num);
-    }
-    TPM_SymmetricKeyData_Free((TPM_SYMMETRIC_KEY_TOKEN *)&tpm_symmetric_key_data);
+        TPM_PrintFour("  TPM_SymmetricKeyData_OfbCrypt: IV", ivec_in);
+	rc = TPM_AES_StreamCrypt(data_out,
+				 data_in,
+				 data_size,
+				 tpm_aes_ofb_cipher,
+				 symmetric_key,		/* truncated to the AES key size */
+				 ivec_in);		/* truncated to the block size */
+    }
+    return rc;
+}
+
+/* TPM_AES_StreamCrypt() runs the AES stream mode 'cipher' over 'data_in' with the raw 'key' and
+   initial value 'iv'.
+
+   The raw key belongs to the caller, e.g. a transport session, so the context holding its key
+   schedule is freed, and with it wiped, before returning.
+*/
+
+static TPM_RESULT TPM_AES_StreamCrypt(unsigned char *data_out,
+				      const unsigned char *data_in,
+				      uint32_t data_size,
+				      const EVP_CIPHER *cipher,
+				      const unsigned char *key,
+				      const unsigned char iv[TPM_AES_BLOCK_SIZE])
+{
+    TPM_RESULT		rc = 0;
+    EVP_CIPHER_CTX	*ctx = NULL;		/* freed @1 */
+    int			length;
+
+    printf("  TPM_AES_StreamCrypt: data_size %u\n", data_size);
+    if (rc == 0) {
+	ctx = EVP_CIPHER_CTX_new();		/* freed @1 */
+	if (ctx == NULL) {
+            printf("TPM_AES_StreamCrypt: Error in EVP_CIPHER_CTX_new()\n");
+            rc = TPM_SIZE;
+	}
+    }
+    if (rc == 0) {
+	if ((EVP_EncryptInit_ex(ctx, cipher, NULL, key, iv) != 1) ||
+	    (EVP_EncryptUpdate(ctx, data_out, &length, data_in, data_size) != 1)) {
+            printf("TPM_AES_StreamCrypt: Error (fatal) in AES stream encrypt\n");
+            TPM_OpenSSL_PrintError();
+            rc = TPM_FAIL;      /* should never occur */
+	}
+    }
+    EVP_CIPHER_CTX_free(ctx);			/* @1, wipes the key schedule */
     return rc;
 }
 
+
 #endif  /* TPM_AES */
@@ -41,17 +41,19 @@
 #define TPM_CRYPTO_H
 
 #include "tpm_secret.h"
+#include "tpm_sha1.h"
 #include "tpm_types.h"
 
 /* self test */
 
 TPM_RESULT TPM_Crypto_Init(void);
+void       TPM_Crypto_Terminate(void);
 TPM_RESULT TPM_Crypto_TestSpecific(void);
 
 /* random number */
 
-TPM_RESULT TPM_Random(BYTE *buffer, size_t bytes);
-TPM_RESULT TPM_StirRandomCmd(TPM_SIZED_BUFFER *inData);
+TPM_RESULT TPM_Entropy_Get(BYTE *buffer, size_t bytes);
+TPM_RESULT TPM_Entropy_Add(const unsigned char *data, uint32_t length);
 
 /*
   bignum
@@ -96,6 +98,7 @@ TPM_RESULT TPM_bn2bin(unsigned char *bin,
 
 TPM_RESULT TPM_BN_new(TPM_BIGNUM *bn_in);
 void 	   TPM_BN_free(TPM_BIGNUM bn_in);
+void 	   TPM_BN_clear_free(TPM_BIGNUM bn_in);
 
 /* RSA */
     
@@ -120,6 +123,32 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,
                                  unsigned char *d,
                                  uint32_t dbytes);
 
+TPM_RESULT TPM_RSAPrivateKeyToken_New(void **rsa_pri_token,
+				      unsigned char *narr,
+				      uint32_t nbytes,
+				      unsigned char *earr,
+				      uint32_t ebytes,
+				      unsigned char *darr,
+				      uint32_t dbytes,
+				      unsigned char *parr,
+				      uint32_t pbytes,
+				      unsigned char *qarr,
+				      uint32_t qbytes,
+				      unsigned char *dparr,
+				      uint32_t dpbytes,
+				      unsigned char *dqarr,
+				      uint32_t dqbytes,
+				      unsigned char *qinvarr,
+				      uint32_t qinvbytes);
+void       TPM_RSAPrivateKeyToken_Free(void **rsa_pri_token);
+TPM_RESULT TPM_RSAPrivateDecryptToken(unsigned char *decrypt_data,
+				      uint32_t *decrypt_data_length,
+				      size_t decrypt_data_size,
+				      TPM_ENC_SCHEME encScheme,
+				      unsigned char *encrypt_data,
+				      uint32_t encrypt_data_size,
+				      void *rsa_pri_token);
+
 TPM_RESULT TPM_RSAPublicEncrypt(unsigned char* encrypt_data,
                                 size_t encrypt_data_size,
                                 TPM_ENC_SCHEME encScheme,
@@ -129,6 +158,18 @@ TPM_RESULT TPM_RSAPublicEncrypt(unsigned char* encrypt_data,
                                 uint32_t nbytes,
                                 unsigned char *earr,
                                 uint32_t ebytes);
+TPM_RESULT TPM_RSAPublicKeyToken_New(void **rsa_pub_token,
+				     unsigned char *narr,
+				     uint32_t nbytes,
+				     unsigned char *earr,
+				     uint32_t ebytes);
+void       TPM_RSAPublicKeyToken_Free(void **rsa_pub_token);
+TPM_RESULT TPM_RSAPublicEncryptToken(unsigned char* encrypt_data,
+				     size_t encrypt_data_size,
+				     TPM_ENC_SCHEME encScheme,
+				     const unsigned char *decrypt_data,
+				     size_t decrypt_data_size,
+				     void *rsa_pub_token);
 TPM_RESULT TPM_RSAPublicEncryptRaw(unsigned char *encrypt_data,
 				   uint32_t encrypt_data_size,
 				   unsigned char *decrypt_data,
@@ -140,6 +181,9 @@ TPM_RESULT TPM_RSAPublicEncryptRaw(unsigned char *encrypt_data,
     
 TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
                                 uint32_t *dbytes, unsigned char **darr,
+                                uint32_t *dpbytes, unsigned char **dparr,
+                                uint32_t *dqbytes, unsigned char **dqarr,
+                                uint32_t *qinvbytes, unsigned char **qinvarr,
                                 uint32_t nbytes, unsigned char *narr,
                                 uint32_t ebytes, unsigned char *earr,
                                 uint32_t pbytes, unsigned char *parr);
@@ -155,6 +199,13 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,
                        uint32_t ebytes,
                        unsigned char *darr,
                        uint32_t dbytes);
+TPM_RESULT TPM_RSASignToken(unsigned char *signature,
+			    unsigned int *signature_length,
+			    unsigned int signature_size,
+			    TPM_SIG_SCHEME sigScheme,
+			    const unsigned char *message,
+			    size_t message_size,
+			    void *rsa_pri_token);
 TPM_RESULT TPM_RSAVerifySHA1(unsigned char *signature,
 			     unsigned int signature_size,
 			     const unsigned char *message,
@@ -164,7 +215,7 @@ TPM_RESULT TPM_RSAVerifySHA1(unsigned char *signature,
 			     unsigned char *earr,
 			     uint32_t ebytes);
 
-/* SHA-1 */
+/* SHA-1, implemented by the built-in engine in tpm_sha1.c */
 
 TPM_RESULT TPM_SHA1InitCmd(void **context);
 TPM_RESULT TPM_SHA1UpdateCmd(void *context, const unsigned char *data, uint32_t length);
@@ -173,6 +224,12 @@ void       TPM_SHA1Delete(void **context);
 
 /* SHA-1 Context */
 
+TPM_RESULT TPM_Sha1Context_Init(TPM_SHA1_CONTEXT *context);
+TPM_RESULT TPM_Sha1Context_Update(TPM_SHA1_CONTEXT *context,
+				  const unsigned char *data,
+				  uint32_t length);
+TPM_RESULT TPM_Sha1Context_Final(unsigned char *md,
+				 TPM_SHA1_CONTEXT *context);
 TPM_RESULT TPM_Sha1Context_Load(void **context,
 				unsigned char **stream,
 				uint32_t *stream_size);
@@ -192,16 +249,19 @@ TPM_RESULT TPM_SymmetricKeyData_Load(TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_t
 TPM_RESULT TPM_SymmetricKeyData_Store(TPM_STORE_BUFFER *sbuffer,
                                       const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token);
 TPM_RESULT TPM_SymmetricKeyData_GenerateKey(TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token);
-TPM_RESULT TPM_SymmetricKeyData_Encrypt(unsigned char **encrypt_data,
-                                        uint32_t *encrypt_length,
-                                        const unsigned char *decrypt_data,
-                                        uint32_t decrypt_length,
-                                        const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token);
-TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,
-                                        uint32_t *decrypt_length,
-                                        const unsigned char *encrypt_data,
-                                        uint32_t encrypt_length,
-                                        const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token);
+void       TPM_SymmetricKeyData_EncryptLength(uint32_t *encrypt_length,
+                                              uint32_t decrypt_length);
+TPM_RESULT TPM_SymmetricKeyData_EncryptBuffer(unsigned char *encrypt_data,
+                                              uint32_t *encrypt_length,
+                                              uint32_t encrypt_size,
+                                              const unsigned char *decrypt_data,
+                                              uint32_t decrypt_length,
+                                              const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token);
+TPM_RESULT TPM_SymmetricKeyData_DecryptBuffer(unsigned char *decrypt_data,
+                                              uint32_t *decrypt_length,
+                                              const unsigned char *encrypt_data,
+                                              uint32_t encrypt_length,
+                                              const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token);
 TPM_RESULT TPM_SymmetricKeyData_CtrCrypt(unsigned char *data_out,
                                          const unsigned char *data_in,
                                          uint32_t data_size,
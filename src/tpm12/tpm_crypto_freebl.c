@@ -88,13 +88,6 @@ static TPM_RESULT TPM_RSAGeneratePublicToken(RSAPublicKey *rsa_pub_key,
 					     uint32_t nbytes,
 					     unsigned char *earr,
 					     uint32_t ebytes);
-static TPM_RESULT TPM_RSAGeneratePrivateToken(RSAPrivateKey *rsa_pri_key,
-					      unsigned char *narr,
-					      uint32_t nbytes,
-					      unsigned char *earr,
-					      uint32_t ebytes,
-					      unsigned char *darr,
-					      uint32_t dbytes);
 static TPM_RESULT TPM_RSASignSHA1(unsigned char *signature,
                                   unsigned int *signature_length,
                                   const unsigned char *message,
@@ -131,6 +124,31 @@ static TPM_RESULT TPM_memcpyPad(unsigned char **bin_out,
 				uint32_t padBytes);
 
 
+/* TPM_RSA_PRIVATE_TOKEN is a prepared freebl private key.  The key SECItems point at the caller's
+   arrays, so the token keeps its own copy of the key parts in 'buffer'.
+*/
+
+typedef struct tdTPM_RSA_PRIVATE_TOKEN {
+    RSAPrivateKey rsa_pri_key;
+    unsigned char *buffer;
+    uint32_t buffer_size;
+} TPM_RSA_PRIVATE_TOKEN;
+
+static void TPM_RSAPrivateToken_SetItem(SECItem *item,
+					unsigned char **next,
+					const unsigned char *data,
+					uint32_t length);
+
+/* TPM_RSA_PUBLIC_TOKEN is a freebl public key.  A token from TPM_RSAPublicKeyToken_New() keeps its
+   own copy of n and e in 'buffer'.  A temporary token on the stack may leave 'buffer' NULL and
+   point at the caller's arrays.
+*/
+
+typedef struct tdTPM_RSA_PUBLIC_TOKEN {
+    RSAPublicKey rsa_pub_key;
+    unsigned char *buffer;
+} TPM_RSA_PUBLIC_TOKEN;
+
 /* TPM_SYMMETRIC_KEY_DATA is a crypto library platform dependent symmetric key structure
  */
 
@@ -197,6 +215,10 @@ TPM_RESULT TPM_Crypto_Init()
 	    rc =TPM_FAIL ;
 	}
     }
+    /* select the SHA-1 implementation for this CPU */
+    if (rc == 0) {
+	TPM_SHA1Engine_Init();
+    }
     /* pre-calculate hash of the constant tpm_oaep_pad_str, used often in the OAEP padding
        calculations */
     if (rc == 0) {
@@ -208,6 +230,18 @@ TPM_RESULT TPM_Crypto_Init()
     return rc;
 }
 
+/* TPM_Crypto_Terminate() frees any crypto library state held across commands
+
+   For freebl, the public key token references the caller's n and e and there is no prepared
+   state to cache, so there is nothing to free.
+*/
+
+void TPM_Crypto_Terminate()
+{
+    printf("TPM_Crypto_Terminate:\n");
+    return;
+}
+
 /* TPM_Crypto_TestSpecific() performs any library specific tests
 
    For FreeBL
@@ -281,20 +315,22 @@ TPM_RESULT TPM_Crypto_TestSpecific()
   Random Number Functions
 */
 
-/* TPM_Random() fills 'buffer' with 'bytes' bytes.
+/* TPM_Entropy_Get() fills 'buffer' with 'bytes' bytes from the crypto library RNG.
+
+   This seeds the TPM_Random() DRBG.
  */
 
-TPM_RESULT TPM_Random(BYTE *buffer, size_t bytes)
+TPM_RESULT TPM_Entropy_Get(BYTE *buffer, size_t bytes)
 {
     TPM_RESULT 	rc = 0;
     SECStatus 	rv = SECSuccess;
 
-    printf(" TPM_Random: Requesting %lu bytes\n", (unsigned long)bytes);
+    printf(" TPM_Entropy_Get: Requesting %lu bytes\n", (unsigned long)bytes);
     /* generate the random bytes */
     if (rc == 0) {
 	rv = RNG_GenerateGlobalRandomBytes(buffer, bytes);
 	if (rv != SECSuccess) {
-	    printf("TPM_Random: Error (fatal) in RNG_GenerateGlobalRandomBytes rv %d\n", rv);
+	    printf("TPM_Entropy_Get: Error (fatal) in RNG_GenerateGlobalRandomBytes rv %d\n", rv);
 	    rc = TPM_FAIL;
 	}
     }
@@ -329,20 +365,20 @@ static TPM_RESULT TPM_RandomNonZero(BYTE *buffer, size_t bytes)
     return rc;
 }
 
-/* TPM_StirRandomCmd() adds the supplied entropy to the random number generator
+/* TPM_Entropy_Add() mixes 'length' bytes of 'data' into the crypto library RNG
  */
 
-TPM_RESULT TPM_StirRandomCmd(TPM_SIZED_BUFFER *inData)
+TPM_RESULT TPM_Entropy_Add(const unsigned char *data, uint32_t length)
 {
     TPM_RESULT 	rc = 0;
     SECStatus 	rv = SECSuccess;
 
-    printf(" TPM_StirRandomCmd:\n");
+    printf(" TPM_Entropy_Add:\n");
     if (rc == 0) {
 	/* add the seeding material */
-	rv = RNG_RandomUpdate(inData->buffer, inData->size);
+	rv = RNG_RandomUpdate(data, length);
 	if (rv != SECSuccess) {
-	    printf("TPM_StirRandom: Error (fatal) in RNG_RandomUpdate rv %d\n", rv);
+	    printf("TPM_Entropy_Add: Error (fatal) in RNG_RandomUpdate rv %d\n", rv);
 	    rc = TPM_FAIL;
 	} 
     }
@@ -516,45 +552,124 @@ static TPM_RESULT TPM_RSAGeneratePublicToken(RSAPublicKey *rsaPublicKey,
     return rc;
 }
 
-/* TPM_RSAGeneratePrivateToken() generates an RSA key token from n, e, d
- */
+/* TPM_RSAPrivateKeyToken_New() constructs a reusable private key token from n,e,d.
 
-static TPM_RESULT TPM_RSAGeneratePrivateToken(RSAPrivateKey *rsa_pri_key, /* freed by caller */
-					      unsigned char *narr,      /* public modulus */
-					      uint32_t nbytes,
-					      unsigned char *earr,      /* public exponent */
-					      uint32_t ebytes,
-					      unsigned char *darr,	/* private exponent */
-					      uint32_t dbytes)
-{
-    TPM_RESULT  rc = 0;
-    SECStatus rv = SECSuccess;
+   If the prime factors 'p', 'q' and the CRT parameters 'dp', 'dq', 'qinv' are supplied (pbytes
+   not zero), they are used directly.  Otherwise they may be NULL with size 0, and
+   RSA_PopulatePrivateKey() recovers them from n,e,d.
 
-    printf("  TPM_RSAGeneratePrivateToken:\n");
-    if (rc == 0) {
-	rsa_pri_key->arena = NULL;
-	/* public exponent */
-	rsa_pri_key->publicExponent.type = siBuffer;
-	rsa_pri_key->publicExponent.data = earr;
-	rsa_pri_key->publicExponent.len = ebytes;
-      	/* public modulus */
-	rsa_pri_key->modulus.type = siBuffer;
-	rsa_pri_key->modulus.data = narr;
-	rsa_pri_key->modulus.len = nbytes;
-	/* private exponent */
-	rsa_pri_key->privateExponent.type = siBuffer;
-	rsa_pri_key->privateExponent.data = darr;
-	rsa_pri_key->privateExponent.len = dbytes;
-	/* given these key parameters (n,e,d), fill in the rest of the parameters */
-	rv = RSA_PopulatePrivateKey(rsa_pri_key); 	/* freed by caller */
-	if (rv != SECSuccess) {
-	    printf("TPM_RSAGeneratePrivateToken: Error, RSA_PopulatePrivateKey rv %d\n", rv);
-	    rc = TPM_BAD_PARAMETER;
+   The token holds the prepared freebl private key, so the key setup runs once and is reused by
+   TPM_RSAPrivateDecryptToken() and TPM_RSASignToken().
+
+   '*rsa_pri_token' must be NULL on entry.  It must be freed with TPM_RSAPrivateKeyToken_Free().
+*/
+
+TPM_RESULT TPM_RSAPrivateKeyToken_New(void **rsa_pri_token,	/* freed by caller */
+				      unsigned char *narr,	/* public modulus */
+				      uint32_t nbytes,
+				      unsigned char *earr,	/* public exponent */
+				      uint32_t ebytes,
+				      unsigned char *darr,	/* private exponent */
+				      uint32_t dbytes,
+				      unsigned char *parr,	/* prime factor p, or NULL */
+				      uint32_t pbytes,
+				      unsigned char *qarr,	/* prime factor q */
+				      uint32_t qbytes,
+				      unsigned char *dparr,	/* d mod (p-1) */
+				      uint32_t dpbytes,
+				      unsigned char *dqarr,	/* d mod (q-1) */
+				      uint32_t dqbytes,
+				      unsigned char *qinvarr,	/* q^-1 mod p */
+				      uint32_t qinvbytes)
+{
+    TPM_RESULT  		rc = 0;
+    SECStatus 			rv = SECSuccess;
+    TPM_RSA_PRIVATE_TOKEN	*token = NULL;
+    RSAPrivateKey		*rsa_pri_key;
+    unsigned char		*next;
+
+    printf(" TPM_RSAPrivateKeyToken_New: CRT %s\n", (pbytes != 0) ? "yes" : "no");
+    if (rc == 0) {
+	rc = TPM_Malloc((unsigned char **)&token, sizeof(TPM_RSA_PRIVATE_TOKEN));
+    }
+    if (rc == 0) {
+	rsa_pri_key = &(token->rsa_pri_key);
+	TPM_RSAPrivateKeyInit(rsa_pri_key);
+	token->buffer = NULL;
+	token->buffer_size = nbytes + ebytes + dbytes +
+			     pbytes + qbytes + dpbytes + dqbytes + qinvbytes;
+	rc = TPM_Malloc(&(token->buffer), token->buffer_size);
+    }
+    if (rc == 0) {
+	next = token->buffer;
+	TPM_RSAPrivateToken_SetItem(&(rsa_pri_key->modulus), &next, narr, nbytes);
+	TPM_RSAPrivateToken_SetItem(&(rsa_pri_key->publicExponent), &next, earr, ebytes);
+	TPM_RSAPrivateToken_SetItem(&(rsa_pri_key->privateExponent), &next, darr, dbytes);
+	/* if the CRT parameters are supplied, the key is complete */
+	if (pbytes != 0) {
+	    TPM_RSAPrivateToken_SetItem(&(rsa_pri_key->prime1), &next, parr, pbytes);
+	    TPM_RSAPrivateToken_SetItem(&(rsa_pri_key->prime2), &next, qarr, qbytes);
+	    TPM_RSAPrivateToken_SetItem(&(rsa_pri_key->exponent1), &next, dparr, dpbytes);
+	    TPM_RSAPrivateToken_SetItem(&(rsa_pri_key->exponent2), &next, dqarr, dqbytes);
+	    TPM_RSAPrivateToken_SetItem(&(rsa_pri_key->coefficient), &next, qinvarr, qinvbytes);
 	}
+	/* else, given n,e,d, fill in the rest of the parameters */
+	else {
+	    rv = RSA_PopulatePrivateKey(rsa_pri_key);
+	    if (rv != SECSuccess) {
+		printf("TPM_RSAPrivateKeyToken_New: Error, RSA_PopulatePrivateKey rv %d\n", rv);
+		rc = TPM_BAD_PARAMETER;
+	    }
+	}
+    }
+    if (rc == 0) {
+	*rsa_pri_token = token;
+    }
+    else {
+	TPM_RSAPrivateKeyToken_Free((void **)&token);
     }
     return rc;
 }
 
+/* TPM_RSAPrivateToken_SetItem() copies 'length' bytes of 'data' to '*next', points 'item' at the
+   copy, and advances '*next'.
+*/
+
+static void TPM_RSAPrivateToken_SetItem(SECItem *item,
+					unsigned char **next,
+					const unsigned char *data,
+					uint32_t length)
+{
+    memcpy(*next, data, length);
+    item->type = siBuffer;
+    item->data = *next;
+    item->len = length;
+    *next += length;
+    return;
+}
+
+/* TPM_RSAPrivateKeyToken_Free() frees a token constructed by TPM_RSAPrivateKeyToken_New() and sets
+   it back to NULL.  No-op if the token is NULL.
+*/
+
+void TPM_RSAPrivateKeyToken_Free(void **rsa_pri_token)
+{
+    TPM_RSA_PRIVATE_TOKEN *token = *rsa_pri_token;
+
+    if (token != NULL) {
+	if (token->rsa_pri_key.arena != NULL) {
+	    PORT_FreeArena(token->rsa_pri_key.arena, PR_TRUE);
+	}
+	if (token->buffer != NULL) {
+	    memset(token->buffer, 0, token->buffer_size);
+	}
+	free(token->buffer);
+	free(token);
+	*rsa_pri_token = NULL;
+    }
+    return;
+}
+
 /* TPM_RSAPrivateDecrypt() decrypts 'encrypt_data' using the private key 'n, e, d'.  The OAEP
    padding is removed and 'decrypt_data_length' bytes are moved to 'decrypt_data'.
 
@@ -574,54 +689,102 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted dat
                                  uint32_t ebytes,
                                  unsigned char *darr,           /* private exponent */
                                  uint32_t dbytes)
+{
+    TPM_RESULT  	rc = 0;
+    void		*rsa_pri_token = NULL;	/* freed @1 */
+
+    printf(" TPM_RSAPrivateDecrypt: Input data size %u\n", encrypt_data_size);
+    /* construct the freebl private key object from n,e,d */
+    if (rc == 0) {
+	rc = TPM_RSAPrivateKeyToken_New(&rsa_pri_token,	/* freed @1 */
+					narr,      	/* public modulus */
+					nbytes,
+					earr,      	/* public exponent */
+					ebytes,
+					darr,		/* private exponent */
+					dbytes,
+					NULL, 0,	/* no CRT parameters */
+					NULL, 0,
+					NULL, 0,
+					NULL, 0,
+					NULL, 0);
+    }
+    if (rc == 0) {
+	rc = TPM_RSAPrivateDecryptToken(decrypt_data,
+					decrypt_data_length,
+					decrypt_data_size,
+					encScheme,
+					encrypt_data,
+					encrypt_data_size,
+					rsa_pri_token);
+    }
+    TPM_RSAPrivateKeyToken_Free(&rsa_pri_token);	/* @1 */
+    return rc;
+}
+
+/* TPM_RSAPrivateDecryptToken() is TPM_RSAPrivateDecrypt() using a private key token constructed by
+   TPM_RSAPrivateKeyToken_New()
+*/
+
+TPM_RESULT TPM_RSAPrivateDecryptToken(unsigned char *decrypt_data,	/* decrypted data */
+				      uint32_t *decrypt_data_length,	/* length of data put into
+									   decrypt_data */
+				      size_t decrypt_data_size,	/* size of decrypt_data buffer */
+				      TPM_ENC_SCHEME encScheme,	/* encryption scheme */
+				      unsigned char *encrypt_data,	/* encrypted data */
+				      uint32_t encrypt_data_size,
+				      void *rsa_pri_token)		/* private key token */
 {
     TPM_RESULT  	rc = 0;
     SECStatus 		rv = SECSuccess;
-    RSAPrivateKey	rsa_pri_key;
-    unsigned char       *padded_data = NULL;	/* freed @2 */
+    RSAPrivateKey	*rsa_pri_key = NULL;
+    /* the decrypted but still padded data is on the stack, unless the key is larger than
+       TPM_RSA_KEY_LENGTH_MAX */
+    unsigned char       padded_buffer[TPM_RSA_KEY_LENGTH_MAX / CHAR_BIT];
+    unsigned char       *padded_alloc = NULL;	/* freed @1 */
+    unsigned char       *padded_data = padded_buffer;
     int                 padded_data_size = 0;
 
-    printf(" TPM_RSAPrivateDecrypt: Input data size %u\n", encrypt_data_size);
-    TPM_RSAPrivateKeyInit(&rsa_pri_key);			/* freed @1 */
-    /* the encrypted data size must equal the public key size */
+    printf(" TPM_RSAPrivateDecryptToken: Input data size %u\n", encrypt_data_size);
     if (rc == 0) {
-	if (encrypt_data_size != nbytes) {
-	    printf("TPM_RSAPrivateDecrypt: Error, Encrypted data size is %u not %u\n",
-		   encrypt_data_size, nbytes);
-	    rc = TPM_DECRYPT_ERROR;
+	if (rsa_pri_token == NULL) {
+	    printf("TPM_RSAPrivateDecryptToken: Error (fatal), NULL token\n");
+	    rc = TPM_FAIL;
 	}
     }
-    /* construct the freebl private key object from n,e,d */
+    /* the encrypted data size must equal the public key size */
     if (rc == 0) {
-	rc = TPM_RSAGeneratePrivateToken(&rsa_pri_key,	/* freed @1 */
-					 narr,      	/* public modulus */
-					 nbytes,
-					 earr,      	/* public exponent */
-					 ebytes,
-					 darr,		/* private exponent */
-					 dbytes);
+	rsa_pri_key = &(((TPM_RSA_PRIVATE_TOKEN *)rsa_pri_token)->rsa_pri_key);
+	if (encrypt_data_size != rsa_pri_key->modulus.len) {
+	    printf("TPM_RSAPrivateDecryptToken: Error, Encrypted data size is %u not %u\n",
+		   encrypt_data_size, rsa_pri_key->modulus.len);
+	    rc = TPM_DECRYPT_ERROR;
+	}
     }
-    /* allocate intermediate buffer for the decrypted but still padded data */
+    /* intermediate buffer for the decrypted but still padded data */
     if (rc == 0) {
         /* the size of the decrypted data is guaranteed to be less than this */
-        padded_data_size = rsa_pri_key.modulus.len;
-        rc = TPM_Malloc(&padded_data, padded_data_size);	/* freed @2 */
+        padded_data_size = rsa_pri_key->modulus.len;
+	if ((size_t)padded_data_size > sizeof(padded_buffer)) {
+	    rc = TPM_Malloc(&padded_alloc, padded_data_size);	/* freed @1 */
+	    padded_data = padded_alloc;
+	}
     }
     if (rc == 0) {
         /* decrypt with private key.  Must decrypt first and then remove padding because the decrypt
            call cannot specify an encoding parameter */
-	rv = RSA_PrivateKeyOp(&rsa_pri_key,		/* private key token */
+	rv = RSA_PrivateKeyOp(rsa_pri_key,		/* private key token */
 			      padded_data,		/* to - the decrypted but padded data */
 			      encrypt_data);		/* from - the encrypted data */
 	if (rv != SECSuccess) {
-	    printf("TPM_RSAPrivateDecrypt: Error in RSA_PrivateKeyOp(), rv %d\n", rv);
+	    printf("TPM_RSAPrivateDecryptToken: Error in RSA_PrivateKeyOp(), rv %d\n", rv);
 	    rc = TPM_DECRYPT_ERROR;
 	}
    }
     if (rc == 0) {
-        printf("  TPM_RSAPrivateDecrypt: RSA_PrivateKeyOp() success\n");
-        printf("  TPM_RSAPrivateDecrypt: Padded data size %u\n", padded_data_size);
-        TPM_PrintFour("  TPM_RSAPrivateDecrypt: Decrypt padded data", padded_data);
+        printf("  TPM_RSAPrivateDecryptToken: RSA_PrivateKeyOp() success\n");
+        printf("  TPM_RSAPrivateDecryptToken: Padded data size %u\n", padded_data_size);
+        TPM_PrintFour("  TPM_RSAPrivateDecryptToken: Decrypt padded data", padded_data);
 	/* check and remove the padding based on the TPM encryption scheme */
         if (encScheme == TPM_ES_RSAESOAEP_SHA1_MGF1) {
 	    /* recovered seed and pHash are not returned */
@@ -647,20 +810,81 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted dat
 					     padded_data_size);  	/* from length */
         }
         else {
-            printf("TPM_RSAPrivateDecrypt: Error, unknown encryption scheme %04x\n", encScheme);
+            printf("TPM_RSAPrivateDecryptToken: Error, unknown encryption scheme %04x\n", encScheme);
             rc = TPM_INAPPROPRIATE_ENC;
         }
     }
     if (rc == 0) {
-        printf("  TPM_RSAPrivateDecrypt: RSA_padding_check_PKCS1 recovered %d bytes\n",
+        printf("  TPM_RSAPrivateDecryptToken: RSA_padding_check_PKCS1 recovered %d bytes\n",
 	       *decrypt_data_length);
-        TPM_PrintFour("  TPM_RSAPrivateDecrypt: Decrypt data", decrypt_data);
+        TPM_PrintFour("  TPM_RSAPrivateDecryptToken: Decrypt data", decrypt_data);
     }
-    PORT_FreeArena(rsa_pri_key.arena, PR_TRUE);	/* @1 */
-    free(padded_data);                  	/* @2 */
+    if (padded_data != NULL) {
+	memset(padded_data, 0, padded_data_size);
+    }
+    free(padded_alloc);                  	/* @1 */
     return rc;
 }
 
+/* TPM_RSAPublicKeyToken_New() constructs a reusable public key token from n,e.
+
+   The freebl public key needs no setup, so the token is just a copy of n and e that the caller
+   may keep, e.g. in a TPM_KEY.
+
+   '*rsa_pub_token' must be NULL on entry.  It must be freed with TPM_RSAPublicKeyToken_Free().
+*/
+
+TPM_RESULT TPM_RSAPublicKeyToken_New(void **rsa_pub_token,	/* freed by caller */
+				     unsigned char *narr,	/* public modulus */
+				     uint32_t nbytes,
+				     unsigned char *earr,	/* public exponent */
+				     uint32_t ebytes)
+{
+    TPM_RESULT  		rc = 0;
+    TPM_RSA_PUBLIC_TOKEN	*token = NULL;
+
+    printf(" TPM_RSAPublicKeyToken_New:\n");
+    if (rc == 0) {
+	rc = TPM_Malloc((unsigned char **)&token, sizeof(TPM_RSA_PUBLIC_TOKEN));
+    }
+    if (rc == 0) {
+	token->buffer = NULL;
+	rc = TPM_Malloc(&(token->buffer), nbytes + ebytes);
+    }
+    if (rc == 0) {
+	memcpy(token->buffer, narr, nbytes);
+	memcpy(token->buffer + nbytes, earr, ebytes);
+	rc = TPM_RSAGeneratePublicToken(&(token->rsa_pub_key),
+					token->buffer,		/* public modulus */
+					nbytes,
+					token->buffer + nbytes,	/* public exponent */
+					ebytes);
+    }
+    if (rc == 0) {
+	*rsa_pub_token = token;
+    }
+    else {
+	TPM_RSAPublicKeyToken_Free((void **)&token);
+    }
+    return rc;
+}
+
+/* TPM_RSAPublicKeyToken_Free() frees a token constructed by TPM_RSAPublicKeyToken_New() and sets
+   it back to NULL.  No-op if the token is NULL.
+*/
+
+void TPM_RSAPublicKeyToken_Free(void **rsa_pub_token)
+{
+    TPM_RSA_PUBLIC_TOKEN *token = *rsa_pub_token;
+
+    if (token != NULL) {
+	free(token->buffer);
+	free(token);
+	*rsa_pub_token = NULL;
+    }
+    return;
+}
+
 /* TPM_RSAPublicEncrypt() PKCS1 pads 'decrypt_data' to 'encrypt_data_size' and encrypts using the
    public key 'n, e'.
 */
@@ -675,13 +899,64 @@ TPM_RESULT TPM_RSAPublicEncrypt(unsigned char *encrypt_data,    /* encrypted dat
                                 unsigned char *earr,           /* public exponent */
                                 uint32_t ebytes)
 {
-    TPM_RESULT  	rc = 0;
-    unsigned char 	*padded_data = NULL;			/* freed @1 */
+    TPM_RESULT  		rc = 0;
+    TPM_RSA_PUBLIC_TOKEN	token;		/* points at n and e */
     
     printf(" TPM_RSAPublicEncrypt: Input data size %lu\n", (unsigned long)decrypt_data_size);
+    if (rc == 0) {
+	token.buffer = NULL;
+	rc = TPM_RSAGeneratePublicToken(&(token.rsa_pub_key),
+					narr,      	/* public modulus */
+					nbytes,
+					earr,      	/* public exponent */
+					ebytes);
+    }
+    if (rc == 0) {
+	rc = TPM_RSAPublicEncryptToken(encrypt_data,
+				       encrypt_data_size,
+				       encScheme,
+				       decrypt_data,
+				       decrypt_data_size,
+				       &token);
+    }
+    return rc;
+}
+
+/* TPM_RSAPublicEncryptToken() PKCS1 pads 'decrypt_data' to 'encrypt_data_size' and encrypts using
+   the public key token from TPM_RSAPublicKeyToken_New().
+*/
+
+TPM_RESULT TPM_RSAPublicEncryptToken(unsigned char *encrypt_data,	/* encrypted data */
+				     size_t encrypt_data_size,	/* size of encrypted data buffer */
+				     TPM_ENC_SCHEME encScheme,	/* padding type */
+				     const unsigned char *decrypt_data,	/* decrypted data */
+				     size_t decrypt_data_size,
+				     void *rsa_pub_token)
+{
+    TPM_RESULT  		rc = 0;
+    SECStatus 			rv = SECSuccess;
+    TPM_RSA_PUBLIC_TOKEN	*token = rsa_pub_token;
+    /* the padded data is on the stack, unless the key is larger than TPM_RSA_KEY_LENGTH_MAX */
+    unsigned char		padded_buffer[TPM_RSA_KEY_LENGTH_MAX / CHAR_BIT];
+    unsigned char 		*padded_alloc = NULL;			/* freed @1 */
+    unsigned char 		*padded_data = padded_buffer;
+    
+    printf(" TPM_RSAPublicEncryptToken: Input data size %lu\n",
+	   (unsigned long)decrypt_data_size);
+    /* the output data size must equal the public key size */
+    if (rc == 0) {
+	if (encrypt_data_size != token->rsa_pub_key.modulus.len) {
+	    printf("TPM_RSAPublicEncryptToken: Error, Output data size is %lu not %u\n",
+		   (unsigned long)encrypt_data_size, token->rsa_pub_key.modulus.len);
+	    rc = TPM_ENCRYPT_ERROR;
+	}
+    }
     /* intermediate buffer for the padded decrypted data */
     if (rc == 0) {
-        rc = TPM_Malloc(&padded_data, encrypt_data_size);	/* freed @1 */
+	if (encrypt_data_size > sizeof(padded_buffer)) {
+	    rc = TPM_Malloc(&padded_alloc, encrypt_data_size);	/* freed @1 */
+	    padded_data = padded_alloc;
+	}
     }
     /* pad the decrypted data */
     if (rc == 0) {
@@ -708,22 +983,25 @@ TPM_RESULT TPM_RSAPublicEncrypt(unsigned char *encrypt_data,    /* encrypted dat
 					   decrypt_data_size);		/* from length */
         }
         else {
-            printf("TPM_RSAPublicEncrypt: Error, unknown encryption scheme %04x\n", encScheme);
+            printf("TPM_RSAPublicEncryptToken: Error, unknown encryption scheme %04x\n",
+		   encScheme);
             rc = TPM_INAPPROPRIATE_ENC;
         }
     }
     /* raw public key operation on the already padded input data */
     if (rc == 0) {
-	rc = TPM_RSAPublicEncryptRaw(encrypt_data,	/* output */
-				     encrypt_data_size,	/* input, size of enc buffer */
-				     padded_data,	/* input */
-				     encrypt_data_size,	/* input, size of dec buffer */
-				     narr,		/* public modulus */
-				     nbytes,
-				     earr,		/* public exponent */
-				     ebytes);
+	rv = RSA_PublicKeyOp(&(token->rsa_pub_key),	/* freebl public key token */
+			     encrypt_data,		/* output - the encrypted data */
+			     padded_data);		/* input - the padded data */
+	if (rv != SECSuccess) {
+	    printf("TPM_RSAPublicEncryptToken: Error in RSA_PublicKeyOp, rv %d\n", rv);
+	    rc = TPM_ENCRYPT_ERROR;
+	}
     }
-    free(padded_data);                  /* @1 */
+    if (padded_data != NULL) {
+	memset(padded_data, 0, encrypt_data_size);
+    }
+    free(padded_alloc);                 /* @1 */
     return rc;
 }
 
@@ -813,25 +1091,65 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
                        uint32_t dbytes)
 {
     TPM_RESULT          rc = 0;
-    RSAPrivateKey 	rsa_pri_key;
+    void		*rsa_pri_token = NULL;	/* freed @1 */
 
     printf(" TPM_RSASign:\n");
-    TPM_RSAPrivateKeyInit(&rsa_pri_key);			/* freed @1 */
-    /* construct the free private key object from n,e,d */
+    /* construct the freebl private key object from n,e,d */
+    if (rc == 0) {
+	rc = TPM_RSAPrivateKeyToken_New(&rsa_pri_token,	/* freed @1 */
+					narr,      	/* public modulus */
+					nbytes,
+					earr,      	/* public exponent */
+					ebytes,
+					darr,		/* private exponent */
+					dbytes,
+					NULL, 0,	/* no CRT parameters */
+					NULL, 0,
+					NULL, 0,
+					NULL, 0,
+					NULL, 0);
+    }
+    if (rc == 0) {
+	rc = TPM_RSASignToken(signature,
+			      signature_length,
+			      signature_size,
+			      sigScheme,
+			      message,
+			      message_size,
+			      rsa_pri_token);
+    }
+    TPM_RSAPrivateKeyToken_Free(&rsa_pri_token);	/* @1 */
+    return rc;
+}
+
+/* TPM_RSASignToken() is TPM_RSASign() using a private key token constructed by
+   TPM_RSAPrivateKeyToken_New()
+*/
+
+TPM_RESULT TPM_RSASignToken(unsigned char *signature,        /* output */
+			    unsigned int *signature_length,  /* output, size of signature */
+			    unsigned int signature_size,     /* input, size of signature buffer */
+			    TPM_SIG_SCHEME sigScheme,        /* input, type of signature */
+			    const unsigned char *message,    /* input */
+			    size_t message_size,             /* input */
+			    void *rsa_pri_token)		/* private key token */
+{
+    TPM_RESULT          rc = 0;
+    RSAPrivateKey 	*rsa_pri_key = NULL;
+
+    printf(" TPM_RSASignToken:\n");
     if (rc == 0) {
-	rc = TPM_RSAGeneratePrivateToken(&rsa_pri_key,	/* freed @1 */
-					 narr,      	/* public modulus */
-					 nbytes,
-					 earr,      	/* public exponent */
-					 ebytes,
-					 darr,		/* private exponent */
-					 dbytes);
+	if (rsa_pri_token == NULL) {
+	    printf("TPM_RSASignToken: Error (fatal), NULL token\n");
+	    rc = TPM_FAIL;
+	}
     }
     /* sanity check the size of the output signature buffer */
     if (rc == 0) {
-        if (signature_size < nbytes) {
-            printf("TPM_RSASign: Error (fatal), buffer %u too small for signature %u\n",
-                   signature_size, nbytes);
+	rsa_pri_key = &(((TPM_RSA_PRIVATE_TOKEN *)rsa_pri_token)->rsa_pri_key);
+        if (signature_size < rsa_pri_key->modulus.len) {
+            printf("TPM_RSASignToken: Error (fatal), buffer %u too small for signature %u\n",
+                   signature_size, rsa_pri_key->modulus.len);
             rc = TPM_FAIL;      /* internal error, should never occur */
         }
     }
@@ -839,7 +1157,7 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
     if (rc == 0) {
         switch(sigScheme) {
           case TPM_SS_NONE:
-            printf("TPM_RSASign: Error, sigScheme TPM_SS_NONE\n");
+            printf("TPM_RSASignToken: Error, sigScheme TPM_SS_NONE\n");
             rc = TPM_INVALID_KEYUSAGE;
             break;
           case TPM_SS_RSASSAPKCS1v15_SHA1:
@@ -848,22 +1166,21 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
                                  signature_length,
                                  message,
                                  message_size,
-                                 &rsa_pri_key);
+                                 rsa_pri_key);
             break;
           case TPM_SS_RSASSAPKCS1v15_DER:
             rc = TPM_RSASignDER(signature,
                                 signature_length,
                                 message,
                                 message_size,
-                                &rsa_pri_key);
+                                rsa_pri_key);
             break;
           default:
-            printf("TPM_RSASign: Error, sigScheme %04hx unknown\n", sigScheme);
+            printf("TPM_RSASignToken: Error, sigScheme %04hx unknown\n", sigScheme);
             rc = TPM_INVALID_KEYUSAGE;
             break;
         }
     }
-    PORT_FreeArena(rsa_pri_key.arena, PR_TRUE);		/* @1 */
     return rc;
 }
 
@@ -1044,11 +1361,17 @@ TPM_RESULT TPM_RSAVerifySHA1(unsigned char *signature,          /* input */
 /* TPM_RSAGetPrivateKey calculates q (2nd prime factor) and d (private key) from n (public key), e
    (public exponent), and p (1st prime factor)
 
-   'qarr', darr' must be freed by the caller.
+   It also returns the CRT parameters dP = d mod (p-1), dQ = d mod (q-1), and qInv = q^-1 mod p,
+   padded to the size of p.
+
+   'qarr', darr', 'dparr', 'dqarr', 'qinvarr' must be freed by the caller.
 */
 
 TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
                                 uint32_t *dbytes, unsigned char **darr,
+                                uint32_t *dpbytes, unsigned char **dparr,
+                                uint32_t *dqbytes, unsigned char **dqarr,
+                                uint32_t *qinvbytes, unsigned char **qinvarr,
                                 uint32_t nbytes, unsigned char *narr,
                                 uint32_t ebytes, unsigned char *earr,
                                 uint32_t pbytes, unsigned char *parr)
@@ -1062,6 +1385,9 @@ TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
     TPM_RSAPrivateKeyInit(&rsa_pri_key);	/* freed @1 */
     *qarr = NULL;
     *darr = NULL;
+    *dparr = NULL;
+    *dqarr = NULL;
+    *qinvarr = NULL;
     /* check input parameters */
     if (rc == 0) {
         if ((narr == NULL) || (nbytes == 0)) {
@@ -1115,6 +1441,25 @@ TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
 			   nbytes);			/* pad to public modulus */
 	*dbytes = nbytes;
     }
+    /* extract and pad the CRT parameters */
+    if (rc == 0) {
+	rc = TPM_memcpyPad(dparr,			/* freed by caller */
+			   rsa_pri_key.exponent1.data, rsa_pri_key.exponent1.len,
+			   pbytes);			/* pad to p prime */
+	*dpbytes = pbytes;
+    }
+    if (rc == 0) {
+	rc = TPM_memcpyPad(dqarr,			/* freed by caller */
+			   rsa_pri_key.exponent2.data, rsa_pri_key.exponent2.len,
+			   pbytes);			/* pad to p prime */
+	*dqbytes = pbytes;
+    }
+    if (rc == 0) {
+	rc = TPM_memcpyPad(qinvarr,			/* freed by caller */
+			   rsa_pri_key.coefficient.data, rsa_pri_key.coefficient.len,
+			   pbytes);			/* pad to p prime */
+	*qinvbytes = pbytes;
+    }
     if (rc == 0) {
         TPM_PrintFour("  TPM_RSAGetPrivateKey: Calculated q",  *qarr);
         TPM_PrintFour("  TPM_RSAGetPrivateKey: Calculated d",  *darr);
@@ -1661,6 +2006,24 @@ void TPM_BN_free(TPM_BIGNUM bn_in)
     return;
 }
 
+/* TPM_BN_clear_free() wraps the gnump function
+
+   Zeros and frees a bignum holding a secret
+*/
+
+void TPM_BN_clear_free(TPM_BIGNUM bn_in)
+{
+    mpz_t *bn = (mpz_t *)bn_in;
+    if (bn != NULL) {
+	/* mpz_clear() does not zero the limbs.  Zero all allocated limbs, not just the used ones,
+	   since a shrunk value leaves stale limbs behind. */
+	memset((*bn)->_mp_d, 0, (*bn)->_mp_alloc * sizeof(mp_limb_t));
+	mpz_clear(*bn);
+	free(bn_in);
+    }
+    return;
+}
+
 /* TPM_bn2bin wraps the function in gnump a TPM error handler.
 
    Converts a bignum to char array
@@ -1760,127 +2123,12 @@ TPM_RESULT TPM_bin2bn(TPM_BIGNUM *bn_in, const unsigned char *bin, unsigned int
   Hash Functions
 */
 
-/* TPM_SHA1InitCmd() initializes a platform dependent TPM_SHA1Context structure.
-
-   The structure must be freed using TPM_SHA1FinalCmd()
-*/
+/* the SHA-1 functions are implemented by the built-in engine in tpm_sha1.c */
 
-TPM_RESULT TPM_SHA1InitCmd(void **context)
-{
-    TPM_RESULT  rc = 0;
+/* TPM_Sha1Context_Load() deserializes a SHA-1 context in the FreeBL SHA1Context format.
 
-    printf(" TPM_SHA1InitCmd:\n");
-    if (rc == 0) {
-	/* create a new freebl SHA1 context */
-	*context = SHA1_NewContext();
-	if (*context == NULL) {
-	    printf("TPM_SHA1InitCmd:  Error allocating a new context\n");
-            rc = TPM_SIZE;
-	}
-    }
-    /* reset the SHA-1 context, preparing it for a fresh round of hashing */
-    if (rc== 0) {
-	SHA1_Begin(*context);
-    }
-    return rc;
-}
-
-/* TPM_SHA1UpdateCmd() adds 'data' of 'length' to the SHA-1 context
- */
-
-TPM_RESULT TPM_SHA1UpdateCmd(void *context, const unsigned char *data, uint32_t length)
-{
-    TPM_RESULT  rc = 0;
-    
-    printf(" TPM_SHA1Update: length %u\n", length);
-    if (context != NULL) {
-        SHA1_Update(context, data, length);
-    }
-    else {
-        printf("TPM_SHA1Update: Error, no existing SHA1 thread\n");
-        rc = TPM_SHA_THREAD;
-    }
-    return rc;
-}
-
-/* TPM_SHA1FinalCmd() extracts the SHA-1 digest 'md' from the context
- */
-
-TPM_RESULT TPM_SHA1FinalCmd(unsigned char *md, void *context)
-{
-    TPM_RESULT  	rc = 0;
-    unsigned int 	digestLen;
-    
-    printf(" TPM_SHA1FinalCmd:\n");
-    if (rc== 0) {
-	if (context == NULL) {
-	    printf("TPM_SHA1FinalCmd: Error, no existing SHA1 thread\n");
-	    rc = TPM_SHA_THREAD;
-	}
-    }
-    if (rc== 0) {
-	SHA1_End(context, md, &digestLen, TPM_DIGEST_SIZE);
-	/* Sanity check.  For SHA1 it should always be 20 bytes. */
-	if (digestLen != TPM_DIGEST_SIZE) {
-	    printf("TPM_SHA1Final: Error (fatal), SHA1_End returned %u bytes\n", digestLen);
-	    rc = TPM_FAIL;
-	}
-    }
-    return rc;
-}
-
-/* TPM_SHA1Delete() zeros and frees the SHA1 context */
-
-void TPM_SHA1Delete(void **context)
-{
-    if (*context != NULL) {
-        printf(" TPM_SHA1Delete:\n");
-	/* zero because the SHA1 context might have data left from an HMAC */
-	SHA1_DestroyContext(*context, PR_TRUE);	
-        *context = NULL;
-    }
-    return;
-}
-
-#if defined (__x86_64__) || \
-    defined(__amd64__) || \
-    defined(__ia64__) || \
-    defined(__powerpc64__) || \
-    defined(__s390x__) || \
-    (defined(__sparc__) && defined(__arch64__)) || \
-    defined(__aarch64__)
-
-#define IS_64
-typedef PRUint64 SHA_HW_t;
-
-#elif defined (__i386__) || \
-    defined (__powerpc__) || \
-    defined (__s390__) || \
-    defined(__sparc__) || \
-    defined(__arm__)
-
-typedef PRUint32 SHA_HW_t;
-#undef IS_64
-
-#else
-#error "Cannot determine 32 or 64 bit platform"
-#endif
-
-/* The structure returned by the SHA1_Flatten() command and passed to SHA1_Resurrect()
- */
-
-typedef struct SHA1SaveContextStrtd {
-    union {
-	PRUint32 w[16];             /* input buffer */
-	PRUint8  b[64];
-    } u;
-    PRUint64 size;                /* count of hashed bytes. */
-    SHA_HW_t H[22];               /* 5 state variables, 16 tmp values, 1
-				     extra */
-} SHA1SaveContextStr;
-
-
-/* TPM_Sha1Context_Load() is non-portable code to deserialize the FreeBL SHA1 context.
+   The FreeBL format holds the partial block, the message length in bytes, and the chaining value.
+   It is converted to the TPM_SHA1_CONTEXT used by the SHA-1 engine.
 
    If the contextPresent prepended by TPM_Sha1Context_Store() is FALSE, context remains NULL.  If
    TRUE, context is allocated and loaded.
@@ -1892,10 +2140,9 @@ TPM_RESULT TPM_Sha1Context_Load(void **context,
 {
     TPM_RESULT 		rc = 0;
     TPM_BOOL		contextPresent;		/* is there a context to be loaded */
-    uint32_t	 	flattenSize;		/* from the freebl library */
-    SHA1Context 	*tmpContext = NULL;	/* temp to get flatten size, freed @1 */
+    TPM_SHA1_CONTEXT	*sha_ctx = NULL;
     uint32_t		tmp32;			/* temp to recreate 64-bit size */
-    SHA1SaveContextStr 	restoreContext;
+    uint64_t		size;			/* message length in bytes */
     size_t		i;
     
     printf(" TPM_Sha1Context_Load: FreeBL\n");
@@ -1917,56 +2164,34 @@ TPM_RESULT TPM_Sha1Context_Load(void **context,
             rc = TPM_FAIL;
 	}
     }
-    /* create a temporary context just to get the freebl library size */
-    if ((rc== 0) && contextPresent) {
-	rc = TPM_SHA1InitCmd((void **)&tmpContext);	/* freed @1 */
-    }
-    /* get the size of the FreeBL library SHA1 context */
     if ((rc== 0) && contextPresent) {
-	flattenSize = SHA1_FlattenSize(tmpContext);
-	/* sanity check that the freebl library and TPM structure here are in sync */
-	if (flattenSize != sizeof(SHA1SaveContextStr)) {
-	    printf("TPM_Sha1Context_Load: Error, "
-		   "SHA1 context size %u from SHA1_FlattenSize not equal %lu from struture\n",
-		   flattenSize, (unsigned long)sizeof(SHA1SaveContextStr));
-	    rc = TPM_BAD_PARAM_SIZE;
-	}
+	rc = TPM_SHA1InitCmd(context);
+	sha_ctx = (TPM_SHA1_CONTEXT *)*context;
     }
-    /*
-      deserialization code to fill in restoreContext
-    */
     /* b[0..63] <- u.b[0..63]  (bytes only, no bytswapping) */
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Loadn(restoreContext.u.b, 64, stream, stream_size);
+	rc = TPM_Loadn((unsigned char *)sha_ctx->data, 64, stream, stream_size);
     }
     /* count <- size (this is 64 bits on all platforms) */
     if ((rc== 0) && contextPresent) {
 	rc = TPM_Load32(&tmp32, stream, stream_size);
-	restoreContext.size = (uint64_t)tmp32 << 32;		/* big endian */
+	size = (uint64_t)tmp32 << 32;		/* big endian */
     }
     if ((rc== 0) && contextPresent) {
 	rc = TPM_Load32(&tmp32, stream, stream_size);
-	restoreContext.size += (uint64_t)tmp32 & 0xffffffff;	/* big endian */
+	size += (uint64_t)tmp32 & 0xffffffff;	/* big endian */
+	sha_ctx->Nl = (uint32_t)(size << 3);
+	sha_ctx->Nh = (uint32_t)(size >> 29);
+	sha_ctx->num = (uint32_t)(size & 63);
     }
     for (i = 0 ; (rc == 0) && contextPresent && (i < 5) ; i++) {
-	rc = TPM_Load32(&tmp32, stream, stream_size);
-	restoreContext.H[i] = tmp32;	/* H can be 32 or 64 bits */
-    }
-    /* load the context */
-    if ((rc== 0) && contextPresent) {
-	/* the size test above ensures that the cast here is safe */
-	*context = SHA1_Resurrect((unsigned char *)&restoreContext, NULL);
-	if (*context == NULL) {
-	    printf("TPM_Sha1Context_Load: Error, could not SHA1_Resurrect\n");
-	    rc = TPM_SIZE;
-	}
+	rc = TPM_Load32(&(sha_ctx->h[i]), stream, stream_size);
     }
-    TPM_SHA1Delete((void *)&tmpContext); 	/* @1 */
     return rc;
 }
 
-/* TPM_Sha1Context_Store() is non-portable code to serialize the FreeBL SHA1 context.  context is
-   not altered.
+/* TPM_Sha1Context_Store() serializes the SHA-1 context in the FreeBL SHA1Context format.  context
+   is not altered.
 
    It prepends a contextPresent flag to the stream, FALSE if context is NULL, TRUE if not.
 */
@@ -1975,10 +2200,9 @@ TPM_RESULT TPM_Sha1Context_Store(TPM_STORE_BUFFER *sbuffer,
 				 void *context)
 {
     TPM_RESULT 		rc = 0;
-    SECStatus 		rv = SECSuccess;
     size_t		i;
-    unsigned int 	flattenSize;
-    SHA1SaveContextStr	saveContext;
+    TPM_SHA1_CONTEXT	*sha_ctx = (TPM_SHA1_CONTEXT *)context;
+    uint64_t		size;			/* message length in bytes */
     TPM_BOOL		contextPresent;		/* is there a context to be stored */
 
     printf(" TPM_Sha1Context_Store: FreeBL\n");
@@ -1999,46 +2223,25 @@ TPM_RESULT TPM_Sha1Context_Store(TPM_STORE_BUFFER *sbuffer,
     if ((rc== 0) && contextPresent) {
 	rc = TPM_Sbuffer_Append16(sbuffer, TPM_TAG_SHA1CONTEXT_FREEBL_V1);
     }
-    if ((rc== 0) && contextPresent) {
-	/* get the size of the FreeBL SHA1 context */
-	flattenSize = SHA1_FlattenSize(context);	/* it will not be NULL here */
-	/* sanity check that the freebl library and TPM structure here are in sync */
-	if (flattenSize != sizeof(SHA1SaveContextStr)) {
-	    printf("TPM_Sha1Context_Store: Error (fatal), "
-		   "SHA1 context size %u from SHA1_FlattenSize not equal %lu from struture\n",
-		   flattenSize, (unsigned long)sizeof(SHA1SaveContextStr));
-	    rc = TPM_FAIL;
-	}
-    }
-    /* store into the structure from the library */
-    if ((rc== 0) && contextPresent) {
-	/* the size test above ensures that the cast here is safe */
-	rv = SHA1_Flatten(context, (unsigned char *)&saveContext);
-	if (rv != SECSuccess) {
-	    printf("TPM_Sha1Context_Store: Error (fatal), SHA1_Flatten rv %d\n", rv);
-	    rc = TPM_FAIL;
-	}
-    }
     /*
-      append the FreeBL SHA1 context to the stream
+      append the SHA1 context to the stream in the FreeBL format
     */
     /* b[0..63] <- u.b[0..63]  (bytes only, no byte swapping) */
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Sbuffer_Append(sbuffer, saveContext.u.b, 64);
+	rc = TPM_Sbuffer_Append(sbuffer, (unsigned char *)sha_ctx->data, 64);
     }
     /* count <- size (this is 64 bits on all platforms) */
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Sbuffer_Append32(sbuffer, saveContext.size >> 32);	/* big endian */
+	size = ((uint64_t)sha_ctx->Nh << 29) | (sha_ctx->Nl >> 3);
+	rc = TPM_Sbuffer_Append32(sbuffer, size >> 32);	/* big endian */
     }
     if ((rc== 0) && contextPresent) {
-	rc = TPM_Sbuffer_Append32(sbuffer, saveContext.size & 0xffffffff);
+	rc = TPM_Sbuffer_Append32(sbuffer, size & 0xffffffff);
     }
-    /* SHA_HW_t - NSS uses 64 bits on 64 bit platforms for performance reasons only.  The lower 32
-       bits are critical, so you can always serialize/deserialize just the lower 32 bits. */
-    /* The remainder of the H array is scratch memory and does not need to be preserved or
-       transmitted. */
+    /* H[0..4], NSS keeps only the lower 32 bits significant.  The remainder of the H array is
+       scratch memory and is not transmitted. */
     for (i = 0 ; (rc == 0) && contextPresent && (i < 5) ; i++) {
-	rc = TPM_Sbuffer_Append32(sbuffer, saveContext.H[i] & 0xffffffff);
+	rc = TPM_Sbuffer_Append32(sbuffer, sha_ctx->h[i]);
     }
     return rc;
 }
@@ -2190,54 +2393,67 @@ TPM_RESULT TPM_SymmetricKeyData_GenerateKey(TPM_SYMMETRIC_KEY_TOKEN tpm_symmetri
     return rc;
 }
 
-/* TPM_SymmetricKeyData_Encrypt() is AES non-portable code to CBC encrypt 'decrypt_data' to
+/* TPM_SymmetricKeyData_EncryptLength() is AES non-portable code to return the length of the
+   encryption of 'decrypt_length' bytes
+
+   The stream is padded as per PKCS#7 / RFC2630, so this is always larger than the input.
+*/
+
+void TPM_SymmetricKeyData_EncryptLength(uint32_t *encrypt_length,
+					uint32_t decrypt_length)
+{
+    *encrypt_length = decrypt_length + TPM_AES_BLOCK_SIZE - (decrypt_length % TPM_AES_BLOCK_SIZE);
+    return;
+}
+
+/* TPM_SymmetricKeyData_EncryptBuffer() is AES non-portable code to CBC encrypt 'decrypt_data' to
    'encrypt_data'
 
    The stream is padded as per PKCS#7 / RFC2630
 
-   'encrypt_data' must be free by the caller
+   'encrypt_data' is preallocated with 'encrypt_size' bytes, at least the
+   TPM_SymmetricKeyData_EncryptLength() of 'decrypt_length'.  It can be the same buffer as
+   'decrypt_data', encrypting in place.
 */
 
-TPM_RESULT TPM_SymmetricKeyData_Encrypt(unsigned char **encrypt_data,   /* output, caller frees */
-                                        uint32_t *encrypt_length,		/* output */
-                                        const unsigned char *decrypt_data,	/* input */
-                                        uint32_t decrypt_length,		/* input */
-                                        const TPM_SYMMETRIC_KEY_TOKEN
-					tpm_symmetric_key_token) 		/* input */
+TPM_RESULT TPM_SymmetricKeyData_EncryptBuffer(unsigned char *encrypt_data,	/* output */
+					      uint32_t *encrypt_length,		/* output */
+					      uint32_t encrypt_size,		/* input */
+					      const unsigned char *decrypt_data,	/* input */
+					      uint32_t decrypt_length,		/* input */
+					      const TPM_SYMMETRIC_KEY_TOKEN
+					      tpm_symmetric_key_token)		/* input */
 {
     TPM_RESULT          rc = 0;
     SECStatus 		rv;
     AESContext 		*cx;
     uint32_t		pad_length;
     uint32_t		output_length;			/* dummy */
-    unsigned char       *decrypt_data_pad;
     unsigned char       ivec[TPM_AES_BLOCK_SIZE];       /* initial chaining vector */
     TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data =
 	(TPM_SYMMETRIC_KEY_DATA *)tpm_symmetric_key_token;
 
-    printf(" TPM_SymmetricKeyData_Encrypt: Length %u\n", decrypt_length);
-    decrypt_data_pad = NULL;    /* freed @1 */
-    cx = NULL;    		/* freed @2 */
+    printf(" TPM_SymmetricKeyData_EncryptBuffer: Length %u\n", decrypt_length);
+    cx = NULL;    		/* freed @1 */
     
     /* sanity check that the AES key has previously been generated */
     if (rc == 0) {
 	if (!tpm_symmetric_key_data->valid) {
-	    printf("TPM_SymmetricKeyData_Encrypt: Error (fatal), AES key not valid\n");
+	    printf("TPM_SymmetricKeyData_EncryptBuffer: Error (fatal), AES key not valid\n");
 	    rc = TPM_FAIL;
 	}
     }
     if (rc == 0) {
         /* calculate the PKCS#7 / RFC2630 pad length and padded data length */
-        pad_length = TPM_AES_BLOCK_SIZE - (decrypt_length % TPM_AES_BLOCK_SIZE);
-        *encrypt_length = decrypt_length + pad_length;
-        printf("  TPM_SymmetricKeyData_Encrypt: Padded length %u pad length %u\n",
+	TPM_SymmetricKeyData_EncryptLength(encrypt_length, decrypt_length);
+        pad_length = *encrypt_length - decrypt_length;
+        printf("  TPM_SymmetricKeyData_EncryptBuffer: Padded length %u pad length %u\n",
                *encrypt_length, pad_length);
-        /* allocate memory for the encrypted response */
-        rc = TPM_Malloc(encrypt_data, *encrypt_length);
-    }
-    /* allocate memory for the padded decrypted data */
-    if (rc == 0) {
-        rc = TPM_Malloc(&decrypt_data_pad, *encrypt_length);
+	if (*encrypt_length > encrypt_size) {
+	    printf("TPM_SymmetricKeyData_EncryptBuffer: Error (fatal), buffer size %u too small\n",
+		   encrypt_size);
+	    rc = TPM_FAIL;	/* should never occur */
+	}
     }
     if (rc == 0) {
         /* set the IV */
@@ -2250,32 +2466,30 @@ TPM_RESULT TPM_SymmetricKeyData_Encrypt(unsigned char **encrypt_data,   /* outpu
 			       TPM_AES_BLOCK_SIZE,	/* key length */
 			       TPM_AES_BLOCK_SIZE);	/* AES  block length */
 	if (cx == NULL) {
-	    printf("TPM_SymmetricKeyData_Encrypt: Error creating AES context\n");
+	    printf("TPM_SymmetricKeyData_EncryptBuffer: Error creating AES context\n");
 	    rc = TPM_SIZE;
 	}
     }
-    /* pad the decrypted clear text data */
+    /* pad the decrypted clear text data in the output */
     if (rc == 0) {
-        /* unpadded original data */
-        memcpy(decrypt_data_pad, decrypt_data, decrypt_length);
+        /* unpadded original data, a no-op in place */
+        memmove(encrypt_data, decrypt_data, decrypt_length);
         /* last gets pad = pad length */
-        memset(decrypt_data_pad + decrypt_length, pad_length, pad_length);
-        /* encrypt the padded input to the output */
-        TPM_PrintFour("  TPM_SymmetricKeyData_Encrypt: Input", decrypt_data_pad);
-	/* perform the AES encryption */
+        memset(encrypt_data + decrypt_length, pad_length, pad_length);
+        TPM_PrintFour("  TPM_SymmetricKeyData_EncryptBuffer: Input", encrypt_data);
+	/* perform the AES encryption in place */
 	rv = AES_Encrypt(cx,
-			 *encrypt_data, &output_length, *encrypt_length,	/* output */
-			 decrypt_data_pad, *encrypt_length);			/* input */
+			 encrypt_data, &output_length, *encrypt_length,	/* output */
+			 encrypt_data, *encrypt_length);		/* input */
 
 	if (rv != SECSuccess) {
-	    printf("TPM_SymmetricKeyData_Encrypt: Error, rv %d\n", rv);
+	    printf("TPM_SymmetricKeyData_EncryptBuffer: Error, rv %d\n", rv);
 	    rc = TPM_ENCRYPT_ERROR;
 	}
     }
     if (rc == 0) {
-       TPM_PrintFour("  TPM_SymmetricKeyData_Encrypt: Output", *encrypt_data);
+       TPM_PrintFour("  TPM_SymmetricKeyData_EncryptBuffer: Output", encrypt_data);
     }	
-    free(decrypt_data_pad);     	/* @1 */
     if (cx != NULL) {
 	/* due to a FreeBL bug, must zero the context before destroying it */
 	unsigned char dummy_key[TPM_AES_BLOCK_SIZE];
@@ -2289,25 +2503,26 @@ TPM_RESULT TPM_SymmetricKeyData_Encrypt(unsigned char **encrypt_data,   /* outpu
 			     NSS_AES_CBC,		/* CBC mode */
 			     TRUE,			/* encrypt */
 			     TPM_AES_BLOCK_SIZE);	/* AES  block length */
-	AES_DestroyContext(cx, PR_TRUE);	/* @2 */
+	AES_DestroyContext(cx, PR_TRUE);	/* @1 */
     }
     return rc;
 }
 
-/* TPM_SymmetricKeyData_Decrypt() is AES non-portable code to CBC decrypt 'encrypt_data' to
+/* TPM_SymmetricKeyData_DecryptBuffer() is AES non-portable code to CBC decrypt 'encrypt_data' to
    'decrypt_data'
 
    The stream must be padded as per PKCS#7 / RFC2630
 
-   decrypt_data must be free by the caller
+   'decrypt_data' is preallocated with at least 'encrypt_length' bytes.  It can be the same buffer
+   as 'encrypt_data', decrypting in place.
 */
 
-TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,   /* output, caller frees */
-                                        uint32_t *decrypt_length,		/* output */
-                                        const unsigned char *encrypt_data,	/* input */
-                                        uint32_t encrypt_length,		/* input */
-                                        const TPM_SYMMETRIC_KEY_TOKEN
-					tpm_symmetric_key_token) 		/* input */
+TPM_RESULT TPM_SymmetricKeyData_DecryptBuffer(unsigned char *decrypt_data,	/* output */
+					      uint32_t *decrypt_length,		/* output */
+					      const unsigned char *encrypt_data,	/* input */
+					      uint32_t encrypt_length,		/* input */
+					      const TPM_SYMMETRIC_KEY_TOKEN
+					      tpm_symmetric_key_token)		/* input */
 {
     TPM_RESULT          rc = 0;
     SECStatus 		rv;
@@ -2320,27 +2535,23 @@ TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,   /* outpu
     TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data =
 	(TPM_SYMMETRIC_KEY_DATA *)tpm_symmetric_key_token;
     
-    printf(" TPM_SymmetricKeyData_Decrypt: Length %u\n", encrypt_length);
+    printf(" TPM_SymmetricKeyData_DecryptBuffer: Length %u\n", encrypt_length);
     cx = NULL;    /* freed @1 */
 
     /* sanity check encrypted length */
     if (rc == 0) {
         if (encrypt_length < TPM_AES_BLOCK_SIZE) {
-            printf("TPM_SymmetricKeyData_Decrypt: Error, bad length\n");
+            printf("TPM_SymmetricKeyData_DecryptBuffer: Error, bad length\n");
             rc = TPM_DECRYPT_ERROR;
         }
     }
     /* sanity check that the AES key has previously been generated */
     if (rc == 0) {
 	if (!tpm_symmetric_key_data->valid) {
-	    printf("TPM_SymmetricKeyData_Decrypt: Error (fatal), AES key not valid\n");
+	    printf("TPM_SymmetricKeyData_DecryptBuffer: Error (fatal), AES key not valid\n");
 	    rc = TPM_FAIL;
 	}
     }
-    /* allocate memory for the PKCS#7 / RFC2630 padded decrypted data */
-    if (rc == 0) {
-        rc = TPM_Malloc(decrypt_data, encrypt_length);
-    }
     if (rc == 0) {
         /* set the IV */
         memset(ivec, 0, sizeof(ivec));
@@ -2352,34 +2563,34 @@ TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,   /* outpu
 			       TPM_AES_BLOCK_SIZE,	/* key length */
 			       TPM_AES_BLOCK_SIZE);	/* AES  block length */
 	if (cx == NULL) {
-	    printf("TPM_SymmetricKeyData_Decrypt: Error creating AES context\n");
+	    printf("TPM_SymmetricKeyData_DecryptBuffer: Error creating AES context\n");
 	    rc = TPM_SIZE;
 	}
     }
     /* decrypt the input to the PKCS#7 / RFC2630 padded output */
     if (rc == 0) {
-        TPM_PrintFour("  TPM_SymmetricKeyData_Decrypt: Input", encrypt_data);
+        TPM_PrintFour("  TPM_SymmetricKeyData_DecryptBuffer: Input", encrypt_data);
 	/* perform the AES decryption */
 	rv = AES_Decrypt(cx,
-			 *decrypt_data, &output_length, encrypt_length,	/* output */
+			 decrypt_data, &output_length, encrypt_length,	/* output */
 			 encrypt_data, encrypt_length);			/* input */
 	if (rv != SECSuccess) {
-	    printf("TPM_SymmetricKeyData_Decrypt: Error, rv %d\n", rv);
+	    printf("TPM_SymmetricKeyData_DecryptBuffer: Error, rv %d\n", rv);
 	    rc = TPM_DECRYPT_ERROR;
 	}
     }
     if (rc == 0) {
-        TPM_PrintFour("  TPM_SymmetricKeyData_Decrypt: Output", *decrypt_data);
+        TPM_PrintFour("  TPM_SymmetricKeyData_DecryptBuffer: Output", decrypt_data);
     }
     /* get the pad length */
     if (rc == 0) {
         /* get the pad length from the last byte */
-        pad_length = (uint32_t)*(*decrypt_data + encrypt_length - 1);
+        pad_length = (uint32_t)*(decrypt_data + encrypt_length - 1);
         /* sanity check the pad length */
-        printf(" TPM_SymmetricKeyData_Decrypt: Pad length %u\n", pad_length);
+        printf(" TPM_SymmetricKeyData_DecryptBuffer: Pad length %u\n", pad_length);
         if ((pad_length == 0) ||
             (pad_length > TPM_AES_BLOCK_SIZE)) {
-            printf("TPM_SymmetricKeyData_Decrypt: Error, illegal pad length\n");
+            printf("TPM_SymmetricKeyData_DecryptBuffer: Error, illegal pad length\n");
             rc = TPM_DECRYPT_ERROR;
         }
     }
@@ -2387,11 +2598,11 @@ TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,   /* outpu
         /* get the unpadded length */
         *decrypt_length = encrypt_length - pad_length;
         /* pad starting point */
-        pad_data = *decrypt_data + *decrypt_length;
+        pad_data = decrypt_data + *decrypt_length;
         /* sanity check the pad */
         for (i = 0 ; i < pad_length ; i++, pad_data++) {
             if (*pad_data != pad_length) {
-                printf("TPM_SymmetricKeyData_Decrypt: Error, bad pad %02x at index %u\n",
+                printf("TPM_SymmetricKeyData_DecryptBuffer: Error, bad pad %02x at index %u\n",
                        *pad_data, i);
                 rc = TPM_DECRYPT_ERROR;
             }
@@ -42,7 +42,13 @@
 #include <string.h>
 #include <stdarg.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TPM_XOR_X86
+#include <immintrin.h>
+#endif
+
 #include "tpm_admin.h"
+#include "tpm_arena.h"
 #include "tpm_auth.h"
 #include "tpm_crypto.h"
 #include "tpm_debug.h"
@@ -65,9 +71,50 @@
 static TPM_RESULT TPM_SHA1_valist(TPM_DIGEST md, 
 				  uint32_t length0, unsigned char *buffer0,
 				  va_list ap);
+static TPM_RESULT TPM_SHA1_Contextvalist(TPM_DIGEST md,
+					 TPM_SHA1_CONTEXT *context,
+					 va_list ap);
 static TPM_RESULT TPM_HMAC_Generatevalist(TPM_HMAC hmac,
 					  const TPM_SECRET key,
 					  va_list ap);
+static TPM_RESULT TPM_HMAC_GenerateMidstatevalist(TPM_HMAC tpm_hmac,
+						  const TPM_HMAC_MIDSTATE *tpm_hmac_midstate,
+						  va_list ap);
+static TPM_RESULT TPM_HMAC_Final(TPM_HMAC tpm_hmac,
+				 const TPM_HMAC_MIDSTATE *tpm_hmac_midstate,
+				 TPM_DIGEST inner_hash);
+static TPM_RESULT TPM_HMAC_Compare(TPM_BOOL *valid,
+				   TPM_HMAC expect,
+				   TPM_HMAC actual);
+static TPM_RESULT TPM_HMAC_Structure(TPM_HMAC tpm_hmac,
+				     const TPM_SECRET hmac_key,
+				     void *tpmStructure,
+				     TPM_STORE_FUNCTION_T storeFunction);
+
+#ifdef TPM_XOR_X86
+static size_t TPM_XOR_AVX2(unsigned char *out,
+			   const unsigned char *in1,
+			   const unsigned char *in2,
+			   size_t length);
+#endif
+
+static TPM_RESULT TPM_Mgf1Context_Setvalist(TPM_MGF1_CONTEXT *tpm_mgf1_context,
+					    uint32_t seedLen,
+					    va_list ap);
+static TPM_RESULT TPM_Mgf1Context_Stream(TPM_MGF1_CONTEXT *tpm_mgf1_context,
+					 unsigned char *out,
+					 const unsigned char *in,
+					 uint32_t length);
+
+static TPM_DRBG_CONTEXT *TPM_Random_GetDrbg(void);
+static TPM_RESULT TPM_Random_Reseed(TPM_DRBG_CONTEXT *tpm_drbg,
+				    const unsigned char *additional,
+				    uint32_t additional_length);
+static TPM_RESULT TPM_DrbgContext_Update(TPM_DRBG_CONTEXT *tpm_drbg_context,
+					 const unsigned char *data1,
+					 uint32_t length1,
+					 const unsigned char *data2,
+					 uint32_t length2);
 
 static TPM_RESULT TPM_SHA1CompleteCommon(TPM_DIGEST hashValue,
 					 void **sha1_context,
@@ -718,9 +765,77 @@ void TPM_SymmetricKey_Delete(TPM_SYMMETRIC_KEY *tpm_symmetric_key)
     return;
 }
 
+/* TPM_SymmetricKeyData_Encrypt() encrypts 'decrypt_data' to 'encrypt_data'
+
+   Padding is included, so the output is larger than the input.
+
+   'encrypt_data' must be free by the caller
+*/
+
+TPM_RESULT TPM_SymmetricKeyData_Encrypt(unsigned char **encrypt_data,   /* output, caller frees */
+                                        uint32_t *encrypt_length,		/* output */
+                                        const unsigned char *decrypt_data,	/* input */
+                                        uint32_t decrypt_length,		/* input */
+                                        const TPM_SYMMETRIC_KEY_TOKEN
+					tpm_symmetric_key_token) 		/* input */
+{
+    TPM_RESULT		rc = 0;
+    uint32_t		encrypt_size;
+
+    *encrypt_data = NULL;	/* freed by caller */
+    /* allocate memory for the padded encrypted data */
+    if (rc == 0) {
+	TPM_SymmetricKeyData_EncryptLength(&encrypt_size, decrypt_length);
+	rc = TPM_Malloc(encrypt_data, encrypt_size);
+    }
+    /* platform dependent symmetric key encrypt */
+    if (rc == 0) {
+	rc = TPM_SymmetricKeyData_EncryptBuffer(*encrypt_data,		/* output */
+						encrypt_length,		/* output */
+						encrypt_size,		/* input */
+						decrypt_data,		/* input */
+						decrypt_length,		/* input */
+						tpm_symmetric_key_token);
+    }
+    return rc;
+}
+
+/* TPM_SymmetricKeyData_Decrypt() decrypts 'encrypt_data' to 'decrypt_data'
+
+   The padding is removed, so the output is smaller than the input.
+
+   'decrypt_data' must be free by the caller
+*/
+
+TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,   /* output, caller frees */
+                                        uint32_t *decrypt_length,		/* output */
+                                        const unsigned char *encrypt_data,	/* input */
+                                        uint32_t encrypt_length,		/* input */
+                                        const TPM_SYMMETRIC_KEY_TOKEN
+					tpm_symmetric_key_token) 		/* input */
+{
+    TPM_RESULT		rc = 0;
+
+    *decrypt_data = NULL;	/* freed by caller */
+    /* allocate memory for the padded decrypted data */
+    if (rc == 0) {
+	rc = TPM_Malloc(decrypt_data, encrypt_length);
+    }
+    /* platform dependent symmetric key decrypt */
+    if (rc == 0) {
+	rc = TPM_SymmetricKeyData_DecryptBuffer(*decrypt_data,		/* output */
+						decrypt_length,		/* output */
+						encrypt_data,		/* input */
+						encrypt_length,		/* input */
+						tpm_symmetric_key_token);
+    }
+    return rc;
+}
+
 /* TPM_SymmetricKeyData_EncryptSbuffer() encrypts 'sbuffer' to 'encrypt_data'
 
-   Padding is included, so the output may be larger than the input.
+   Padding is included, so the output may be larger than the input.  The serialization is
+   encrypted directly into 'encrypt_data'.
 
    'encrypt_data' must be free by the caller
 */
@@ -732,17 +847,24 @@ TPM_RESULT TPM_SymmetricKeyData_EncryptSbuffer(TPM_SIZED_BUFFER *encrypt_data,
     TPM_RESULT		rc = 0;
     const unsigned char *decrypt_data;		/* serialization buffer */
     uint32_t		decrypt_data_size;	/* serialization size */
+    uint32_t		encrypt_size;
 
     printf(" TPM_SymmetricKeyData_EncryptSbuffer:\n");
     if (rc == 0) {
 	/* get the serialization results */
 	TPM_Sbuffer_Get(sbuffer, &decrypt_data, &decrypt_data_size);
-	/* platform dependent symmetric key encrypt */
-	rc = TPM_SymmetricKeyData_Encrypt(&(encrypt_data->buffer),	/* output, caller frees */
-					  &(encrypt_data->size),	/* output */
-					  decrypt_data,			/* input */
-					  decrypt_data_size,		/* input */
-					  tpm_symmetric_key_data);
+	/* size the output for the padding */
+	TPM_SymmetricKeyData_EncryptLength(&encrypt_size, decrypt_data_size);
+	rc = TPM_SizedBuffer_Allocate(encrypt_data, encrypt_size);
+    }
+    /* platform dependent symmetric key encrypt */
+    if (rc == 0) {
+	rc = TPM_SymmetricKeyData_EncryptBuffer(encrypt_data->buffer,	/* output */
+						&(encrypt_data->size),	/* output */
+						encrypt_size,		/* input */
+						decrypt_data,		/* input */
+						decrypt_data_size,	/* input */
+						tpm_symmetric_key_data);
     }
     return rc;
 }
@@ -816,6 +938,9 @@ TPM_RESULT TPM_SymmetricKeyData_StreamCrypt(unsigned char *data_out,		/* output
    This is commonly used when calculating a digest on a serialized structure.  Structures are
    serialized to a TPM_STORE_BUFFER.
 
+   If the TPM_STORE_BUFFER is a digest sink, the structures were hashed as they were serialized, and
+   the digest is extracted from the sink's context.
+
    The TPM_STORE_BUFFER is not deleted.
 */
 
@@ -827,7 +952,10 @@ TPM_RESULT TPM_SHA1Sbuffer(TPM_DIGEST tpm_digest,
     uint32_t		length;		/* serialization length */
 
     printf(" TPM_SHA1Sbuffer:\n");
-    if (rc == 0) {
+    if (sbuffer->sha1_context != NULL) {
+	rc = TPM_Sha1Context_Final(tpm_digest, sbuffer->sha1_context);
+    }
+    else {
 	/* get the components of the TPM_STORE_BUFFER */
 	TPM_Sbuffer_Get(sbuffer, &buffer, &length);
 	TPM_PrintFour("  TPM_SHA1Sbuffer: input", buffer);
@@ -840,7 +968,8 @@ TPM_RESULT TPM_SHA1Sbuffer(TPM_DIGEST tpm_digest,
 }
 
 /* TPM_SHA1_GenerateStructure() generates a SHA-1 digest of a structure.  It serializes the
-   structure and hashes the result.
+   structure directly into the hash through a digest sink TPM_STORE_BUFFER, so the serialization
+   is never buffered.
 
    tpmStructure is the structure to be serialized
    storeFunction is the serialization function for the structure
@@ -851,19 +980,25 @@ TPM_RESULT TPM_SHA1_GenerateStructure(TPM_DIGEST tpm_digest,
 				      TPM_STORE_FUNCTION_T storeFunction)
 {
     TPM_RESULT		rc = 0;
-    TPM_STORE_BUFFER	sbuffer;	/* serialized tpmStructure */
+    TPM_SHA1_CONTEXT	context;	/* caller owned, nothing to free */
+    TPM_STORE_BUFFER	sbuffer;	/* digest sink, nothing to free */
 
     printf(" TPM_SHA1_GenerateStructure:\n");
-    TPM_Sbuffer_Init(&sbuffer);				/* freed @1 */
-    /* Serialize the structure */
+    TPM_Sbuffer_InitDigest(&sbuffer, &context);
+    if (rc == 0) {
+	rc = TPM_Sha1Context_Init(&context);
+    }
+    /* Serialize the structure into the hash */
     if (rc == 0) {
 	rc = storeFunction(&sbuffer, tpmStructure);
     }	 
-    /* hash the serialized buffer to tpm_hmac */
+    /* TPM_Sha1Context_Final() zeros the context, zero it here if there was an error */
     if (rc == 0) {
-	rc = TPM_SHA1Sbuffer(tpm_digest, &sbuffer);
+	rc = TPM_Sha1Context_Final(tpm_digest, &context);
+    }
+    else {
+	memset(&context, 0, sizeof(TPM_SHA1_CONTEXT));
     }
-    TPM_Sbuffer_Delete(&sbuffer);			/* @1 */
     return rc;
 }
 
@@ -954,40 +1089,63 @@ static TPM_RESULT TPM_SHA1_valist(TPM_DIGEST md,
 				  va_list ap)
 {
     TPM_RESULT		rc = 0;
-    uint32_t		length;
-    unsigned char	*buffer;
-    void		*context = NULL;	/* platform dependent context */
-    TPM_BOOL		done = FALSE;
+    TPM_SHA1_CONTEXT	context;		/* caller owned, nothing to free */
     
     printf(" TPM_SHA1_valist:\n");
     if (rc == 0) {
-	rc = TPM_SHA1InitCmd(&context);
+	rc = TPM_Sha1Context_Init(&context);
     }
     if (rc == 0) {	
 	if (length0 !=0) {		/* optional first text block */
 	    printf("  TPM_SHA1_valist: Digesting %u bytes\n", length0);
-	    rc = TPM_SHA1UpdateCmd(context, buffer0, length0);	/* hash the buffer */
+	    rc = TPM_Sha1Context_Update(&context, buffer0, length0);	/* hash the buffer */
 	}
     }
+    if (rc == 0) {
+	rc = TPM_SHA1_Contextvalist(md, &context, ap);
+    }
+    else {
+	memset(&context, 0, sizeof(TPM_SHA1_CONTEXT));
+    }
+    return rc;
+}
+
+/* TPM_SHA1_Contextvalist() adds the va_list message list to a caller owned SHA-1 context that has
+   already been started, and extracts the digest 'md'.
+
+   The context is zeroed on return.
+*/
+
+static TPM_RESULT TPM_SHA1_Contextvalist(TPM_DIGEST md,
+					 TPM_SHA1_CONTEXT *context,
+					 va_list ap)
+{
+    TPM_RESULT		rc = 0;
+    uint32_t		length;
+    unsigned char	*buffer;
+    TPM_BOOL		done = FALSE;
+    
     while ((rc == 0) && !done) {
 	length = va_arg(ap, uint32_t);		/* first vararg is the length */
 	if (length != 0) {			/* loop until a zero length argument terminates */
 	    buffer = va_arg(ap, unsigned char *);	/* second vararg is the array */
 	    printf("  TPM_SHA1_valist: Digesting %u bytes\n", length);
-	    rc = TPM_SHA1UpdateCmd(context, buffer, length);	/* hash the buffer */
+	    rc = TPM_Sha1Context_Update(context, buffer, length);	/* hash the buffer */
 	}
 	else {
 	    done = TRUE;
 	}
     }
+    /* TPM_Sha1Context_Final() zeros the context, zero it here if there was an error */
     if (rc == 0) {
-	rc = TPM_SHA1FinalCmd(md, context);
+	rc = TPM_Sha1Context_Final(md, context);
+    }
+    else {
+	memset(context, 0, sizeof(TPM_SHA1_CONTEXT));
     }
     if (rc == 0) {
 	TPM_PrintFour("  TPM_SHA1_valist: Digest", md);
     }	 
-    /* call TPM_SHA1Delete even if there was an error */
-    TPM_SHA1Delete(&context);
     return rc;
 }
 
@@ -1034,19 +1192,9 @@ TPM_RESULT TPM_HMAC_GenerateStructure(TPM_HMAC tpm_hmac,
 				      TPM_STORE_FUNCTION_T storeFunction)
 {
     TPM_RESULT		rc = 0;
-    TPM_STORE_BUFFER	sbuffer;	/* serialized tpmStructure */
 
     printf(" TPM_HMAC_GenerateStructure:\n");
-    TPM_Sbuffer_Init(&sbuffer);				/* freed @1 */
-    /* Serialize the structure */
-    if (rc == 0) {
-	rc = storeFunction(&sbuffer, tpmStructure);
-    }	 
-    /* hash the serialized buffer to tpm_hmac */
-    if (rc == 0) {
-	rc = TPM_HMAC_GenerateSbuffer(tpm_hmac, hmac_key, &sbuffer);
-    }
-    TPM_Sbuffer_Delete(&sbuffer);			/* @1 */
+    rc = TPM_HMAC_Structure(tpm_hmac, hmac_key, tpmStructure, storeFunction);
     return rc;
 }
     
@@ -1077,43 +1225,23 @@ TPM_RESULT TPM_HMAC_Generate(TPM_HMAC tpm_hmac,
    formed.
 */
 
-#define TPM_HMAC_BLOCK_SIZE 64
-
 static TPM_RESULT TPM_HMAC_Generatevalist(TPM_HMAC tpm_hmac,
 					  const TPM_SECRET key,
 					  va_list ap)
 {
     TPM_RESULT		rc = 0;
-    unsigned char	ipad[TPM_HMAC_BLOCK_SIZE];
-    unsigned char	opad[TPM_HMAC_BLOCK_SIZE];
-    size_t		i;
-    TPM_DIGEST		inner_hash;
+    TPM_HMAC_MIDSTATE	tpm_hmac_midstate;
 
     printf(" TPM_HMAC_Generatevalist:\n");
-    /* calculate key XOR ipad and key XOR opad */
+    TPM_HmacMidstate_Init(&tpm_hmac_midstate);		/* freed @1 */
+    /* calculate the key XOR ipad and key XOR opad midstates */
     if (rc == 0) {
-	/* first part, key XOR pad */
-	for (i = 0 ; i < TPM_AUTHDATA_SIZE ; i++) {
-	    ipad[i] = key[i] ^ 0x36;	/* magic numbers from RFC 2104 */
-	    opad[i] = key[i] ^ 0x5c;
-	}
-	/* second part, 0x00 XOR pad */
-	memset(ipad + TPM_AUTHDATA_SIZE, 0x36, TPM_HMAC_BLOCK_SIZE - TPM_AUTHDATA_SIZE);
-	memset(opad + TPM_AUTHDATA_SIZE, 0x5c, TPM_HMAC_BLOCK_SIZE - TPM_AUTHDATA_SIZE);
-	/* calculate the inner hash, hash the key XOR ipad and the text */
-	rc = TPM_SHA1_valist(inner_hash,
-			     TPM_HMAC_BLOCK_SIZE, ipad, ap);
+	rc = TPM_HmacMidstate_Set(&tpm_hmac_midstate, key);
     }
-    /* hash the key XOR opad and the previous hash */
     if (rc == 0) {
-	rc = TPM_SHA1(tpm_hmac,
-		      TPM_HMAC_BLOCK_SIZE, opad,
-		      TPM_DIGEST_SIZE, inner_hash,
-		      0, NULL);
+	rc = TPM_HMAC_GenerateMidstatevalist(tpm_hmac, &tpm_hmac_midstate, ap);
     }
-    if (rc == 0) {
-	TPM_PrintFour(" TPM_HMAC_Generatevalist: HMAC", tpm_hmac);
-    }	 
+    TPM_HmacMidstate_Delete(&tpm_hmac_midstate);	/* @1 */
     return rc;
 }
 
@@ -1164,7 +1292,6 @@ TPM_RESULT TPM_HMAC_Check(TPM_BOOL *valid,
     TPM_RESULT		rc = 0;
     va_list		ap;
     TPM_HMAC		actual;
-    int			result;
 
     printf(" TPM_HMAC_Check:\n");
     va_start(ap, key);
@@ -1172,20 +1299,34 @@ TPM_RESULT TPM_HMAC_Check(TPM_BOOL *valid,
 	rc = TPM_HMAC_Generatevalist(actual, key, ap);
     }
     if (rc == 0) {
-	TPM_PrintFour("  TPM_HMAC_Check: Calculated", actual);
-	TPM_PrintFour("  TPM_HMAC_Check: Received  ", expect);
-	result = memcmp(expect, actual, TPM_DIGEST_SIZE);
-	if (result == 0) {
-	    *valid = TRUE;
-	}
-	else {
-	    *valid = FALSE;
-	}
+	rc = TPM_HMAC_Compare(valid, expect, actual);
     }
     va_end(ap);
     return rc;
 }
 
+/* TPM_HMAC_Compare() sets 'valid' to TRUE if the calculated HMAC 'actual' matches 'expect'.
+ */
+
+static TPM_RESULT TPM_HMAC_Compare(TPM_BOOL *valid,
+				   TPM_HMAC expect,
+				   TPM_HMAC actual)
+{
+    TPM_RESULT		rc = 0;
+    int			result;
+
+    TPM_PrintFour("  TPM_HMAC_Check: Calculated", actual);
+    TPM_PrintFour("  TPM_HMAC_Check: Received  ", expect);
+    result = memcmp(expect, actual, TPM_DIGEST_SIZE);
+    if (result == 0) {
+	*valid = TRUE;
+    }
+    else {
+	*valid = FALSE;
+    }
+    return rc;
+}
+
 /* TPM_HMAC_CheckStructure() is a generic function that checks the integrity HMAC of a structure.
 
    hmacKey is the HMAC key
@@ -1207,24 +1348,21 @@ TPM_RESULT TPM_HMAC_CheckStructure(const TPM_SECRET hmac_key,
 				   TPM_RESULT error)
 {
     TPM_RESULT		rc = 0;
-    TPM_STORE_BUFFER	sbuffer;	/* serialized tpmStructure */
     TPM_HMAC		saveExpect;
+    TPM_HMAC		actual;
     TPM_BOOL		valid;
 
     printf(" TPM_HMAC_CheckStructure:\n");
-    TPM_Sbuffer_Init(&sbuffer);			/* freed @1 */
     if (rc == 0) {
 	TPM_Digest_Copy(saveExpect, expect);	/* save the expected value */
 	TPM_Digest_Init(expect);		/* set value in structure to NULL */
-	rc = storeFunction(&sbuffer,
-			   tpmStructure);
+	rc = TPM_HMAC_Structure(actual, hmac_key, tpmStructure, storeFunction);
     }
     /* verify the HMAC of the serialized structure */
     if (rc == 0) {
-	rc = TPM_HMAC_CheckSbuffer(&valid,		/* result */
-				   saveExpect,		/* expected */
-				   hmac_key,		/* key */
-				   &sbuffer);		/* data stream */
+	rc = TPM_HMAC_Compare(&valid,		/* result */
+			      saveExpect,	/* expected */
+			      actual);
     }
     if (rc == 0) {
 	if (!valid) {
@@ -1232,12 +1370,258 @@ TPM_RESULT TPM_HMAC_CheckStructure(const TPM_SECRET hmac_key,
 	    rc = error;
 	}
     }
-    TPM_Sbuffer_Delete(&sbuffer);		/* @1 */
+    return rc;
+}
+
+/* TPM_HMAC_Structure() is the internal function that HMAC's a structure.  The structure is
+   serialized through a digest sink TPM_STORE_BUFFER directly into the inner hash, so the
+   serialization is never buffered.
+*/
+
+static TPM_RESULT TPM_HMAC_Structure(TPM_HMAC tpm_hmac,
+				     const TPM_SECRET hmac_key,
+				     void *tpmStructure,
+				     TPM_STORE_FUNCTION_T storeFunction)
+{
+    TPM_RESULT		rc = 0;
+    TPM_HMAC_MIDSTATE	tpm_hmac_midstate;
+    TPM_SHA1_CONTEXT	context;	/* caller owned, nothing to free */
+    TPM_STORE_BUFFER	sbuffer;	/* digest sink, nothing to free */
+    TPM_DIGEST		inner_hash;
+
+    TPM_HmacMidstate_Init(&tpm_hmac_midstate);		/* freed @1 */
+    TPM_Sbuffer_InitDigest(&sbuffer, &context);
+    if (rc == 0) {
+	rc = TPM_HmacMidstate_Set(&tpm_hmac_midstate, hmac_key);
+    }
+    /* Serialize the structure into the inner hash */
+    if (rc == 0) {
+	context = tpm_hmac_midstate.inner;
+	rc = storeFunction(&sbuffer, tpmStructure);
+    }
+    /* TPM_Sha1Context_Final() zeros the context, zero it here if there was an error */
+    if (rc == 0) {
+	rc = TPM_Sha1Context_Final(inner_hash, &context);
+    }
+    else {
+	memset(&context, 0, sizeof(TPM_SHA1_CONTEXT));
+    }
+    if (rc == 0) {
+	rc = TPM_HMAC_Final(tpm_hmac, &tpm_hmac_midstate, inner_hash);
+    }
+    TPM_HmacMidstate_Delete(&tpm_hmac_midstate);	/* @1 */
+    return rc;
+}
+
+/*
+  HMAC midstates
+*/
+
+#define TPM_HMAC_BLOCK_SIZE 64
+
+/* TPM_HmacMidstate_Init()
+
+   sets members to default values
+   always succeeds - no return code
+*/
+
+void TPM_HmacMidstate_Init(TPM_HMAC_MIDSTATE *tpm_hmac_midstate)
+{
+    memset(tpm_hmac_midstate, 0, sizeof(TPM_HMAC_MIDSTATE));
+    tpm_hmac_midstate->valid = FALSE;
+    return;
+}
+
+/* TPM_HmacMidstate_Set() calculates the inner and outer midstates for 'hmac_key'.
+
+   If the midstates are already valid for 'hmac_key', this is a no-op.  A cached midstate is
+   therefore safe to use with any key.  A different key recalculates it at the same cost as an
+   uncached HMAC.
+*/
+
+TPM_RESULT TPM_HmacMidstate_Set(TPM_HMAC_MIDSTATE *tpm_hmac_midstate,
+				const TPM_SECRET hmac_key)
+{
+    TPM_RESULT		rc = 0;
+    unsigned char	ipad[TPM_HMAC_BLOCK_SIZE];
+    unsigned char	opad[TPM_HMAC_BLOCK_SIZE];
+    size_t		i;
+    TPM_BOOL		cached;
+
+    /* the midstates are already calculated for this key */
+    cached = tpm_hmac_midstate->valid &&
+	     (memcmp(tpm_hmac_midstate->key, hmac_key, TPM_SECRET_SIZE) == 0);
+    if (!cached) {
+	printf(" TPM_HmacMidstate_Set: Calculating midstates\n");
+	tpm_hmac_midstate->valid = FALSE;
+    }
+    /* calculate key XOR ipad and key XOR opad */
+    if ((rc == 0) && !cached) {
+	/* first part, key XOR pad */
+	for (i = 0 ; i < TPM_AUTHDATA_SIZE ; i++) {
+	    ipad[i] = hmac_key[i] ^ 0x36;	/* magic numbers from RFC 2104 */
+	    opad[i] = hmac_key[i] ^ 0x5c;
+	}
+	/* second part, 0x00 XOR pad */
+	memset(ipad + TPM_AUTHDATA_SIZE, 0x36, TPM_HMAC_BLOCK_SIZE - TPM_AUTHDATA_SIZE);
+	memset(opad + TPM_AUTHDATA_SIZE, 0x5c, TPM_HMAC_BLOCK_SIZE - TPM_AUTHDATA_SIZE);
+	rc = TPM_Sha1Context_Init(&(tpm_hmac_midstate->inner));
+    }
+    /* compress one block each, leaving the midstates on a block boundary */
+    if ((rc == 0) && !cached) {
+	rc = TPM_Sha1Context_Update(&(tpm_hmac_midstate->inner), ipad, TPM_HMAC_BLOCK_SIZE);
+    }
+    if ((rc == 0) && !cached) {
+	rc = TPM_Sha1Context_Init(&(tpm_hmac_midstate->outer));
+    }
+    if ((rc == 0) && !cached) {
+	rc = TPM_Sha1Context_Update(&(tpm_hmac_midstate->outer), opad, TPM_HMAC_BLOCK_SIZE);
+    }
+    if ((rc == 0) && !cached) {
+	TPM_Secret_Copy(tpm_hmac_midstate->key, hmac_key);
+	tpm_hmac_midstate->valid = TRUE;
+    }
+    memset(ipad, 0, TPM_HMAC_BLOCK_SIZE);
+    memset(opad, 0, TPM_HMAC_BLOCK_SIZE);
+    return rc;
+}
+
+/* TPM_HmacMidstate_Copy() copies the source to the destination
+ */
+
+void TPM_HmacMidstate_Copy(TPM_HMAC_MIDSTATE *dest_hmac_midstate,
+			   const TPM_HMAC_MIDSTATE *src_hmac_midstate)
+{
+    *dest_hmac_midstate = *src_hmac_midstate;
+    return;
+}
+
+/* TPM_HmacMidstate_Delete()
+
+   zeros the key and midstates
+   calls TPM_HmacMidstate_Init to set members back to default values
+   The object itself is not freed
+*/
+
+void TPM_HmacMidstate_Delete(TPM_HMAC_MIDSTATE *tpm_hmac_midstate)
+{
+    if (tpm_hmac_midstate != NULL) {
+	TPM_HmacMidstate_Init(tpm_hmac_midstate);
+    }
+    return;
+}
+
+/* TPM_HMAC_GenerateMidstate() is TPM_HMAC_Generate() starting from the precalculated midstates of
+   the key.
+
+   The ... arguments are a message list of the form
+	size_t length, unsigned char *buffer
+   terminated by a 0 length
+*/
+
+TPM_RESULT TPM_HMAC_GenerateMidstate(TPM_HMAC tpm_hmac,
+				     const TPM_HMAC_MIDSTATE *tpm_hmac_midstate,
+				     ...)
+{
+    TPM_RESULT		rc = 0;
+    va_list		ap;
+    
+    printf(" TPM_HMAC_GenerateMidstate:\n");
+    va_start(ap, tpm_hmac_midstate);
+    rc = TPM_HMAC_GenerateMidstatevalist(tpm_hmac, tpm_hmac_midstate, ap);
+    va_end(ap);
+    return rc;
+}
+
+/* TPM_HMAC_CheckMidstate() is TPM_HMAC_Check() starting from the precalculated midstates of the
+   key.
+*/
+
+TPM_RESULT TPM_HMAC_CheckMidstate(TPM_BOOL *valid,
+				  TPM_HMAC expect,
+				  const TPM_HMAC_MIDSTATE *tpm_hmac_midstate,
+				  ...)
+{
+    TPM_RESULT		rc = 0;
+    va_list		ap;
+    TPM_HMAC		actual;
+
+    printf(" TPM_HMAC_CheckMidstate:\n");
+    va_start(ap, tpm_hmac_midstate);
+    if (rc == 0) {
+	rc = TPM_HMAC_GenerateMidstatevalist(actual, tpm_hmac_midstate, ap);
+    }
+    if (rc == 0) {
+	rc = TPM_HMAC_Compare(valid, expect, actual);
+    }
+    va_end(ap);
+    return rc;
+}
+
+/* TPM_HMAC_GenerateMidstatevalist() is the internal function, called with the va_list already
+   created.
+
+   The midstates are copied, so that the caller's cache is unchanged.
+*/
+
+static TPM_RESULT TPM_HMAC_GenerateMidstatevalist(TPM_HMAC tpm_hmac,
+						  const TPM_HMAC_MIDSTATE *tpm_hmac_midstate,
+						  va_list ap)
+{
+    TPM_RESULT		rc = 0;
+    TPM_SHA1_CONTEXT	context;		/* caller owned, nothing to free */
+    TPM_DIGEST		inner_hash;
+
+    if (rc == 0) {
+	if (!tpm_hmac_midstate->valid) {
+	    printf("TPM_HMAC_GenerateMidstatevalist: Error (fatal), midstate not set\n");
+	    rc = TPM_FAIL;
+	}
+    }
+    /* calculate the inner hash, continue the key XOR ipad midstate with the text */
+    if (rc == 0) {
+	context = tpm_hmac_midstate->inner;
+	rc = TPM_SHA1_Contextvalist(inner_hash, &context, ap);
+    }
+    if (rc == 0) {
+	rc = TPM_HMAC_Final(tpm_hmac, tpm_hmac_midstate, inner_hash);
+    }
+    return rc;
+}
+
+/* TPM_HMAC_Final() calculates the outer hash, continuing the key XOR opad midstate with the inner
+   hash.
+*/
+
+static TPM_RESULT TPM_HMAC_Final(TPM_HMAC tpm_hmac,
+				 const TPM_HMAC_MIDSTATE *tpm_hmac_midstate,
+				 TPM_DIGEST inner_hash)
+{
+    TPM_RESULT		rc = 0;
+    TPM_SHA1_CONTEXT	context;		/* caller owned, nothing to free */
+
+    if (rc == 0) {
+	context = tpm_hmac_midstate->outer;
+	rc = TPM_Sha1Context_Update(&context, inner_hash, TPM_DIGEST_SIZE);
+    }
+    if (rc == 0) {
+	rc = TPM_Sha1Context_Final(tpm_hmac, &context);
+    }
+    else {
+	memset(&context, 0, sizeof(TPM_SHA1_CONTEXT));
+    }
+    if (rc == 0) {
+	TPM_PrintFour(" TPM_HMAC_Final: HMAC", tpm_hmac);
+    }	 
     return rc;
 }
 
 /* TPM_XOR XOR's 'in1' and 'in2' of 'length', putting the result in 'out'
 
+   'out' may be the same buffer as 'in1' or 'in2', but must not otherwise overlap them.
+
+   The bulk is done 32 bytes at a time with AVX2 if TPM_SHA1Engine_Init() found it, else 16 bytes
+   at a time with SSE2, else a 64 bit word at a time.  The tail is done a byte at a time.
 */
 
 void TPM_XOR(unsigned char *out,
@@ -1245,175 +1629,674 @@ void TPM_XOR(unsigned char *out,
 	     const unsigned char *in2,
 	     size_t length)
 {
-    size_t i;
-    
-    for (i = 0 ; i < length ; i++) {
-	out[i] = in1[i] ^ in2[i];
-    }
+    size_t i = 0;
+    uint64_t word1;
+    uint64_t word2;
+    
+#ifdef TPM_XOR_X86
+    if ((length >= 32) && ((TPM_SHA1Engine_CpuFeatures() & TPM_SHA1_CPU_AVX2) != 0)) {
+	i = TPM_XOR_AVX2(out, in1, in2, length);
+    }
+#endif
+#ifdef __SSE2__
+    for ( ; (i + 16) <= length ; i += 16) {
+	_mm_storeu_si128((__m128i *)(out + i),
+			 _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in1 + i)),
+				       _mm_loadu_si128((const __m128i *)(in2 + i))));
+    }
+#endif
+    /* memcpy() is an unaligned load or store */
+    for ( ; (i + sizeof(uint64_t)) <= length ; i += sizeof(uint64_t)) {
+	memcpy(&word1, in1 + i, sizeof(uint64_t));
+	memcpy(&word2, in2 + i, sizeof(uint64_t));
+	word1 ^= word2;
+	memcpy(out + i, &word1, sizeof(uint64_t));
+    }
+    for ( ; i < length ; i++) {
+	out[i] = in1[i] ^ in2[i];
+    }
+    return;
+}
+
+#ifdef TPM_XOR_X86
+
+/* TPM_XOR_AVX2() XOR's the leading multiple of 32 bytes of 'in1' and 'in2', returning the number
+   of bytes done
+*/
+
+__attribute__((target("avx2")))
+static size_t TPM_XOR_AVX2(unsigned char *out,
+			   const unsigned char *in1,
+			   const unsigned char *in2,
+			   size_t length)
+{
+    size_t i;
+
+    for (i = 0 ; (i + 32) <= length ; i += 32) {
+	_mm256_storeu_si256((__m256i *)(out + i),
+			    _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(in1 + i)),
+					     _mm256_loadu_si256((const __m256i *)(in2 + i))));
+    }
+    _mm256_zeroupper();
+    return i;
+}
+
+#endif
+
+/* TPM_MGF1() generates an MGF1 'array' of length 'arrayLen' from 'seed' of length 'seedlen'
+
+   The openSSL DLL doesn't export MGF1 in Windows or Linux 1.0.0, so this version is created from
+   scratch.
+   
+   Algorithm and comments (not the code) from:
+
+   PKCS #1: RSA Cryptography Specifications Version 2.1 B.2.1 MGF1
+
+   Prototype designed to be compatible with openSSL
+
+   MGF1 is a Mask Generation Function based on a hash function.
+   
+   MGF1 (mgfSeed, maskLen)
+
+   Options:     
+
+   Hash hash function (hLen denotes the length in octets of the hash 
+   function output)
+
+   Input:
+   
+   mgfSeed         seed from which mask is generated, an octet string
+   maskLen         intended length in octets of the mask, at most 2^32(hLen)
+
+   Output:      
+   mask            mask, an octet string of length l; or "mask too long"
+
+   Error:          "mask too long'
+*/
+
+TPM_RESULT TPM_MGF1(unsigned char       *mask,
+                    uint32_t            maskLen,
+                    const unsigned char *mgfSeed,
+                    uint32_t		mgfSeedlen)
+{
+    TPM_RESULT 		rc = 0;
+    TPM_MGF1_CONTEXT	tpm_mgf1_context;
+    
+    printf(" TPM_MGF1: Output length %u\n", maskLen);
+    TPM_Mgf1Context_Init(&tpm_mgf1_context);		/* freed @1 */
+    if (rc == 0) {
+        /* this is possible with arrayLen on a 64 bit architecture, comment to quiet beam */
+        if ((maskLen / TPM_DIGEST_SIZE) > 0xffffffff) {        /*constant condition*/
+            printf(" TPM_MGF1: Error (fatal), Output length too large for 32 bit counter\n");
+            rc = TPM_FAIL;              /* should never occur */
+        }
+    }
+    /* 1.If l > 2^32(hLen), output "mask too long" and stop. */
+    /* NOTE Checked by caller */
+    /* 2. Let T be the empty octet string. */
+    if (rc == 0) {
+	rc = TPM_Mgf1Context_Set(&tpm_mgf1_context,
+				 mgfSeedlen,
+				 mgfSeedlen, mgfSeed,
+				 0, NULL);
+    }
+    /* 3. For counter from 0 to [masklen/hLen] - 1, do the following: */
+    /* a. Convert counter to an octet string C of length 4 octets - see Section 4.1 */
+    /* b.Concatenate the hash of the seed mgfSeed and C to the octet string T: */
+    /* T = T || Hash (mgfSeed || C) */
+    /* 4.Output the leading l octets of T as the octet string mask. */
+    if (rc == 0) {
+	rc = TPM_Mgf1Context_Generate(&tpm_mgf1_context, mask, maskLen);
+    }
+    TPM_Mgf1Context_Delete(&tpm_mgf1_context);		/* @1 */
+    return rc;
+}
+
+/* TPM_MGF1_GenerateArray() generates an array of length arrayLen using the varargs as the seed.
+
+   Since the seed is a known length, it is passed in rather that extracted from the varargs.  If the
+   seed length turns out to be wrong once the varargs are parsed, TPM_FAIL is returned.
+
+   'array' must be freed by the caller.
+*/
+
+TPM_RESULT TPM_MGF1_GenerateArray(unsigned char **array,
+				  uint32_t arrayLen,
+				  uint32_t seedLen,
+				  ...)
+{
+    TPM_RESULT		rc = 0;
+    va_list		ap;
+    TPM_MGF1_CONTEXT	tpm_mgf1_context;
+
+    printf(" TPM_MGF1_GenerateArray: arrayLen %u seedLen %u\n", arrayLen, seedLen);
+    TPM_Mgf1Context_Init(&tpm_mgf1_context);		/* freed @1 */
+    *array = NULL;		/* freed by caller */
+    /* hash the seed */
+    if (rc == 0) {
+	va_start(ap, seedLen);
+	rc = TPM_Mgf1Context_Setvalist(&tpm_mgf1_context, seedLen, ap);
+	va_end(ap);
+    }
+    /* allocate memory for the array */
+    if (rc == 0) {
+	rc = TPM_Malloc(array, arrayLen);
+    }
+    /* generate the MGF1 array */
+    if (rc == 0) {
+	rc = TPM_Mgf1Context_Generate(&tpm_mgf1_context, *array, arrayLen);
+    }
+    if (rc == 0) {
+	TPM_PrintFour("  TPM_MGF1_GenerateArray: MGF1", *array);
+    }
+    TPM_Mgf1Context_Delete(&tpm_mgf1_context);		/* @1 */
+    return rc;
+}
+
+/* TPM_Mgf1Context_Init()
+
+   sets members to default values
+   always succeeds - no return code
+*/
+
+void TPM_Mgf1Context_Init(TPM_MGF1_CONTEXT *tpm_mgf1_context)
+{
+    memset(tpm_mgf1_context, 0, sizeof(TPM_MGF1_CONTEXT));
+    return;
+}
+
+/* TPM_Mgf1Context_Set() starts an MGF1 mask from the seed in the varargs.  The seed is hashed once,
+   and the mask starts at counter 0.
+
+   The ... arguments are the seed, a list of the form
+	uint32_t length, unsigned char *buffer
+   terminated by a 0 length.  If the total is not 'seedLen', TPM_FAIL is returned.
+*/
+
+TPM_RESULT TPM_Mgf1Context_Set(TPM_MGF1_CONTEXT *tpm_mgf1_context,
+			       uint32_t seedLen,
+			       ...)
+{
+    TPM_RESULT		rc = 0;
+    va_list		ap;
+
+    va_start(ap, seedLen);
+    rc = TPM_Mgf1Context_Setvalist(tpm_mgf1_context, seedLen, ap);
+    va_end(ap);
+    return rc;
+}
+
+/* TPM_Mgf1Context_Setvalist() is the internal function, called with the va_list already created.
+ */
+
+static TPM_RESULT TPM_Mgf1Context_Setvalist(TPM_MGF1_CONTEXT *tpm_mgf1_context,
+					    uint32_t seedLen,
+					    va_list ap)
+{
+    TPM_RESULT		rc = 0;
+    uint32_t		vaLength;	/* next seed segment length */
+    unsigned char	*vaBuffer;	/* next seed segment buffer */
+    uint32_t		seedLeft;	/* remaining seed bytes required */
+    TPM_BOOL		done = FALSE;	/* done when a vaLength == 0 is reached */
+
+    TPM_Mgf1Context_Delete(tpm_mgf1_context);
+    seedLeft = seedLen;
+    if (rc == 0) {
+	rc = TPM_Sha1Context_Init(&(tpm_mgf1_context->seed));
+    }
+    /* hash the seed */
+    while ((rc == 0) && !done) {
+	vaLength = va_arg(ap, uint32_t);		/* first vararg is the length */
+	if (vaLength != 0) {			/* loop until a zero length argument terminates */
+	    if (rc == 0) {
+		printf("  TPM_Mgf1Context_Set: Appending %u bytes\n", vaLength);
+		if (vaLength > seedLeft) {
+		    printf("TPM_Mgf1Context_Set: Error (fatal), seedLen too small\n");
+		    rc = TPM_FAIL;	/* internal error, should never occur */
+		}
+	    }
+	    if (rc == 0) {
+		vaBuffer = va_arg(ap, unsigned char *); /* second vararg is the array */
+		rc = TPM_Sha1Context_Update(&(tpm_mgf1_context->seed), vaBuffer, vaLength);
+		seedLeft-= vaLength;
+	    }
+	}
+	else {
+	    done = TRUE;
+	    if (seedLeft != 0) {
+		printf("TPM_Mgf1Context_Set: Error (fatal), seedLen too large by %u\n",
+		       seedLeft);
+		rc = TPM_FAIL;	/* internal error, should never occur */
+	    }
+	}
+    }
+    if (rc != 0) {
+	TPM_Mgf1Context_Delete(tpm_mgf1_context);
+    }
+    return rc;
+}
+
+/* TPM_Mgf1Context_Generate() returns the next 'maskLen' bytes of the MGF1 mask.
+
+   The mask is a stream.  Consecutive calls return consecutive parts of the same mask.
+*/
+
+TPM_RESULT TPM_Mgf1Context_Generate(TPM_MGF1_CONTEXT *tpm_mgf1_context,
+				    unsigned char *mask,
+				    uint32_t maskLen)
+{
+    TPM_RESULT		rc = 0;
+
+    rc = TPM_Mgf1Context_Stream(tpm_mgf1_context, mask, NULL, maskLen);
+    return rc;
+}
+
+/* TPM_Mgf1Context_Xor() XOR's 'in' of 'length' with the next bytes of the MGF1 mask, putting the
+   result in 'out'.  'out' and 'in' may be the same buffer.
+
+   This encrypts or decrypts a large buffer without allocating the whole mask.
+*/
+
+TPM_RESULT TPM_Mgf1Context_Xor(TPM_MGF1_CONTEXT *tpm_mgf1_context,
+			       unsigned char *out,
+			       const unsigned char *in,
+			       uint32_t length)
+{
+    TPM_RESULT		rc = 0;
+
+    rc = TPM_Mgf1Context_Stream(tpm_mgf1_context, out, in, length);
+    return rc;
+}
+
+/* TPM_Mgf1Context_Stream() is the common code for TPM_Mgf1Context_Generate() and
+   TPM_Mgf1Context_Xor().  If 'in' is NULL, the mask is copied to 'out', else it is XOR'ed with
+   'in'.
+
+   The mask is generated up to TPM_SHA1_LANES counter blocks at a time, but no more blocks than
+   this call needs, so that a short mask does not pay for unused blocks.
+*/
+
+static TPM_RESULT TPM_Mgf1Context_Stream(TPM_MGF1_CONTEXT *tpm_mgf1_context,
+					 unsigned char *out,
+					 const unsigned char *in,
+					 uint32_t length)
+{
+    TPM_RESULT		rc = 0;
+    uint32_t		blocks;		/* counter blocks to generate */
+    uint32_t		chunk;		/* mask bytes used this pass */
+
+    while ((rc == 0) && (length > 0)) {
+	/* generate more of the mask */
+	if (tpm_mgf1_context->maskOffset == tpm_mgf1_context->maskLength) {
+	    blocks = (length + TPM_DIGEST_SIZE - 1) / TPM_DIGEST_SIZE;
+	    if (blocks > TPM_SHA1_LANES) {
+		blocks = TPM_SHA1_LANES;
+	    }
+	    rc = TPM_Sha1Context_FinalCounters(tpm_mgf1_context->mask,
+					       &(tpm_mgf1_context->seed),
+					       tpm_mgf1_context->counter,
+					       blocks);
+	    tpm_mgf1_context->counter += blocks;
+	    tpm_mgf1_context->maskOffset = 0;
+	    tpm_mgf1_context->maskLength = blocks * TPM_DIGEST_SIZE;
+	}
+	if (rc == 0) {
+	    chunk = tpm_mgf1_context->maskLength - tpm_mgf1_context->maskOffset;
+	    if (chunk > length) {
+		chunk = length;
+	    }
+	    if (in == NULL) {
+		memcpy(out, tpm_mgf1_context->mask + tpm_mgf1_context->maskOffset, chunk);
+	    }
+	    else {
+		TPM_XOR(out, in, tpm_mgf1_context->mask + tpm_mgf1_context->maskOffset, chunk);
+		in += chunk;
+	    }
+	    out += chunk;
+	    length -= chunk;
+	    tpm_mgf1_context->maskOffset += chunk;
+	}
+    }
+    return rc;
+}
+
+/* TPM_Mgf1Context_Delete()
+
+   zeros the seed state and the generated mask
+   The object itself is not freed
+*/
+
+void TPM_Mgf1Context_Delete(TPM_MGF1_CONTEXT *tpm_mgf1_context)
+{
+    if (tpm_mgf1_context != NULL) {
+	TPM_Mgf1Context_Init(tpm_mgf1_context);
+    }
+    return;
+}
+
+/*
+  Random number generator
+*/
+
+/* TPM_Random_GetDrbg() returns the DRBG of the TPM instance, or NULL if there is no instance yet.
+
+   The callers of TPM_Random() take no tpm_state.  TPMS_MAX is 1, so the instance is
+   tpm_instances[0].  It is set once TPM_MainInit() has initialized it.
+*/
+
+static TPM_DRBG_CONTEXT *TPM_Random_GetDrbg(void)
+{
+    TPM_DRBG_CONTEXT	*tpm_drbg = NULL;
+
+    if (tpm_instances[0] != NULL) {
+	tpm_drbg = &(tpm_instances[0]->tpm_drbg_context);
+    }
+    return tpm_drbg;
+}
+
+/* TPM_Random() fills 'buffer' with 'bytes' bytes.
+
+   The bytes are served from the prefetch buffer of the TPM instance DRBG, so that the typical 20
+   byte nonce request does not call the crypto library.  The DRBG is instantiated on first use and
+   reseeded from the crypto library every TPM_DRBG_RESEED_INTERVAL prefetches.
+
+   Before the instance exists, e.g. during the TPM_MainInit() self tests, the bytes come directly
+   from the crypto library.
+*/
+
+TPM_RESULT TPM_Random(BYTE *buffer, size_t bytes)
+{
+    TPM_RESULT		rc = 0;
+    TPM_DRBG_CONTEXT	*tpm_drbg = TPM_Random_GetDrbg();
+    size_t		length;
+
+    printf(" TPM_Random: Requesting %lu bytes\n", (unsigned long)bytes);
+    /* no instance yet, use the crypto library */
+    if ((rc == 0) && (tpm_drbg == NULL)) {
+	rc = TPM_Entropy_Get(buffer, bytes);
+	bytes = 0;
+    }
+    if ((rc == 0) && (tpm_drbg != NULL) && !tpm_drbg->instantiated) {
+	rc = TPM_Random_Reseed(tpm_drbg, NULL, 0);
+    }
+    while ((rc == 0) && (bytes > 0)) {
+	/* refill the prefetch buffer */
+	if (tpm_drbg->bufferOffset == tpm_drbg->bufferLength) {
+	    if (tpm_drbg->reseedCounter > TPM_DRBG_RESEED_INTERVAL) {
+		rc = TPM_Random_Reseed(tpm_drbg, NULL, 0);
+	    }
+	    if (rc == 0) {
+		rc = TPM_DrbgContext_Generate(tpm_drbg,
+					      tpm_drbg->buffer, TPM_DRBG_BUFFER_SIZE);
+	    }
+	    if (rc == 0) {
+		tpm_drbg->bufferOffset = 0;
+		tpm_drbg->bufferLength = TPM_DRBG_BUFFER_SIZE;
+	    }
+	}
+	/* serve from the prefetch buffer, zeroing what was served */
+	if (rc == 0) {
+	    length = tpm_drbg->bufferLength - tpm_drbg->bufferOffset;
+	    if (length > bytes) {
+		length = bytes;
+	    }
+	    memcpy(buffer, tpm_drbg->buffer + tpm_drbg->bufferOffset, length);
+	    memset(tpm_drbg->buffer + tpm_drbg->bufferOffset, 0, length);
+	    tpm_drbg->bufferOffset += length;
+	    buffer += length;
+	    bytes -= length;
+	}
+    }
+    return rc;
+}
+
+/* TPM_StirRandomCmd() adds the supplied entropy to the random number generator
+
+   The data is mixed into the crypto library RNG, and the instance DRBG is reseeded with it as
+   additional input.  The prefetched output is discarded, so that all later output depends on the
+   data.
+*/
+
+TPM_RESULT TPM_StirRandomCmd(TPM_SIZED_BUFFER *inData)
+{
+    TPM_RESULT		rc = 0;
+    TPM_DRBG_CONTEXT	*tpm_drbg = TPM_Random_GetDrbg();
+
+    printf(" TPM_StirRandomCmd:\n");
+    if (rc == 0) {
+	rc = TPM_Entropy_Add(inData->buffer, inData->size);
+    }
+    if ((rc == 0) && (tpm_drbg != NULL) && !tpm_drbg->instantiated) {
+	rc = TPM_Random_Reseed(tpm_drbg, NULL, 0);
+    }
+    if ((rc == 0) && (tpm_drbg != NULL)) {
+	rc = TPM_Random_Reseed(tpm_drbg, inData->buffer, inData->size);
+    }
+    return rc;
+}
+
+/* TPM_Random_Reseed() gets fresh entropy from the crypto library and instantiates or reseeds the
+   TPM_Random() DRBG 'tpm_drbg'.  'additional' is optional additional input for the reseed.
+*/
+
+static TPM_RESULT TPM_Random_Reseed(TPM_DRBG_CONTEXT *tpm_drbg,
+				    const unsigned char *additional,
+				    uint32_t additional_length)
+{
+    TPM_RESULT		rc = 0;
+    unsigned char	entropy[TPM_DRBG_SEED_SIZE];
+
+    printf(" TPM_Random_Reseed:\n");
+    if (rc == 0) {
+	rc = TPM_Entropy_Get(entropy, sizeof(entropy));
+    }
+    if (rc == 0) {
+	if (!tpm_drbg->instantiated) {
+	    rc = TPM_DrbgContext_Instantiate(tpm_drbg, entropy, sizeof(entropy));
+	}
+	else {
+	    rc = TPM_DrbgContext_Reseed(tpm_drbg, entropy, sizeof(entropy),
+					additional, additional_length);
+	}
+    }
+    memset(entropy, 0, sizeof(entropy));
+    return rc;
+}
+
+/*
+  HMAC_DRBG
+*/
+
+/* TPM_DrbgContext_Init()
+
+   sets members to default values
+   always succeeds - no return code
+*/
+
+void TPM_DrbgContext_Init(TPM_DRBG_CONTEXT *tpm_drbg_context)
+{
+    memset(tpm_drbg_context, 0, sizeof(TPM_DRBG_CONTEXT));
+    TPM_HmacMidstate_Init(&(tpm_drbg_context->key));
+    tpm_drbg_context->instantiated = FALSE;
     return;
 }
 
-/* TPM_MGF1() generates an MGF1 'array' of length 'arrayLen' from 'seed' of length 'seedlen'
+/* TPM_DrbgContext_Instantiate() seeds the DRBG with 'seed', the entropy input and nonce.
 
-   The openSSL DLL doesn't export MGF1 in Windows or Linux 1.0.0, so this version is created from
-   scratch.
-   
-   Algorithm and comments (not the code) from:
+   SP 800-90A 10.1.2.3 HMAC_DRBG_Instantiate_algorithm
+*/
 
-   PKCS #1: RSA Cryptography Specifications Version 2.1 B.2.1 MGF1
+TPM_RESULT TPM_DrbgContext_Instantiate(TPM_DRBG_CONTEXT *tpm_drbg_context,
+				       const unsigned char *seed,
+				       uint32_t seed_length)
+{
+    TPM_RESULT		rc = 0;
+    TPM_SECRET		key;
 
-   Prototype designed to be compatible with openSSL
+    printf(" TPM_DrbgContext_Instantiate:\n");
+    TPM_DrbgContext_Init(tpm_drbg_context);
+    /* K = 0x00 00...00, V = 0x01 01...01 */
+    if (rc == 0) {
+	memset(key, 0x00, TPM_SECRET_SIZE);
+	memset(tpm_drbg_context->value, 0x01, TPM_DIGEST_SIZE);
+	rc = TPM_HmacMidstate_Set(&(tpm_drbg_context->key), key);
+    }
+    if (rc == 0) {
+	rc = TPM_DrbgContext_Update(tpm_drbg_context, seed, seed_length, NULL, 0);
+    }
+    if (rc == 0) {
+	tpm_drbg_context->reseedCounter = 1;
+	tpm_drbg_context->instantiated = TRUE;
+    }
+    return rc;
+}
 
-   MGF1 is a Mask Generation Function based on a hash function.
-   
-   MGF1 (mgfSeed, maskLen)
+/* TPM_DrbgContext_Reseed() reseeds the DRBG with 'entropy' and the optional 'additional' input.
+   The prefetched output is discarded.
 
-   Options:     
+   SP 800-90A 10.1.2.4 HMAC_DRBG_Reseed_algorithm
+*/
 
-   Hash hash function (hLen denotes the length in octets of the hash 
-   function output)
+TPM_RESULT TPM_DrbgContext_Reseed(TPM_DRBG_CONTEXT *tpm_drbg_context,
+				  const unsigned char *entropy,
+				  uint32_t entropy_length,
+				  const unsigned char *additional,
+				  uint32_t additional_length)
+{
+    TPM_RESULT		rc = 0;
 
-   Input:
-   
-   mgfSeed         seed from which mask is generated, an octet string
-   maskLen         intended length in octets of the mask, at most 2^32(hLen)
+    printf(" TPM_DrbgContext_Reseed:\n");
+    if (rc == 0) {
+	rc = TPM_DrbgContext_Update(tpm_drbg_context,
+				    entropy, entropy_length,
+				    additional, additional_length);
+    }
+    if (rc == 0) {
+	tpm_drbg_context->reseedCounter = 1;
+    }
+    memset(tpm_drbg_context->buffer, 0, TPM_DRBG_BUFFER_SIZE);
+    tpm_drbg_context->bufferOffset = 0;
+    tpm_drbg_context->bufferLength = 0;
+    return rc;
+}
 
-   Output:      
-   mask            mask, an octet string of length l; or "mask too long"
+/* TPM_DrbgContext_Generate() fills 'output' with 'length' bytes of DRBG output.  It does not use
+   the prefetch buffer.
 
-   Error:          "mask too long'
+   SP 800-90A 10.1.2.5 HMAC_DRBG_Generate_algorithm, without additional input
 */
 
-TPM_RESULT TPM_MGF1(unsigned char       *mask,
-                    uint32_t            maskLen,
-                    const unsigned char *mgfSeed,
-                    uint32_t		mgfSeedlen)
+TPM_RESULT TPM_DrbgContext_Generate(TPM_DRBG_CONTEXT *tpm_drbg_context,
+				    unsigned char *output,
+				    uint32_t length)
 {
-    TPM_RESULT 		rc = 0;
-    unsigned char       counter[4];     /* 4 octets */
-    uint32_t	        count;          /* counter as an integral type */
-    uint32_t		outLen;
-    TPM_DIGEST          lastDigest;     
-    
-    printf(" TPM_MGF1: Output length %u\n", maskLen);
+    TPM_RESULT		rc = 0;
+    uint32_t		copy_length;
+
+    printf(" TPM_DrbgContext_Generate: Length %u\n", length);
     if (rc == 0) {
-        /* this is possible with arrayLen on a 64 bit architecture, comment to quiet beam */
-        if ((maskLen / TPM_DIGEST_SIZE) > 0xffffffff) {        /*constant condition*/
-            printf(" TPM_MGF1: Error (fatal), Output length too large for 32 bit counter\n");
-            rc = TPM_FAIL;              /* should never occur */
-        }
-    }
-    /* 1.If l > 2^32(hLen), output "mask too long" and stop. */
-    /* NOTE Checked by caller */
-    /* 2. Let T be the empty octet string. */
-    /* 3. For counter from 0 to [masklen/hLen] - 1, do the following: */
-    for (count = 0, outLen = 0 ; (rc == 0) && (outLen < maskLen) ; count++) {
-	/* a. Convert counter to an octet string C of length 4 octets - see Section 4.1 */
-	/* C = I2OSP(counter, 4) NOTE Basically big endian */
-        uint32_t count_n = htonl(count);
-	memcpy(counter, &count_n, 4);
-	/* b.Concatenate the hash of the seed mgfSeed and C to the octet string T: */
-	/* T = T || Hash (mgfSeed || C) */
-	/* If the entire digest is needed for the mask */
-	if ((outLen + TPM_DIGEST_SIZE) < maskLen) {
-	    rc = TPM_SHA1(mask + outLen,
-			  mgfSeedlen, mgfSeed,
-			  4, counter,
-			  0, NULL);
-	    outLen += TPM_DIGEST_SIZE;
+	if (!tpm_drbg_context->instantiated ||
+	    (tpm_drbg_context->reseedCounter > TPM_DRBG_RESEED_INTERVAL)) {
+	    printf("TPM_DrbgContext_Generate: Error (fatal), DRBG requires a reseed\n");
+	    rc = TPM_FAIL;
 	}
-	/* if the mask is not modulo TPM_DIGEST_SIZE, only part of the final digest is needed */
-	else {
-	    /* hash to a temporary digest variable */
-	    rc = TPM_SHA1(lastDigest,
-			  mgfSeedlen, mgfSeed,
-			  4, counter,
-			  0, NULL);
-	    /* copy what's needed */
-	    memcpy(mask + outLen, lastDigest, maskLen - outLen);
-	    outLen = maskLen;           /* outLen = outLen + maskLen - outLen */
+    }
+    /* V = HMAC (K, V), output the V blocks */
+    while ((rc == 0) && (length > 0)) {
+	rc = TPM_HMAC_GenerateMidstate(tpm_drbg_context->value,
+				       &(tpm_drbg_context->key),
+				       TPM_DIGEST_SIZE, tpm_drbg_context->value,
+				       0, NULL);
+	if (rc == 0) {
+	    copy_length = (length < TPM_DIGEST_SIZE) ? length : TPM_DIGEST_SIZE;
+	    memcpy(output, tpm_drbg_context->value, copy_length);
+	    output += copy_length;
+	    length -= copy_length;
 	}
     }
-    /* 4.Output the leading l octets of T as the octet string mask. */
+    if (rc == 0) {
+	rc = TPM_DrbgContext_Update(tpm_drbg_context, NULL, 0, NULL, 0);
+    }
+    if (rc == 0) {
+	tpm_drbg_context->reseedCounter++;
+    }
     return rc;
 }
 
-/* TPM_MGF1_GenerateArray() generates an array of length arrayLen using the varargs as the seed.
-
-   Since the seed is a known length, it is passed in rather that extracted from the varargs.  If the
-   seed length turns out to be wrong once the varargs are parsed, TPM_FAIL is returned.
+/* TPM_DrbgContext_Update() updates K and V with the provided data, the concatenation of 'data1'
+   and 'data2'.
 
-   'array' must be freed by the caller.
+   SP 800-90A 10.1.2.2 HMAC_DRBG_Update
 */
 
-TPM_RESULT TPM_MGF1_GenerateArray(unsigned char **array,
-				  uint32_t arrayLen,
-				  uint32_t seedLen,
-				  ...)
+static TPM_RESULT TPM_DrbgContext_Update(TPM_DRBG_CONTEXT *tpm_drbg_context,
+					 const unsigned char *data1,
+					 uint32_t length1,
+					 const unsigned char *data2,
+					 uint32_t length2)
 {
     TPM_RESULT		rc = 0;
-    va_list		ap;
-    unsigned char	*seed;		/* constructed MGF1 seed */
-    size_t		vaLength;	/* next seed segment length */
-    unsigned char	*vaBuffer;	/* next seed segment buffer */
-    uint32_t		seedLeft;	/* remaining seed bytes required */
-    unsigned char	*seedBuffer;	/* running pointer to the seed array */
-    TPM_BOOL		done = FALSE;	/* done when a vaLength == 0 is reached */
+    TPM_SHA1_CONTEXT	context;		/* caller owned, nothing to free */
+    TPM_DIGEST		inner_hash;
+    TPM_SECRET		key;
+    unsigned char	separator;
+    TPM_BOOL		done = FALSE;
 
-    printf(" TPM_MGF1_GenerateArray: arrayLen %u seedLen %u\n", arrayLen, seedLen);
-    seed = NULL;		/* freed @1 */
-    *array = NULL;		/* freed by caller */
-    va_start(ap, seedLen);
-    /* allocate temporary memory for the seed */
-    if (rc == 0) {
-	rc = TPM_Malloc(&seed, seedLen);
-	seedBuffer = seed;
-	seedLeft = seedLen;
-    }
-    /* construct the seed */
-    while ((rc == 0) && !done) {
-	vaLength = (size_t)va_arg(ap, uint32_t);		/* first vararg is the length */
-	if (vaLength != 0) {			/* loop until a zero length argument terminates */
-	    if (rc == 0) {
-		printf("  TPM_MGF1_GenerateArray: Appending %lu bytes\n", (unsigned long)vaLength);
-		if (vaLength > seedLeft) {
-		    printf("TPM_MGF1_GenerateArray: Error (fatal), seedLen too small\n");
-		    rc = TPM_FAIL;	/* internal error, should never occur */
-		}
-	    }
-	    if (rc == 0) {
-		vaBuffer = va_arg(ap, unsigned char *); /* second vararg is the array */
-		memcpy(seedBuffer, vaBuffer, vaLength);
-		seedBuffer += vaLength;
-		seedLeft-= vaLength;
-	    }
+    /* the 0x00 round always, the 0x01 round only if there is provided data */
+    for (separator = 0x00 ; (rc == 0) && !done ; separator++) {
+	/* K = HMAC (K, V || separator || provided_data) */
+	context = tpm_drbg_context->key.inner;
+	rc = TPM_Sha1Context_Update(&context, tpm_drbg_context->value, TPM_DIGEST_SIZE);
+	if (rc == 0) {
+	    rc = TPM_Sha1Context_Update(&context, &separator, 1);
+	}
+	if ((rc == 0) && (length1 != 0)) {
+	    rc = TPM_Sha1Context_Update(&context, data1, length1);
+	}
+	if ((rc == 0) && (length2 != 0)) {
+	    rc = TPM_Sha1Context_Update(&context, data2, length2);
+	}
+	if (rc == 0) {
+	    rc = TPM_Sha1Context_Final(inner_hash, &context);
 	}
 	else {
-	    done = TRUE;
-	    if (seedLeft != 0) {
-		printf("TPM_MGF1_GenerateArray: Error (fatal), seedLen too large by %u\n",
-		       seedLeft);
-		rc = TPM_FAIL;	/* internal error, should never occur */
-	    }
+	    memset(&context, 0, sizeof(TPM_SHA1_CONTEXT));
 	}
+	if (rc == 0) {
+	    rc = TPM_HMAC_Final(key, &(tpm_drbg_context->key), inner_hash);
+	}
+	if (rc == 0) {
+	    rc = TPM_HmacMidstate_Set(&(tpm_drbg_context->key), key);
+	}
+	/* V = HMAC (K, V) */
+	if (rc == 0) {
+	    rc = TPM_HMAC_GenerateMidstate(tpm_drbg_context->value,
+					   &(tpm_drbg_context->key),
+					   TPM_DIGEST_SIZE, tpm_drbg_context->value,
+					   0, NULL);
+	}
+	done = (separator == 0x01) || ((length1 == 0) && (length2 == 0));
     }
-    /* allocate memory for the array */
-    if (rc == 0) {
-	rc = TPM_Malloc(array, arrayLen);
-    }
-    /* generate the MGF1 array */
-    if (rc == 0) {
-	TPM_MGF1(*array,
-		 arrayLen,
-		 seed,
-		 seedLen);
-	TPM_PrintFour("  TPM_MGF1_GenerateArray: MGF1", *array);
-    }
-    va_end(ap);
-    free(seed);		/* @1 */
+    memset(inner_hash, 0, TPM_DIGEST_SIZE);
+    memset(key, 0, TPM_SECRET_SIZE);
     return rc;
 }
 
+/* TPM_DrbgContext_Delete()
+
+   zeros the DRBG state and the prefetched output
+   The object itself is not freed
+*/
+
+void TPM_DrbgContext_Delete(TPM_DRBG_CONTEXT *tpm_drbg_context)
+{
+    if (tpm_drbg_context != NULL) {
+	TPM_HmacMidstate_Delete(&(tpm_drbg_context->key));
+	TPM_DrbgContext_Init(tpm_drbg_context);
+    }
+    return;
+}
+
 /* TPM_bn2binMalloc() allocates a buffer 'bin' and loads it from 'bn'.
    'bytes' is set to the allocated size of 'bin'.
 
@@ -1587,10 +2470,7 @@ TPM_RESULT TPM_RSAPrivateDecryptH(unsigned char *decrypt_data,	/* decrypted data
     TPM_RESULT		rc = 0;
     unsigned char	*narr;		/* public modulus */
     uint32_t		nbytes;
-    unsigned char	*earr;		/* public exponent */
-    uint32_t		ebytes;
-    unsigned char	*darr;		/* private exponent */
-    uint32_t		dbytes;
+    void		*rsa_pri_token;	/* private key token, cached in the TPM_KEY */
 
     printf(" TPM_RSAPrivateDecryptH: Data size %u bytes\n", encrypt_data_size);
     TPM_PrintFour("  TPM_RSAPrivateDecryptH: Encrypt data", encrypt_data);
@@ -1604,13 +2484,9 @@ TPM_RESULT TPM_RSAPrivateDecryptH(unsigned char *decrypt_data,	/* decrypted data
     if (rc == 0) {
 	rc = TPM_Key_GetPublicKey(&nbytes, &narr, tpm_key);
     }	
-    /* extract the private key from TPM_KEY */
-    if (rc == 0) {
-	rc = TPM_Key_GetPrivateKey(&dbytes, &darr, tpm_key);
-    }
-    /* extract the exponent from TPM_KEY */
+    /* get the prepared private key from TPM_KEY */
     if (rc == 0) {
-	rc = TPM_Key_GetExponent(&ebytes, &earr, tpm_key);
+	rc = TPM_Key_GetPrivateKeyToken(&rsa_pri_token, tpm_key);
     }
     /* check the key size vs the data size */
     if (rc == 0) {
@@ -1623,23 +2499,16 @@ TPM_RESULT TPM_RSAPrivateDecryptH(unsigned char *decrypt_data,	/* decrypted data
     if (rc == 0) {
 	/* debug printing */
 	printf("  TPM_RSAPrivateDecryptH: Public key length %u\n", nbytes);
-	printf("  TPM_RSAPrivateDecryptH: Private key length %u\n", dbytes);
 	TPM_PrintFour("  TPM_RSAPrivateDecryptH: Public key", narr);
-	printf("  TPM_RSAPrivateDecryptH: Exponent %02x %02x %02x\n", earr[0], earr[1], earr[2]);
-	TPM_PrintFour("  TPM_RSAPrivateDecryptH: Private key", darr);
 	/* decrypt with private key */
-	rc = TPM_RSAPrivateDecrypt(decrypt_data,	/* decrypted data */
-				   decrypt_data_length, /* length of data put into decrypt_data */
-				   decrypt_data_size,	/* size of decrypt_data buffer */
-				   tpm_key->algorithmParms.encScheme,	/* encryption scheme */
-				   encrypt_data,	/* encrypted data */
-				   encrypt_data_size,
-				   narr,		/* public modulus */
-				   nbytes,
-				   earr,		/* public exponent */
-				   ebytes,
-				   darr,		/* private exponent */
-				   dbytes);
+	rc = TPM_RSAPrivateDecryptToken(decrypt_data,	/* decrypted data */
+					decrypt_data_length, /* length of data put into
+								decrypt_data */
+					decrypt_data_size,	/* size of decrypt_data buffer */
+					tpm_key->algorithmParms.encScheme,	/* encryption scheme */
+					encrypt_data,	/* encrypted data */
+					encrypt_data_size,
+					rsa_pri_token);	/* private key token */
     }
     if (rc == 0) {
 	TPM_PrintFour(" TPM_RSAPrivateDecryptH: Decrypt data", decrypt_data);
@@ -1685,6 +2554,7 @@ TPM_RESULT TPM_RSAPublicEncrypt_Key(TPM_SIZED_BUFFER *enc_data,
     uint32_t		nbytes;
     unsigned char	*earr;		 /* public exponent */
     uint32_t		ebytes;
+    void		*rsa_pub_token;	 /* public key token, cached in the TPM_KEY */
     
     printf(" TPM_RSAPublicEncrypt_Key: Data size %lu bytes\n", (unsigned long)decrypt_data_size);
     if (rc == 0) {
@@ -1701,6 +2571,10 @@ TPM_RESULT TPM_RSAPublicEncrypt_Key(TPM_SIZED_BUFFER *enc_data,
     if (rc == 0) {
 	rc = TPM_Key_GetExponent(&ebytes, &earr, tpm_key);
     }
+    /* get the prepared public key from TPM_KEY */
+    if (rc == 0) {
+	rc = TPM_Key_GetPublicKeyToken(&rsa_pub_token, tpm_key);
+    }
     if (rc == 0) {
 	rc = TPM_RSAPublicEncrypt_Common(enc_data,
 					 decrypt_data,
@@ -1709,7 +2583,8 @@ TPM_RESULT TPM_RSAPublicEncrypt_Key(TPM_SIZED_BUFFER *enc_data,
 					 narr,
 					 nbytes,
 					 earr,
-					 ebytes);
+					 ebytes,
+					 rsa_pub_token);
     }
     return rc;
 }
@@ -1752,13 +2627,16 @@ TPM_RESULT TPM_RSAPublicEncrypt_Pubkey(TPM_SIZED_BUFFER *enc_data,
 					 narr,
 					 nbytes,
 					 earr,
-					 ebytes);
+					 ebytes,
+					 NULL);		/* no cached token */
     }
     return rc;
 }
 
 /* TPM_RSAPublicEncrypt_Key() encrypts 'buffer' of 'length' using the public key modulus and
    exponent, and puts the results in 'encData'
+
+   If 'rsa_pub_token' is not NULL, it is the prepared public key for n, e and is used instead.
 */
 
 TPM_RESULT TPM_RSAPublicEncrypt_Common(TPM_SIZED_BUFFER *enc_data,
@@ -1768,11 +2646,11 @@ TPM_RESULT TPM_RSAPublicEncrypt_Common(TPM_SIZED_BUFFER *enc_data,
 				       unsigned char	*narr,		 /* public modulus */
 				       uint32_t 	nbytes,
 				       unsigned char	*earr,		 /* public exponent */
-				       uint32_t 	ebytes)
+				       uint32_t 	ebytes,
+				       void		*rsa_pub_token)	 /* prepared n, e, or NULL */
 
 {
     TPM_RESULT		rc = 0;
-    unsigned char	*encrypt_data = NULL;
     
     printf(" TPM_RSAPublicEncrypt_Common: Data size %lu bytes\n", (unsigned long)decrypt_data_size);
     TPM_PrintFour(" TPM_RSAPublicEncrypt_Common: Decrypt data", decrypt_data);
@@ -1784,32 +2662,40 @@ TPM_RESULT TPM_RSAPublicEncrypt_Common(TPM_SIZED_BUFFER *enc_data,
 	    rc = TPM_BAD_DATASIZE;
 	}
     }
-    /* allocate an array for the encrypted data */
+    /* size the sized buffer for the encrypted data, which is encrypted directly into it */
     if (rc == 0) {
-	rc = TPM_Malloc(&encrypt_data, nbytes);
+	rc = TPM_Arena_Realloc(enc_data->arena, &(enc_data->buffer), enc_data->size, nbytes);
     }
     /* pad and encrypt the data */
     if (rc == 0) {
+	enc_data->size = nbytes;
 	TPM_PrintFour(" TPM_RSAPublicEncrypt_Common: Public key", narr);
 	printf(" TPM_RSAPublicEncrypt_Common: Exponent %02x %02x %02x\n",
 	       earr[0], earr[1], earr[2]);
-	rc = TPM_RSAPublicEncrypt(encrypt_data,		/* encrypted data */
-				  nbytes,		/* encrypted data size */
-				  encScheme,		/* encryption scheme */
-				  decrypt_data,		/* decrypted data */
-				  decrypt_data_size,
-				  narr,			/* public modulus */
-				  nbytes,
-				  earr,			/* public exponent */
-				  ebytes);
+	if (rsa_pub_token != NULL) {
+	    rc = TPM_RSAPublicEncryptToken(enc_data->buffer,	/* encrypted data */
+					   nbytes,		/* encrypted data size */
+					   encScheme,		/* encryption scheme */
+					   decrypt_data,	/* decrypted data */
+					   decrypt_data_size,
+					   rsa_pub_token);
+	}
+	else {
+	    rc = TPM_RSAPublicEncrypt(enc_data->buffer,		/* encrypted data */
+				      nbytes,			/* encrypted data size */
+				      encScheme,		/* encryption scheme */
+				      decrypt_data,		/* decrypted data */
+				      decrypt_data_size,
+				      narr,			/* public modulus */
+				      nbytes,
+				      earr,			/* public exponent */
+				      ebytes);
+	}
     }
-    /* copy the result to the sized buffer */
     if (rc == 0) {
 	printf("  TPM_RSAPublicEncrypt_Common: Encrypt data size %u\n", nbytes);
-	TPM_PrintFour(" TPM_RSAPublicEncrypt_Common: Encrypt data", encrypt_data);
-	rc = TPM_SizedBuffer_Set(enc_data, nbytes, encrypt_data);
+	TPM_PrintFour(" TPM_RSAPublicEncrypt_Common: Encrypt data", enc_data->buffer);
     }
-    free(encrypt_data); /* @1 */
     return rc;
 }
 
@@ -1891,10 +2777,7 @@ TPM_RESULT TPM_RSASignH(unsigned char *signature,		/* output */
     TPM_RESULT		rc = 0;
     unsigned char	*narr;		 /* public modulus */
     uint32_t		nbytes;
-    unsigned char	*earr;		 /* public exponent */
-    uint32_t		ebytes;
-    unsigned char	*darr;		/* private exponent */
-    uint32_t		dbytes;
+    void		*rsa_pri_token;	/* private key token, cached in the TPM_KEY */
     
     printf(" TPM_RSASignH: Message size %lu bytes\n", (unsigned long)message_size);
     TPM_PrintFour("  TPM_RSASignH: Message", message);
@@ -1902,32 +2785,21 @@ TPM_RESULT TPM_RSASignH(unsigned char *signature,		/* output */
     if (rc == 0) {
 	rc = TPM_Key_GetPublicKey(&nbytes, &narr, tpm_key);
     }	
-    /* extract the private key from TPM_KEY */
-    if (rc == 0) {
-	rc = TPM_Key_GetPrivateKey(&dbytes, &darr, tpm_key);
-    }
-    /* extract the exponent from TPM_KEY */
+    /* get the prepared private key from TPM_KEY */
     if (rc == 0) {
-	rc = TPM_Key_GetExponent(&ebytes, &earr, tpm_key);
+	rc = TPM_Key_GetPrivateKeyToken(&rsa_pri_token, tpm_key);
     }
     if (rc == 0) {
 	/* debug printing */
 	TPM_PrintFour("  TPM_RSASignH: Public key", narr);
-	printf("  TPM_RSASignH: Exponent %02x %02x %02x\n", earr[0], earr[1], earr[2]);
-	TPM_PrintFour("  TPM_RSASignH: Private key", darr);
 	/* sign with private key */
-	rc = TPM_RSASign(signature,		/* output */
-			 signature_length,	/* output, size of signature */
-			 signature_size,	/* input, size of signature buffer */
-			 tpm_key->algorithmParms.sigScheme,	/* input, type of signature */
-			 message,	/* input */
-			 message_size,	/* input */
-			 narr,		/* public modulus */
-			 nbytes,
-			 earr,		/* public exponent */
-			 ebytes,
-			 darr,		/* private exponent */
-			 dbytes);
+	rc = TPM_RSASignToken(signature,		/* output */
+			      signature_length,	/* output, size of signature */
+			      signature_size,	/* input, size of signature buffer */
+			      tpm_key->algorithmParms.sigScheme,	/* input, type of signature */
+			      message,		/* input */
+			      message_size,	/* input */
+			      rsa_pri_token);	/* private key token */
     }
     if (rc == 0) {
 	TPM_PrintFour("  TPM_RSASignH: Signature", signature);
@@ -2059,7 +2931,7 @@ TPM_RESULT TPM_RSA_padding_add_PKCS1_OAEP(unsigned char *em, uint32_t emLen,
 					  const unsigned char *seed)		/* input 20 bytes */
 {	
     TPM_RESULT	rc = 0;
-    unsigned char *dbMask;
+    TPM_MGF1_CONTEXT dbMask;		/* the dbMask stream */
     unsigned char *db;
     unsigned char *maskedDb;
     unsigned char *seedMask;
@@ -2070,7 +2942,7 @@ TPM_RESULT TPM_RSA_padding_add_PKCS1_OAEP(unsigned char *em, uint32_t emLen,
     TPM_PrintFour("  TPM_RSA_padding_add_PKCS1_OAEP: pHash", pHash);
     TPM_PrintFour("  TPM_RSA_padding_add_PKCS1_OAEP: seed", seed);
     
-    dbMask = NULL;			/* freed @1 */
+    TPM_Mgf1Context_Init(&dbMask);	/* freed @1 */
 
     /* 1. If the length of P is greater than the input limitation for */
     /* the hash function (2^61-1 octets for SHA-1) then output "parameter */
@@ -2110,17 +2982,18 @@ TPM_RESULT TPM_RSA_padding_add_PKCS1_OAEP(unsigned char *em, uint32_t emLen,
 	/* NOTE seed is input directly */
 
 	/* 7. Let dbMask = MGF(seed, emLen-hLen). */
-	rc = TPM_Malloc(&dbMask, emLen - TPM_DIGEST_SIZE);
-    }
-    if (rc == 0) {
-	rc = TPM_MGF1(dbMask, emLen - TPM_DIGEST_SIZE, seed, TPM_DIGEST_SIZE);
+	/* NOTE dbMask is generated as a stream by step 8 */
+	rc = TPM_Mgf1Context_Set(&dbMask, TPM_DIGEST_SIZE,
+				 TPM_DIGEST_SIZE, seed,
+				 0, NULL);
     }
     if (rc == 0) {
 	/* 8. Let maskedDB = DB \xor dbMask. */
-	/* NOTE Since maskedDB is eventually em, XOR directly to em */
+	/* NOTE Since maskedDB is eventually em, XOR in place in em */
 	maskedDb = em + TPM_DIGEST_SIZE;
-	TPM_XOR(maskedDb, db, dbMask, emLen - TPM_DIGEST_SIZE);
-
+	rc = TPM_Mgf1Context_Xor(&dbMask, maskedDb, db, emLen - TPM_DIGEST_SIZE);
+    }
+    if (rc == 0) {
 	/* 9. Let seedMask = MGF(maskedDB, hLen). */
 	/* NOTE Since seedMask is eventually em, create directly to em */
 	seedMask = em;
@@ -2138,7 +3011,7 @@ TPM_RESULT TPM_RSA_padding_add_PKCS1_OAEP(unsigned char *em, uint32_t emLen,
 	/* 12. Output EM. */
 	TPM_PrintFour("  TPM_RSA_padding_add_PKCS1_OAEP: em", em);
     }
-    free(dbMask);		/* @1 */
+    TPM_Mgf1Context_Delete(&dbMask);	/* @1 */
     return rc;
 }
 
@@ -2174,15 +3047,17 @@ TPM_RESULT TPM_RSA_padding_check_PKCS1_OAEP(unsigned char *to, uint32_t *tLen, u
     const unsigned char *maskedSeed;
     const unsigned char *maskedDB;
     uint32_t		dbLen;
-    unsigned char	*dbMask;
+    TPM_MGF1_CONTEXT	dbMask;			/* the dbMask stream */
     unsigned char	*seedMask;
-    unsigned char	*db;
-    size_t		i;
+    unsigned char	db[TPM_DIGEST_SIZE];	/* DB, unmasked a block at a time */
+    uint32_t		dbIndex = TPM_DIGEST_SIZE;	/* index of db[0] in DB, after pHash' */
+    uint32_t		dbBlockLen = 0;			/* bytes unmasked in db */
+    uint32_t		i;
 
     printf(" TPM_RSA_padding_check_PKCS1_OAEP: emLen %d tSize %d\n", emLen, tSize);
     TPM_PrintFour("  TPM_RSA_padding_check_PKCS1_OAEP: em", em);
 
-    dbMask = NULL;			/* freed @1 */
+    TPM_Mgf1Context_Init(&dbMask);	/* freed @1 */
     
     /* 1. If the length of P is greater than the input limitation for the hash function (2^61-1
        octets for SHA-1) then output "parameter string too long" and stop. */
@@ -2211,36 +3086,46 @@ TPM_RESULT TPM_RSA_padding_check_PKCS1_OAEP(unsigned char *to, uint32_t *tLen, u
 	/* 5. Let seed = maskedSeed \xor seedMask. */
 	TPM_XOR(seed, maskedSeed, seedMask, TPM_DIGEST_SIZE);
 	/* 6. Let dbMask = MGF(seed, ||EM|| - hLen). */
-	rc = TPM_Malloc(&dbMask, dbLen);
-    }
-    if (rc == 0) {
-	rc = TPM_MGF1(dbMask, dbLen, seed, TPM_DIGEST_SIZE);
-    }
-    if (rc == 0) {
-	/* 7. Let DB = maskedDB \xor dbMask. */
-	/* NOTE XOR back to dbMask, since dbMask no longer needed */
-	db = dbMask;
-	TPM_XOR(db, maskedDB, dbMask, dbLen);
-	/* 8. Let pHash = Hash(P), an octet string of length hLen. */
-	/* NOTE pHash is input directly */
-	/* 9. Separate DB into an octet string pHash' consisting of the first hLen octets of DB,
-	   ... */
-	memcpy(pHash, db, TPM_DIGEST_SIZE);
-	/* ... a (possibly empty) octet string PS consisting of consecutive zero octets following
-	   pHash', and a message M as: DB = pHash' || PS || 01 || M */
-	for (i = TPM_DIGEST_SIZE; i < dbLen; i++) {
-	    if (db[i] != 0x00) {
-		break;	/* skip the PS segment */
+	/* NOTE dbMask is generated as a stream by step 7 */
+	rc = TPM_Mgf1Context_Set(&dbMask, TPM_DIGEST_SIZE,
+				 TPM_DIGEST_SIZE, seed,
+				 0, NULL);
+    }
+    /* 7. Let DB = maskedDB \xor dbMask. */
+    /* NOTE DB is unmasked a block at a time as it is parsed, and M is unmasked directly to the
+       output */
+    /* 8. Let pHash = Hash(P), an octet string of length hLen. */
+    /* NOTE pHash is input directly */
+    /* 9. Separate DB into an octet string pHash' consisting of the first hLen octets of DB,
+       ... */
+    if (rc == 0) {
+	rc = TPM_Mgf1Context_Xor(&dbMask, pHash, maskedDB, TPM_DIGEST_SIZE);
+    }
+    /* ... a (possibly empty) octet string PS consisting of consecutive zero octets following
+       pHash', and a message M as: DB = pHash' || PS || 01 || M */
+    for (i = TPM_DIGEST_SIZE ; (rc == 0) && (i < dbLen) ; i++) {
+	/* unmask the next block of DB */
+	if (i == (dbIndex + dbBlockLen)) {
+	    dbIndex = i;
+	    dbBlockLen = dbLen - i;
+	    if (dbBlockLen > TPM_DIGEST_SIZE) {
+		dbBlockLen = TPM_DIGEST_SIZE;
 	    }
+	    rc = TPM_Mgf1Context_Xor(&dbMask, db, maskedDB + dbIndex, dbBlockLen);
 	}
-	/* If there is no 01 octet to separate PS from M, output "decoding error" and stop. */
+	if ((rc == 0) && (db[i - dbIndex] != 0x00)) {
+	    break;	/* skip the PS segment */
+	}
+    }
+    /* If there is no 01 octet to separate PS from M, output "decoding error" and stop. */
+    if (rc == 0) {
 	if (i == dbLen) {
 	    printf("TPM_RSA_padding_check_PKCS1_OAEP: Error, missing 0x01\n");
 	    rc = TPM_DECRYPT_ERROR;
 	}
     }
     if (rc == 0) {
-	if (db[i] != 0x01) {
+	if (db[i - dbIndex] != 0x01) {
 	    printf("TPM_RSA_padding_check_PKCS1_OAEP: Error, missing 0x01\n");
 	    rc = TPM_DECRYPT_ERROR;
 	}
@@ -2258,13 +3143,21 @@ TPM_RESULT TPM_RSA_padding_check_PKCS1_OAEP(unsigned char *to, uint32_t *tLen, u
 	}
     }
     if (rc == 0) {
-	memcpy(to, db + i, *tLen);
+	/* the rest of the unmasked block, then unmask the remainder of M to the output */
+	memcpy(to, db + (i - dbIndex), dbIndex + dbBlockLen - i);
+	rc = TPM_Mgf1Context_Xor(&dbMask,
+				 to + (dbIndex + dbBlockLen - i),
+				 maskedDB + dbIndex + dbBlockLen,
+				 dbLen - (dbIndex + dbBlockLen));
+    }
+    if (rc == 0) {
 	printf("  TPM_RSA_padding_check_PKCS1_OAEP: tLen %d \n", *tLen);
 	TPM_PrintFour("  TPM_RSA_padding_check_PKCS1_OAEP: to", to);
 	TPM_PrintFour("  TPM_RSA_padding_check_PKCS1_OAEP: pHash", pHash);
 	TPM_PrintFour("  TPM_RSA_padding_check_PKCS1_OAEP: seed", seed);
     }
-    free(dbMask);		/* @1 */
+    memset(db, 0, TPM_DIGEST_SIZE);
+    TPM_Mgf1Context_Delete(&dbMask);	/* @1 */
     return rc;
 }
 
@@ -2322,6 +3215,42 @@ TPM_RESULT TPM_CryptoTest(void)
 			       0x9a,0xf4,0x8a,0xa1,0x7b,0x4f,0x63,0xf1,0x75,0xd3};
     /* data  0xdd repeated 50 times */
     unsigned char data2[50];
+    TPM_HMAC_MIDSTATE hmac_midstate;
+
+    /* structure digest sink */
+    TPM_SIGN_INFO	tpm_sign_info;
+    TPM_STORE_BUFFER	sbuffer;
+    TPM_DIGEST		expect3;
+
+    /* MGF1 stream, seeds of 50 bytes (parallel counter blocks) and 56 bytes (one at a time) */
+    TPM_MGF1_CONTEXT	mgf1_context;
+    unsigned char	mgf1_expect[200];
+    unsigned char	mgf1_actual[200];
+    unsigned char	mgf1_counter[4];
+    uint32_t		mgf1_chunks[] = {1, 19, 41, 139};
+    uint32_t		mgf1_seed;
+    uint32_t		mgf1_index;
+    uint32_t		mgf1_offset;
+
+    /* XOR, all tail lengths past two AVX2 blocks, unaligned */
+    unsigned char	xor_in[2][72];
+    unsigned char	xor_out[72];
+    size_t		xor_length;
+    size_t		xor_index;
+
+    /* HMAC_DRBG, instantiate with seed bytes 0-47, generate, reseed with entropy bytes 48-95 and
+       additional input 'TCPA', generate */
+    TPM_DRBG_CONTEXT	drbg_context;
+    unsigned char	drbg_seed[2 * TPM_DRBG_SEED_SIZE];
+    unsigned char	drbg_actual[40];
+    unsigned char	drbg_expect[2][40] = {
+	{0xd1,0x50,0x4d,0x6b,0x8f,0xc8,0x93,0x93,0x41,0x13,0x64,0x06,0xdc,0x3e,0xa6,0x0b,
+	 0x94,0x14,0xac,0x90,0xac,0x92,0xb0,0x2c,0xb7,0x02,0x37,0x1b,0x3b,0xad,0xe6,0x81,
+	 0x57,0xe1,0xd4,0x3a,0x08,0x2b,0x52,0xb8},
+	{0x10,0xf6,0x0f,0xcf,0x8e,0x13,0xf7,0x73,0x82,0xf4,0x76,0x3f,0xdc,0x0e,0x4a,0x0e,
+	 0x7d,0x9b,0xe9,0x71,0xea,0xf5,0x63,0xed,0x0f,0xb0,0x00,0xf5,0xdf,0x89,0xaf,0xdb,
+	 0x52,0x71,0x18,0xa4,0x4c,0x80,0x1b,0xbf}};
+    size_t		drbg_index;
 
     /* oaep tests */
     const unsigned char oaep_pad_str[] = { 'T', 'C', 'P', 'A' };
@@ -2342,6 +3271,8 @@ TPM_RESULT TPM_CryptoTest(void)
     unsigned char	*encStream;	/* encrypted */
     uint32_t		encSize;
     unsigned char	*decStream;	/* actual */
+    unsigned char	cryptStream[sizeof(clrStream) + 32];	/* in place encrypt and decrypt */
+    uint32_t		cryptSize;
     uint32_t		decSize;
 
     /* symmetric key ctr and ofb mode */
@@ -2359,6 +3290,11 @@ TPM_RESULT TPM_CryptoTest(void)
     unsigned char encrypt_data[2048/8];		/* encrypted data */
     
     printf(" TPM_CryptoTest:\n");
+    TPM_HmacMidstate_Init(&hmac_midstate);	/* freed @8 */
+    TPM_SignInfo_Init(&tpm_sign_info);		/* freed @9 */
+    TPM_Sbuffer_Init(&sbuffer);			/* freed @10 */
+    TPM_Mgf1Context_Init(&mgf1_context);	/* freed @11 */
+    TPM_DrbgContext_Init(&drbg_context);	/* freed @12 */
     encStream = NULL;		/* freed @1 */
     decStream = NULL;		/* freed @2 */
     n = NULL;			/* freed @3 */
@@ -2547,6 +3483,37 @@ TPM_RESULT TPM_CryptoTest(void)
 	    rc = TPM_FAILEDSELFTEST;
 	}
     }
+    /* symmetric encrypt in place, must match the allocating encrypt */
+    if (rc == 0) {
+	memcpy(cryptStream, clrStream, sizeof(clrStream));
+	rc = TPM_SymmetricKeyData_EncryptBuffer(cryptStream,		/* output */
+						&cryptSize,		/* output */
+						sizeof(cryptStream),	/* input */
+						cryptStream,		/* input */
+						sizeof(clrStream),	/* input */
+						tpm_symmetric_key_data);	/* key */
+    }
+    if (rc == 0) {
+	if ((cryptSize != encSize) || (memcmp(cryptStream, encStream, encSize) != 0)) {
+	    printf("TPM_CryptoTest: Error in test 6 in place encrypt, size %u\n", cryptSize);
+	    rc = TPM_FAILEDSELFTEST;
+	}
+    }
+    /* symmetric decrypt in place */
+    if (rc == 0) {
+	rc = TPM_SymmetricKeyData_DecryptBuffer(cryptStream,		/* output */
+						&cryptSize,		/* output */
+						cryptStream,		/* input */
+						cryptSize,		/* input */
+						tpm_symmetric_key_data);	/* key */
+    }
+    if (rc == 0) {
+	if ((cryptSize != sizeof(clrStream)) ||
+	    (memcmp(cryptStream, clrStream, sizeof(clrStream)) != 0)) {
+	    printf("TPM_CryptoTest: Error in test 6 in place decrypt, size %u\n", cryptSize);
+	    rc = TPM_FAILEDSELFTEST;
+	}
+    }
     if (rc == 0) {
 	printf(" TPM_CryptoTest: Test 7 - Symmetric key with CTR mode\n");
 	/* generate a key */
@@ -2730,6 +3697,202 @@ TPM_RESULT TPM_CryptoTest(void)
 	    rc = TPM_FAILEDSELFTEST;
 	}
     }
+    if (rc == 0) {
+	printf(" TPM_CryptoTest: Test 11 - SHA1 engine implementations\n");
+	rc = TPM_SHA1Engine_Test();
+    }
+    if (rc == 0) {
+	printf(" TPM_CryptoTest: Test 12 - HMAC from cached midstates\n");
+	memset(data2, 0xdd, 50);
+	rc = TPM_HmacMidstate_Set(&hmac_midstate, key2);
+    }
+    /* the second HMAC reuses the midstates, they must not have been modified by the first */
+    if (rc == 0) {
+	rc = TPM_HMAC_GenerateMidstate(actual,
+				       &hmac_midstate,
+				       20, data2,
+				       30, data2 + 20,
+				       0, NULL);
+    }
+    if (rc == 0) {
+	rc = TPM_HmacMidstate_Set(&hmac_midstate, key2);
+    }
+    if (rc == 0) {
+	rc = TPM_HMAC_CheckMidstate(&valid,
+				    expect2,
+				    &hmac_midstate,
+				    50, data2,
+				    0, NULL);
+    }
+    if (rc == 0) {
+	not_equal = memcmp(expect2, actual, TPM_DIGEST_SIZE);
+	if (not_equal || !valid) {
+	    printf("TPM_CryptoTest: Error in test 12\n");
+	    TPM_PrintFour("\texpect", expect2);
+	    TPM_PrintFour("\tactual", actual);
+	    rc = TPM_FAILEDSELFTEST;
+	}
+    }
+    /* digest a structure through the sink and through a serialized buffer */
+    if (rc == 0) {
+	printf(" TPM_CryptoTest: Test 13 - SHA1 and HMAC structure digest sink\n");
+	memcpy(tpm_sign_info.fixed, "TEST", TPM_SIGN_INFO_FIXED_SIZE);
+	memset(tpm_sign_info.replay, 0xa5, TPM_NONCE_SIZE);
+	rc = TPM_SizedBuffer_Set(&(tpm_sign_info.data), sizeof(data2), data2);
+    }
+    if (rc == 0) {
+	rc = TPM_SignInfo_Store(&sbuffer, &tpm_sign_info);
+    }
+    if (rc == 0) {
+	rc = TPM_SHA1Sbuffer(expect3, &sbuffer);
+    }
+    if (rc == 0) {
+	rc = TPM_SHA1_GenerateStructure(actual, &tpm_sign_info,
+					(TPM_STORE_FUNCTION_T)TPM_SignInfo_Store);
+    }
+    if (rc == 0) {
+	not_equal = memcmp(expect3, actual, TPM_DIGEST_SIZE);
+	if (not_equal) {
+	    printf("TPM_CryptoTest: Error in test 13 SHA1\n");
+	    TPM_PrintFour("\texpect", expect3);
+	    TPM_PrintFour("\tactual", actual);
+	    rc = TPM_FAILEDSELFTEST;
+	}
+    }
+    if (rc == 0) {
+	rc = TPM_HMAC_GenerateSbuffer(expect3, key2, &sbuffer);
+    }
+    if (rc == 0) {
+	rc = TPM_HMAC_GenerateStructure(actual, key2, &tpm_sign_info,
+					(TPM_STORE_FUNCTION_T)TPM_SignInfo_Store);
+    }
+    if (rc == 0) {
+	not_equal = memcmp(expect3, actual, TPM_DIGEST_SIZE);
+	if (not_equal) {
+	    printf("TPM_CryptoTest: Error in test 13 HMAC\n");
+	    TPM_PrintFour("\texpect", expect3);
+	    TPM_PrintFour("\tactual", actual);
+	    rc = TPM_FAILEDSELFTEST;
+	}
+    }
+    /* the MGF1 stream in odd chunks against a hash per counter block */
+    if (rc == 0) {
+	printf(" TPM_CryptoTest: Test 14 - MGF1 stream\n");
+    }
+    for (mgf1_seed = 50 ; (rc == 0) && (mgf1_seed <= 56) ; mgf1_seed += 6) {
+	for (mgf1_index = 0 ; (rc == 0) && (mgf1_index < sizeof(mgf1_expect)/TPM_DIGEST_SIZE) ;
+	     mgf1_index++) {
+	    STORE32(mgf1_counter, 0, mgf1_index);
+	    rc = TPM_SHA1(mgf1_expect + (mgf1_index * TPM_DIGEST_SIZE),
+			  mgf1_seed, buffer1,
+			  sizeof(mgf1_counter), mgf1_counter,
+			  0, NULL);
+	}
+	if (rc == 0) {
+	    rc = TPM_Mgf1Context_Set(&mgf1_context, mgf1_seed,
+				     mgf1_seed, buffer1,
+				     0, NULL);
+	}
+	for (mgf1_index = 0, mgf1_offset = 0 ;
+	     (rc == 0) && (mgf1_index < sizeof(mgf1_chunks)/sizeof(uint32_t)) ;
+	     mgf1_offset += mgf1_chunks[mgf1_index], mgf1_index++) {
+	    rc = TPM_Mgf1Context_Generate(&mgf1_context,
+					  mgf1_actual + mgf1_offset,
+					  mgf1_chunks[mgf1_index]);
+	}
+	if (rc == 0) {
+	    not_equal = memcmp(mgf1_expect, mgf1_actual, sizeof(mgf1_actual));
+	    if (not_equal) {
+		printf("TPM_CryptoTest: Error in test 14, generate, seed length %u\n", mgf1_seed);
+		TPM_PrintFour("\texpect", mgf1_expect);
+		TPM_PrintFour("\tactual", mgf1_actual);
+		rc = TPM_FAILEDSELFTEST;
+	    }
+	}
+	/* XOR'ing the same stream in place removes the mask */
+	if (rc == 0) {
+	    rc = TPM_Mgf1Context_Set(&mgf1_context, mgf1_seed,
+				     mgf1_seed, buffer1,
+				     0, NULL);
+	}
+	for (mgf1_index = sizeof(mgf1_chunks)/sizeof(uint32_t), mgf1_offset = 0 ;
+	     (rc == 0) && (mgf1_index > 0) ;
+	     mgf1_offset += mgf1_chunks[mgf1_index - 1], mgf1_index--) {
+	    rc = TPM_Mgf1Context_Xor(&mgf1_context,
+				     mgf1_expect + mgf1_offset,
+				     mgf1_expect + mgf1_offset,
+				     mgf1_chunks[mgf1_index - 1]);
+	}
+	if (rc == 0) {
+	    memset(mgf1_actual, 0, sizeof(mgf1_actual));
+	    not_equal = memcmp(mgf1_expect, mgf1_actual, sizeof(mgf1_actual));
+	    if (not_equal) {
+		printf("TPM_CryptoTest: Error in test 14, XOR, seed length %u\n", mgf1_seed);
+		TPM_PrintFour("\tactual", mgf1_expect);
+		rc = TPM_FAILEDSELFTEST;
+	    }
+	}
+    }
+    if (rc == 0) {
+	printf(" TPM_CryptoTest: Test 15 - XOR\n");
+	for (xor_index = 0 ; xor_index < sizeof(xor_in[0]) ; xor_index++) {
+	    xor_in[0][xor_index] = (unsigned char)(xor_index * 7);
+	    xor_in[1][xor_index] = (unsigned char)(xor_index * 13 + 5);
+	}
+    }
+    for (xor_length = 0 ; (rc == 0) && (xor_length < (sizeof(xor_out) - 1)) ; xor_length++) {
+	memcpy(xor_out, xor_in[0], sizeof(xor_out));
+	TPM_XOR(xor_out + 1, xor_in[0] + 1, xor_in[1] + 1, xor_length);
+	for (xor_index = 0, not_equal = 0 ; !not_equal && (xor_index < xor_length) ; xor_index++) {
+	    not_equal = (xor_out[1 + xor_index] !=
+			 (xor_in[0][1 + xor_index] ^ xor_in[1][1 + xor_index]));
+	}
+	/* XOR'ing the keystream again restores the input, and nothing past the length changed */
+	if (!not_equal) {
+	    TPM_XOR(xor_out + 1, xor_out + 1, xor_in[1] + 1, xor_length);
+	    not_equal = memcmp(xor_out, xor_in[0], sizeof(xor_out));
+	}
+	if (not_equal) {
+	    printf("TPM_CryptoTest: Error in test 15, length %lu\n", (unsigned long)xor_length);
+	    rc = TPM_FAILEDSELFTEST;
+	}
+    }
+    if (rc == 0) {
+	printf(" TPM_CryptoTest: Test 16 - HMAC_DRBG\n");
+	for (drbg_index = 0 ; drbg_index < sizeof(drbg_seed) ; drbg_index++) {
+	    drbg_seed[drbg_index] = (unsigned char)drbg_index;
+	}
+	rc = TPM_DrbgContext_Instantiate(&drbg_context, drbg_seed, TPM_DRBG_SEED_SIZE);
+    }
+    if (rc == 0) {
+	rc = TPM_DrbgContext_Generate(&drbg_context, drbg_actual, sizeof(drbg_actual));
+    }
+    if (rc == 0) {
+	not_equal = memcmp(drbg_expect[0], drbg_actual, sizeof(drbg_actual));
+	if (not_equal) {
+	    printf("TPM_CryptoTest: Error in test 16 instantiate\n");
+	    TPM_PrintFour("\texpect", drbg_expect[0]);
+	    TPM_PrintFour("\tactual", drbg_actual);
+	    rc = TPM_FAILEDSELFTEST;
+	}
+    }
+    if (rc == 0) {
+	rc = TPM_DrbgContext_Reseed(&drbg_context,
+				    drbg_seed + TPM_DRBG_SEED_SIZE, TPM_DRBG_SEED_SIZE,
+				    oaep_pad_str, sizeof(oaep_pad_str));
+    }
+    if (rc == 0) {
+	rc = TPM_DrbgContext_Generate(&drbg_context, drbg_actual, sizeof(drbg_actual));
+    }
+    if (rc == 0) {
+	not_equal = memcmp(drbg_expect[1], drbg_actual, sizeof(drbg_actual));
+	if (not_equal) {
+	    printf("TPM_CryptoTest: Error in test 16 reseed\n");
+	    TPM_PrintFour("\texpect", drbg_expect[1]);
+	    TPM_PrintFour("\tactual", drbg_actual);
+	    rc = TPM_FAILEDSELFTEST;
+	}
+    }
     /* run library specific self tests as required */
     if (rc == 0) {
 	rc = TPM_Crypto_TestSpecific();
@@ -2744,6 +3907,11 @@ TPM_RESULT TPM_CryptoTest(void)
     free(q);						/* @5 */
     free(d);						/* @6 */
     TPM_SymmetricKeyData_Free(&tpm_symmetric_key_data);	/* @7 */
+    TPM_HmacMidstate_Delete(&hmac_midstate);		/* @8 */
+    TPM_SignInfo_Delete(&tpm_sign_info);		/* @9 */
+    TPM_Sbuffer_Delete(&sbuffer);			/* @10 */
+    TPM_Mgf1Context_Delete(&mgf1_context);		/* @11 */
+    TPM_DrbgContext_Delete(&drbg_context);		/* @12 */
     return rc;
 }
 
@@ -96,6 +96,16 @@ TPM_RESULT TPM_SymmetricKey_Store(TPM_STORE_BUFFER *sbuffer,
                                   const TPM_SYMMETRIC_KEY *tpm_symmetric_key);
 void       TPM_SymmetricKey_Delete(TPM_SYMMETRIC_KEY *tpm_symmetric_key);
 
+TPM_RESULT TPM_SymmetricKeyData_Encrypt(unsigned char **encrypt_data,
+                                        uint32_t *encrypt_length,
+                                        const unsigned char *decrypt_data,
+                                        uint32_t decrypt_length,
+                                        const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token);
+TPM_RESULT TPM_SymmetricKeyData_Decrypt(unsigned char **decrypt_data,
+                                        uint32_t *decrypt_length,
+                                        const unsigned char *encrypt_data,
+                                        uint32_t encrypt_length,
+                                        const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token);
 TPM_RESULT TPM_SymmetricKeyData_EncryptSbuffer(TPM_SIZED_BUFFER *encrypt_data,
                                                TPM_STORE_BUFFER *sbuffer,
                                                const TPM_SYMMETRIC_KEY_TOKEN
@@ -147,7 +157,8 @@ TPM_RESULT TPM_RSAPublicEncrypt_Common(TPM_SIZED_BUFFER *enc_data,
                                        unsigned char    *narr,
                                        uint32_t 	nbytes,
                                        unsigned char    *earr,
-                                       uint32_t		ebytes);
+                                       uint32_t		ebytes,
+                                       void		*rsa_pub_token);
 
 TPM_RESULT TPM_RSASignH(unsigned char *signature,
                         unsigned int *signature_length,
@@ -231,6 +242,25 @@ TPM_RESULT TPM_HMAC_CheckStructure(const TPM_SECRET hmac_key,
                                    TPM_STORE_FUNCTION_T storeFunction,
                                    TPM_RESULT error);
 
+/*
+  HMAC midstates
+*/
+
+void       TPM_HmacMidstate_Init(TPM_HMAC_MIDSTATE *tpm_hmac_midstate);
+TPM_RESULT TPM_HmacMidstate_Set(TPM_HMAC_MIDSTATE *tpm_hmac_midstate,
+                                const TPM_SECRET hmac_key);
+void       TPM_HmacMidstate_Copy(TPM_HMAC_MIDSTATE *dest_hmac_midstate,
+                                 const TPM_HMAC_MIDSTATE *src_hmac_midstate);
+void       TPM_HmacMidstate_Delete(TPM_HMAC_MIDSTATE *tpm_hmac_midstate);
+
+TPM_RESULT TPM_HMAC_GenerateMidstate(TPM_HMAC tpm_hmac,
+                                     const TPM_HMAC_MIDSTATE *tpm_hmac_midstate,
+                                     ...);
+TPM_RESULT TPM_HMAC_CheckMidstate(TPM_BOOL *valid,
+                                  TPM_HMAC expect,
+                                  const TPM_HMAC_MIDSTATE *tpm_hmac_midstate,
+                                  ...);
+
 /*
   XOR
 */
@@ -252,6 +282,41 @@ TPM_RESULT TPM_MGF1_GenerateArray(unsigned char **array,
 				  uint32_t arrayLen,
 				  uint32_t seedLen,
 				  ...);
+
+void       TPM_Mgf1Context_Init(TPM_MGF1_CONTEXT *tpm_mgf1_context);
+TPM_RESULT TPM_Mgf1Context_Set(TPM_MGF1_CONTEXT *tpm_mgf1_context,
+                               uint32_t seedLen,
+                               ...);
+TPM_RESULT TPM_Mgf1Context_Generate(TPM_MGF1_CONTEXT *tpm_mgf1_context,
+                                    unsigned char *mask,
+                                    uint32_t maskLen);
+TPM_RESULT TPM_Mgf1Context_Xor(TPM_MGF1_CONTEXT *tpm_mgf1_context,
+                               unsigned char *out,
+                               const unsigned char *in,
+                               uint32_t length);
+void       TPM_Mgf1Context_Delete(TPM_MGF1_CONTEXT *tpm_mgf1_context);
+
+/*
+  Random number generator
+*/
+
+TPM_RESULT TPM_Random(BYTE *buffer, size_t bytes);
+TPM_RESULT TPM_StirRandomCmd(TPM_SIZED_BUFFER *inData);
+
+void       TPM_DrbgContext_Init(TPM_DRBG_CONTEXT *tpm_drbg_context);
+TPM_RESULT TPM_DrbgContext_Instantiate(TPM_DRBG_CONTEXT *tpm_drbg_context,
+                                       const unsigned char *seed,
+                                       uint32_t seed_length);
+TPM_RESULT TPM_DrbgContext_Reseed(TPM_DRBG_CONTEXT *tpm_drbg_context,
+                                  const unsigned char *entropy,
+                                  uint32_t entropy_length,
+                                  const unsigned char *additional,
+                                  uint32_t additional_length);
+TPM_RESULT TPM_DrbgContext_Generate(TPM_DRBG_CONTEXT *tpm_drbg_context,
+                                    unsigned char *output,
+                                    uint32_t length);
+void       TPM_DrbgContext_Delete(TPM_DRBG_CONTEXT *tpm_drbg_context);
+
 /* bignum */
 
 TPM_RESULT TPM_bn2binMalloc(unsigned char **bin,
@@ -865,6 +865,7 @@ void TPM_DAAContext_Init(TPM_DAA_CONTEXT *tpm_daa_context)
     memset(tpm_daa_context->DAA_scratch, 0, sizeof(tpm_daa_context->DAA_scratch));
     tpm_daa_context->DAA_stage = 0;
     tpm_daa_context->DAA_scratch_null = TRUE;
+    tpm_daa_context->DAA_scratchBignum = NULL;
     return;
 }
 
@@ -885,6 +886,9 @@ TPM_RESULT TPM_DAAContext_Load(TPM_DAA_CONTEXT *tpm_daa_context,
     TPM_RESULT		rc = 0;
 
     printf(" TPM_DAAContext_Load:\n");
+    /* a resident bignum would shadow the loaded DAA_scratch bytes */
+    TPM_BN_clear_free(tpm_daa_context->DAA_scratchBignum);
+    tpm_daa_context->DAA_scratchBignum = NULL;
     /* check tag */
     if (rc == 0) {
 	rc = TPM_CheckTag(TPM_TAG_DAA_CONTEXT, stream, stream_size);
@@ -927,6 +931,7 @@ TPM_RESULT TPM_DAAContext_Store(TPM_STORE_BUFFER *sbuffer,
 				const TPM_DAA_CONTEXT *tpm_daa_context)
 {
     TPM_RESULT		rc = 0;
+    BYTE		DAA_scratch[sizeof(tpm_daa_context->DAA_scratch)];
 
     printf(" TPM_DAAContext_Store:\n");
     /* store tag  */
@@ -945,10 +950,19 @@ TPM_RESULT TPM_DAAContext_Store(TPM_STORE_BUFFER *sbuffer,
     if (rc == 0) {
 	rc = TPM_Nonce_Store(sbuffer, tpm_daa_context->DAA_contextSeed);
     }
-    /* store DAA_scratch */
+    /* store DAA_scratch, serializing the resident bignum if there is one */
     if (rc == 0) {
-	rc = TPM_Sbuffer_Append(sbuffer, tpm_daa_context->DAA_scratch,
-				sizeof(tpm_daa_context->DAA_scratch));
+	if (tpm_daa_context->DAA_scratchBignum == NULL) {
+	    rc = TPM_Sbuffer_Append(sbuffer, tpm_daa_context->DAA_scratch,
+				    sizeof(tpm_daa_context->DAA_scratch));
+	}
+	else {
+	    rc = TPM_bn2binArray(DAA_scratch, sizeof(DAA_scratch),
+				 tpm_daa_context->DAA_scratchBignum);
+	    if (rc == 0) {
+		rc = TPM_Sbuffer_Append(sbuffer, DAA_scratch, sizeof(DAA_scratch));
+	    }
+	}
     }
     /* store DAA_stage	*/
     if (rc == 0) {
@@ -974,6 +988,7 @@ void TPM_DAAContext_Delete(TPM_DAA_CONTEXT *tpm_daa_context)
 {
     printf(" TPM_DAAContext_Delete:\n");
     if (tpm_daa_context != NULL) {
+	TPM_BN_clear_free(tpm_daa_context->DAA_scratchBignum);
 	TPM_DAAContext_Init(tpm_daa_context);
     }
     return;
@@ -991,11 +1006,63 @@ void TPM_DAAContext_Copy(TPM_DAA_CONTEXT *dest_daa_context, TPM_DAA_CONTEXT *src
     TPM_Nonce_Copy(dest_daa_context->DAA_contextSeed, src_daa_context->DAA_contextSeed);
     memcpy(dest_daa_context->DAA_scratch, src_daa_context->DAA_scratch,
 	   sizeof(src_daa_context->DAA_scratch));
+    /* the destination gets the serialized form of a resident bignum.  The size was checked when
+       the bignum was set, so this cannot fail. */
+    TPM_BN_clear_free(dest_daa_context->DAA_scratchBignum);
+    dest_daa_context->DAA_scratchBignum = NULL;
+    if (src_daa_context->DAA_scratchBignum != NULL) {
+	TPM_bn2binArray(dest_daa_context->DAA_scratch, sizeof(dest_daa_context->DAA_scratch),
+			src_daa_context->DAA_scratchBignum);
+    }
     dest_daa_context->DAA_stage = src_daa_context->DAA_stage;
     dest_daa_context->DAA_scratch_null = src_daa_context->DAA_scratch_null;
     return;
 }
 
+/* TPM_DAAContext_GetScratch() returns DAA_scratch as a bignum.
+
+   The bignum stays resident in the context across stages, so the DAA_scratch bytes are converted
+   at most once per session load.  The bignum is owned by the context and must not be freed by the
+   caller.
+*/
+
+TPM_RESULT TPM_DAAContext_GetScratch(TPM_BIGNUM *bn,
+				     TPM_DAA_CONTEXT *tpm_daa_context)
+{
+    TPM_RESULT		rc = 0;
+
+    printf(" TPM_DAAContext_GetScratch:\n");
+    if (tpm_daa_context->DAA_scratchBignum == NULL) {
+	rc = TPM_bin2bn(&(tpm_daa_context->DAA_scratchBignum),
+			tpm_daa_context->DAA_scratch,
+			sizeof(tpm_daa_context->DAA_scratch));
+    }
+    if (rc == 0) {
+	*bn = tpm_daa_context->DAA_scratchBignum;
+    }
+    return rc;
+}
+
+/* TPM_DAAContext_FlushScratch() writes a resident DAA_scratch bignum back to the DAA_scratch bytes
+   and frees it.
+
+   It must be called before DAA_scratch is used as a byte array.
+*/
+
+TPM_RESULT TPM_DAAContext_FlushScratch(TPM_DAA_CONTEXT *tpm_daa_context)
+{
+    TPM_RESULT		rc = 0;
+
+    printf(" TPM_DAAContext_FlushScratch:\n");
+    if (tpm_daa_context->DAA_scratchBignum != NULL) {
+	rc = TPM_bn2binArray(tpm_daa_context->DAA_scratch, sizeof(tpm_daa_context->DAA_scratch),
+			     tpm_daa_context->DAA_scratchBignum);
+	TPM_BN_clear_free(tpm_daa_context->DAA_scratchBignum);
+	tpm_daa_context->DAA_scratchBignum = NULL;
+    }
+    return rc;
+}
+
 /*
   TPM_DAA_JOINDATA
 */
@@ -1761,8 +1828,7 @@ TPM_RESULT TPM_DAAJoin_Stage04(tpm_state_t *tpm_state,
     }
     /* l. Set DAA_session -> DAA_scratch = (X^f0) mod n */
     if (rc == 0) {
-	rc = TPM_ComputeAexpPmodn(tpm_daa_session_data->DAA_session.DAA_scratch,
-				  sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
+	rc = TPM_ComputeAexpPmodn(&(tpm_daa_session_data->DAA_session),
 				  &rBignum,	/* R */
 				  xBignum,	/* A */
 				  fBignum,	/* P */
@@ -1791,7 +1857,7 @@ TPM_RESULT TPM_DAAJoin_Stage05(tpm_state_t *tpm_state,
     TPM_BIGNUM		nBignum = NULL;		/* freed @2 */
     TPM_BIGNUM		fBignum = NULL;		/* freed @3 */
     TPM_BIGNUM		f1Bignum = NULL;	/* freed @4 */
-    TPM_BIGNUM		zBignum = NULL;		/* freed @5 */
+    TPM_BIGNUM		zBignum = NULL;		/* owned by DAA_session */
 
     printf("TPM_DAAJoin_Stage05:\n");
     tpm_state = tpm_state;			/* not used */
@@ -1853,14 +1919,11 @@ TPM_RESULT TPM_DAAJoin_Stage05(tpm_state_t *tpm_state,
     /* l. Set Z = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAAJoin_Stage05: Creating Z\n");
-	rc = TPM_bin2bn(&zBignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&zBignum, &(tpm_daa_session_data->DAA_session));
     }
     /* m. Set DAA_session -> DAA_scratch = Z*(X^f1) mod n */
     if (rc == 0) {
-	rc = TPM_ComputeZxAexpPmodn(tpm_daa_session_data->DAA_session.DAA_scratch,
-				    sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
+	rc = TPM_ComputeZxAexpPmodn(&(tpm_daa_session_data->DAA_session),
 				    zBignum,	/* Z */
 				    xBignum,	/* A */
 				    f1Bignum,	/* P */
@@ -1875,7 +1938,6 @@ TPM_RESULT TPM_DAAJoin_Stage05(tpm_state_t *tpm_state,
     TPM_BN_free(nBignum);	/* @2 */
     TPM_BN_free(fBignum);	/* @3 */
     TPM_BN_free(f1Bignum);	/* @4 */
-    TPM_BN_free(zBignum);	/* @5 */
     return rc;
 }
 
@@ -1888,8 +1950,8 @@ TPM_RESULT TPM_DAAJoin_Stage06(tpm_state_t *tpm_state,
     TPM_RESULT		rc = 0;
     TPM_BIGNUM		xBignum = NULL;	/* freed @1 */
     TPM_BIGNUM		nBignum = NULL;	/* freed @2 */
-    TPM_BIGNUM		zBignum = NULL;	/* freed @3 */
-    TPM_BIGNUM		yBignum = NULL;	/* freed @4 */
+    TPM_BIGNUM		zBignum = NULL;	/* owned by DAA_session */
+    TPM_BIGNUM		yBignum = NULL;	/* freed @3 */
 
     printf("TPM_DAAJoin_Stage06:\n");
     tpm_state = tpm_state;			/* not used */
@@ -1940,9 +2002,7 @@ TPM_RESULT TPM_DAAJoin_Stage06(tpm_state_t *tpm_state,
     /* j. Set Z = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAAJoin_Stage06: Creating Z\n");
-	rc = TPM_bin2bn(&zBignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&zBignum, &(tpm_daa_session_data->DAA_session));
     }
     /* k. Set Y = DAA_joinSession -> DAA_join_u0 */
     if (rc == 0) {
@@ -1953,8 +2013,7 @@ TPM_RESULT TPM_DAAJoin_Stage06(tpm_state_t *tpm_state,
     }
     /* l. Set DAA_session -> DAA_scratch = Z*(X^Y) mod n */
     if (rc == 0) {
-	rc = TPM_ComputeZxAexpPmodn(tpm_daa_session_data->DAA_session.DAA_scratch,
-				    sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
+	rc = TPM_ComputeZxAexpPmodn(&(tpm_daa_session_data->DAA_session),
 				    zBignum,	/* Z */
 				    xBignum,	/* A */
 				    yBignum,	/* P */
@@ -1967,8 +2026,7 @@ TPM_RESULT TPM_DAAJoin_Stage06(tpm_state_t *tpm_state,
     /* o. return TPM_SUCCESS */
     TPM_BN_free(xBignum);	/* @1 */
     TPM_BN_free(nBignum);	/* @2 */
-    TPM_BN_free(zBignum);	/* @3 */
-    TPM_BN_free(yBignum);	/* @4 */
+    TPM_BN_free(yBignum);	/* @3 */
     return rc;
 }
 
@@ -1983,7 +2041,7 @@ TPM_RESULT TPM_DAAJoin_Stage07(tpm_state_t *tpm_state,
     TPM_BIGNUM		xBignum = NULL;	/* freed @1 */
     TPM_BIGNUM		nBignum = NULL;	/* freed @2 */
     TPM_BIGNUM		yBignum = NULL;	/* freed @3 */
-    TPM_BIGNUM		zBignum = NULL;	/* freed @4 */
+    TPM_BIGNUM		zBignum = NULL;	/* owned by DAA_session */
 
     printf("TPM_DAAJoin_Stage07:\n");
     tpm_state = tpm_state;			/* not used */
@@ -2040,19 +2098,20 @@ TPM_RESULT TPM_DAAJoin_Stage07(tpm_state_t *tpm_state,
     /* k. Set Z = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAAJoin_Stage07: Creating Z\n");
-	rc = TPM_bin2bn(&zBignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&zBignum, &(tpm_daa_session_data->DAA_session));
     }
     /* l. Set DAA_session -> DAA_scratch = Z*(X^Y) mod n */
     if (rc == 0) {
-	rc = TPM_ComputeZxAexpPmodn(tpm_daa_session_data->DAA_session.DAA_scratch,
-				    sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
+	rc = TPM_ComputeZxAexpPmodn(&(tpm_daa_session_data->DAA_session),
 				    zBignum,	/* Z */
 				    xBignum,	/* A */
 				    yBignum,	/* P */
 				    nBignum);	/* N */
     }
+    /* the byte form of DAA_scratch is used below */
+    if (rc == 0) {
+	rc = TPM_DAAContext_FlushScratch(&(tpm_daa_session_data->DAA_session));
+    }
     /* m. Set DAA_session -> DAA_digest to the SHA-1 (DAA_session -> DAA_scratch || DAA_tpmSpecific
        -> DAA_count || DAA_joinSession -> DAA_digest_n0) */
     if (rc == 0) {
@@ -2081,7 +2140,6 @@ TPM_RESULT TPM_DAAJoin_Stage07(tpm_state_t *tpm_state,
     TPM_BN_free(xBignum);	/* @1 */
     TPM_BN_free(nBignum);	/* @2 */
     TPM_BN_free(yBignum);	/* @3 */
-    TPM_BN_free(zBignum);	/* @4 */
     return rc;
 }
 
@@ -2224,8 +2282,7 @@ TPM_RESULT TPM_DAAJoin_Stage09_Sign_Stage2(tpm_state_t *tpm_state,
     }
     /* l. Set DAA_session -> DAA_scratch = (X^Y) mod n */
     if (rc == 0) {
-	rc = TPM_ComputeAexpPmodn(tpm_daa_session_data->DAA_session.DAA_scratch,
-				  sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
+	rc = TPM_ComputeAexpPmodn(&(tpm_daa_session_data->DAA_session),
 				  &rBignum,	/* R */
 				  xBignum,	/* A */
 				  yBignum,	/* P */
@@ -2255,8 +2312,8 @@ TPM_RESULT TPM_DAAJoin_Stage10_Sign_Stage3(tpm_state_t *tpm_state,
     unsigned char	*Y= NULL;	/* freed @1 */
     TPM_BIGNUM		xBignum = NULL;	/* freed @2 */
     TPM_BIGNUM		nBignum = NULL;	/* freed @3 */
-    TPM_BIGNUM		zBignum = NULL;	/* freed @4 */
-    TPM_BIGNUM		yBignum = NULL;	/* freed @5*/
+    TPM_BIGNUM		zBignum = NULL;	/* owned by DAA_session */
+    TPM_BIGNUM		yBignum = NULL;	/* freed @4*/
 
     printf("TPM_DAAJoin_Stage10_Sign_Stage3:\n");
     tpm_state = tpm_state;			/* not used */
@@ -2324,14 +2381,11 @@ TPM_RESULT TPM_DAAJoin_Stage10_Sign_Stage3(tpm_state_t *tpm_state,
     /* k. Set Z = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAAJoin_Stage10_Sign_Stage3: Creating Z\n");
-	rc = TPM_bin2bn(&zBignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&zBignum, &(tpm_daa_session_data->DAA_session));
     }
     /* l. Set DAA_session -> DAA_scratch = Z*(X^Y) mod n */
     if (rc == 0) {
-	rc = TPM_ComputeZxAexpPmodn(tpm_daa_session_data->DAA_session.DAA_scratch,
-				    sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
+	rc = TPM_ComputeZxAexpPmodn(&(tpm_daa_session_data->DAA_session),
 				    zBignum,	/* Z */
 				    xBignum,	/* A */
 				    yBignum,	/* P */
@@ -2345,8 +2399,7 @@ TPM_RESULT TPM_DAAJoin_Stage10_Sign_Stage3(tpm_state_t *tpm_state,
     free(Y);			/* @1 */
     TPM_BN_free(xBignum);	/* @2 */
     TPM_BN_free(nBignum);	/* @3 */
-    TPM_BN_free(zBignum);	/* @4 */
-    TPM_BN_free(yBignum);	/* @5 */
+    TPM_BN_free(yBignum);	/* @4 */
     return rc;
 }
 
@@ -2361,7 +2414,7 @@ TPM_RESULT TPM_DAAJoin_Stage11_Sign_Stage4(tpm_state_t *tpm_state,
     TPM_BIGNUM		yBignum = NULL;	/* freed @2 */
     TPM_BIGNUM		xBignum = NULL;	/* freed @3 */
     TPM_BIGNUM		nBignum = NULL;	/* freed @4 */
-    TPM_BIGNUM		zBignum = NULL;	/* freed @5 */
+    TPM_BIGNUM		zBignum = NULL;	/* owned by DAA_session */
 
     printf("TPM_DAAJoin_Stage11_Sign_Stage4:\n");
     tpm_state = tpm_state;			/* not used */
@@ -2429,14 +2482,11 @@ TPM_RESULT TPM_DAAJoin_Stage11_Sign_Stage4(tpm_state_t *tpm_state,
     /* k. Set Z = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAAJoin_Stage11_Sign_Stage4: Creating Z\n");
-	rc = TPM_bin2bn(&zBignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&zBignum, &(tpm_daa_session_data->DAA_session));
     }
     /* l. Set DAA_session -> DAA_scratch = Z*(X^Y) mod n */
     if (rc == 0) {
-	rc = TPM_ComputeZxAexpPmodn(tpm_daa_session_data->DAA_session.DAA_scratch,
-				    sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
+	rc = TPM_ComputeZxAexpPmodn(&(tpm_daa_session_data->DAA_session),
 				    zBignum,	/* Z */
 				    xBignum,	/* A */
 				    yBignum,	/* P */
@@ -2451,7 +2501,6 @@ TPM_RESULT TPM_DAAJoin_Stage11_Sign_Stage4(tpm_state_t *tpm_state,
     TPM_BN_free(yBignum);	/* @2 */
     TPM_BN_free(xBignum);	/* @3 */
     TPM_BN_free(nBignum);	/* @4 */
-    TPM_BN_free(zBignum);	/* @5 */
     return rc;
 }
 
@@ -2466,7 +2515,7 @@ TPM_RESULT TPM_DAAJoin_Stage12(tpm_state_t *tpm_state,
     TPM_BIGNUM		yBignum = NULL;	/* freed @2 */
     TPM_BIGNUM		xBignum = NULL;	/* freed @3 */
     TPM_BIGNUM		nBignum = NULL;	/* freed @4 */
-    TPM_BIGNUM		zBignum = NULL;	/* freed @5 */
+    TPM_BIGNUM		zBignum = NULL;	/* owned by DAA_session */
 
     printf("TPM_DAAJoin_Stage12:\n");
     tpm_state = tpm_state;			/* not used */
@@ -2533,19 +2582,20 @@ TPM_RESULT TPM_DAAJoin_Stage12(tpm_state_t *tpm_state,
     /* k. Set Z = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAAJoin_Stage12: Creating Z\n");
-	rc = TPM_bin2bn(&zBignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&zBignum, &(tpm_daa_session_data->DAA_session));
     }
     /* l. Set DAA_session -> DAA_scratch = Z*(X^Y) mod n */
     if (rc == 0) {
-	rc = TPM_ComputeZxAexpPmodn(tpm_daa_session_data->DAA_session.DAA_scratch,
-				    sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
+	rc = TPM_ComputeZxAexpPmodn(&(tpm_daa_session_data->DAA_session),
 				    zBignum,	/* Z */
 				    xBignum,	/* A */
 				    yBignum,	/* P */
 				    nBignum);	/* N */
     }
+    /* the byte form of DAA_scratch is used below */
+    if (rc == 0) {
+	rc = TPM_DAAContext_FlushScratch(&(tpm_daa_session_data->DAA_session));
+    }
     /* m. set outputData = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	rc = TPM_SizedBuffer_Set(outputData,
@@ -2563,7 +2613,6 @@ TPM_RESULT TPM_DAAJoin_Stage12(tpm_state_t *tpm_state,
     TPM_BN_free(yBignum);	/* @2 */
     TPM_BN_free(xBignum);	/* @3 */
     TPM_BN_free(nBignum);	/* @4 */
-    TPM_BN_free(zBignum);	/* @5 */
     return rc;
 }
 
@@ -2632,7 +2681,6 @@ TPM_RESULT TPM_DAAJoin_Stage13_Sign_Stage6(tpm_state_t *tpm_state,
     /* FIXME w1 = (w^q) mod n */
     if (rc == 0) {
 	rc = TPM_ComputeAexpPmodn(NULL,
-				  0,
 				  &w1Bignum,	/* R */
 				  wBignum,	/* A */
 				  qBignum,	/* P */
@@ -2645,9 +2693,7 @@ TPM_RESULT TPM_DAAJoin_Stage13_Sign_Stage6(tpm_state_t *tpm_state,
     }
     /* j. Set DAA_session -> DAA_scratch = w */
     if (rc == 0) {
-	rc = TPM_ComputeDAAScratch(tpm_daa_session_data->DAA_session.DAA_scratch,
-				   sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
-				   wBignum);
+	rc = TPM_ComputeDAAScratch(&(tpm_daa_session_data->DAA_session), &wBignum);
     }
     /* k. set outputData = NULL */
     /* NOTE Done by caller */
@@ -2668,9 +2714,9 @@ TPM_RESULT TPM_DAAJoin_Stage14_Sign_Stage7(tpm_state_t *tpm_state,
 {
     TPM_RESULT		rc = 0;
     TPM_BIGNUM		fBignum = NULL;	/* freed @1 */
-    TPM_BIGNUM		wBignum = NULL;	/* freed @2 */
-    TPM_BIGNUM		nBignum = NULL;	/* freed @3 */
-    TPM_BIGNUM		eBignum = NULL;	/* freed @4 */
+    TPM_BIGNUM		wBignum = NULL;	/* owned by DAA_session */
+    TPM_BIGNUM		nBignum = NULL;	/* freed @2 */
+    TPM_BIGNUM		eBignum = NULL;	/* freed @3 */
 
     unsigned int	numBytes;	/* for debug */
 
@@ -2711,9 +2757,7 @@ TPM_RESULT TPM_DAAJoin_Stage14_Sign_Stage7(tpm_state_t *tpm_state,
     /* FIXME Set W = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAAJoin_Stage14_Sign_Stage7: Creating W\n");
-	rc = TPM_bin2bn(&wBignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&wBignum, &(tpm_daa_session_data->DAA_session));
     }
     if (rc == 0) {
 	rc = TPM_BN_num_bytes(&numBytes, wBignum);
@@ -2732,7 +2776,6 @@ TPM_RESULT TPM_DAAJoin_Stage14_Sign_Stage7(tpm_state_t *tpm_state,
     /* FIXME E = (w^f) mod n */
     if (rc == 0) {
 	rc = TPM_ComputeAexpPmodn(NULL,
-				  0,
 				  &eBignum,	/* R */
 				  wBignum,	/* A */
 				  fBignum,	/* P */
@@ -2749,9 +2792,8 @@ TPM_RESULT TPM_DAAJoin_Stage14_Sign_Stage7(tpm_state_t *tpm_state,
     /* NOTE Done by common code */
     /* j. return TPM_SUCCESS. */
     TPM_BN_free(fBignum);	/* @1 */
-    TPM_BN_free(wBignum);	/* @2 */
-    TPM_BN_free(nBignum);	/* @3 */
-    TPM_BN_free(eBignum);	/* @4 */
+    TPM_BN_free(nBignum);	/* @2 */
+    TPM_BN_free(eBignum);	/* @3 */
     return rc;
 }
 
@@ -2770,7 +2812,7 @@ TPM_RESULT TPM_DAAJoin_Stage15_Sign_Stage8(tpm_state_t *tpm_state,
     TPM_BIGNUM		e1Bignum = NULL;	/* freed @7 */
     TPM_BIGNUM		qBignum = NULL;		/* freed @8 */
     TPM_BIGNUM		nBignum = NULL;		/* freed @9 */
-    TPM_BIGNUM		wBignum = NULL;		/* freed @10 */
+    TPM_BIGNUM		wBignum = NULL;		/* owned by DAA_session */
 
     printf("TPM_DAAJoin_Stage15_Sign_Stage8:\n");
     tpm_state = tpm_state;			/* not used */
@@ -2859,15 +2901,12 @@ TPM_RESULT TPM_DAAJoin_Stage15_Sign_Stage8(tpm_state_t *tpm_state,
     /* FIXME Set w = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAAJoin_Stage15_Sign_Stage8: Creating w from DAA_scratch\n");
-	rc = TPM_bin2bn(&wBignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&wBignum, &(tpm_daa_session_data->DAA_session));
     }
     /* i. set E1 = ((DAA_session -> DAA_scratch)^r) mod (DAA_generic_gamma). */
     /* (w ^ r) mod n */
     if (rc == 0) {
 	rc = TPM_ComputeAexpPmodn(NULL,
-				  0,
 				  &e1Bignum,	/* R */
 				  wBignum,	/* A */
 				  rBignum,	/* P */
@@ -2895,7 +2934,6 @@ TPM_RESULT TPM_DAAJoin_Stage15_Sign_Stage8(tpm_state_t *tpm_state,
     TPM_BN_free(e1Bignum);	/* @7 */
     TPM_BN_free(qBignum);	/* @8 */
     TPM_BN_free(nBignum);	/* @9 */
-    TPM_BN_free(wBignum);	/* @10 */
     return rc;
 }
 
@@ -3279,9 +3317,7 @@ TPM_RESULT TPM_DAAJoin_Stage20(tpm_state_t *tpm_state,
     }
     /* g. Set DAA_session -> DAA_scratch = s12 */
     if (rc == 0) {
-	rc = TPM_ComputeDAAScratch(tpm_daa_session_data->DAA_session.DAA_scratch,
-				   sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
-				   s12sBignum);
+	rc = TPM_ComputeDAAScratch(&(tpm_daa_session_data->DAA_session), &s12sBignum);
     }
     /* h. Set outputData = DAA_session -> DAA_digest */
     if (rc == 0) {
@@ -3310,7 +3346,7 @@ TPM_RESULT TPM_DAAJoin_Stage21(tpm_state_t *tpm_state,
     TPM_BIGNUM		s3Bignum = NULL;	/* freed @3 */
     TPM_BIGNUM		cBignum = NULL;		/* freed @4 */
     TPM_BIGNUM		u1Bignum = NULL;	/* freed @5 */
-    TPM_BIGNUM		s12Bignum = NULL;	/* freed @6 */
+    TPM_BIGNUM		s12Bignum = NULL;	/* owned by DAA_session */
 
     unsigned int	numBytes;	/* just for debug */
 
@@ -3374,9 +3410,7 @@ TPM_RESULT TPM_DAAJoin_Stage21(tpm_state_t *tpm_state,
     /* FIXME Set s12 = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAAJoin_Stage21: Creating s12 from DAA_session -> DAA_scratch\n");
-	rc = TPM_bin2bn(&s12Bignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&s12Bignum, &(tpm_daa_session_data->DAA_session));
     }
     if (rc == 0) {
 	rc = TPM_BN_num_bytes(&numBytes, s12Bignum);
@@ -3412,7 +3446,6 @@ TPM_RESULT TPM_DAAJoin_Stage21(tpm_state_t *tpm_state,
     TPM_BN_free(s3Bignum);	/* @3 */
     TPM_BN_free(cBignum);	/* @4 */
     TPM_BN_free(u1Bignum);	/* @5 */
-    TPM_BN_free(s12Bignum);	/* @6 */
     return rc;
 }
 
@@ -3508,9 +3541,7 @@ TPM_RESULT TPM_DAAJoin_Stage22(tpm_state_t *tpm_state,
     }
     /* j. Set DAA_session -> DAA_scratch = v10 */
     if (rc == 0) {
-	rc = TPM_ComputeDAAScratch(tpm_daa_session_data->DAA_session.DAA_scratch,
-				   sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
-				   v10sBignum);
+	rc = TPM_ComputeDAAScratch(&(tpm_daa_session_data->DAA_session), &v10sBignum);
     }
     /* k. Set outputData */
     /* i. Fill in TPM_DAA_BLOB with a type of TPM_RT_DAA_V0 and encrypt the v0 parameters using
@@ -3555,11 +3586,11 @@ TPM_RESULT TPM_DAAJoin_Stage23(tpm_state_t *tpm_state,
     TPM_BIGNUM		u1Bignum = NULL;	/* freed @1 */
     TPM_BIGNUM		u3Bignum = NULL;	/* freed @2 */
     TPM_BIGNUM		v1Bignum = NULL;	/* freed @3 */
-    TPM_BIGNUM		v10Bignum = NULL;	/* freed @4 */
+    TPM_BIGNUM		v10Bignum = NULL;	/* owned by DAA_session */
     TPM_DAA_SENSITIVE	tpm_daa_sensitive;
 
     printf("TPM_DAAJoin_Stage23:\n");
-    TPM_DAASensitive_Init(&tpm_daa_sensitive);	/* freed @5 */
+    TPM_DAASensitive_Init(&tpm_daa_sensitive);	/* freed @4 */
     /* a. Verify that DAA_session ->DAA_stage==23. Return TPM_DAA_STAGE and flush handle on
        mismatch */
     /* NOTE Done by common code */
@@ -3594,9 +3625,7 @@ TPM_RESULT TPM_DAAJoin_Stage23(tpm_state_t *tpm_state,
     /* FIXME Set v10 = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAAJoin_Stage23: Creating v10\n");
-	rc = TPM_bin2bn(&v10Bignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&v10Bignum, &(tpm_daa_session_data->DAA_session));
     }
     if (rc == 0) {
 	rc = TPM_BN_new(&v1Bignum);
@@ -3648,8 +3677,7 @@ TPM_RESULT TPM_DAAJoin_Stage23(tpm_state_t *tpm_state,
     TPM_BN_free(u1Bignum);				/* @1 */
     TPM_BN_free(u3Bignum);				/* @2 */
     TPM_BN_free(v1Bignum);				/* @3 */
-    TPM_BN_free(v10Bignum);				/* @4 */
-    TPM_DAASensitive_Delete(&tpm_daa_sensitive);	/* @5 */ 
+    TPM_DAASensitive_Delete(&tpm_daa_sensitive);	/* @4 */ 
     return rc;
 }
 
@@ -3818,7 +3846,7 @@ TPM_RESULT TPM_DAASign_Stage05(tpm_state_t *tpm_state,
     TPM_BIGNUM		yBignum = NULL;	/* freed @2 */
     TPM_BIGNUM		xBignum = NULL;	/* freed @3 */
     TPM_BIGNUM		nBignum = NULL;	/* freed @4 */
-    TPM_BIGNUM		zBignum = NULL;	/* freed @5 */
+    TPM_BIGNUM		zBignum = NULL;	/* owned by DAA_session */
 
     printf("TPM_DAASign_Stage05:\n");
     tpm_state = tpm_state;		/* not used */
@@ -3885,19 +3913,20 @@ TPM_RESULT TPM_DAASign_Stage05(tpm_state_t *tpm_state,
     /* k. Set Z = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAASign_Stage05: Creating Z\n");
-	rc = TPM_bin2bn(&zBignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&zBignum, &(tpm_daa_session_data->DAA_session));
     }
     /* l. Set DAA_session -> DAA_scratch = Z*(X^Y) mod n */
     if (rc == 0) {
-	rc = TPM_ComputeZxAexpPmodn(tpm_daa_session_data->DAA_session.DAA_scratch,
-				    sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
+	rc = TPM_ComputeZxAexpPmodn(&(tpm_daa_session_data->DAA_session),
 				    zBignum,	/* Z */
 				    xBignum,	/* A */
 				    yBignum,	/* P */
 				    nBignum);	/* N */
     }
+    /* the byte form of DAA_scratch is used below */
+    if (rc == 0) {
+	rc = TPM_DAAContext_FlushScratch(&(tpm_daa_session_data->DAA_session));
+    }
     /* m. set outputData = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	rc = TPM_SizedBuffer_Set(outputData,
@@ -3915,7 +3944,6 @@ TPM_RESULT TPM_DAASign_Stage05(tpm_state_t *tpm_state,
     TPM_BN_free(yBignum);	/* @2 */
     TPM_BN_free(xBignum);	/* @3 */
     TPM_BN_free(nBignum);	/* @4 */
-    TPM_BN_free(zBignum);	/* @5 */
     return rc;
 }
 			       
@@ -4244,9 +4272,7 @@ TPM_RESULT TPM_DAASign_Stage14(tpm_state_t *tpm_state,
     }
     /* i. Set DAA_session -> DAA_scratch = s12 */
     if (rc == 0) {
-	rc = TPM_ComputeDAAScratch(tpm_daa_session_data->DAA_session.DAA_scratch,
-				   sizeof(tpm_daa_session_data->DAA_session.DAA_scratch),
-				   s12sBignum);
+	rc = TPM_ComputeDAAScratch(&(tpm_daa_session_data->DAA_session), &s12sBignum);
     }
     /* j. set outputData = NULL */
     /* NOTE Done by caller */
@@ -4274,11 +4300,11 @@ TPM_RESULT TPM_DAASign_Stage15(tpm_state_t *tpm_state,
     TPM_BIGNUM		s3Bignum = NULL;	/* freed @3 */
     TPM_BIGNUM		cBignum = NULL;		/* freed @4 */
     TPM_BIGNUM		v1Bignum = NULL;	/* freed @5 */
-    TPM_BIGNUM		s12Bignum = NULL;	/* freed @6 */
+    TPM_BIGNUM		s12Bignum = NULL;	/* owned by DAA_session */
     TPM_DAA_SENSITIVE	tpm_daa_sensitive;
 
     printf("TPM_DAASign_Stage15:\n");
-    TPM_DAASensitive_Init(&tpm_daa_sensitive);	/* freed @7 */
+    TPM_DAASensitive_Init(&tpm_daa_sensitive);	/* freed @6 */
     /* a. Verify that DAA_session ->DAA_stage==15. Return TPM_DAA_STAGE and flush handle on
        mismatch */
     /* NOTE Done by common code */
@@ -4342,9 +4368,7 @@ TPM_RESULT TPM_DAASign_Stage15(tpm_state_t *tpm_state,
     /* FIXME Set s12 = DAA_session -> DAA_scratch */
     if (rc == 0) {
 	printf("TPM_DAASign_Stage15: Creating s12 from DAA_session -> DAA_scratch\n");
-	rc = TPM_bin2bn(&s12Bignum,
-			tpm_daa_session_data->DAA_session.DAA_scratch,
-			sizeof(tpm_daa_session_data->DAA_session.DAA_scratch));
+	rc = TPM_DAAContext_GetScratch(&s12Bignum, &(tpm_daa_session_data->DAA_session));
     }
     /* s3 = r4 + c * v1 + s12 */
     if (rc == 0) {
@@ -4373,8 +4397,7 @@ TPM_RESULT TPM_DAASign_Stage15(tpm_state_t *tpm_state,
     TPM_BN_free(s3Bignum);				/* @3 */
     TPM_BN_free(cBignum);				/* @4 */
     TPM_BN_free(v1Bignum);				/* @5 */
-    TPM_BN_free(s12Bignum);				/* @6 */
-    TPM_DAASensitive_Delete(&tpm_daa_sensitive);	/* @7 */
+    TPM_DAASensitive_Delete(&tpm_daa_sensitive);	/* @6 */
     return rc;
 }
 
@@ -4390,10 +4413,14 @@ TPM_RESULT TPM_DAADigestContext_GenerateDigestJoin(TPM_DIGEST tpm_digest,
 						   TPM_DAA_SESSION_DATA *tpm_daa_session_data)
 {
     TPM_RESULT		rc = 0;
-    TPM_STORE_BUFFER	sbuffer;	/* TPM_STORED_DATA serialization */
+    TPM_SHA1_CONTEXT	context;	/* caller owned, nothing to free */
+    TPM_STORE_BUFFER	sbuffer;	/* digest sink of the DAA serialization */
     
     printf(" TPM_DAADigestContext_GenerateDigestJoin:\n");
-    TPM_Sbuffer_Init(&sbuffer);			/* freed @1 */
+    TPM_Sbuffer_InitDigest(&sbuffer, &context);	/* freed @1 */
+    if (rc == 0) {
+	rc = TPM_Sha1Context_Init(&context);
+    }
     /* serialize DAA_tpmSpecific */
     if (rc == 0) {
 	rc = TPM_DAATpm_Store(&sbuffer, &(tpm_daa_session_data->DAA_tpmSpecific));
@@ -4503,11 +4530,10 @@ TPM_RESULT TPM_ComputeF(TPM_BIGNUM *fBignum,		/* freed by caller */
 
    rBignum is new'ed by this function and must be freed by the caller
 
-   If DAA_scratch is not NULL, r is returned in DAA_scratch.
+   If tpm_daa_context is not NULL, R is moved to its DAA_scratch and *rBignum is set to NULL.
 */
 
-TPM_RESULT TPM_ComputeAexpPmodn(BYTE *DAA_scratch,
-				uint32_t DAA_scratch_size,
+TPM_RESULT TPM_ComputeAexpPmodn(TPM_DAA_CONTEXT *tpm_daa_context,
 				TPM_BIGNUM *rBignum,	/* freed by caller */
 				TPM_BIGNUM aBignum,
 				TPM_BIGNUM pBignum,
@@ -4523,19 +4549,19 @@ TPM_RESULT TPM_ComputeAexpPmodn(BYTE *DAA_scratch,
 	rc = TPM_BN_mod_exp(*rBignum, aBignum, pBignum, nBignum);
     }
     /* if the result should be returned in DAA_scratch */
-    if ((rc == 0) && (DAA_scratch != NULL)) {
+    if ((rc == 0) && (tpm_daa_context != NULL)) {
 	/* store the result in DAA_scratch */
-	rc = TPM_ComputeDAAScratch(DAA_scratch, DAA_scratch_size, *rBignum);
+	rc = TPM_ComputeDAAScratch(tpm_daa_context, rBignum);
     }
     return rc;
 }
 
 /* TPM_ComputeZxAexpPmodn() performs DAA_scratch = Z * (A ^ P) mod n.
 
+   Z may be the DAA_scratch bignum itself.
 */
 
-TPM_RESULT TPM_ComputeZxAexpPmodn(BYTE *DAA_scratch,
-				  uint32_t DAA_scratch_size,
+TPM_RESULT TPM_ComputeZxAexpPmodn(TPM_DAA_CONTEXT *tpm_daa_context,
 				  TPM_BIGNUM zBignum,
 				  TPM_BIGNUM aBignum,
 				  TPM_BIGNUM pBignum,
@@ -4548,7 +4574,6 @@ TPM_RESULT TPM_ComputeZxAexpPmodn(BYTE *DAA_scratch,
     if (rc == 0) {
 	printf("  TPM_ComputeZxAexpPmodn: Calculate R = A ^ P mod n\n");
 	rc = TPM_ComputeAexpPmodn(NULL,		/* DAA_scratch */
-				  0,
 				  &rBignum,	/* R */
 				  aBignum,	/* A */
 				  pBignum,
@@ -4560,7 +4585,7 @@ TPM_RESULT TPM_ComputeZxAexpPmodn(BYTE *DAA_scratch,
     }
     /* store the result in DAA_scratch */
     if (rc == 0) {
-	rc = TPM_ComputeDAAScratch(DAA_scratch, DAA_scratch_size, rBignum);
+	rc = TPM_ComputeDAAScratch(tpm_daa_context, &rBignum);
     }
     TPM_BN_free(rBignum);	/* @1 */
     return rc;
@@ -4641,17 +4666,33 @@ TPM_RESULT TPM_ComputeApBxCpD(TPM_BIGNUM *rBignum, /* freed by caller */
 
 /* TPM_ComputeDAAScratch() stores 'bn' in DAA_scratch
 
+   The bignum is moved to the context, where it stays resident until the context is serialized.
+   *bn is set to NULL.
 */
 
-TPM_RESULT TPM_ComputeDAAScratch(BYTE *DAA_scratch,
-				 uint32_t DAA_scratch_size,
-				 TPM_BIGNUM bn)
+TPM_RESULT TPM_ComputeDAAScratch(TPM_DAA_CONTEXT *tpm_daa_context,
+				 TPM_BIGNUM *bn)
 {
     TPM_RESULT		rc = 0;
+    unsigned int	numBytes;
 
     printf(" TPM_ComputeDAAScratch:\n");
+    /* check the size now, so that serializing the context later cannot fail */
+    if (rc == 0) {
+	rc = TPM_BN_num_bytes(&numBytes, *bn);
+    }
+    if (rc == 0) {
+	if (numBytes > sizeof(tpm_daa_context->DAA_scratch)) {
+            printf("TPM_ComputeDAAScratch: Error, "
+                   "BN bytes %u greater than DAA_scratch bytes %lu\n",
+		   numBytes, (unsigned long)sizeof(tpm_daa_context->DAA_scratch));
+            rc = TPM_SIZE;
+	}
+    }
     if (rc == 0) {
-	rc = TPM_bn2binArray(DAA_scratch, DAA_scratch_size, bn);
+	TPM_BN_clear_free(tpm_daa_context->DAA_scratchBignum);
+	tpm_daa_context->DAA_scratchBignum = *bn;
+	*bn = NULL;
     }
     return rc;
 }
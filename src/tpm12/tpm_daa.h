@@ -138,6 +138,9 @@ TPM_RESULT TPM_DAAContext_Store(TPM_STORE_BUFFER *sbuffer,
 void       TPM_DAAContext_Delete(TPM_DAA_CONTEXT *tpm_daa_context);
 
 void       TPM_DAAContext_Copy(TPM_DAA_CONTEXT *dest_daa_context, TPM_DAA_CONTEXT *src_daa_context);
+TPM_RESULT TPM_DAAContext_GetScratch(TPM_BIGNUM *bn,
+                                     TPM_DAA_CONTEXT *tpm_daa_context);
+TPM_RESULT TPM_DAAContext_FlushScratch(TPM_DAA_CONTEXT *tpm_daa_context);
 
 /*
   TPM_DAA_JOINDATA
@@ -190,14 +193,12 @@ TPM_RESULT TPM_DAASession_CheckStage(TPM_DAA_SESSION_DATA *tpm_daa_session_data,
                                      BYTE stage);
 TPM_RESULT TPM_ComputeF(TPM_BIGNUM *fBignum,
                         TPM_DAA_SESSION_DATA *tpm_daa_session_data);
-TPM_RESULT TPM_ComputeAexpPmodn(BYTE *DAA_scratch,
-                                uint32_t DAA_scratch_size,
+TPM_RESULT TPM_ComputeAexpPmodn(TPM_DAA_CONTEXT *tpm_daa_context,
                                 TPM_BIGNUM *rBignum,
                                 TPM_BIGNUM xBignum,
                                 TPM_BIGNUM fBignum,
                                 TPM_BIGNUM nBignum);
-TPM_RESULT TPM_ComputeZxAexpPmodn(BYTE *DAA_scratch,
-                                  uint32_t DAA_scratch_size,
+TPM_RESULT TPM_ComputeZxAexpPmodn(TPM_DAA_CONTEXT *tpm_daa_context,
                                   TPM_BIGNUM zBignum,
                                   TPM_BIGNUM aBignum,
                                   TPM_BIGNUM pBignum,
@@ -215,9 +216,8 @@ TPM_RESULT TPM_ComputeApBxCpD(TPM_BIGNUM *rBignum,
                               TPM_BIGNUM bBignum,
                               TPM_BIGNUM cBignum,
                               TPM_BIGNUM dBignum);
-TPM_RESULT TPM_ComputeDAAScratch(BYTE *DAA_scratch,
-                                 uint32_t DAA_scratch_size,
-                                 TPM_BIGNUM bn);
+TPM_RESULT TPM_ComputeDAAScratch(TPM_DAA_CONTEXT *tpm_daa_context,
+                                 TPM_BIGNUM *bn);
 TPM_RESULT TPM_ComputeEnlarge(unsigned char **out,
                               uint32_t outSize,
                               unsigned char *in,
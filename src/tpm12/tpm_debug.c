@@ -44,6 +44,8 @@
 
 #include "tpm_debug.h"
 #undef printf
+#undef TPM_PrintFour
+#undef TPM_PrintAll
 
 #if 0
 
@@ -64,6 +64,27 @@ extern int swallow_rc;
 #endif  /* TPM_DEBUG */
 #endif
 
-#define printf(...) TPMLIB_LogPrintf(__VA_ARGS__);
+/* TPM_TRACE_ACTIVE() is TRUE if a trace line indented by 'indent' spaces is printed.  Callers use it
+   to skip trace-only work, such as walking state, when the output would be discarded. */
+
+#ifdef TPM_NOTRACE      /* trace compiled out, the arguments are still type checked */
+
+#define TPM_TRACE_ACTIVE(indent) 0
+
+#define printf(...) do { if (0) TPMLIB_LogPrintf(__VA_ARGS__); } while (0)
+
+#else
+
+#define TPM_TRACE_ACTIVE(indent) (tpmlib_log_level > (unsigned int)(indent))
+
+/* the level check is inline, so disabled trace does not evaluate the arguments or call out */
+#define printf(...) do { if (tpmlib_log_level) TPMLIB_LogPrintf(__VA_ARGS__); } while (0)
+
+#endif  /* TPM_NOTRACE */
+
+#define TPM_PrintFour(string, buff) \
+    do { if (TPM_TRACE_ACTIVE(0)) TPM_PrintFour(string, buff); } while (0)
+#define TPM_PrintAll(string, buff, length) \
+    do { if (TPM_TRACE_ACTIVE(0)) TPM_PrintAll(string, buff, length); } while (0)
 
 #endif
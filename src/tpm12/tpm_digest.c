@@ -40,6 +40,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "tpm_cryptoh.h"
 #include "tpm_debug.h"
 #include "tpm_error.h"
 #include "tpm_structures.h"
@@ -106,12 +107,8 @@ void TPM_Digest_Copy(TPM_DIGEST destination, const TPM_DIGEST source)
 
 void TPM_Digest_XOR(TPM_DIGEST out, const TPM_DIGEST in1, const TPM_DIGEST in2)
 {
-    size_t i;
-    
     printf(" TPM_Digest_XOR:\n");
-    for (i = 0 ; i < TPM_DIGEST_SIZE ; i++) {
-	out[i] = in1[i] ^ in2[i];
-    }
+    TPM_XOR(out, in1, in2, TPM_DIGEST_SIZE);
     return;
 }
 
@@ -40,7 +40,9 @@
 #include <string.h>
 #include <stdio.h>
 
+#include "tpm_arena.h"
 #include "tpm_crypto.h"
+#include "tpm_cryptoh.h"
 #include "tpm_debug.h"
 #include "tpm_digest.h"
 #include "tpm_error.h"
@@ -112,6 +114,8 @@ TPM_RESULT TPM_Global_Init(tpm_state_t *tpm_state)
 	tpm_state->transportHandle = 0;
         printf("TPM_Global_Init: Initializing TPM_NV_INDEX_ENTRIES\n");
 	TPM_NVIndexEntries_Init(&(tpm_state->tpm_nv_index_entries));
+	TPM_Arena_Init(&(tpm_state->tpm_arena));
+	TPM_DrbgContext_Init(&(tpm_state->tpm_drbg_context));
     }
     /* comes up in limited operation mode */
     /* shutdown is set on a self test failure, before calling TPM_Global_Init() */
@@ -200,6 +204,8 @@ void TPM_Global_Delete(tpm_state_t *tpm_state)
 	TPM_SHA1Delete(&(tpm_state->sha1_context));
 	TPM_SHA1Delete(&(tpm_state->sha1_context_tis));
 	TPM_NVIndexEntries_Delete(&(tpm_state->tpm_nv_index_entries));
+	TPM_Arena_Delete(&(tpm_state->tpm_arena));
+	TPM_DrbgContext_Delete(&(tpm_state->tpm_drbg_context));
     }
     return;
 }
@@ -77,6 +77,10 @@ typedef struct tdTPM_STATE
        have been read.  The index not being present indicates that some volatile fields should be
        cleared at first read. */
     TPM_NV_INDEX_ENTRIES tpm_nv_index_entries;
+    /* Command arena for ordinal temporaries, reset at the end of each TPM_Process() */
+    TPM_ARENA tpm_arena;
+    /* TPM_Random() DRBG, instantiated on first use, never serialized */
+    TPM_DRBG_CONTEXT tpm_drbg_context;
     /* NOTE: members added here should be initialized by TPM_Global_Init() and possibly added to
        TPM_SaveState_Load() and TPM_SaveState_Store() */
 } tpm_state_t;
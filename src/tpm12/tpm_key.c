@@ -50,6 +50,7 @@
 #include "tpm_error.h"
 #include "tpm_init.h"
 #include "tpm_io.h"
+#include "tpm_keypool.h"
 #include "tpm_load.h"
 #include "tpm_memory.h"
 #include "tpm_nonce.h"
@@ -101,6 +102,8 @@ void TPM_Key_Init(TPM_KEY *tpm_key)
     tpm_key->tpm_pcr_info_long = NULL;
     tpm_key->tpm_store_asymkey = NULL;
     tpm_key->tpm_migrate_asymkey = NULL;
+    tpm_key->tpm_rsa_pri_token = NULL;
+    tpm_key->tpm_rsa_pub_token = NULL;
     return;
 }
 
@@ -665,6 +668,8 @@ void TPM_Key_Delete(TPM_KEY *tpm_key)
 	free(tpm_key->tpm_store_asymkey);
 	TPM_MigrateAsymkey_Delete(tpm_key->tpm_migrate_asymkey);
 	free(tpm_key->tpm_migrate_asymkey);
+	TPM_RSAPrivateKeyToken_Free(&(tpm_key->tpm_rsa_pri_token));
+	TPM_RSAPublicKeyToken_Free(&(tpm_key->tpm_rsa_pub_token));
 	TPM_Key_Init(tpm_key);
     }
     return;
@@ -772,6 +777,10 @@ TPM_RESULT TPM_Key_CheckProperties(int *ver,
 
    Call this function when a key is loaded, either from the host (stream is decrypted encData) or
    from permanent data or saved state (stream was clear text).
+
+   Only the prime factor p is loaded.  The conversion to the private key is deferred to the first
+   private key use, see TPM_Key_GetPrivateKey(), so that loading a key that is never used for a
+   private key operation does not pay for it.
 */
 
 TPM_RESULT TPM_Key_LoadStoreAsymKey(TPM_KEY *tpm_key,
@@ -806,7 +815,7 @@ TPM_RESULT TPM_Key_LoadStoreAsymKey(TPM_KEY *tpm_key,
 	TPM_StoreAsymkey_Init(tpm_key->tpm_store_asymkey);
 	rc = TPM_StoreAsymkey_Load(tpm_key->tpm_store_asymkey, isEK,
 				   stream, stream_size,
-				   &(tpm_key->algorithmParms), &(tpm_key->pubKey));
+				   NULL, NULL);		/* convert on first use */
 	TPM_PrintFour("  TPM_Key_LoadStoreAsymKey: usageAuth",
 		      tpm_key->tpm_store_asymkey->usageAuth);
     }
@@ -942,6 +951,9 @@ TPM_RESULT TPM_Key_GetPrimeFactorP(uint32_t 		*pbytes,
 }
 
 /* TPM_Key_GetPrivateKey() gets the private key from the TPM_STORE_ASYMKEY contained in a TPM_KEY
+
+   If the key was loaded with only the prime factor p, the private key and CRT parameters are
+   calculated on the first call and cached in the TPM_STORE_ASYMKEY.
  */
 
 TPM_RESULT TPM_Key_GetPrivateKey(uint32_t	*dbytes,
@@ -955,6 +967,11 @@ TPM_RESULT TPM_Key_GetPrivateKey(uint32_t	*dbytes,
     if (rc == 0) {
 	rc = TPM_Key_GetStoreAsymkey(&tpm_store_asymkey, tpm_key);
     }
+    /* convert prime factor p to the private key on first use */
+    if ((rc == 0) && (tpm_store_asymkey->privKey.d_key.size == 0)) {
+	rc = TPM_StorePrivkey_Convert(tpm_store_asymkey,
+				      &(tpm_key->algorithmParms), &(tpm_key->pubKey));
+    }
     if (rc == 0) {
 	*dbytes = tpm_store_asymkey->privKey.d_key.size;
 	*darr = tpm_store_asymkey->privKey.d_key.buffer;
@@ -962,6 +979,120 @@ TPM_RESULT TPM_Key_GetPrivateKey(uint32_t	*dbytes,
     return rc;
 }
 
+/* TPM_Key_GetPrivateKeyToken() gets the crypto library private key token for a TPM_KEY.
+
+   The token is constructed from n, e, d on the first call and cached in the TPM_KEY, so that
+   subsequent private key operations on a loaded key skip the key setup.  It is freed by
+   TPM_Key_Delete(), e.g. when the key handle is flushed or evicted.
+
+   The caller must not free the token.
+*/
+
+TPM_RESULT TPM_Key_GetPrivateKeyToken(void **rsa_pri_token,
+				      TPM_KEY *tpm_key)
+{
+    TPM_RESULT		rc = 0;
+    unsigned char	*narr;		/* public modulus */
+    uint32_t		nbytes;
+    unsigned char	*earr;		/* public exponent */
+    uint32_t		ebytes;
+    unsigned char	*darr;		/* private exponent */
+    uint32_t		dbytes;
+    TPM_STORE_ASYMKEY	*tpm_store_asymkey;
+    TPM_STORE_PRIVKEY	*privKey;
+
+    printf(" TPM_Key_GetPrivateKeyToken:\n");
+    if ((rc == 0) && (tpm_key->tpm_rsa_pri_token == NULL)) {
+	/* extract the public key from TPM_KEY */
+	if (rc == 0) {
+	    rc = TPM_Key_GetPublicKey(&nbytes, &narr, tpm_key);
+	}
+	/* extract the private key from TPM_KEY */
+	if (rc == 0) {
+	    rc = TPM_Key_GetPrivateKey(&dbytes, &darr, tpm_key);
+	}
+	/* extract the exponent from TPM_KEY */
+	if (rc == 0) {
+	    rc = TPM_Key_GetExponent(&ebytes, &earr, tpm_key);
+	}
+	if (rc == 0) {
+	    rc = TPM_Key_GetStoreAsymkey(&tpm_store_asymkey, tpm_key);
+	}
+	if (rc == 0) {
+	    privKey = &(tpm_store_asymkey->privKey);
+	    /* the CRT parameters are used if they were calculated */
+	    if ((privKey->q_key.size != 0) && (privKey->dp_key.size != 0) &&
+		(privKey->dq_key.size != 0) && (privKey->qinv_key.size != 0)) {
+		rc = TPM_RSAPrivateKeyToken_New(&(tpm_key->tpm_rsa_pri_token),
+						narr, nbytes,
+						earr, ebytes,
+						darr, dbytes,
+						privKey->p_key.buffer, privKey->p_key.size,
+						privKey->q_key.buffer, privKey->q_key.size,
+						privKey->dp_key.buffer, privKey->dp_key.size,
+						privKey->dq_key.buffer, privKey->dq_key.size,
+						privKey->qinv_key.buffer, privKey->qinv_key.size);
+	    }
+	    else {
+		rc = TPM_RSAPrivateKeyToken_New(&(tpm_key->tpm_rsa_pri_token),
+						narr, nbytes,
+						earr, ebytes,
+						darr, dbytes,
+						NULL, 0,	/* no CRT parameters */
+						NULL, 0,
+						NULL, 0,
+						NULL, 0,
+						NULL, 0);
+	    }
+	}
+    }
+    if (rc == 0) {
+	*rsa_pri_token = tpm_key->tpm_rsa_pri_token;
+    }
+    return rc;
+}
+
+/* TPM_Key_GetPublicKeyToken() gets the crypto library public key token for a TPM_KEY.
+
+   Like the private key token, it is constructed on first use and freed by TPM_Key_Delete().  For
+   the EK and SRK, which live in TPM_PERMANENT_DATA rather than in a key handle entry, this keeps
+   the prepared key until the key itself is replaced, e.g. by TPM_TakeOwnership, TPM_OwnerClear,
+   or TPM_ForceClear.
+
+   The caller must not free the token.
+*/
+
+TPM_RESULT TPM_Key_GetPublicKeyToken(void **rsa_pub_token,
+				     TPM_KEY *tpm_key)
+{
+    TPM_RESULT		rc = 0;
+    unsigned char	*narr;		/* public modulus */
+    uint32_t		nbytes;
+    unsigned char	*earr;		/* public exponent */
+    uint32_t		ebytes;
+
+    printf(" TPM_Key_GetPublicKeyToken:\n");
+    if ((rc == 0) && (tpm_key->tpm_rsa_pub_token == NULL)) {
+	/* extract the public key from TPM_KEY */
+	if (rc == 0) {
+	    rc = TPM_Key_GetPublicKey(&nbytes, &narr, tpm_key);
+	}
+	/* extract the exponent from TPM_KEY */
+	if (rc == 0) {
+	    rc = TPM_Key_GetExponent(&ebytes, &earr, tpm_key);
+	}
+	if (rc == 0) {
+	    rc = TPM_RSAPublicKeyToken_New(&(tpm_key->tpm_rsa_pub_token),
+					   narr, nbytes,
+					   earr, ebytes);
+	}
+    }
+    if (rc == 0) {
+	*rsa_pub_token = tpm_key->tpm_rsa_pub_token;
+    }
+    return rc;
+}
+
 /* TPM_Key_GetExponent() gets the exponent key from the TPM_RSA_KEY_PARMS contained in a TPM_KEY
  */
 
@@ -1035,6 +1166,9 @@ TPM_RESULT TPM_Key_GetLocalityAtRelease(TPM_LOCALITY_SELECTION *localityAtReleas
 
    It returns the TPM_KEY object.
 
+   The key pair is taken from the RSA key pool if a matching one is available, and generated
+   otherwise.
+
    Call tree:
 	local - sets tpm_store_asymkey->privkey
 	TPM_Key_Set - sets keyUsage, keyFlags, authDataUsage, algorithmParms
@@ -1042,6 +1176,7 @@ TPM_RESULT TPM_Key_GetLocalityAtRelease(TPM_LOCALITY_SELECTION *localityAtReleas
 	    TPM_Key_GeneratePubDataDigest - pubDataDigest
 		TPM_Key_Store
 		    TPM_Key_StorePubData - serializes tpm_pcr_info cache
+	TPM_StorePrivkey_Convert - sets tpm_store_asymkey->privkey CRT parameters
 */
 
 TPM_RESULT TPM_Key_GenerateRSA(TPM_KEY *tpm_key,		/* output created key */
@@ -1066,6 +1201,7 @@ TPM_RESULT TPM_Key_GenerateRSA(TPM_KEY *tpm_key,		/* output created key */
     unsigned char	*p = NULL;	/* prime factor */
     unsigned char	*q = NULL;	/* prime factor */
     unsigned char	*d = NULL;	/* private key */
+    TPM_BOOL		found = FALSE;	/* key pair from the pool */
     
     printf(" TPM_Key_GenerateRSA:\n");
     /* extract the TPM_RSA_KEY_PARMS from TPM_KEY_PARMS */
@@ -1085,8 +1221,21 @@ TPM_RESULT TPM_Key_GenerateRSA(TPM_KEY *tpm_key,		/* output created key */
     if (rc == 0) {
 	TPM_StoreAsymkey_Init(tpm_key->tpm_store_asymkey);
     }
-    /* generate the key pair */
+#ifdef TPM_RSA_KEYPOOL
+    /* take a pre-generated key pair from the pool if one matches */
     if (rc == 0) {
+	TPM_RSAKeyPool_Get(&found,
+			   &n,		/* public key (modulus) freed @3 */
+			   &p,		/* private prime factor freed @4 */
+			   &q,		/* private prime factor freed @5 */
+			   &d,		/* private key (private exponent) freed @6 */
+			   tpm_rsa_key_parms->keyLength,	/* key size in bits */
+			   earr,	/* public exponent */
+			   ebytes);
+    }
+#endif
+    /* otherwise generate the key pair */
+    if ((rc == 0) && !found) {
 	rc = TPM_RSAGenerateKeyPair(&n,		/* public key (modulus) freed @3 */
 				    &p,		/* private prime factor freed @4 */
 				    &q,		/* private prime factor freed @5 */
@@ -1135,6 +1284,12 @@ TPM_RESULT TPM_Key_GenerateRSA(TPM_KEY *tpm_key,		/* output created key */
 			 tpm_key->tpm_store_asymkey,	/* cache the TPM_STORE_ASYMKEY structure */
 			 NULL);				/* TPM_MIGRATE_ASYMKEY */
     }
+    /* calculate the CRT parameters, the same way as when the key is loaded */
+    if (rc == 0) {
+	rc = TPM_StorePrivkey_Convert(tpm_key->tpm_store_asymkey,
+				      &(tpm_key->algorithmParms),
+				      &(tpm_key->pubKey));
+    }
     free(n);					/* @3 */
     free(p);					/* @4 */
     free(q);					/* @5 */
@@ -1205,11 +1360,15 @@ TPM_RESULT TPM_Key_ComparePubkey(TPM_KEY *tpm_key,
 TPM_RESULT TPM_Key_GeneratePubDataDigest(TPM_KEY *tpm_key)
 {
     TPM_RESULT		rc = 0;
-    TPM_STORE_BUFFER	sbuffer;	/* TPM_KEY serialization */
+    TPM_SHA1_CONTEXT	context;	/* caller owned, nothing to free */
+    TPM_STORE_BUFFER	sbuffer;	/* digest sink of the TPM_KEY serialization */
     TPM_STORE_ASYMKEY	*tpm_store_asymkey;
     
     printf(" TPM_Key_GeneratePubDataDigest:\n");
-    TPM_Sbuffer_Init(&sbuffer);			/* freed @1 */
+    TPM_Sbuffer_InitDigest(&sbuffer, &context);	/* freed @1 */
+    if (rc == 0) {
+	rc = TPM_Sha1Context_Init(&context);
+    }
     /* serialize the TPM_KEY excluding the encData fields */
     if (rc == 0) {
 	rc = TPM_Key_StorePubData(&sbuffer, FALSE, tpm_key);
@@ -1235,12 +1394,16 @@ TPM_RESULT TPM_Key_GeneratePubDataDigest(TPM_KEY *tpm_key)
 TPM_RESULT TPM_Key_CheckPubDataDigest(TPM_KEY *tpm_key)
 {
     TPM_RESULT		rc = 0;
-    TPM_STORE_BUFFER	sbuffer;	/* TPM_KEY serialization */
+    TPM_SHA1_CONTEXT	context;	/* caller owned, nothing to free */
+    TPM_STORE_BUFFER	sbuffer;	/* digest sink of the TPM_KEY serialization */
     TPM_STORE_ASYMKEY	*tpm_store_asymkey;
     TPM_DIGEST		tpm_digest;	/* calculated pubDataDigest */
     
     printf(" TPM_Key_CheckPubDataDigest:\n");
-    TPM_Sbuffer_Init(&sbuffer);			/* freed @1 */
+    TPM_Sbuffer_InitDigest(&sbuffer, &context);	/* freed @1 */
+    if (rc == 0) {
+	rc = TPM_Sha1Context_Init(&context);
+    }
     /* serialize the TPM_KEY excluding the encData fields */
     if (rc == 0) {
 	rc = TPM_Key_StorePubData(&sbuffer, FALSE, tpm_key);
@@ -2019,13 +2182,13 @@ void TPM_StoreAsymkey_Init(TPM_STORE_ASYMKEY *tpm_store_asymkey)
 
 /* TPM_StoreAsymkey_Load() deserializes the TPM_STORE_ASYMKEY structure.
 
-   The serialized structure contains the private factor p.  Normally, 'tpm_key_parms' and
-   tpm_store_pubkey are not NULL and the private key d is derived from p and the public key n and
-   exponent e.
+   The serialized structure contains the private factor p.  If 'tpm_key_parms' and 'pubKey' are
+   not NULL, the private key d is derived from p and the public key n and exponent e.
 
-   In some cases, a TPM_STORE_ASYMKEY is being manipulated without the rest of the TPM_KEY
-   structure.  When 'tpm_key' is NULL, p is left intact, and the resulting structure cannot be used
-   as a private key.
+   When 'tpm_key_parms' or 'pubKey' is NULL, p is left intact, and the resulting structure cannot
+   be used as a private key until TPM_StorePrivkey_Convert() is called.  This is used when a
+   TPM_STORE_ASYMKEY is being manipulated without the rest of the TPM_KEY structure, and by
+   TPM_Key_LoadStoreAsymKey(), which defers the conversion to the first private key use.
 */
 
 TPM_RESULT TPM_StoreAsymkey_Load(TPM_STORE_ASYMKEY *tpm_store_asymkey,
@@ -2613,11 +2776,14 @@ void TPM_StorePrivkey_Init(TPM_STORE_PRIVKEY *tpm_store_privkey)
     TPM_SizedBuffer_Init(&(tpm_store_privkey->d_key));
     TPM_SizedBuffer_Init(&(tpm_store_privkey->p_key));
     TPM_SizedBuffer_Init(&(tpm_store_privkey->q_key));
+    TPM_SizedBuffer_Init(&(tpm_store_privkey->dp_key));
+    TPM_SizedBuffer_Init(&(tpm_store_privkey->dq_key));
+    TPM_SizedBuffer_Init(&(tpm_store_privkey->qinv_key));
     return;
 }
 
-/* TPM_StorePrivkey_Convert() sets the prime factor q and private key d based on the prime factor p
-   and the public key and exponent.
+/* TPM_StorePrivkey_Convert() sets the prime factor q, private key d, and the CRT parameters dP, dQ,
+   qInv based on the prime factor p and the public key and exponent.
 */
 
 TPM_RESULT TPM_StorePrivkey_Convert(TPM_STORE_ASYMKEY *tpm_store_asymkey,	/* I/O result */
@@ -2631,11 +2797,17 @@ TPM_RESULT TPM_StorePrivkey_Convert(TPM_STORE_ASYMKEY *tpm_store_asymkey,	/* I/O
     unsigned char	*parr;		
     unsigned char	*qarr = NULL;
     unsigned char	*darr = NULL;
+    unsigned char	*dparr = NULL;
+    unsigned char	*dqarr = NULL;
+    unsigned char	*qinvarr = NULL;
     uint32_t		nbytes;
     uint32_t		ebytes;
     uint32_t		pbytes;
     uint32_t		qbytes;
     uint32_t		dbytes;
+    uint32_t		dpbytes;
+    uint32_t		dqbytes;
+    uint32_t		qinvbytes;
 
     
     printf(" TPM_StorePrivkey_Convert:\n");
@@ -2649,8 +2821,11 @@ TPM_RESULT TPM_StorePrivkey_Convert(TPM_STORE_ASYMKEY *tpm_store_asymkey,	/* I/O
 	rc = TPM_StoreAsymkey_GetPrimeFactorP(&pbytes, &parr, tpm_store_asymkey);
     }
     if (rc == 0) {
-	rc = TPM_RSAGetPrivateKey(&qbytes, &qarr,	/* freed @1 */
-				  &dbytes, &darr,	/* freed @2 */
+	rc = TPM_RSAGetPrivateKey(&qbytes, &qarr,		/* freed @1 */
+				  &dbytes, &darr,		/* freed @2 */
+				  &dpbytes, &dparr,		/* freed @3 */
+				  &dqbytes, &dqarr,		/* freed @4 */
+				  &qinvbytes, &qinvarr,		/* freed @5 */
 				  nbytes, narr,
 				  ebytes, earr,
 				  pbytes, parr);
@@ -2663,15 +2838,42 @@ TPM_RESULT TPM_StorePrivkey_Convert(TPM_STORE_ASYMKEY *tpm_store_asymkey,	/* I/O
     if (rc == 0) {
 	rc = TPM_SizedBuffer_Set((&(tpm_store_asymkey->privKey.d_key)), dbytes, darr);
     }
-    free(qarr); /* @1 */
-    free(darr); /* @2 */
+    if (rc == 0) {
+	rc = TPM_SizedBuffer_Set((&(tpm_store_asymkey->privKey.dp_key)), dpbytes, dparr);
+    }
+    if (rc == 0) {
+	rc = TPM_SizedBuffer_Set((&(tpm_store_asymkey->privKey.dq_key)), dqbytes, dqarr);
+    }
+    if (rc == 0) {
+	rc = TPM_SizedBuffer_Set((&(tpm_store_asymkey->privKey.qinv_key)), qinvbytes, qinvarr);
+    }
+    if (qarr != NULL) {
+	memset(qarr, 0, qbytes);
+    }
+    if (darr != NULL) {
+	memset(darr, 0, dbytes);
+    }
+    if (dparr != NULL) {
+	memset(dparr, 0, dpbytes);
+    }
+    if (dqarr != NULL) {
+	memset(dqarr, 0, dqbytes);
+    }
+    if (qinvarr != NULL) {
+	memset(qinvarr, 0, qinvbytes);
+    }
+    free(qarr);		/* @1 */
+    free(darr);		/* @2 */
+    free(dparr);	/* @3 */
+    free(dqarr);	/* @4 */
+    free(qinvarr);	/* @5 */
     return rc;
 }
 
 /* TPM_StorePrivkey_Store serializes a TPM_STORE_PRIVKEY structure, appending results to 'sbuffer'
 
    Only the prime factor p is stored.  The other prime factor q and the private key d are
-   recalculated after a load.
+   recalculated on the first private key use after a load.
  */
 
 TPM_RESULT TPM_StorePrivkey_Store(TPM_STORE_BUFFER *sbuffer,
@@ -2694,10 +2896,16 @@ void TPM_StorePrivkey_Delete(TPM_STORE_PRIVKEY *tpm_store_privkey)
 	TPM_SizedBuffer_Zero(&(tpm_store_privkey->d_key));
 	TPM_SizedBuffer_Zero(&(tpm_store_privkey->p_key));
 	TPM_SizedBuffer_Zero(&(tpm_store_privkey->q_key));
+	TPM_SizedBuffer_Zero(&(tpm_store_privkey->dp_key));
+	TPM_SizedBuffer_Zero(&(tpm_store_privkey->dq_key));
+	TPM_SizedBuffer_Zero(&(tpm_store_privkey->qinv_key));
 	
 	TPM_SizedBuffer_Delete(&(tpm_store_privkey->d_key));
 	TPM_SizedBuffer_Delete(&(tpm_store_privkey->p_key));
 	TPM_SizedBuffer_Delete(&(tpm_store_privkey->q_key));
+	TPM_SizedBuffer_Delete(&(tpm_store_privkey->dp_key));
+	TPM_SizedBuffer_Delete(&(tpm_store_privkey->dq_key));
+	TPM_SizedBuffer_Delete(&(tpm_store_privkey->qinv_key));
 	TPM_StorePrivkey_Init(tpm_store_privkey);
     }
     return;
@@ -142,6 +142,10 @@ TPM_RESULT TPM_Key_GetPrimeFactorP(uint32_t 		*pbytes,
 TPM_RESULT TPM_Key_GetPrivateKey(uint32_t	*dbytes,
                                  unsigned char  **darr,
                                  TPM_KEY        *tpm_key);
+TPM_RESULT TPM_Key_GetPrivateKeyToken(void **rsa_pri_token,
+                                      TPM_KEY *tpm_key);
+TPM_RESULT TPM_Key_GetPublicKeyToken(void **rsa_pub_token,
+                                     TPM_KEY *tpm_key);
 TPM_RESULT TPM_Key_GetExponent(uint32_t		*ebytes,
                                unsigned char    **earr,
                                TPM_KEY  *tpm_key);
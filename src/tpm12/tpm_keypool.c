@@ -0,0 +1,323 @@
+/********************************************************************************/
+/*										*/
+/*				RSA Key Pool					*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+/* The RSA key pool holds pre-generated key pairs of TPM_RSA_KEYPOOL_KEY_LENGTH bits and one
+   configurable public exponent.  A background thread refills the pool whenever it holds fewer
+   than 'depth' keys, so that TPM_Key_GenerateRSA() can usually skip the expensive prime search.
+
+   The pool is library wide.  It is disabled (depth 0) by default.  The thread is started by
+   TPM_RSAKeyPool_Start() from TPMLIB_MainInit() and stopped by TPM_RSAKeyPool_Stop() from
+   TPMLIB_Terminate().  Stopping waits for a key generation in progress to complete.
+
+   If a key generation fails, the thread exits and key pairs are generated synchronously until the
+   pool is restarted by TPMLIB_MainInit() or TPMLIB_SetRSAKeyPool().
+
+   This file is only built if the library was configured with --enable-rsa-keypool.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "tpm_constants.h"
+#include "tpm_crypto.h"
+#include "tpm_cryptoh.h"
+#include "tpm_debug.h"
+#include "tpm_error.h"
+#include "tpm_load.h"
+
+#include "tpm_keypool.h"
+
+/* one pre-generated key pair, in the format returned by TPM_RSAGenerateKeyPair() */
+
+typedef struct tdTPM_RSA_KEYPOOL_ENTRY {
+    unsigned char	*n;		/* public key - modulus */
+    unsigned char	*p;		/* private key prime */
+    unsigned char	*q;		/* private key prime */
+    unsigned char	*d;		/* private key (private exponent) */
+} TPM_RSA_KEYPOOL_ENTRY;
+
+static struct {
+    pthread_mutex_t		mutex;		/* protects all members below */
+    pthread_cond_t		cond;		/* signals the thread to refill or stop */
+    pthread_t			thread;
+    TPM_BOOL			running;	/* thread is alive, cleared when it exits on error */
+    TPM_BOOL			joinable;	/* thread has been started and not yet joined */
+    TPM_BOOL			stop;		/* request to the thread to exit */
+    unsigned int		depth;		/* number of key pairs to keep */
+    unsigned long		exponent;	/* public exponent of the key pairs */
+    unsigned int		count;		/* number of key pairs in entries */
+    TPM_RSA_KEYPOOL_ENTRY	entries[TPM_RSA_KEYPOOL_DEPTH_MAX];
+} tpm_rsa_keypool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .running = FALSE,
+    .joinable = FALSE,
+    .stop = FALSE,
+    .depth = 0,
+    .exponent = 65537,
+    .count = 0,
+};
+
+/* TPM_RSAKeyPoolEntry_Delete() zeros the private parts of the key pair and frees it */
+
+static void TPM_RSAKeyPoolEntry_Delete(TPM_RSA_KEYPOOL_ENTRY *entry)
+{
+    if (entry->p != NULL) {
+	memset(entry->p, 0, TPM_RSA_KEYPOOL_KEY_LENGTH/16);
+    }
+    if (entry->q != NULL) {
+	memset(entry->q, 0, TPM_RSA_KEYPOOL_KEY_LENGTH/16);
+    }
+    if (entry->d != NULL) {
+	memset(entry->d, 0, TPM_RSA_KEYPOOL_KEY_LENGTH/8);
+    }
+    free(entry->n);
+    free(entry->p);
+    free(entry->q);
+    free(entry->d);
+    entry->n = NULL;
+    entry->p = NULL;
+    entry->q = NULL;
+    entry->d = NULL;
+    return;
+}
+
+/* TPM_RSAKeyPool_Main() is the pool thread.  It generates key pairs until the pool is full, then
+   waits until a key pair is taken or the thread is asked to stop.
+
+   The mutex is not held during key generation.
+
+   On a key generation error, the thread clears 'running' and exits.  It is joined by the next
+   TPM_RSAKeyPool_Start() or TPM_RSAKeyPool_Stop().
+*/
+
+static void *TPM_RSAKeyPool_Main(void *arg)
+{
+    TPM_RESULT			rc = 0;
+    TPM_RSA_KEYPOOL_ENTRY	entry;
+    unsigned char		earr[4];
+
+    pthread_mutex_lock(&tpm_rsa_keypool.mutex);
+    while ((rc == 0) && !tpm_rsa_keypool.stop) {
+	if (tpm_rsa_keypool.count >= tpm_rsa_keypool.depth) {
+	    pthread_cond_wait(&tpm_rsa_keypool.cond, &tpm_rsa_keypool.mutex);
+	    continue;
+	}
+	earr[0] = (tpm_rsa_keypool.exponent >> 24) & 0xff;
+	earr[1] = (tpm_rsa_keypool.exponent >> 16) & 0xff;
+	earr[2] = (tpm_rsa_keypool.exponent >>  8) & 0xff;
+	earr[3] = (tpm_rsa_keypool.exponent >>  0) & 0xff;
+	pthread_mutex_unlock(&tpm_rsa_keypool.mutex);
+	rc = TPM_RSAGenerateKeyPair(&entry.n, &entry.p, &entry.q, &entry.d,
+				    TPM_RSA_KEYPOOL_KEY_LENGTH,
+				    earr, sizeof(earr));
+	pthread_mutex_lock(&tpm_rsa_keypool.mutex);
+	if (rc != 0) {
+	    /* do not spin on a persistent failure, fall back to synchronous generation */
+	    printf("TPM_RSAKeyPool_Main: Error %08x generating a key pair, pool thread exits\n",
+		   rc);
+	    tpm_rsa_keypool.running = FALSE;
+	}
+	/* the pool may have been shrunk or stopped meanwhile */
+	else if (!tpm_rsa_keypool.stop &&
+		 (tpm_rsa_keypool.count < tpm_rsa_keypool.depth)) {
+	    tpm_rsa_keypool.entries[tpm_rsa_keypool.count] = entry;
+	    tpm_rsa_keypool.count++;
+	}
+	else {
+	    TPM_RSAKeyPoolEntry_Delete(&entry);
+	}
+    }
+    pthread_mutex_unlock(&tpm_rsa_keypool.mutex);
+    return NULL;
+}
+
+/* TPM_RSAKeyPool_SetParameters() sets the depth of the pool and the public exponent of the pooled
+   key pairs.  An exponent of 0 selects the default exponent 65537.  A depth of 0 disables the
+   pool.
+
+   If the pool was started, it is restarted with the new parameters and refilled, also after the
+   thread exited on an error.
+*/
+
+TPM_RESULT TPM_RSAKeyPool_SetParameters(unsigned int depth,
+					uint32_t exponent)
+{
+    TPM_RESULT		rc = 0;
+    TPM_BOOL		started;
+
+    printf(" TPM_RSAKeyPool_SetParameters: depth %u exponent %08x\n", depth, exponent);
+    if (exponent == 0) {
+	exponent = 65537;
+    }
+    if (rc == 0) {
+	if (depth > TPM_RSA_KEYPOOL_DEPTH_MAX) {
+	    printf("TPM_RSAKeyPool_SetParameters: Error, depth %u greater than %u\n",
+		   depth, TPM_RSA_KEYPOOL_DEPTH_MAX);
+	    rc = TPM_BAD_PARAMETER;
+	}
+    }
+    /* an illegal exponent would fail every key generation */
+    if (rc == 0) {
+	rc = TPM_RSA_exponent_verify(exponent);
+    }
+    if (rc == 0) {
+	pthread_mutex_lock(&tpm_rsa_keypool.mutex);
+	started = tpm_rsa_keypool.joinable;
+	pthread_mutex_unlock(&tpm_rsa_keypool.mutex);
+	TPM_RSAKeyPool_Stop();
+	pthread_mutex_lock(&tpm_rsa_keypool.mutex);
+	tpm_rsa_keypool.depth = depth;
+	tpm_rsa_keypool.exponent = exponent;
+	pthread_mutex_unlock(&tpm_rsa_keypool.mutex);
+	if (started) {
+	    rc = TPM_RSAKeyPool_Start();
+	}
+    }
+    return rc;
+}
+
+/* TPM_RSAKeyPool_Start() starts the pool thread if the pool is enabled and not already running.
+
+   A thread that exited on an error is joined first.
+ */
+
+TPM_RESULT TPM_RSAKeyPool_Start(void)
+{
+    TPM_RESULT		rc = 0;
+    int			irc;
+
+    pthread_mutex_lock(&tpm_rsa_keypool.mutex);
+    if (!tpm_rsa_keypool.running && (tpm_rsa_keypool.depth != 0)) {
+	printf(" TPM_RSAKeyPool_Start: depth %u\n", tpm_rsa_keypool.depth);
+	/* the thread cleared 'running' and released the mutex, so it is exiting */
+	if (tpm_rsa_keypool.joinable) {
+	    pthread_join(tpm_rsa_keypool.thread, NULL);
+	    tpm_rsa_keypool.joinable = FALSE;
+	}
+	tpm_rsa_keypool.stop = FALSE;
+	irc = pthread_create(&tpm_rsa_keypool.thread, NULL, TPM_RSAKeyPool_Main, NULL);
+	if (irc == 0) {
+	    tpm_rsa_keypool.running = TRUE;
+	    tpm_rsa_keypool.joinable = TRUE;
+	}
+	else {
+	    printf("TPM_RSAKeyPool_Start: Error %d creating the pool thread\n", irc);
+	    rc = TPM_FAIL;
+	}
+    }
+    pthread_mutex_unlock(&tpm_rsa_keypool.mutex);
+    return rc;
+}
+
+/* TPM_RSAKeyPool_Stop() stops the pool thread and frees all pooled key pairs.
+ */
+
+void TPM_RSAKeyPool_Stop(void)
+{
+    TPM_BOOL		joinable;
+    unsigned int	i;
+
+    pthread_mutex_lock(&tpm_rsa_keypool.mutex);
+    joinable = tpm_rsa_keypool.joinable;
+    tpm_rsa_keypool.stop = TRUE;
+    pthread_cond_signal(&tpm_rsa_keypool.cond);
+    pthread_mutex_unlock(&tpm_rsa_keypool.mutex);
+    if (joinable) {
+	printf(" TPM_RSAKeyPool_Stop:\n");
+	pthread_join(tpm_rsa_keypool.thread, NULL);
+    }
+    pthread_mutex_lock(&tpm_rsa_keypool.mutex);
+    tpm_rsa_keypool.running = FALSE;
+    tpm_rsa_keypool.joinable = FALSE;
+    for (i = 0 ; i < tpm_rsa_keypool.count ; i++) {
+	TPM_RSAKeyPoolEntry_Delete(&tpm_rsa_keypool.entries[i]);
+    }
+    tpm_rsa_keypool.count = 0;
+    pthread_mutex_unlock(&tpm_rsa_keypool.mutex);
+    return;
+}
+
+/* TPM_RSAKeyPool_Get() takes a pre-generated key pair from the pool if one of size 'num_bits' with
+   public exponent 'earr' is available.
+
+   If 'found' is TRUE, 'n', 'p', 'q', 'd' must be freed by the caller, as if returned by
+   TPM_RSAGenerateKeyPair().  If 'found' is FALSE, the caller should generate the key pair.
+*/
+
+void TPM_RSAKeyPool_Get(TPM_BOOL *found,
+			unsigned char **n,
+			unsigned char **p,
+			unsigned char **q,
+			unsigned char **d,
+			int num_bits,
+			const unsigned char *earr,
+			uint32_t ebytes)
+{
+    TPM_RESULT			rc = 0;
+    unsigned long		e;
+    TPM_RSA_KEYPOOL_ENTRY	*entry;
+
+    *found = FALSE;
+    if (num_bits != TPM_RSA_KEYPOOL_KEY_LENGTH) {
+	rc = TPM_BAD_KEY_PROPERTY;	/* not pooled */
+    }
+    if (rc == 0) {
+	rc = TPM_LoadLong(&e, earr, ebytes);
+    }
+    if (rc == 0) {
+	pthread_mutex_lock(&tpm_rsa_keypool.mutex);
+	if ((tpm_rsa_keypool.count > 0) && (tpm_rsa_keypool.exponent == e)) {
+	    tpm_rsa_keypool.count--;
+	    entry = &tpm_rsa_keypool.entries[tpm_rsa_keypool.count];
+	    *n = entry->n;
+	    *p = entry->p;
+	    *q = entry->q;
+	    *d = entry->d;
+	    entry->n = NULL;
+	    entry->p = NULL;
+	    entry->q = NULL;
+	    entry->d = NULL;
+	    *found = TRUE;
+	    /* wake up the thread to refill the pool */
+	    pthread_cond_signal(&tpm_rsa_keypool.cond);
+	}
+	printf(" TPM_RSAKeyPool_Get: found %u, %u key pairs left\n",
+	       *found, tpm_rsa_keypool.count);
+	pthread_mutex_unlock(&tpm_rsa_keypool.mutex);
+    }
+    return;
+}
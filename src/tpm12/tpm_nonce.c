@@ -41,6 +41,7 @@
 #include <string.h>
 
 #include "tpm_crypto.h"
+#include "tpm_cryptoh.h"
 #include "tpm_debug.h"
 #include "tpm_error.h"
 #include "tpm_structures.h"
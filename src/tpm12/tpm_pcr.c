@@ -2723,7 +2723,9 @@ TPM_RESULT TPM_Process_Quote(tpm_state_t *tpm_state,
     TPM_PCRSelection_Init(&targetPCR);		/* freed @1 */
     TPM_PCRComposite_Init(&pcrData);		/* freed @2 */
     TPM_QuoteInfo_Init(&q1QuoteInfo);		/* freed @3 */
-    TPM_SizedBuffer_Init(&sig);			/* freed @4 */
+    TPM_SizedBuffer_InitArena(&sig, &(tpm_state->tpm_arena));	/* freed @4 */
+    /* the PCR values and the signature are only returned */
+    TPM_SizedBuffer_InitArena(&(pcrData.pcrValue), &(tpm_state->tpm_arena));
     /*
       get inputs
     */
@@ -47,6 +47,7 @@
 #endif
 
 #include "tpm_admin.h"
+#include "tpm_arena.h"
 #include "tpm_audit.h"
 #include "tpm_auth.h"
 #include "tpm_constants.h"
@@ -349,6 +350,9 @@ void TPM_CapVersionInfo_Delete(TPM_CAP_VERSION_INFO *tpm_cap_version_info)
    It provides direct mapping that easier to understand and maintain than scattering and hard coding
    these values.
 
+   The TPM ordinals are dense below TPM_ORDINALS_MAX, so the table is indexed directly by the
+   ordinal.  Unused slots are zero filled.  The TSC ordinals are in tpm_tsc_ordinal_table.
+
    The functions currently supported are:
 
 	- processing jump table for 1.1 and 1.2 (implied get capability - ordinals supported)
@@ -357,6 +361,7 @@ void TPM_CapVersionInfo_Delete(TPM_CAP_VERSION_INFO *tpm_cap_version_info)
 	- owner delegation permissions
 	- key delegation permissions
 	- wrappable
+	- ordinal property flags (TPM_ORDFLAG_xx) used by TPM_Process_Preprocess()
 
    Future possibilities include:
 
@@ -380,11 +385,13 @@ void TPM_CapVersionInfo_Delete(TPM_CAP_VERSION_INFO *tpm_cap_version_info)
    TPM_BOOL transportWrappable;
    TPM_BOOL instanceWrappable;				
    TPM_BOOL hardwareWrappable;
+   uint32_t ordinalFlags;
    } TPM_ORDINAL_TABLE;
 */
 
-static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
+static TPM_ORDINAL_TABLE tpm_ordinal_table[TPM_ORDINALS_MAX] =
 {
+    [TPM_ORD_ActivateIdentity] =
     {TPM_ORD_ActivateIdentity,
      TPM_Process_ActivateIdentity, TPM_Process_ActivateIdentity,
      TRUE,
@@ -396,8 +403,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_AuthorizeMigrationKey] =
     {TPM_ORD_AuthorizeMigrationKey,
      TPM_Process_AuthorizeMigrationKey, TPM_Process_AuthorizeMigrationKey,
      TRUE,
@@ -409,8 +418,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CertifyKey] =
     {TPM_ORD_CertifyKey,
      TPM_Process_CertifyKey, TPM_Process_CertifyKey,
      TRUE,
@@ -422,8 +433,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CertifyKey2] =
     {TPM_ORD_CertifyKey2,
      TPM_Process_Unused, TPM_Process_CertifyKey2,
      TRUE,
@@ -435,8 +448,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CertifySelfTest] =
     {TPM_ORD_CertifySelfTest,
      TPM_Process_CertifySelfTest, TPM_Process_Unused,
      TRUE,
@@ -448,8 +463,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ChangeAuth] =
     {TPM_ORD_ChangeAuth,
      TPM_Process_ChangeAuth, TPM_Process_ChangeAuth,
      TRUE,
@@ -461,8 +478,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ChangeAuthAsymFinish] =
     {TPM_ORD_ChangeAuthAsymFinish,
      TPM_Process_ChangeAuthAsymFinish, TPM_Process_ChangeAuthAsymFinish,
      TRUE,
@@ -474,8 +493,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ChangeAuthAsymStart] =
     {TPM_ORD_ChangeAuthAsymStart,
      TPM_Process_ChangeAuthAsymStart, TPM_Process_ChangeAuthAsymStart,
      TRUE,
@@ -487,8 +508,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ChangeAuthOwner] =
     {TPM_ORD_ChangeAuthOwner,
      TPM_Process_ChangeAuthOwner, TPM_Process_ChangeAuthOwner,
      TRUE,
@@ -500,8 +523,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CMK_ApproveMA] =
     {TPM_ORD_CMK_ApproveMA,
      TPM_Process_Unused, TPM_Process_CMK_ApproveMA,
      TRUE,
@@ -513,8 +538,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CMK_ConvertMigration] =
     {TPM_ORD_CMK_ConvertMigration,
      TPM_Process_Unused, TPM_Process_CMK_ConvertMigration,
      TRUE,
@@ -526,8 +553,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CMK_CreateBlob] =
     {TPM_ORD_CMK_CreateBlob,
      TPM_Process_Unused, TPM_Process_CMK_CreateBlob,
      TRUE,
@@ -539,8 +568,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CMK_CreateKey] =
     {TPM_ORD_CMK_CreateKey,
      TPM_Process_Unused, TPM_Process_CMK_CreateKey,
      TRUE,
@@ -552,8 +583,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CMK_CreateTicket] =
     {TPM_ORD_CMK_CreateTicket,
      TPM_Process_Unused, TPM_Process_CMK_CreateTicket,
      TRUE,
@@ -565,8 +598,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CMK_SetRestrictions] =
     {TPM_ORD_CMK_SetRestrictions,
      TPM_Process_Unused, TPM_Process_CMK_SetRestrictions,
      TRUE,
@@ -578,8 +613,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ContinueSelfTest] =
     {TPM_ORD_ContinueSelfTest,
      TPM_Process_ContinueSelfTest, TPM_Process_ContinueSelfTest,
      TRUE,
@@ -591,8 +628,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE},
     
+    [TPM_ORD_ConvertMigrationBlob] =
     {TPM_ORD_ConvertMigrationBlob,
      TPM_Process_ConvertMigrationBlob, TPM_Process_ConvertMigrationBlob,
      TRUE,
@@ -604,8 +643,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CreateCounter] =
     {TPM_ORD_CreateCounter,
      TPM_Process_Unused, TPM_Process_CreateCounter,
      TRUE,
@@ -617,8 +658,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CreateEndorsementKeyPair] =
     {TPM_ORD_CreateEndorsementKeyPair,
      TPM_Process_CreateEndorsementKeyPair, TPM_Process_CreateEndorsementKeyPair,
      TRUE,
@@ -630,8 +673,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CreateMaintenanceArchive] =
     {TPM_ORD_CreateMaintenanceArchive,
 #ifdef TPM_NOMAINTENANCE
      TPM_Process_Unused, TPM_Process_Unused,
@@ -649,8 +694,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CreateMigrationBlob] =
     {TPM_ORD_CreateMigrationBlob,
      TPM_Process_CreateMigrationBlob, TPM_Process_CreateMigrationBlob,
      TRUE,
@@ -662,8 +709,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CreateRevocableEK] =
     {TPM_ORD_CreateRevocableEK,
      TPM_Process_Unused, TPM_Process_CreateRevocableEK,
      TRUE,
@@ -675,8 +724,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_CreateWrapKey] =
     {TPM_ORD_CreateWrapKey,
      TPM_Process_CreateWrapKey, TPM_Process_CreateWrapKey,
      TRUE,
@@ -688,8 +739,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_DAA_Join] =
     {TPM_ORD_DAA_Join,
      TPM_Process_Unused, TPM_Process_DAAJoin,
      TRUE,
@@ -701,8 +754,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_DAA_Sign] =
     {TPM_ORD_DAA_Sign,
      TPM_Process_Unused, TPM_Process_DAASign,
      TRUE,
@@ -714,8 +769,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Delegate_CreateKeyDelegation] =
     {TPM_ORD_Delegate_CreateKeyDelegation,
      TPM_Process_Unused, TPM_Process_DelegateCreateKeyDelegation,
      TRUE,
@@ -727,8 +784,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Delegate_CreateOwnerDelegation] =
     {TPM_ORD_Delegate_CreateOwnerDelegation,
      TPM_Process_Unused, TPM_Process_DelegateCreateOwnerDelegation,
      TRUE,
@@ -740,8 +799,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Delegate_LoadOwnerDelegation] =
     {TPM_ORD_Delegate_LoadOwnerDelegation,
      TPM_Process_Unused, TPM_Process_DelegateLoadOwnerDelegation,
      TRUE,
@@ -753,8 +814,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Delegate_Manage] =
     {TPM_ORD_Delegate_Manage,
      TPM_Process_Unused, TPM_Process_DelegateManage,
      TRUE,
@@ -766,8 +829,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Delegate_ReadTable] =
     {TPM_ORD_Delegate_ReadTable,
      TPM_Process_Unused, TPM_Process_DelegateReadTable,
      TRUE,
@@ -779,8 +844,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Delegate_UpdateVerification] =
     {TPM_ORD_Delegate_UpdateVerification,
      TPM_Process_Unused, TPM_Process_DelegateUpdateVerification,
      TRUE,
@@ -792,8 +859,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Delegate_VerifyDelegation] =
     {TPM_ORD_Delegate_VerifyDelegation,
      TPM_Process_Unused, TPM_Process_DelegateVerifyDelegation,
      TRUE,
@@ -805,8 +874,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_DirRead] =
     {TPM_ORD_DirRead,
      TPM_Process_DirRead, TPM_Process_DirRead,
      TRUE,
@@ -818,8 +889,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_DirWriteAuth] =
     {TPM_ORD_DirWriteAuth,
      TPM_Process_DirWriteAuth, TPM_Process_DirWriteAuth,
      TRUE,
@@ -831,8 +904,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_DisableForceClear] =
     {TPM_ORD_DisableForceClear,
      TPM_Process_DisableForceClear, TPM_Process_DisableForceClear,
      TRUE,
@@ -844,8 +919,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_DisableOwnerClear] =
     {TPM_ORD_DisableOwnerClear,
      TPM_Process_DisableOwnerClear, TPM_Process_DisableOwnerClear,
      TRUE,
@@ -857,8 +934,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_DisablePubekRead] =
     {TPM_ORD_DisablePubekRead,
      TPM_Process_DisablePubekRead, TPM_Process_DisablePubekRead,
      TRUE,
@@ -870,8 +949,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_DSAP] =
     {TPM_ORD_DSAP,
      TPM_Process_Unused, TPM_Process_DSAP,
      TRUE,
@@ -883,8 +964,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      sizeof(TPM_AUTHHANDLE) + TPM_NONCE_SIZE + TPM_NONCE_SIZE,
      TRUE,
      TRUE,
-     TRUE},
+     TRUE,
+     0},
     
+    [TPM_ORD_EstablishTransport] =
     {TPM_ORD_EstablishTransport,
      TPM_Process_Unused, TPM_Process_EstablishTransport,
      TRUE,
@@ -896,8 +979,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      FALSE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_EvictKey] =
     {TPM_ORD_EvictKey,
      TPM_Process_EvictKey, TPM_Process_EvictKey,
      TRUE,
@@ -909,8 +994,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ExecuteTransport] =
     {TPM_ORD_ExecuteTransport,
      TPM_Process_Unused, TPM_Process_ExecuteTransport,
      TRUE,
@@ -922,8 +1009,11 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      FALSE,
      FALSE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_SHA1_DEFERRED |
+     TPM_ORDFLAG_EXCLUSIVE_DEFERRED},
     
+    [TPM_ORD_Extend] =
     {TPM_ORD_Extend,
      TPM_Process_Extend, TPM_Process_Extend,
      TRUE,
@@ -935,8 +1025,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE},
     
+    [TPM_ORD_FieldUpgrade] =
     {TPM_ORD_FieldUpgrade,
      TPM_Process_Unused, TPM_Process_Unused,
      TRUE,
@@ -948,8 +1040,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_FlushSpecific] =
     {TPM_ORD_FlushSpecific,
      TPM_Process_Unused, TPM_Process_FlushSpecific,
      TRUE,
@@ -961,8 +1055,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     TRUE},
+     TRUE,
+     0},
     
+    [TPM_ORD_ForceClear] =
     {TPM_ORD_ForceClear,
      TPM_Process_ForceClear, TPM_Process_ForceClear,
      TRUE,
@@ -974,8 +1070,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_GetAuditDigest] =
     {TPM_ORD_GetAuditDigest,
      TPM_Process_Unused, TPM_Process_GetAuditDigest,
      FALSE,
@@ -987,8 +1085,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_GetAuditDigestSigned] =
     {TPM_ORD_GetAuditDigestSigned,
      TPM_Process_Unused, TPM_Process_GetAuditDigestSigned,
      FALSE,
@@ -1000,8 +1100,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_GetAuditEvent] =
     {TPM_ORD_GetAuditEvent,
      TPM_Process_Unused, TPM_Process_Unused,
      FALSE,
@@ -1013,8 +1115,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_GetAuditEventSigned] =
     {TPM_ORD_GetAuditEventSigned,
      TPM_Process_Unused, TPM_Process_Unused,
      FALSE,
@@ -1026,8 +1130,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_GetCapability] =
     {TPM_ORD_GetCapability,
      TPM_Process_GetCapability, TPM_Process_GetCapability,
      TRUE,
@@ -1039,8 +1145,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE},
     
+    [TPM_ORD_GetCapabilityOwner] =
     {TPM_ORD_GetCapabilityOwner,
      TPM_Process_GetCapabilityOwner, TPM_Process_GetCapabilityOwner,
      TRUE,
@@ -1052,8 +1160,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_GetCapabilitySigned] =
     {TPM_ORD_GetCapabilitySigned,
      TPM_Process_GetCapabilitySigned, TPM_Process_Unused,
      TRUE,
@@ -1065,8 +1175,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_GetOrdinalAuditStatus] =
     {TPM_ORD_GetOrdinalAuditStatus,
      TPM_Process_Unused, TPM_Process_Unused,
      FALSE,
@@ -1078,8 +1190,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_GetPubKey] =
     {TPM_ORD_GetPubKey,
      TPM_Process_GetPubKey, TPM_Process_GetPubKey,
      TRUE,
@@ -1091,8 +1205,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_GetRandom] =
     {TPM_ORD_GetRandom,
      TPM_Process_GetRandom, TPM_Process_GetRandom,
      TRUE,
@@ -1104,8 +1220,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_GetTestResult] =
     {TPM_ORD_GetTestResult,
      TPM_Process_GetTestResult, TPM_Process_GetTestResult,
      TRUE,
@@ -1117,8 +1235,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE},
     
+    [TPM_ORD_GetTicks] =
     {TPM_ORD_GetTicks,
      TPM_Process_Unused, TPM_Process_GetTicks,
      TRUE,
@@ -1130,8 +1250,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_IncrementCounter] =
     {TPM_ORD_IncrementCounter,
      TPM_Process_Unused, TPM_Process_IncrementCounter,
      TRUE,
@@ -1143,8 +1265,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Init] =
     {TPM_ORD_Init,
      TPM_Process_Init, TPM_Process_Init,
      TRUE,
@@ -1156,8 +1280,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_KEEP_SAVED_STATE},
     
+    [TPM_ORD_KeyControlOwner] =
     {TPM_ORD_KeyControlOwner,
      TPM_Process_Unused, TPM_Process_KeyControlOwner,
      TRUE,
@@ -1169,8 +1295,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_KillMaintenanceFeature] =
     {TPM_ORD_KillMaintenanceFeature,
 #ifdef TPM_NOMAINTENANCE
      TPM_Process_Unused, TPM_Process_Unused,
@@ -1188,8 +1316,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_LoadAuthContext] =
     {TPM_ORD_LoadAuthContext,
      TPM_Process_LoadAuthContext, TPM_Process_LoadAuthContext,
      TRUE,
@@ -1201,8 +1331,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      sizeof(TPM_HANDLE),
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_LoadContext] =
     {TPM_ORD_LoadContext,
      TPM_Process_Unused, TPM_Process_LoadContext,
      TRUE,
@@ -1214,8 +1346,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      sizeof(TPM_HANDLE),
      TRUE,
      TRUE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_LoadKey] =
     {TPM_ORD_LoadKey,
      TPM_Process_LoadKey, TPM_Process_LoadKey,
      TRUE,
@@ -1227,8 +1361,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_LoadKey2] =
     {TPM_ORD_LoadKey2,
      TPM_Process_Unused, TPM_Process_LoadKey2,
      TRUE,
@@ -1240,8 +1376,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      sizeof(TPM_KEY_HANDLE),
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_LoadKeyContext] =
     {TPM_ORD_LoadKeyContext,
      TPM_Process_LoadKeyContext, TPM_Process_LoadKeyContext,
      TRUE,
@@ -1253,8 +1391,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      sizeof(TPM_KEY_HANDLE),
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_LoadMaintenanceArchive] =
     {TPM_ORD_LoadMaintenanceArchive,
 #ifdef TPM_NOMAINTENANCE
      TPM_Process_Unused, TPM_Process_Unused,
@@ -1272,8 +1412,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_LoadManuMaintPub] =
     {TPM_ORD_LoadManuMaintPub,
 #ifdef TPM_NOMAINTENANCE
      TPM_Process_Unused, TPM_Process_Unused,
@@ -1291,8 +1433,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_MakeIdentity] =
     {TPM_ORD_MakeIdentity,
      TPM_Process_MakeIdentity, TPM_Process_MakeIdentity,
      TRUE,
@@ -1304,8 +1448,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_MigrateKey] =
     {TPM_ORD_MigrateKey,
      TPM_Process_Unused, TPM_Process_MigrateKey,
      TRUE,
@@ -1317,8 +1463,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_NV_DefineSpace] =
     {TPM_ORD_NV_DefineSpace,
      TPM_Process_Unused, TPM_Process_NVDefineSpace,
      TRUE,
@@ -1330,8 +1478,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_NV_ReadValue] =
     {TPM_ORD_NV_ReadValue,
      TPM_Process_Unused, TPM_Process_NVReadValue,
      TRUE,
@@ -1343,8 +1493,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_NV_ReadValueAuth] =
     {TPM_ORD_NV_ReadValueAuth,
      TPM_Process_Unused, TPM_Process_NVReadValueAuth,
      TRUE,
@@ -1356,8 +1508,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_NV_WriteValue] =
     {TPM_ORD_NV_WriteValue,
      TPM_Process_Unused, TPM_Process_NVWriteValue,
      TRUE,
@@ -1369,8 +1523,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_NV_WriteValueAuth] =
     {TPM_ORD_NV_WriteValueAuth,
      TPM_Process_Unused, TPM_Process_NVWriteValueAuth,
      TRUE,
@@ -1382,8 +1538,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_OIAP] =
     {TPM_ORD_OIAP,
      TPM_Process_OIAP, TPM_Process_OIAP,
      TRUE,
@@ -1395,8 +1553,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      sizeof(TPM_AUTHHANDLE) + TPM_NONCE_SIZE,
      TRUE,
      TRUE,
-     TRUE},
+     TRUE,
+     0},
     
+    [TPM_ORD_OSAP] =
     {TPM_ORD_OSAP,
      TPM_Process_OSAP, TPM_Process_OSAP,
      TRUE,
@@ -1408,8 +1568,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      sizeof(TPM_AUTHHANDLE) + TPM_NONCE_SIZE + TPM_NONCE_SIZE,
      TRUE,
      TRUE,
-     TRUE},
+     TRUE,
+     0},
     
+    [TPM_ORD_OwnerClear] =
     {TPM_ORD_OwnerClear,
      TPM_Process_OwnerClear, TPM_Process_OwnerClear,
      TRUE,
@@ -1421,8 +1583,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_OwnerReadInternalPub] =
     {TPM_ORD_OwnerReadInternalPub,
      TPM_Process_Unused, TPM_Process_OwnerReadInternalPub,
      TRUE,
@@ -1434,8 +1598,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_OwnerReadPubek] =
     {TPM_ORD_OwnerReadPubek,
      TPM_Process_OwnerReadPubek, TPM_Process_OwnerReadPubek,
      TRUE,
@@ -1447,8 +1613,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_OwnerSetDisable] =
     {TPM_ORD_OwnerSetDisable,
      TPM_Process_OwnerSetDisable, TPM_Process_OwnerSetDisable,
      TRUE,
@@ -1460,8 +1628,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_PCR_Reset] =
     {TPM_ORD_PCR_Reset,
      TPM_Process_Unused, TPM_Process_PcrReset,
      TRUE,
@@ -1473,8 +1643,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_PcrRead] =
     {TPM_ORD_PcrRead,
      TPM_Process_PcrRead, TPM_Process_PcrRead,
      TRUE,
@@ -1486,8 +1658,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_PhysicalDisable] =
     {TPM_ORD_PhysicalDisable,
      TPM_Process_PhysicalDisable, TPM_Process_PhysicalDisable,
      TRUE,
@@ -1499,8 +1673,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_PhysicalEnable] =
     {TPM_ORD_PhysicalEnable,
      TPM_Process_PhysicalEnable, TPM_Process_PhysicalEnable,
      TRUE,
@@ -1512,8 +1688,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_PhysicalSetDeactivated] =
     {TPM_ORD_PhysicalSetDeactivated,
      TPM_Process_PhysicalSetDeactivated, TPM_Process_PhysicalSetDeactivated,
      TRUE,
@@ -1525,8 +1703,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Quote] =
     {TPM_ORD_Quote,
      TPM_Process_Quote, TPM_Process_Quote,
      TRUE,
@@ -1538,8 +1718,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     TRUE},
+     TRUE,
+     0},
     
+    [TPM_ORD_Quote2] =
     {TPM_ORD_Quote2,
      TPM_Process_Unused, TPM_Process_Quote2,
      TRUE,
@@ -1551,8 +1733,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     TRUE},
+     TRUE,
+     0},
     
+    [TPM_ORD_ReadCounter] =
     {TPM_ORD_ReadCounter,
      TPM_Process_Unused, TPM_Process_ReadCounter,
      TRUE,
@@ -1564,8 +1748,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ReadManuMaintPub] =
     {TPM_ORD_ReadManuMaintPub,
 #ifdef TPM_NOMAINTENANCE
      TPM_Process_Unused, TPM_Process_Unused,
@@ -1583,8 +1769,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ReadPubek] =
     {TPM_ORD_ReadPubek,
      TPM_Process_ReadPubek, TPM_Process_ReadPubek,
      TRUE,
@@ -1596,8 +1784,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ReleaseCounter] =
     {TPM_ORD_ReleaseCounter,
      TPM_Process_Unused, TPM_Process_ReleaseCounter,
      TRUE,
@@ -1609,8 +1799,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ReleaseCounterOwner] =
     {TPM_ORD_ReleaseCounterOwner,
      TPM_Process_Unused, TPM_Process_ReleaseCounterOwner,
      TRUE,
@@ -1622,8 +1814,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ReleaseTransportSigned] =
     {TPM_ORD_ReleaseTransportSigned,
      TPM_Process_Unused, TPM_Process_ReleaseTransportSigned,
      TRUE,
@@ -1635,8 +1829,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      FALSE,
      FALSE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_EXCLUSIVE_DEFERRED},
     
+    [TPM_ORD_Reset] =
     {TPM_ORD_Reset,
      TPM_Process_Reset, TPM_Process_Reset,
      TRUE,
@@ -1648,8 +1844,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_ResetLockValue] =
     {TPM_ORD_ResetLockValue,
      TPM_Process_Unused, TPM_Process_ResetLockValue,
      TRUE,
@@ -1661,8 +1859,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_RevokeTrust] =
     {TPM_ORD_RevokeTrust,
      TPM_Process_Unused, TPM_Process_RevokeTrust,
      TRUE,
@@ -1674,8 +1874,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SaveAuthContext] =
     {TPM_ORD_SaveAuthContext,
      TPM_Process_SaveAuthContext, TPM_Process_SaveAuthContext,
      TRUE,
@@ -1687,8 +1889,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SaveContext] =
     {TPM_ORD_SaveContext,
      TPM_Process_Unused, TPM_Process_SaveContext,
      TRUE,
@@ -1700,8 +1904,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SaveKeyContext] =
     {TPM_ORD_SaveKeyContext,
      TPM_Process_SaveKeyContext, TPM_Process_SaveKeyContext,
      TRUE,
@@ -1713,8 +1919,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SaveState] =
     {TPM_ORD_SaveState,
      TPM_Process_SaveState, TPM_Process_SaveState,
      TRUE,
@@ -1726,8 +1934,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Seal] =
     {TPM_ORD_Seal,
      TPM_Process_Seal, TPM_Process_Seal,
      TRUE,
@@ -1739,8 +1949,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Sealx] =
     {TPM_ORD_Sealx,
      TPM_Process_Unused, TPM_Process_Sealx,
      TRUE,
@@ -1752,8 +1964,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SelfTestFull] =
     {TPM_ORD_SelfTestFull,
      TPM_Process_SelfTestFull, TPM_Process_SelfTestFull,
      TRUE,
@@ -1765,8 +1979,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE},
     
+    [TPM_ORD_SetCapability] =
     {TPM_ORD_SetCapability,
      TPM_Process_Unused, TPM_Process_SetCapability,
      TRUE,
@@ -1778,8 +1994,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SetOperatorAuth] =
     {TPM_ORD_SetOperatorAuth,
      TPM_Process_Unused, TPM_Process_SetOperatorAuth,
      TRUE,
@@ -1791,8 +2009,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SetOrdinalAuditStatus] =
     {TPM_ORD_SetOrdinalAuditStatus,
      TPM_Process_SetOrdinalAuditStatus, TPM_Process_SetOrdinalAuditStatus,
      TRUE,
@@ -1804,8 +2024,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SetOwnerInstall] =
     {TPM_ORD_SetOwnerInstall,
      TPM_Process_SetOwnerInstall, TPM_Process_SetOwnerInstall,
      TRUE,
@@ -1817,8 +2039,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SetOwnerPointer] =
     {TPM_ORD_SetOwnerPointer,
      TPM_Process_Unused, TPM_Process_SetOwnerPointer,
      TRUE,
@@ -1830,8 +2054,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SetRedirection] =
     {TPM_ORD_SetRedirection,
      TPM_Process_Unused, TPM_Process_Unused,
      TRUE,
@@ -1843,8 +2069,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SetTempDeactivated] =
     {TPM_ORD_SetTempDeactivated,
      TPM_Process_SetTempDeactivated, TPM_Process_SetTempDeactivated,
      TRUE,
@@ -1856,8 +2084,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_SHA1Complete] =
     {TPM_ORD_SHA1Complete,
      TPM_Process_SHA1Complete, TPM_Process_SHA1Complete,
      TRUE,
@@ -1869,8 +2099,11 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE |
+     TPM_ORDFLAG_SHA1_THREAD},
     
+    [TPM_ORD_SHA1CompleteExtend] =
     {TPM_ORD_SHA1CompleteExtend,
      TPM_Process_SHA1CompleteExtend, TPM_Process_SHA1CompleteExtend,
      TRUE,
@@ -1882,8 +2115,11 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE |
+     TPM_ORDFLAG_SHA1_THREAD},
     
+    [TPM_ORD_SHA1Start] =
     {TPM_ORD_SHA1Start,
      TPM_Process_SHA1Start, TPM_Process_SHA1Start,
      TRUE,
@@ -1895,8 +2131,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE},
     
+    [TPM_ORD_SHA1Update] =
     {TPM_ORD_SHA1Update,
      TPM_Process_SHA1Update, TPM_Process_SHA1Update,
      TRUE,
@@ -1908,8 +2146,11 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE |
+     TPM_ORDFLAG_SHA1_THREAD},
     
+    [TPM_ORD_Sign] =
     {TPM_ORD_Sign,
      TPM_Process_Sign, TPM_Process_Sign,
      TRUE,
@@ -1921,8 +2162,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Startup] =
     {TPM_ORD_Startup,
      TPM_Process_Startup, TPM_Process_Startup,
      TRUE,
@@ -1934,8 +2177,11 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE |
+     TPM_ORDFLAG_KEEP_SAVED_STATE},
     
+    [TPM_ORD_StirRandom] =
     {TPM_ORD_StirRandom,
      TPM_Process_StirRandom, TPM_Process_StirRandom,
      TRUE,
@@ -1947,8 +2193,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_TakeOwnership] =
     {TPM_ORD_TakeOwnership,
      TPM_Process_TakeOwnership, TPM_Process_TakeOwnership,
      TRUE,
@@ -1960,8 +2208,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Terminate_Handle] =
     {TPM_ORD_Terminate_Handle,
      TPM_Process_TerminateHandle, TPM_Process_TerminateHandle,
      TRUE,
@@ -1973,8 +2223,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     TRUE},
+     TRUE,
+     0},
     
+    [TPM_ORD_TickStampBlob] =
     {TPM_ORD_TickStampBlob,
      TPM_Process_Unused, TPM_Process_TickStampBlob,
      TRUE,
@@ -1986,8 +2238,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_UnBind] =
     {TPM_ORD_UnBind,
      TPM_Process_UnBind, TPM_Process_UnBind,
      TRUE,
@@ -1999,8 +2253,10 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
+     FALSE,
+     0},
     
+    [TPM_ORD_Unseal] =
     {TPM_ORD_Unseal,
      TPM_Process_Unseal, TPM_Process_Unseal,
      TRUE,
@@ -2012,8 +2268,15 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE},
-    
+     FALSE,
+     0}
+};
+
+/* TSC ordinals are outside the dense TPM ordinal range.  This side table is indexed by the ordinal
+   minus TSC_ORD_PhysicalPresence. */
+
+static TPM_ORDINAL_TABLE tpm_tsc_ordinal_table[] =
+{
     {TSC_ORD_PhysicalPresence,
      TPM_Process_PhysicalPresence, TPM_Process_PhysicalPresence,
      TRUE,
@@ -2025,7 +2288,8 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      TRUE,
-     FALSE},
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE},
     
     {TSC_ORD_ResetEstablishmentBit,
      TPM_Process_Unused, TPM_Process_ResetEstablishmentBit,
@@ -2038,10 +2302,8 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
      0,
      TRUE,
      FALSE,
-     FALSE}
-    
-
-    
+     FALSE,
+     TPM_ORDFLAG_LIMITED_MODE}
 };
 
 /* 
@@ -2050,46 +2312,49 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
 
 /* TPM_OrdinalTable_GetEntry() gets the table entry for the ordinal.
 
-   If the ordinal is not in the table, TPM_BAD_ORDINAL is returned
+   The lookup is a direct index, so the command processor resolves the entry once per command and
+   passes it on.
+
+   If the ordinal is not in the table, 'entry' is set to NULL and TPM_BAD_ORDINAL is returned
 */
 
 TPM_RESULT TPM_OrdinalTable_GetEntry(TPM_ORDINAL_TABLE **entry,
-				     TPM_ORDINAL_TABLE *ordinalTable,
 				     TPM_COMMAND_CODE ordinal)
 {
     TPM_RESULT	rc = TPM_BAD_ORDINAL;
-    size_t	i;
+    TPM_ORDINAL_TABLE *candidate = NULL;
 
     /* printf(" TPM_OrdinalTable_GetEntry: Ordinal %08x\n", ordinal); */
     *entry = NULL;
-    for (i = 0 ; i < (sizeof(tpm_ordinal_table)/sizeof(TPM_ORDINAL_TABLE)) ; i++) {
-	if (ordinalTable[i].ordinal == ordinal) {	/* if found */
-	    *entry = &(ordinalTable[i]);		/* return the entry */
-	    rc = 0;					/* return found */
-	    break;
-	}
+    if (ordinal < TPM_ORDINALS_MAX) {
+	candidate = &(tpm_ordinal_table[ordinal]);
+    }
+    else if ((ordinal - TSC_ORD_PhysicalPresence) <
+	     (sizeof(tpm_tsc_ordinal_table)/sizeof(TPM_ORDINAL_TABLE))) {
+	candidate = &(tpm_tsc_ordinal_table[ordinal - TSC_ORD_PhysicalPresence]);
+    }
+    /* unused slots are zero filled and have no processing function */
+    if ((candidate != NULL) &&
+	(candidate->ordinal == ordinal) &&
+	(candidate->process_function_v12 != NULL)) {
+	*entry = candidate;		/* return the entry */
+	rc = 0;				/* return found */
     }
     return rc;
 }
 
-/* TPM_OrdinalTable_GetProcessFunction() returns the processing function for the ordinal.
+/* TPM_OrdinalTable_GetProcessFunction() returns the processing function for the ordinal table
+   entry.
 
-   If the ordinal is not in the table, the function TPM_Process_Unused() is returned.
+   If the entry is NULL, the ordinal is not in the table, and the function TPM_Process_Unused() is
+   returned.
 */
 
 void TPM_OrdinalTable_GetProcessFunction(tpm_process_function_t *tpm_process_function,
-					 TPM_ORDINAL_TABLE *ordinalTable,
-					 TPM_COMMAND_CODE ordinal)
+					 TPM_ORDINAL_TABLE *entry)
 {
-    TPM_RESULT	rc = 0;
-    TPM_ORDINAL_TABLE *entry;
-    
-    printf(" TPM_OrdinalTable_GetProcessFunction: Ordinal %08x\n", ordinal);
-
-    if (rc == 0) {
-	rc = TPM_OrdinalTable_GetEntry(&entry, ordinalTable, ordinal);
-    }
-    if (rc == 0) {	/* if found */
+    if (entry != NULL) {	/* if found */
+	printf(" TPM_OrdinalTable_GetProcessFunction: Ordinal %08x\n", entry->ordinal);
 #ifdef TPM_V12
 	*tpm_process_function = entry->process_function_v12;
 #else
@@ -2097,6 +2362,7 @@ void TPM_OrdinalTable_GetProcessFunction(tpm_process_function_t *tpm_process_fun
 #endif
     }
     else {	/* if not found, default processing function */
+	printf(" TPM_OrdinalTable_GetProcessFunction: Ordinal not found\n");
 	*tpm_process_function = TPM_Process_Unused;
     }
     return;
@@ -2115,7 +2381,7 @@ void TPM_OrdinalTable_GetAuditable(TPM_BOOL *auditable,
     
     printf(" TPM_OrdinalTable_GetAuditable: Ordinal %08x\n", ordinal);
     if (rc == 0) {
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, ordinal);
+	rc = TPM_OrdinalTable_GetEntry(&entry, ordinal);
     }
     /* if not found, unimplemented, not auditable */
     if (rc != 0) {
@@ -2152,7 +2418,7 @@ void TPM_OrdinalTable_GetAuditDefault(TPM_BOOL *auditDefault,
     TPM_ORDINAL_TABLE *entry;
 
     if (rc == 0) {
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, ordinal);
+	rc = TPM_OrdinalTable_GetEntry(&entry, ordinal);
     }
     /* if not found, unimplemented, not auditable */
     if (rc != 0) {
@@ -2178,7 +2444,7 @@ TPM_RESULT TPM_OrdinalTable_GetOwnerPermission(uint16_t *ownerPermissionBlock,
     TPM_ORDINAL_TABLE *entry;
 
     if (rc == 0) {
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, ordinal);
+	rc = TPM_OrdinalTable_GetEntry(&entry, ordinal);
     }
     if (rc == 0) {
 	*ownerPermissionBlock = entry->ownerPermissionBlock;
@@ -2205,7 +2471,7 @@ TPM_RESULT TPM_OrdinalTable_GetKeyPermission(uint16_t *keyPermissionBlock,
     TPM_ORDINAL_TABLE *entry;
 
     if (rc == 0) {
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, ordinal);
+	rc = TPM_OrdinalTable_GetEntry(&entry, ordinal);
     }
     if (rc == 0) {
 	*keyPermissionBlock = entry->keyPermissionBlock;
@@ -2225,6 +2491,7 @@ TPM_RESULT TPM_OrdinalTable_GetKeyPermission(uint16_t *keyPermissionBlock,
 	- length of DATAw
 	- number of key handles and their indexes
 	- ordinal
+	- the ordinal table entry, later passed to TPM_OrdinalTable_ParseWrappedRsp()
 	- transportWrappable FALSE if the command cannot be wrapped in a transport session
 
    FIXME if audit has to occur before command parsing, this command becomes more generally useful,
@@ -2240,6 +2507,7 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedCmd(uint32_t *datawStart,
 					    uint32_t *keyHandle1Index,
 					    uint32_t *keyHandle2Index,
 					    TPM_COMMAND_CODE *ordinal,
+					    TPM_ORDINAL_TABLE **entry,
 					    TPM_BOOL *transportWrappable,
 					    TPM_SIZED_BUFFER *wrappedCmd)
 {
@@ -2248,7 +2516,6 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedCmd(uint32_t *datawStart,
     unsigned char	*stream;
     TPM_TAG		tag = 0;
     uint32_t		paramSize = 0;
-    TPM_ORDINAL_TABLE	*entry;		/* table entry for the ordinal */
     uint32_t		authLen;	/* length of below the line parameters */
 
     printf(" TPM_OrdinalTable_ParseWrappedCmd:\n");
@@ -2266,12 +2533,12 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedCmd(uint32_t *datawStart,
     /* get the entry from the ordinal table */
     if (rc == 0) {
 	printf("  TPM_OrdinalTable_ParseWrappedCmd: ordinal %08x\n", *ordinal);
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, *ordinal);
+	rc = TPM_OrdinalTable_GetEntry(entry, *ordinal);
     }
     if (rc == 0) {
 	/* datawStart indexes into the dataW area, skip the standard 3 inputs and the handles */
 	*datawStart = sizeof(TPM_TAG) + sizeof(uint32_t) + sizeof(TPM_COMMAND_CODE) +
-		      entry->inputHandleSize;
+		      (*entry)->inputHandleSize;
 	/* authLen is the length of the below-the-line auth parameters that are excluded from the
 	   dataW area */
 	switch (tag) {
@@ -2303,9 +2570,9 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedCmd(uint32_t *datawStart,
 	printf("  TPM_OrdinalTable_ParseWrappedCmd: datawStart %u datawLen %u\n",
 	       *datawStart, *datawLen);
 	/* determine whether the command can be wrapped in a transport session */
-	*transportWrappable = entry->transportWrappable;
+	*transportWrappable = (*entry)->transportWrappable;
 	/* return the number of key handles */
-	*keyHandles = entry->keyHandles;
+	*keyHandles = (*entry)->keyHandles;
     }
     if (rc == 0) {
 	printf("  TPM_OrdinalTable_ParseWrappedCmd: key handles %u\n", *keyHandles);
@@ -2353,17 +2620,16 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedCmd(uint32_t *datawStart,
 TPM_RESULT TPM_OrdinalTable_ParseWrappedRsp(uint32_t *datawStart,
 					    uint32_t *datawLen,
 					    TPM_RESULT *rcw,
-					    TPM_COMMAND_CODE ordinal,
+					    TPM_ORDINAL_TABLE *entry,
 					    const unsigned char *wrappedRspStream,
 					    uint32_t wrappedRspStreamSize)
 {
     TPM_RESULT		rc = 0;
     TPM_TAG		tag = 0;
     uint32_t		paramSize = 0;
-    TPM_ORDINAL_TABLE	*entry;		/* table entry for the ordinal */
     uint32_t		authLen;	/* length of below the line parameters */
 
-    printf(" TPM_OrdinalTable_ParseWrappedRsp: ordinal %08x\n", ordinal);
+    printf(" TPM_OrdinalTable_ParseWrappedRsp: ordinal %08x\n", entry->ordinal);
     /* Extract the standard response parameters from the response stream.  This also validates
        paramSize against wrappedRspSize */
     if (rc == 0) {
@@ -2371,10 +2637,8 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedRsp(uint32_t *datawStart,
 					   (unsigned char **)&wrappedRspStream,
 					   &wrappedRspStreamSize);
     }
-    /* get the entry from the ordinal table */
     if (rc == 0) {
 	printf(" TPM_OrdinalTable_ParseWrappedRsp: returnCode %08x\n", *rcw);
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, ordinal);
     }
     /* parse the success return code case */
     if ((rc == 0) && (*rcw == TPM_SUCCESS)) {
@@ -2507,6 +2771,44 @@ TPM_RESULT TPM_ProcessA(unsigned char **response,
     return rc;
 }
 
+/* TPM_ProcessInto() is an alternate to TPM_ProcessA() where the caller owns the response buffer.
+
+   The ordinal serializes its response into the instance ordinalResponse buffer, which is copied
+   to 'response' once the response is complete, so there is no allocation for the response.  The
+   ordinal reads back its output parameters for the digests and the transport log, so they must
+   not be built in memory the caller may change.  The buffer is never grown.  If the response does
+   not fit in 'response_total' bytes, the command fails with TPM_SIZE.  A buffer of the TPM I/O
+   buffer size always fits.
+
+   On output:
+
+   'response_size' - the number of valid bytes in buffer, 0 on a fatal error
+*/
+
+TPM_RESULT TPM_ProcessInto(unsigned char *response,
+			   uint32_t response_total,
+			   uint32_t *response_size,
+			   unsigned char *command,		/* complete command array */
+			   uint32_t command_size)		/* actual bytes in command */
+{
+    TPM_RESULT		rc = 0;
+    TPM_STORE_BUFFER	responseSbuffer;
+    const unsigned char	*buffer;
+
+    *response_size = 0;
+    /* the sbuffer wraps the caller's response buffer, it is never grown or freed */
+    TPM_Sbuffer_InitFixed(&responseSbuffer, response, response_total);
+    if (rc == 0) {
+	rc = TPM_Process(&responseSbuffer,
+			 command,		/* complete command array */
+			 command_size);		/* actual bytes in command */
+    }
+    if (rc == 0) {
+	TPM_Sbuffer_Get(&responseSbuffer, &buffer, response_size);
+    }
+    return rc;
+}
+
 /* Process the command from the host to the TPM.
 
    'command_size' is the actual size of the command stream.
@@ -2528,6 +2830,8 @@ TPM_RESULT TPM_Process(TPM_STORE_BUFFER *response,
     TPM_TAG		tag = 0;
     uint32_t		paramSize = 0;
     TPM_COMMAND_CODE	ordinal = 0;
+    TPM_ORDINAL_TABLE	*entry = NULL;			/* ordinal table entry, NULL if not
+							   found */
     tpm_process_function_t tpm_process_function = NULL;	/* based on ordinal */
     tpm_state_t		*targetInstance = NULL;		/* TPM global state */
     TPM_STORE_BUFFER	localBuffer;		/* for response if instance was not found */
@@ -2545,19 +2849,23 @@ TPM_RESULT TPM_Process(TPM_STORE_BUFFER *response,
 	/* extract the standard command parameters from the command stream */
 	returnCode = TPM_Process_GetCommandParams(&tag, &paramSize, &ordinal,
 						  &command, &command_size);
+    }
+    /* resolve the ordinal table entry once per command */
+    if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
+	TPM_OrdinalTable_GetEntry(&entry, ordinal);
     }	 
     /* preprocessing common to all ordinals */
     if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
-	returnCode = TPM_Process_Preprocess(targetInstance, ordinal, NULL);
+	returnCode = TPM_Process_Preprocess(targetInstance, ordinal, entry, NULL);
     }
     /* NOTE Only for debugging */
-    if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
+    if ((rc == 0) && (returnCode == TPM_SUCCESS) && TPM_TRACE_ACTIVE(0)) {
 	TPM_KeyHandleEntries_Trace(targetInstance->tpm_key_handle_entries);
     }
     /* process the ordinal */
     if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
 	/* get the processing function from the ordinal table */
-	TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, tpm_ordinal_table, ordinal);
+	TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, entry);
 	/* call the processing function to execute the command */
 	returnCode = tpm_process_function(targetInstance,
 					  &(targetInstance->tpm_stclear_data.ordinalResponse),
@@ -2565,11 +2873,11 @@ TPM_RESULT TPM_Process(TPM_STORE_BUFFER *response,
 					  NULL);	/* not from encrypted transport */
     }
     /* NOTE Only for debugging */
-    if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
+    if ((rc == 0) && (returnCode == TPM_SUCCESS) && TPM_TRACE_ACTIVE(0)) {
 	TPM_KeyHandleEntries_Trace(targetInstance->tpm_key_handle_entries);
     }
     /* NOTE Only for debugging */
-    if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
+    if ((rc == 0) && (returnCode == TPM_SUCCESS) && TPM_TRACE_ACTIVE(0)) {
 	TPM_State_Trace(targetInstance);
     }
 #ifdef TPM_VOLATILE_STORE
@@ -2604,7 +2912,10 @@ TPM_RESULT TPM_Process(TPM_STORE_BUFFER *response,
 	}
 	if (rc == 0) {
 	    /* it's not even known whether the initial response was stored, so just start
-	       over */
+	       over.  Zero the partial response, it may hold output such as unsealed data. */
+	    if (sbuffer->buffer != NULL) {
+		memset(sbuffer->buffer, 0, sbuffer->buffer_current - sbuffer->buffer);
+	    }
 	    TPM_Sbuffer_Clear(sbuffer);
 	    /* store the tag, paramSize, and returnCode */
 	    printf("TPM_Process: Ordinal returnCode %08x %u\n",
@@ -2623,6 +2934,10 @@ TPM_RESULT TPM_Process(TPM_STORE_BUFFER *response,
       cleanup
     */
     TPM_Sbuffer_Delete(&localBuffer);	/* @1 */
+    /* the response is complete, release the command temporaries */
+    if (targetInstance != NULL) {
+	TPM_Arena_Reset(&(targetInstance->tpm_arena));
+    }
     return rc;
 }
 
@@ -2659,6 +2974,8 @@ TPM_RESULT TPM_Process_Wrapped(TPM_STORE_BUFFER *response,
     TPM_TAG		tag = 0;
     uint32_t		paramSize = 0;
     TPM_COMMAND_CODE	ordinal = 0;
+    TPM_ORDINAL_TABLE	*entry = NULL;			/* ordinal table entry, NULL if not
+							   found */
     tpm_process_function_t tpm_process_function = NULL; /* based on ordinal */
     TPM_STORE_BUFFER	ordinalResponse;		/* response for this ordinal */
     
@@ -2670,14 +2987,19 @@ TPM_RESULT TPM_Process_Wrapped(TPM_STORE_BUFFER *response,
 	returnCode = TPM_Process_GetCommandParams(&tag, &paramSize, &ordinal,
 						  &command, &command_size);
     }
+    /* resolve the ordinal table entry once per command */
+    if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
+	TPM_OrdinalTable_GetEntry(&entry, ordinal);
+    }
     /* preprocessing common to all ordinals */
     if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
-	returnCode = TPM_Process_Preprocess(targetInstance, ordinal, transportInternal);
+	returnCode = TPM_Process_Preprocess(targetInstance, ordinal, entry,
+						    transportInternal);
     }
     /* process the ordinal */
     if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
 	/* get the processing function from the ordinal table */
-	TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, tpm_ordinal_table, ordinal);
+	TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, entry);
 	/* call the processing function to execute the command */
 	returnCode = tpm_process_function(targetInstance, &ordinalResponse,
 					  tag, command_size, ordinal, command,
@@ -2977,17 +3299,25 @@ TPM_RESULT TPM_CheckState(tpm_state_t *tpm_state,
 
 /* TPM_Process_Preprocess() handles check functions common to all ordinals
 
+   'entry' is the ordinal table entry, NULL if the ordinal is not in the table.  The per-ordinal
+   policy comes from its TPM_ORDFLAG_xx flags.
+
    'transportPublic' not NULL indicates that this function was called recursively from
    TPM_ExecuteTransport
 */
 
 TPM_RESULT TPM_Process_Preprocess(tpm_state_t *tpm_state,
 				  TPM_COMMAND_CODE ordinal,
+				  TPM_ORDINAL_TABLE *entry,
 				  TPM_TRANSPORT_INTERNAL *transportInternal)
 {
     TPM_RESULT		rc = 0;				/* fatal error, no response */
+    uint32_t		ordinalFlags = 0;		/* unknown ordinals have no properties */
 
     printf(" TPM_Process_Preprocess: Ordinal %08x\n", ordinal);
+    if (entry != NULL) {
+	ordinalFlags = entry->ordinalFlags;
+    }
     /* Preprocess to check if command can be run in limited operation mode */
     if (rc == 0) {
 	if (tpm_state->testState == TPM_TEST_STATE_LIMITED) {
@@ -2995,28 +3325,17 @@ TPM_RESULT TPM_Process_Preprocess(tpm_state_t *tpm_state,
 	       TPM_SHA1Start, TPM_SHA1Update, TPM_SHA1Complete, TPM_SHA1CompleteExtend, TPM_Extend,
 	       TPM_Startup, TPM_ContinueSelfTest, a subset of TPM_GetCapability, and
 	       TPM_GetTestResult..
+
+	       2. The TSC_PhysicalPresence and TSC_ResetEstablishmentBit commands do not operate on
+	       shielded-locations and have no requirement to be self-tested before any use.
+
+	       3. The TPM MAY allow TPM_SelfTestFull to be used before completion of the actions of
+	       TPM_ContinueSelfTest.
+
+	       A subset of TPM_GetCapability does not require self-test.  The ordinal itself decides
+	       whether to run TPM_ContinueSelfTest().
 	    */
-	    if (!((ordinal == TPM_ORD_Startup) ||
-		  (ordinal == TPM_ORD_SHA1Start) ||
-		  (ordinal == TPM_ORD_SHA1Update) ||
-		  (ordinal == TPM_ORD_SHA1Complete) ||
-		  (ordinal == TPM_ORD_SHA1CompleteExtend) ||
-		  (ordinal == TPM_ORD_Extend) ||
-		  (ordinal == TPM_ORD_Startup) ||
-		  (ordinal == TPM_ORD_ContinueSelfTest) ||
-		  /* a subset of TPM_GetCapability does not require self-test.	The ordinal itself
-		     decides whether to run TPM_ContinueSelfTest() */
-		  (ordinal == TPM_ORD_GetCapability) ||
-		  /* 3. The TPM MAY allow TPM_SelfTestFull to be used before completion of the
-		     actions of TPM_ContinueSelfTest. */
-		  (ordinal == TPM_ORD_SelfTestFull) ||
-		  (ordinal == TPM_ORD_GetTestResult) ||
-		  /* 2. The TSC_PhysicalPresence and TSC_ResetEstablishmentBit commands do not
-		     operate on shielded-locations and have no requirement to be self-tested before
-		     any use. TPM's SHOULD test these functions before operation. */
-		  (ordinal == TSC_ORD_PhysicalPresence) ||
-		  (ordinal == TSC_ORD_ResetEstablishmentBit)
-		  )) {
+	    if (!(ordinalFlags & TPM_ORDFLAG_LIMITED_MODE)) {
 		/* One of the optional actions. */
 		/* rc = TPM_NEEDS_SELFTEST; */
 		/* Alternatively, could run the actions of continue self-test */
@@ -3026,14 +3345,13 @@ TPM_RESULT TPM_Process_Preprocess(tpm_state_t *tpm_state,
     }
     /* special pre-processing for SHA1 context */
     if (rc == 0) {
-	rc = TPM_Check_SHA1Context(tpm_state, ordinal, transportInternal);
+	rc = TPM_Check_SHA1Context(tpm_state, ordinalFlags, transportInternal);
     }
     /* Special pre-processing to invalidate the saved state if it exists.  Omit this processing for
        TPM_Startup, since that function might restore the state first */
     if (rc == 0) {
 	if (tpm_state->tpm_stany_flags.stateSaved &&
-	    !((ordinal == TPM_ORD_Startup) ||
-	      (ordinal == TPM_ORD_Init))) {
+	    !(ordinalFlags & TPM_ORDFLAG_KEEP_SAVED_STATE)) {
 	    /* For any other ordinal, invalidate the saved state if it exists.	*/
 	    rc = TPM_SaveState_NVDelete(tpm_state, TRUE);
 	}
@@ -3046,8 +3364,7 @@ TPM_RESULT TPM_Process_Preprocess(tpm_state_t *tpm_state,
 	    /* These two ordinals terminate the exclusive transport session if the transport handle
 	       is not the specified handle.  So the check is deferred until the command is parsed
 	       for the transport handle. */
-	    !((ordinal == TPM_ORD_ExecuteTransport) ||
-	      (ordinal == TPM_ORD_ReleaseTransportSigned))) {
+	    !(ordinalFlags & TPM_ORDFLAG_EXCLUSIVE_DEFERRED)) {
 	    rc = TPM_TransportSessions_TerminateHandle
 		 (tpm_state->tpm_stclear_data.transSessions,
 		  tpm_state->tpm_stany_flags.transportExclusive,
@@ -3079,22 +3396,23 @@ TPM_RESULT TPM_Process_Preprocess(tpm_state_t *tpm_state,
    
    b. A SHA-1 thread (start, update, complete) MUST take place either completely outside a transport
    session or completely within a single transport session.
+
+   'ordinalFlags' are the TPM_ORDFLAG_xx flags from the ordinal table entry.
 */
 
 TPM_RESULT TPM_Check_SHA1Context(tpm_state_t *tpm_state,
-				 TPM_COMMAND_CODE ordinal,
+				 uint32_t ordinalFlags,
 				 TPM_TRANSPORT_INTERNAL *transportInternal)
 {
     TPM_RESULT rc = 0;
 
-    if ((tpm_state->sha1_context != NULL) &&	/* if there was a SHA-1 context set up */
-	(ordinal != TPM_ORD_ExecuteTransport))	/* depends on the wrapped command */
+    if ((tpm_state->sha1_context != NULL) &&			/* if there was a SHA-1 context set
+								   up */
+	!(ordinalFlags & TPM_ORDFLAG_SHA1_DEFERRED))		/* depends on the wrapped command */
 	{
 	/* the non-SHA1 ordinals invalidate the SHA-1 session */
 	if (
-	    ((ordinal != TPM_ORD_SHA1Update) &&
-	     (ordinal != TPM_ORD_SHA1Complete) &&
-	     (ordinal != TPM_ORD_SHA1CompleteExtend)) ||
+	    !(ordinalFlags & TPM_ORDFLAG_SHA1_THREAD) ||
 	    
 	    /* invalidate if the SHA1 ordinal is within a transport session and the session was not
 	       set up within the same transport session. */
@@ -3741,10 +4059,12 @@ static TPM_RESULT TPM_GetCapability_CapOrd(TPM_STORE_BUFFER *capabilityResponse,
 					   uint32_t ordinal)
 {
     TPM_RESULT			rc = 0;
+    TPM_ORDINAL_TABLE		*entry;
     tpm_process_function_t	tpm_process_function;
     TPM_BOOL			supported;
 
-    TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, tpm_ordinal_table, ordinal);
+    TPM_OrdinalTable_GetEntry(&entry, ordinal);
+    TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, entry);
     /* determine of the ordinal is supported */
     if (tpm_process_function != TPM_Process_Unused) {
 	supported = TRUE;
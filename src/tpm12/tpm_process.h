@@ -98,6 +98,11 @@ TPM_RESULT TPM_ProcessA(unsigned char **response,
 			uint32_t *response_total,
 			unsigned char *command,
 			uint32_t command_size);
+TPM_RESULT TPM_ProcessInto(unsigned char *response,
+                           uint32_t response_total,
+                           uint32_t *response_size,
+                           unsigned char *command,
+                           uint32_t command_size);
 TPM_RESULT TPM_Process(TPM_STORE_BUFFER *response,
                        unsigned char *command,
                        uint32_t command_size);
@@ -172,12 +177,6 @@ TPM_RESULT TPM_CheckRequestTag0  (TPM_TAG tpm_tag);
 TPM_RESULT TPM_CheckState(tpm_state_t *tpm_state,
                           TPM_TAG tag,
                           uint32_t tpm_check_map);
-TPM_RESULT TPM_Process_Preprocess(tpm_state_t *tpm_state,
-                                  TPM_COMMAND_CODE ordinal,
-                                  TPM_TRANSPORT_INTERNAL *transportInternal);
-TPM_RESULT TPM_Check_SHA1Context(tpm_state_t *tpm_state,
-                                 TPM_COMMAND_CODE ordinal,
-                                 TPM_TRANSPORT_INTERNAL *transportInternal);
 
 /* ordinal processing */
 
@@ -223,14 +222,34 @@ typedef struct tdTPM_ORDINAL_TABLE {
                                                            a parent instance  */
     TPM_BOOL hardwareWrappable;                         /* ordinal can be wrapped and call the
                                                            hardware TPM instance  */
+    uint32_t ordinalFlags;                              /* TPM_ORDFLAG_xx properties */
 } TPM_ORDINAL_TABLE;
 
+/*
+  defines for TPM_ORDINAL_TABLE -> ordinalFlags
+*/
+
+#define TPM_ORDFLAG_LIMITED_MODE        0x00000001      /* can run in limited operation mode,
+                                                           before the self test completes */
+#define TPM_ORDFLAG_SHA1_THREAD         0x00000002      /* continues an active SHA-1 thread */
+#define TPM_ORDFLAG_SHA1_DEFERRED       0x00000004      /* SHA-1 thread check is based on the
+                                                           wrapped command */
+#define TPM_ORDFLAG_KEEP_SAVED_STATE    0x00000008      /* does not invalidate the saved state */
+#define TPM_ORDFLAG_EXCLUSIVE_DEFERRED  0x00000010      /* exclusive transport check is deferred
+                                                           until the transport handle is parsed */
+
+TPM_RESULT TPM_Process_Preprocess(tpm_state_t *tpm_state,
+                                  TPM_COMMAND_CODE ordinal,
+                                  TPM_ORDINAL_TABLE *entry,
+                                  TPM_TRANSPORT_INTERNAL *transportInternal);
+TPM_RESULT TPM_Check_SHA1Context(tpm_state_t *tpm_state,
+                                 uint32_t ordinalFlags,
+                                 TPM_TRANSPORT_INTERNAL *transportInternal);
+
 TPM_RESULT TPM_OrdinalTable_GetEntry(TPM_ORDINAL_TABLE **entry,
-                                     TPM_ORDINAL_TABLE *ordinalTable,
                                      TPM_COMMAND_CODE ordinal);
 void       TPM_OrdinalTable_GetProcessFunction(tpm_process_function_t *tpm_process_function,
-                                               TPM_ORDINAL_TABLE *ordinalTable,
-                                               TPM_COMMAND_CODE ordinal);
+                                               TPM_ORDINAL_TABLE *entry);
 void       TPM_OrdinalTable_GetAuditable(TPM_BOOL *auditable,
                                          TPM_COMMAND_CODE ordinal);
 void       TPM_OrdinalTable_GetAuditDefault(TPM_BOOL *auditDefault,
@@ -247,12 +266,13 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedCmd(uint32_t *datawStart,
                                             uint32_t *keyHandle1Index,
                                             uint32_t *keyHandle2Index,
                                             TPM_COMMAND_CODE *ordinal,
+                                            TPM_ORDINAL_TABLE **entry,
                                             TPM_BOOL *transportWrappable,
                                             TPM_SIZED_BUFFER *wrappedCmd);
 TPM_RESULT TPM_OrdinalTable_ParseWrappedRsp(uint32_t *datawStart,
                                             uint32_t *datawLen,
                                             TPM_RESULT *rcw,
-                                            TPM_COMMAND_CODE ordinal,
+                                            TPM_ORDINAL_TABLE *entry,
                                             const unsigned char *wrappedRspStream,
                                             uint32_t wrappedRspStreamSize);
 
@@ -41,6 +41,7 @@
 #include <string.h>
 
 #include "tpm_crypto.h"
+#include "tpm_cryptoh.h"
 #include "tpm_debug.h"
 #include "tpm_error.h"
 #include "tpm_store.h"
@@ -156,11 +157,7 @@ TPM_RESULT TPM_Secret_Generate(TPM_SECRET tpm_secret)
 
 void TPM_Secret_XOR(TPM_SECRET output, TPM_SECRET input1, TPM_SECRET input2)
 {
-    size_t i;
-
     printf("  TPM_Secret_XOR:\n");
-    for (i = 0 ; i < TPM_SECRET_SIZE ; i++) {
-        output[i] = input1[i] ^ input2[i];
-    }
+    TPM_XOR(output, input1, input2, TPM_SECRET_SIZE);
     return;
 }
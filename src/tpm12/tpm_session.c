@@ -111,6 +111,7 @@ void TPM_AuthSessionData_Init(TPM_AUTH_SESSION_DATA *tpm_auth_session_data)
     TPM_Digest_Init(tpm_auth_session_data->entityDigest);
     TPM_DelegatePublic_Init(&(tpm_auth_session_data->pub));
     tpm_auth_session_data->valid = FALSE;
+    TPM_HmacMidstate_Init(&(tpm_auth_session_data->hmacMidstate));
     return;
 }
 
@@ -231,6 +232,7 @@ void TPM_AuthSessionData_Delete(TPM_AUTH_SESSION_DATA *tpm_auth_session_data)
     printf(" TPM_AuthSessionData_Delete:\n");
     if (tpm_auth_session_data != NULL) {
 	TPM_DelegatePublic_Delete(&(tpm_auth_session_data->pub));
+	TPM_HmacMidstate_Delete(&(tpm_auth_session_data->hmacMidstate));
 	TPM_AuthSessionData_Init(tpm_auth_session_data);
     }
     return;
@@ -253,6 +255,8 @@ void TPM_AuthSessionData_Copy(TPM_AUTH_SESSION_DATA *dest_auth_session_data,
     TPM_Digest_Copy(dest_auth_session_data->entityDigest, src_auth_session_data->entityDigest);
     TPM_DelegatePublic_Copy(&(dest_auth_session_data->pub), &(src_auth_session_data->pub));
     dest_auth_session_data->valid= src_auth_session_data->valid;
+    TPM_HmacMidstate_Copy(&(dest_auth_session_data->hmacMidstate),
+			  &(src_auth_session_data->hmacMidstate));
 }
 
 /* TPM_AuthSessionData_GetDelegatePublic() */
@@ -3474,8 +3478,6 @@ TPM_RESULT TPM_Process_LoadContext(tpm_state_t *tpm_state,
     TPM_BOOL			trans_session_added = FALSE;
     TPM_BOOL			daa_session_added = FALSE;
     TPM_STCLEAR_DATA		*v1StClearData = NULL;
-    unsigned char		*m1Decrypt;		/* decrypted sensitive data */
-    uint32_t			m1_length;		/* actual data in m1 */
     unsigned char		*stream;
     uint32_t			stream_size;
     TPM_CONTEXT_SENSITIVE	c1ContextSensitive;
@@ -3495,7 +3497,6 @@ TPM_RESULT TPM_Process_LoadContext(tpm_state_t *tpm_state,
     printf("TPM_Process_LoadContext: Ordinal Entry\n");
     TPM_ContextBlob_Init(&b1ContextBlob);			/* freed @1 */
     TPM_KeyHandleEntry_Init(&tpm_key_handle_entry);		/* no free */
-    m1Decrypt = NULL;						/* freed @2 */
     TPM_ContextSensitive_Init(&c1ContextSensitive);		/* freed @3 */
     TPM_AuthSessionData_Init(&tpm_auth_session_data);		/* freed @4 */
     TPM_TransportInternal_Init(&tpm_transport_internal);	/* freed @5 */
@@ -3561,20 +3562,22 @@ TPM_RESULT TPM_Process_LoadContext(tpm_state_t *tpm_state,
 	/* 2. Map V1 to TPM_STANY_DATA NOTE MAY be TPM_STCLEAR_DATA */
 	v1StClearData = &(tpm_state->tpm_stclear_data);
 	/* 3. Create M1 by decrypting B1 -> sensitiveData using TPM_PERMANENT_DATA -> contextKey */
+	/* NOTE M1 is decrypted in place, B1 -> sensitiveData holds the cleartext afterwards */
 	printf("TPM_Process_LoadContext: Decrypting sensitiveData\n");
-	returnCode = TPM_SymmetricKeyData_Decrypt(&m1Decrypt,		/* decrypted data */
-						  &m1_length,		/* length decrypted data */
-						  b1ContextBlob.sensitiveData.buffer, /* encrypt */
-						  b1ContextBlob.sensitiveData.size,
-						  tpm_state->tpm_permanent_data.contextKey);
+	returnCode =
+	    TPM_SymmetricKeyData_DecryptBuffer(b1ContextBlob.sensitiveData.buffer, /* decrypt */
+					       &(b1ContextBlob.sensitiveData.size),
+					       b1ContextBlob.sensitiveData.buffer, /* encrypt */
+					       b1ContextBlob.sensitiveData.size,
+					       tpm_state->tpm_permanent_data.contextKey);
     }
     /* 4. Create C1 and R1 by splitting M1 into a TPM_CONTEXT_SENSITIVE structure and internal
        resource data */
     /* NOTE R1 is manufacturer specific data that might be part of the blob.  This implementation
        does not use R1 */
     if (returnCode == TPM_SUCCESS) {
-	stream = m1Decrypt;
-	stream_size = m1_length;
+	stream = b1ContextBlob.sensitiveData.buffer;
+	stream_size = b1ContextBlob.sensitiveData.size;
 	returnCode = TPM_ContextSensitive_Load(&c1ContextSensitive, &stream, &stream_size);
     }
     /* Parse the TPM_CONTEXT_SENSITIVE -> internalData depending on the resource type */
@@ -3709,7 +3712,7 @@ TPM_RESULT TPM_Process_LoadContext(tpm_state_t *tpm_state,
 	/* b. Set B1 -> integrityDigest to all zeros */
 	/* NOTE Done by TPM_HMAC_CheckStructure() */
 	/* c. Copy M1 to B1 -> sensitiveData (integrityDigest HMAC uses cleartext) */
-	returnCode = TPM_SizedBuffer_Set(&(b1ContextBlob.sensitiveData), m1_length, m1Decrypt);
+	/* NOTE Done by the in place decrypt */
     }
     /* d. Create H2 the HMAC of B1 using TPM_PERMANENT_DATA -> tpmProof as the HMAC key */
     /* e. If H2 does not equal H1 return TPM_BADCONTEXT */
@@ -3844,7 +3847,6 @@ TPM_RESULT TPM_Process_LoadContext(tpm_state_t *tpm_state,
 	}
     }
     TPM_ContextBlob_Delete(&b1ContextBlob);			/* @1 */
-    free(m1Decrypt);						/* @2 */
     TPM_ContextSensitive_Delete(&c1ContextSensitive);		/* @3 */
     TPM_AuthSessionData_Delete(&tpm_auth_session_data);		/* @4 */
     TPM_TransportInternal_Delete(&tpm_transport_internal);	/* @5 */
@@ -4665,8 +4667,6 @@ TPM_RESULT TPM_Process_LoadKeyContext(tpm_state_t *tpm_state,
     TPM_BOOL			transportEncrypt;	/* wrapped in encrypted transport session */
     unsigned char		*stream;
     uint32_t			stream_size;
-    unsigned char	*contextSensitiveBuffer;	/* decrypted sensitive data */
-    uint32_t		contextSensitiveBuffer_length;	/* actual data in contextSensitiveBuffer */
     TPM_CONTEXT_SENSITIVE	contextSensitive;
     TPM_KEY_HANDLE_ENTRY	*used_key_handle_entry;
     TPM_KEY_HANDLE_ENTRY	tpm_key_handle_entry;
@@ -4684,7 +4684,6 @@ TPM_RESULT TPM_Process_LoadKeyContext(tpm_state_t *tpm_state,
 
     printf("TPM_Process_LoadKeyContext: Ordinal Entry\n");
     TPM_ContextBlob_Init(&keyContextBlob);		/* freed @1 */
-    contextSensitiveBuffer = NULL;			/* freed @2 */
     TPM_ContextSensitive_Init(&contextSensitive);	/* freed @3 */
     TPM_KeyHandleEntry_Init(&tpm_key_handle_entry);	/* no free */
     /*
@@ -4754,17 +4753,17 @@ TPM_RESULT TPM_Process_LoadKeyContext(tpm_state_t *tpm_state,
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_LoadKeyContext: Decrypting TPM_CONTEXT_SENSITIVE stream\n");
 	returnCode =
-	    TPM_SymmetricKeyData_Decrypt(&contextSensitiveBuffer,	/* decrypted data */
-					 &contextSensitiveBuffer_length, /* length decrypted data */
-					 keyContextBlob.sensitiveData.buffer, /* encrypted */
-					 keyContextBlob.sensitiveData.size,
-					 tpm_state->tpm_permanent_data.contextKey);
+	    TPM_SymmetricKeyData_DecryptBuffer(keyContextBlob.sensitiveData.buffer, /* decrypted */
+					       &(keyContextBlob.sensitiveData.size),
+					       keyContextBlob.sensitiveData.buffer, /* encrypted */
+					       keyContextBlob.sensitiveData.size,
+					       tpm_state->tpm_permanent_data.contextKey);
     }
     /* deserialize TPM_CONTEXT_SENSITIVE */
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_LoadKeyContext: Creating TPM_CONTEXT_SENSITIVE\n");
-	stream = contextSensitiveBuffer;
-	stream_size = contextSensitiveBuffer_length;
+	stream = keyContextBlob.sensitiveData.buffer;
+	stream_size = keyContextBlob.sensitiveData.size;
 	returnCode = TPM_ContextSensitive_Load(&contextSensitive, &stream, &stream_size);
     }
     if (returnCode == TPM_SUCCESS) {
@@ -4783,11 +4782,8 @@ TPM_RESULT TPM_Process_LoadKeyContext(tpm_state_t *tpm_state,
 	    returnCode = TPM_BADCONTEXT;
 	}
     }
-    /* Move decrypted data back to keyContextBlob for integrityDigest check. */
-    if (returnCode == TPM_SUCCESS) {
-	returnCode = TPM_SizedBuffer_Set(&(keyContextBlob.sensitiveData),
-					 contextSensitiveBuffer_length, contextSensitiveBuffer);
-    }
+    /* NOTE keyContextBlob already holds the decrypted data for the integrityDigest check, since
+       it was decrypted in place */
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_LoadKeyContext: Checking integrityDigest\n");
 	/* make a copy of integrityDigest, because it needs to be 0 for the HMAC calculation */
@@ -4885,7 +4881,6 @@ TPM_RESULT TPM_Process_LoadKeyContext(tpm_state_t *tpm_state,
       cleanup
     */
     TPM_ContextBlob_Delete(&keyContextBlob);		/* @1 */
-    free(contextSensitiveBuffer);			/* @2 */
     TPM_ContextSensitive_Delete(&contextSensitive);	/* @3 */
     /* if there was a failure, roll back */
     if ((rcf != 0) || (returnCode != TPM_SUCCESS)) {
@@ -5208,8 +5203,6 @@ TPM_RESULT TPM_Process_LoadAuthContext(tpm_state_t *tpm_state,
     TPM_BOOL			transportEncrypt;	/* wrapped in encrypted transport session */
     unsigned char		*stream;
     uint32_t			stream_size;
-    unsigned char	*contextSensitiveBuffer;	/* decrypted sensitive data */
-    uint32_t		contextSensitiveBuffer_length;	/* actual data in contextSensitiveBuffer */
     TPM_CONTEXT_SENSITIVE	contextSensitive;
     TPM_AUTH_SESSION_DATA	tpm_auth_session_data;
     TPM_AUTH_SESSION_DATA	*used_auth_session_data;
@@ -5231,7 +5224,6 @@ TPM_RESULT TPM_Process_LoadAuthContext(tpm_state_t *tpm_state,
 
     printf("TPM_Process_LoadAuthContext: Ordinal Entry\n");
     TPM_ContextBlob_Init(&authContextBlob);		/* freed @1 */
-    contextSensitiveBuffer = NULL;			/* freed @2 */
     TPM_ContextSensitive_Init(&contextSensitive);	/* freed @3 */
     TPM_AuthSessionData_Init(&tpm_auth_session_data);	/* freed @4 */
     /*
@@ -5309,17 +5301,17 @@ TPM_RESULT TPM_Process_LoadAuthContext(tpm_state_t *tpm_state,
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_LoadAuthContext: Decrypting TPM_CONTEXT_SENSITIVE stream\n");
 	returnCode =
-	    TPM_SymmetricKeyData_Decrypt(&contextSensitiveBuffer,	 /* decrypted data */
-					 &contextSensitiveBuffer_length, /* length decrypted data */
-					 authContextBlob.sensitiveData.buffer, /* encrypted */
-					 authContextBlob.sensitiveData.size,
-					 tpm_state->tpm_permanent_data.contextKey);
+	    TPM_SymmetricKeyData_DecryptBuffer(authContextBlob.sensitiveData.buffer, /* decrypted */
+					       &(authContextBlob.sensitiveData.size),
+					       authContextBlob.sensitiveData.buffer, /* encrypted */
+					       authContextBlob.sensitiveData.size,
+					       tpm_state->tpm_permanent_data.contextKey);
     }
     /* deserialize TPM_CONTEXT_SENSITIVE */
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_LoadAuthContext: Creating TPM_CONTEXT_SENSITIVE\n");
-	stream = contextSensitiveBuffer;
-	stream_size = contextSensitiveBuffer_length;
+	stream = authContextBlob.sensitiveData.buffer;
+	stream_size = authContextBlob.sensitiveData.size;
 	returnCode = TPM_ContextSensitive_Load(&contextSensitive,
 					       &stream,
 					       &stream_size);
@@ -5421,8 +5413,7 @@ TPM_RESULT TPM_Process_LoadAuthContext(tpm_state_t *tpm_state,
 	/* b. Set B1 -> integrityDigest to NULL */
 	/* NOTE Done by TPM_HMAC_CheckStructure() */
 	/* c. Copy M1 to B1 -> sensitiveData (integrityDigest HMAC uses cleartext) */
-	returnCode = TPM_SizedBuffer_Set(&(authContextBlob.sensitiveData),
-					 contextSensitiveBuffer_length, contextSensitiveBuffer);
+	/* NOTE Done by the in place decrypt */
 	/* verify the integrityDigest HMAC of TPM_CONTEXT_BLOB using TPM_PERMANENT_DATA -> tpmProof
 	   as the HMAC key */
 	returnCode = TPM_HMAC_CheckStructure
@@ -5527,7 +5518,6 @@ TPM_RESULT TPM_Process_LoadAuthContext(tpm_state_t *tpm_state,
       cleanup
     */
     TPM_ContextBlob_Delete(&authContextBlob);		/* @1 */
-    free(contextSensitiveBuffer);			/* @2 */
     TPM_ContextSensitive_Delete(&contextSensitive);	/* @3 */
     TPM_AuthSessionData_Delete(&tpm_auth_session_data); /* @4 */
     /* if there was a failure, roll back */
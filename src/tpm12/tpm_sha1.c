@@ -0,0 +1,1131 @@
+/********************************************************************************/
+/*										*/
+/*				SHA-1 Engine					*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+/* The SHA-1 engine implements the TPM_SHA1*Cmd and TPM_Sha1Context_* functions for all crypto
+   libraries.  Only the serialization of a SHA-1 thread, TPM_Sha1Context_Load() and
+   TPM_Sha1Context_Store(), remains in the crypto library specific files, since the stream format
+   of each library is kept.
+
+   The compression function has several implementations.  TPM_SHA1Engine_Init(), called from
+   TPM_Crypto_Init(), checks the CPU once and selects the fastest one:
+
+	SHA-NI		x86 SHA extensions, one block at a time
+	AVX2		message schedule of two blocks in parallel, scalar rounds
+	portable	C
+
+   TPM_Sha1Context_FinalCounters() finishes many independent blocks from one chaining value, the
+   MGF1 counter blocks.  It has its own lane implementations, selected the same way:
+
+	AVX2		eight blocks, one per vector element
+	SHA-NI		one block at a time
+	portable	four blocks in a GCC generic vector
+
+   Until TPM_SHA1Engine_Init() runs, the portable implementations are used.  Other vector code,
+   e.g. TPM_XOR(), uses the CPU features it found through TPM_SHA1Engine_CpuFeatures(), so the
+   library checks the CPU in one place.  Define TPM_SHA1_PORTABLE to build only the portable
+   implementation, e.g. for a compiler without the x86 target attributes.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    !defined(TPM_SHA1_PORTABLE)
+#define TPM_SHA1_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include "tpm_crypto.h"
+#include "tpm_debug.h"
+#include "tpm_error.h"
+#include "tpm_memory.h"
+
+#include "tpm_sha1.h"
+
+/* TPM_SHA1_BLOCK_FUNCTION compresses 'blocks' 64 byte blocks of 'data' into the chaining value 'h'
+ */
+
+typedef void (*TPM_SHA1_BLOCK_FUNCTION)(uint32_t h[5],
+					const unsigned char *data,
+					size_t blocks);
+
+/* TPM_SHA1_LANES_FUNCTION compresses 'n' independent 64 byte 'blocks', each starting from the
+   chaining value 'h', and stores each resulting chaining value as a 20 byte digest in 'md'.
+ */
+
+typedef void (*TPM_SHA1_LANES_FUNCTION)(unsigned char *md,
+					const uint32_t h[5],
+					const unsigned char *blocks,
+					size_t n);
+
+typedef struct tdTPM_SHA1_ENGINE {
+    const char			*name;
+    TPM_SHA1_BLOCK_FUNCTION	block;
+    uint32_t			features;	/* required TPM_SHA1_CPU_ features */
+} TPM_SHA1_ENGINE;
+
+typedef struct tdTPM_SHA1_LANE_ENGINE {
+    const char			*name;
+    TPM_SHA1_LANES_FUNCTION	lanes;
+    uint32_t			features;	/* required TPM_SHA1_CPU_ features */
+} TPM_SHA1_LANE_ENGINE;
+
+static void TPM_SHA1_BlockPortable(uint32_t h[5],
+				   const unsigned char *data,
+				   size_t blocks);
+static void TPM_SHA1_LanesPortable(unsigned char *md,
+				   const uint32_t h[5],
+				   const unsigned char *blocks,
+				   size_t n);
+#ifdef TPM_SHA1_X86
+static void TPM_SHA1_BlockSHANI(uint32_t h[5],
+				const unsigned char *data,
+				size_t blocks);
+static void TPM_SHA1_LanesSHANI(unsigned char *md,
+				const uint32_t h[5],
+				const unsigned char *blocks,
+				size_t n);
+static void TPM_SHA1_BlockAVX2(uint32_t h[5],
+			       const unsigned char *data,
+			       size_t blocks);
+static void TPM_SHA1_LanesAVX2(unsigned char *md,
+			       const uint32_t h[5],
+			       const unsigned char *blocks,
+			       size_t n);
+#endif
+
+/* implementations, in order of preference.  The portable implementation must be last. */
+
+static const TPM_SHA1_ENGINE tpm_sha1_engines[] = {
+#ifdef TPM_SHA1_X86
+    {"SHA-NI",	 TPM_SHA1_BlockSHANI,	 TPM_SHA1_CPU_SHANI},
+    {"AVX2",	 TPM_SHA1_BlockAVX2,	 TPM_SHA1_CPU_AVX2},
+#endif
+    {"portable", TPM_SHA1_BlockPortable, 0}
+};
+
+#define TPM_SHA1_ENGINES	(sizeof(tpm_sha1_engines) / sizeof(tpm_sha1_engines[0]))
+
+/* lane implementations, in order of preference.  They are selected separately, since eight vector
+   lanes outrun the SHA extensions on independent blocks.  The portable implementation must be
+   last. */
+
+static const TPM_SHA1_LANE_ENGINE tpm_sha1_lanes[] = {
+#ifdef TPM_SHA1_X86
+    {"AVX2",	 TPM_SHA1_LanesAVX2,	 TPM_SHA1_CPU_AVX2},
+    {"SHA-NI",	 TPM_SHA1_LanesSHANI,	 TPM_SHA1_CPU_SHANI},
+#endif
+    {"portable", TPM_SHA1_LanesPortable, 0}
+};
+
+#define TPM_SHA1_LANES_ENGINES	(sizeof(tpm_sha1_lanes) / sizeof(tpm_sha1_lanes[0]))
+
+/* the selected implementations and the CPU features found by TPM_SHA1Engine_Init() */
+
+static const TPM_SHA1_ENGINE *tpm_sha1_engine = &tpm_sha1_engines[TPM_SHA1_ENGINES - 1];
+static const TPM_SHA1_LANE_ENGINE *tpm_sha1_lane = &tpm_sha1_lanes[TPM_SHA1_LANES_ENGINES - 1];
+static uint32_t tpm_sha1_cpu_features = 0;
+
+static const uint32_t tpm_sha1_k[4] = {0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6};
+
+#define TPM_SHA1_ROL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+#define TPM_SHA1_LOAD32(p)	(((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | \
+				 ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+#define TPM_SHA1_STORE32(p, v)	do {				\
+	(p)[0] = (unsigned char)((v) >> 24);			\
+	(p)[1] = (unsigned char)((v) >> 16);			\
+	(p)[2] = (unsigned char)((v) >> 8);			\
+	(p)[3] = (unsigned char)(v);				\
+    } while (0)
+
+/*
+  Rounds
+*/
+
+#define TPM_SHA1_F1(b, c, d)	((d) ^ ((b) & ((c) ^ (d))))
+#define TPM_SHA1_F2(b, c, d)	((b) ^ (c) ^ (d))
+#define TPM_SHA1_F3(b, c, d)	(((b) & (c)) | ((d) & ((b) | (c))))
+
+/* one round, the caller rotates the variable names instead of moving the values.  'a' is the
+   result of the previous round, so it is added last to keep it off the other additions. */
+
+#define TPM_SHA1_ROUND(f, a, b, c, d, e, wk)			\
+    (e) += (wk);						\
+    (e) += f(b, c, d);						\
+    (e) += TPM_SHA1_ROL(a, 5);					\
+    (b) = TPM_SHA1_ROL(b, 30);
+
+#define TPM_SHA1_ROUNDS5(f, i)					\
+    TPM_SHA1_ROUND(f, a, b, c, d, e, wk[(i)]);			\
+    TPM_SHA1_ROUND(f, e, a, b, c, d, wk[(i) + 1]);		\
+    TPM_SHA1_ROUND(f, d, e, a, b, c, wk[(i) + 2]);		\
+    TPM_SHA1_ROUND(f, c, d, e, a, b, wk[(i) + 3]);		\
+    TPM_SHA1_ROUND(f, b, c, d, e, a, wk[(i) + 4]);
+
+/* TPM_SHA1_Rounds() runs the 80 rounds of one block on the chaining value 'h'.
+
+   'wk' is the message schedule with the round constants already added.
+*/
+
+static void TPM_SHA1_Rounds(uint32_t h[5], const uint32_t wk[80])
+{
+    uint32_t	a = h[0];
+    uint32_t	b = h[1];
+    uint32_t	c = h[2];
+    uint32_t	d = h[3];
+    uint32_t	e = h[4];
+    size_t	i;
+
+    for (i = 0 ; i < 20 ; i += 5) {
+	TPM_SHA1_ROUNDS5(TPM_SHA1_F1, i);
+    }
+    for ( ; i < 40 ; i += 5) {
+	TPM_SHA1_ROUNDS5(TPM_SHA1_F2, i);
+    }
+    for ( ; i < 60 ; i += 5) {
+	TPM_SHA1_ROUNDS5(TPM_SHA1_F3, i);
+    }
+    for ( ; i < 80 ; i += 5) {
+	TPM_SHA1_ROUNDS5(TPM_SHA1_F2, i);
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    return;
+}
+
+/*
+  Block functions
+*/
+
+/* TPM_SHA1_BlockPortable() is the C implementation, used when the CPU has no faster one.
+
+   The message schedule is kept in a 16 word circular buffer and computed as the rounds need it.
+*/
+
+#define TPM_SHA1_W(i)						\
+    (w[(i) & 15] = TPM_SHA1_ROL(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^	\
+				w[((i) + 2) & 15] ^ w[(i) & 15], 1))
+
+#define TPM_SHA1_ROUNDS5W(f, k, i)				\
+    TPM_SHA1_ROUND(f, a, b, c, d, e, (k) + TPM_SHA1_W(i));	\
+    TPM_SHA1_ROUND(f, e, a, b, c, d, (k) + TPM_SHA1_W((i) + 1));	\
+    TPM_SHA1_ROUND(f, d, e, a, b, c, (k) + TPM_SHA1_W((i) + 2));	\
+    TPM_SHA1_ROUND(f, c, d, e, a, b, (k) + TPM_SHA1_W((i) + 3));	\
+    TPM_SHA1_ROUND(f, b, c, d, e, a, (k) + TPM_SHA1_W((i) + 4));
+
+static void TPM_SHA1_BlockPortable(uint32_t h[5],
+				   const unsigned char *data,
+				   size_t blocks)
+{
+    uint32_t	w[16];
+    uint32_t	a, b, c, d, e;
+    size_t	i;
+
+    for ( ; blocks > 0 ; blocks--, data += 64) {
+	a = h[0];
+	b = h[1];
+	c = h[2];
+	d = h[3];
+	e = h[4];
+	for (i = 0 ; i < 15 ; i += 5) {
+	    w[i] = TPM_SHA1_LOAD32(data + (4 * i));
+	    w[i + 1] = TPM_SHA1_LOAD32(data + (4 * i) + 4);
+	    w[i + 2] = TPM_SHA1_LOAD32(data + (4 * i) + 8);
+	    w[i + 3] = TPM_SHA1_LOAD32(data + (4 * i) + 12);
+	    w[i + 4] = TPM_SHA1_LOAD32(data + (4 * i) + 16);
+	    TPM_SHA1_ROUND(TPM_SHA1_F1, a, b, c, d, e, 0x5a827999 + w[i]);
+	    TPM_SHA1_ROUND(TPM_SHA1_F1, e, a, b, c, d, 0x5a827999 + w[i + 1]);
+	    TPM_SHA1_ROUND(TPM_SHA1_F1, d, e, a, b, c, 0x5a827999 + w[i + 2]);
+	    TPM_SHA1_ROUND(TPM_SHA1_F1, c, d, e, a, b, 0x5a827999 + w[i + 3]);
+	    TPM_SHA1_ROUND(TPM_SHA1_F1, b, c, d, e, a, 0x5a827999 + w[i + 4]);
+	}
+	/* round 15 is the last one with a message word, 16-19 use the schedule */
+	w[15] = TPM_SHA1_LOAD32(data + 60);
+	TPM_SHA1_ROUND(TPM_SHA1_F1, a, b, c, d, e, 0x5a827999 + w[15]);
+	TPM_SHA1_ROUND(TPM_SHA1_F1, e, a, b, c, d, 0x5a827999 + TPM_SHA1_W(16));
+	TPM_SHA1_ROUND(TPM_SHA1_F1, d, e, a, b, c, 0x5a827999 + TPM_SHA1_W(17));
+	TPM_SHA1_ROUND(TPM_SHA1_F1, c, d, e, a, b, 0x5a827999 + TPM_SHA1_W(18));
+	TPM_SHA1_ROUND(TPM_SHA1_F1, b, c, d, e, a, 0x5a827999 + TPM_SHA1_W(19));
+	for (i = 20 ; i < 40 ; i += 5) {
+	    TPM_SHA1_ROUNDS5W(TPM_SHA1_F2, 0x6ed9eba1, i);
+	}
+	for ( ; i < 60 ; i += 5) {
+	    TPM_SHA1_ROUNDS5W(TPM_SHA1_F3, 0x8f1bbcdc, i);
+	}
+	for ( ; i < 80 ; i += 5) {
+	    TPM_SHA1_ROUNDS5W(TPM_SHA1_F2, 0xca62c1d6, i);
+	}
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+    }
+    return;
+}
+
+/* TPM_SHA1_LanesPortable() compresses the independent blocks four at a time, one block in each
+   element of a GCC generic vector.  The compiler maps the vector to the CPU's 128 bit registers
+   where there are any.  A short last group repeats its last block.
+
+   Without the GCC vector extension, the blocks are compressed one at a time.
+*/
+
+#ifdef __GNUC__
+
+#define TPM_SHA1_PORTABLE_LANES	4
+
+typedef uint32_t TPM_SHA1_V4 __attribute__((vector_size(16)));
+
+#define TPM_SHA1_V4_ROL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+#define TPM_SHA1_LANE_ROUND(f, k, i)					\
+    t = TPM_SHA1_V4_ROL(a, 5) + f(b, c, d) + e + (k) + w[(i) & 15];	\
+    e = d;								\
+    d = c;								\
+    c = TPM_SHA1_V4_ROL(b, 30);						\
+    b = a;								\
+    a = t;
+
+#define TPM_SHA1_LANE_W(i)						\
+    t = w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^ w[((i) + 2) & 15] ^ w[(i) & 15];	\
+    w[(i) & 15] = TPM_SHA1_V4_ROL(t, 1);
+
+static void TPM_SHA1_LanesPortable(unsigned char *md,
+				   const uint32_t h[5],
+				   const unsigned char *blocks,
+				   size_t n)
+{
+    TPM_SHA1_V4		w[16];
+    TPM_SHA1_V4		a, b, c, d, e, t;
+    const unsigned char	*block;
+    size_t		lanes;
+    size_t		i;
+    size_t		l;
+
+    for ( ; n > 0 ; n -= lanes, blocks += 64 * lanes, md += TPM_DIGEST_SIZE * lanes) {
+	lanes = (n < TPM_SHA1_PORTABLE_LANES) ? n : TPM_SHA1_PORTABLE_LANES;
+	for (l = 0 ; l < TPM_SHA1_PORTABLE_LANES ; l++) {
+	    block = blocks + (64 * ((l < lanes) ? l : (lanes - 1)));
+	    for (i = 0 ; i < 16 ; i++) {
+		w[i][l] = TPM_SHA1_LOAD32(block + (4 * i));
+	    }
+	}
+	a = (TPM_SHA1_V4){h[0], h[0], h[0], h[0]};
+	b = (TPM_SHA1_V4){h[1], h[1], h[1], h[1]};
+	c = (TPM_SHA1_V4){h[2], h[2], h[2], h[2]};
+	d = (TPM_SHA1_V4){h[3], h[3], h[3], h[3]};
+	e = (TPM_SHA1_V4){h[4], h[4], h[4], h[4]};
+	for (i = 0 ; i < 16 ; i++) {
+	    TPM_SHA1_LANE_ROUND(TPM_SHA1_F1, 0x5a827999, i);
+	}
+	for ( ; i < 20 ; i++) {
+	    TPM_SHA1_LANE_W(i);
+	    TPM_SHA1_LANE_ROUND(TPM_SHA1_F1, 0x5a827999, i);
+	}
+	for ( ; i < 40 ; i++) {
+	    TPM_SHA1_LANE_W(i);
+	    TPM_SHA1_LANE_ROUND(TPM_SHA1_F2, 0x6ed9eba1, i);
+	}
+	for ( ; i < 60 ; i++) {
+	    TPM_SHA1_LANE_W(i);
+	    TPM_SHA1_LANE_ROUND(TPM_SHA1_F3, 0x8f1bbcdc, i);
+	}
+	for ( ; i < 80 ; i++) {
+	    TPM_SHA1_LANE_W(i);
+	    TPM_SHA1_LANE_ROUND(TPM_SHA1_F2, 0xca62c1d6, i);
+	}
+	for (l = 0 ; l < lanes ; l++) {
+	    TPM_SHA1_STORE32(md + (TPM_DIGEST_SIZE * l), h[0] + a[l]);
+	    TPM_SHA1_STORE32(md + (TPM_DIGEST_SIZE * l) + 4, h[1] + b[l]);
+	    TPM_SHA1_STORE32(md + (TPM_DIGEST_SIZE * l) + 8, h[2] + c[l]);
+	    TPM_SHA1_STORE32(md + (TPM_DIGEST_SIZE * l) + 12, h[3] + d[l]);
+	    TPM_SHA1_STORE32(md + (TPM_DIGEST_SIZE * l) + 16, h[4] + e[l]);
+	}
+    }
+    return;
+}
+
+#else
+
+static void TPM_SHA1_LanesPortable(unsigned char *md,
+				   const uint32_t h[5],
+				   const unsigned char *blocks,
+				   size_t n)
+{
+    uint32_t	hl[5];
+    size_t	i;
+
+    for ( ; n > 0 ; n--, blocks += 64, md += TPM_DIGEST_SIZE) {
+	memcpy(hl, h, sizeof(hl));
+	TPM_SHA1_BlockPortable(hl, blocks, 1);
+	for (i = 0 ; i < 5 ; i++) {
+	    TPM_SHA1_STORE32(md + (4 * i), hl[i]);
+	}
+    }
+    return;
+}
+
+#endif
+
+#ifdef TPM_SHA1_X86
+
+/* TPM_SHA1_BlockSHANI() uses the SHA extensions.  The four round groups are sha1rnds4
+   instructions, and the message schedule is sha1msg1/sha1msg2.
+
+   ABCD holds a..d with 'a' in the high word.  E0 and E1 alternate as the 'e' input of the next
+   group.  MSG0..MSG3 hold the schedule words of four consecutive groups.
+*/
+
+/* round group 'i', 3 <= i <= 19.  mc is the message of this group, mn, mx, mp the messages of the
+   groups i+1, i+2 and i+3 (mod 4) */
+
+#define TPM_SHA1_SHANI_GROUP(func, en, eo, mc, mn, mx, mp)	\
+    en = _mm_sha1nexte_epu32(en, mc);				\
+    eo = abcd;							\
+    mn = _mm_sha1msg2_epu32(mn, mc);				\
+    abcd = _mm_sha1rnds4_epu32(abcd, en, func);			\
+    mp = _mm_sha1msg1_epu32(mp, mc);				\
+    mx = _mm_xor_si128(mx, mc);
+
+__attribute__((target("sha,sse4.1")))
+static void TPM_SHA1_BlockSHANI(uint32_t h[5],
+				const unsigned char *data,
+				size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i	abcd;
+    __m128i	abcd_save;
+    __m128i	e0;
+    __m128i	e0_save;
+    __m128i	e1;
+    __m128i	msg0;
+    __m128i	msg1;
+    __m128i	msg2;
+    __m128i	msg3;
+
+    abcd = _mm_loadu_si128((const __m128i *)h);
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    e0 = _mm_set_epi32(h[4], 0, 0, 0);
+    for ( ; blocks > 0 ; blocks--, data += 64) {
+	abcd_save = abcd;
+	e0_save = e0;
+	/* rounds 0-3 */
+	msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+	e0 = _mm_add_epi32(e0, msg0);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+	/* rounds 4-7 */
+	msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+	e1 = _mm_sha1nexte_epu32(e1, msg1);
+	e0 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+	msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+	/* rounds 8-11 */
+	msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+	e0 = _mm_sha1nexte_epu32(e0, msg2);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+	msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+	msg0 = _mm_xor_si128(msg0, msg2);
+	/* rounds 12-79 */
+	msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+	TPM_SHA1_SHANI_GROUP(0, e1, e0, msg3, msg0, msg1, msg2);
+	TPM_SHA1_SHANI_GROUP(0, e0, e1, msg0, msg1, msg2, msg3);
+	TPM_SHA1_SHANI_GROUP(1, e1, e0, msg1, msg2, msg3, msg0);
+	TPM_SHA1_SHANI_GROUP(1, e0, e1, msg2, msg3, msg0, msg1);
+	TPM_SHA1_SHANI_GROUP(1, e1, e0, msg3, msg0, msg1, msg2);
+	TPM_SHA1_SHANI_GROUP(1, e0, e1, msg0, msg1, msg2, msg3);
+	TPM_SHA1_SHANI_GROUP(1, e1, e0, msg1, msg2, msg3, msg0);
+	TPM_SHA1_SHANI_GROUP(2, e0, e1, msg2, msg3, msg0, msg1);
+	TPM_SHA1_SHANI_GROUP(2, e1, e0, msg3, msg0, msg1, msg2);
+	TPM_SHA1_SHANI_GROUP(2, e0, e1, msg0, msg1, msg2, msg3);
+	TPM_SHA1_SHANI_GROUP(2, e1, e0, msg1, msg2, msg3, msg0);
+	TPM_SHA1_SHANI_GROUP(2, e0, e1, msg2, msg3, msg0, msg1);
+	TPM_SHA1_SHANI_GROUP(3, e1, e0, msg3, msg0, msg1, msg2);
+	TPM_SHA1_SHANI_GROUP(3, e0, e1, msg0, msg1, msg2, msg3);
+	TPM_SHA1_SHANI_GROUP(3, e1, e0, msg1, msg2, msg3, msg0);
+	TPM_SHA1_SHANI_GROUP(3, e0, e1, msg2, msg3, msg0, msg1);
+	TPM_SHA1_SHANI_GROUP(3, e1, e0, msg3, msg0, msg1, msg2);
+	/* add the saved state */
+	e0 = _mm_sha1nexte_epu32(e0, e0_save);
+	abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    _mm_storeu_si128((__m128i *)h, abcd);
+    h[4] = _mm_extract_epi32(e0, 3);
+    return;
+}
+
+/* TPM_SHA1_LanesSHANI() compresses the independent blocks one at a time, since the SHA extensions
+   are faster than the vector lanes.
+*/
+
+static void TPM_SHA1_LanesSHANI(unsigned char *md,
+				const uint32_t h[5],
+				const unsigned char *blocks,
+				size_t n)
+{
+    uint32_t	hl[5];
+    size_t	i;
+
+    for ( ; n > 0 ; n--, blocks += 64, md += TPM_DIGEST_SIZE) {
+	memcpy(hl, h, sizeof(hl));
+	TPM_SHA1_BlockSHANI(hl, blocks, 1);
+	for (i = 0 ; i < 5 ; i++) {
+	    TPM_SHA1_STORE32(md + (4 * i), hl[i]);
+	}
+    }
+    return;
+}
+
+/* TPM_SHA1_BlockAVX2() computes the message schedule of two blocks at once, one block in each 128
+   bit lane, and then runs the scalar rounds on each block.  A remaining single block uses the
+   portable code.
+
+   Words 16-31 use the standard recurrence, fixing up the last word of each group of four, which
+   depends on the first.  Words 32-79 use the equivalent
+
+	w[i] = (w[i-6] ^ w[i-16] ^ w[i-28] ^ w[i-32]) rol 2
+
+   which has no dependency inside a group of four.
+*/
+
+#define TPM_SHA1_AVX2_ROL(x, n)	_mm256_or_si256(_mm256_slli_epi32(x, n),	\
+						_mm256_srli_epi32(x, 32 - (n)))
+
+__attribute__((target("avx2")))
+static void TPM_SHA1_BlockAVX2(uint32_t h[5],
+			       const unsigned char *data,
+			       size_t blocks)
+{
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+					   11, 10, 9, 8, 15, 14, 13, 12,
+					   3, 2, 1, 0, 7, 6, 5, 4,
+					   11, 10, 9, 8, 15, 14, 13, 12);
+    __m256i		w[20];		/* schedule, four words per lane per group */
+    __m256i		x;
+    uint32_t		wk[2][80];	/* schedule plus round constants, per block */
+    size_t		g;
+
+    for ( ; blocks > 1 ; blocks -= 2, data += 128) {
+	for (g = 0 ; g < 4 ; g++) {
+	    x = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(data + (16 * g))));
+	    x = _mm256_inserti128_si256(x, _mm_loadu_si128((const __m128i *)(data + 64 + (16 * g))), 1);
+	    w[g] = _mm256_shuffle_epi8(x, bswap);
+	}
+	for ( ; g < 8 ; g++) {
+	    x = _mm256_xor_si256(w[g-4], _mm256_alignr_epi8(w[g-3], w[g-4], 8));
+	    x = _mm256_xor_si256(x, w[g-2]);
+	    x = _mm256_xor_si256(x, _mm256_srli_si256(w[g-1], 4));
+	    x = TPM_SHA1_AVX2_ROL(x, 1);
+	    /* the last word needs w[i] of this group as its w[i-3] */
+	    w[g] = _mm256_xor_si256(x, TPM_SHA1_AVX2_ROL(_mm256_slli_si256(x, 12), 1));
+	}
+	for ( ; g < 20 ; g++) {
+	    x = _mm256_alignr_epi8(w[g-1], w[g-2], 8);
+	    x = _mm256_xor_si256(x, w[g-4]);
+	    x = _mm256_xor_si256(x, w[g-7]);
+	    x = _mm256_xor_si256(x, w[g-8]);
+	    w[g] = TPM_SHA1_AVX2_ROL(x, 2);
+	}
+	for (g = 0 ; g < 20 ; g++) {
+	    x = _mm256_add_epi32(w[g], _mm256_set1_epi32(tpm_sha1_k[g / 5]));
+	    _mm_storeu_si128((__m128i *)&wk[0][4 * g], _mm256_castsi256_si128(x));
+	    _mm_storeu_si128((__m128i *)&wk[1][4 * g], _mm256_extracti128_si256(x, 1));
+	}
+	/* the rounds are not AVX code, avoid the transition penalty */
+	_mm256_zeroupper();
+	TPM_SHA1_Rounds(h, wk[0]);
+	TPM_SHA1_Rounds(h, wk[1]);
+    }
+    /* a single block does not pay for the vector schedule */
+    if (blocks > 0) {
+	TPM_SHA1_BlockPortable(h, data, blocks);
+    }
+    return;
+}
+
+/* TPM_SHA1_LanesAVX2() compresses eight independent blocks at once, one block in each 32 bit
+   element.  A short group repeats its last block.
+*/
+
+#define TPM_SHA1_AVX2_F1(b, c, d)	_mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)))
+#define TPM_SHA1_AVX2_F2(b, c, d)	_mm256_xor_si256(_mm256_xor_si256(b, c), d)
+#define TPM_SHA1_AVX2_F3(b, c, d)	_mm256_or_si256(_mm256_and_si256(b, c),		\
+							_mm256_and_si256(d, _mm256_or_si256(b, c)))
+
+#define TPM_SHA1_AVX2_ROUND(f, k, i)					\
+    t = _mm256_add_epi32(_mm256_add_epi32(TPM_SHA1_AVX2_ROL(a, 5), f(b, c, d)),	\
+			 _mm256_add_epi32(_mm256_add_epi32(e, k), w[(i) & 15])); \
+    e = d;								\
+    d = c;								\
+    c = TPM_SHA1_AVX2_ROL(b, 30);					\
+    b = a;								\
+    a = t;
+
+#define TPM_SHA1_AVX2_W(i)						\
+    x = _mm256_xor_si256(_mm256_xor_si256(w[((i) + 13) & 15], w[((i) + 8) & 15]),	\
+			 _mm256_xor_si256(w[((i) + 2) & 15], w[(i) & 15]));	\
+    w[(i) & 15] = TPM_SHA1_AVX2_ROL(x, 1);
+
+#define TPM_SHA1_AVX2_LANES	8
+
+__attribute__((target("avx2")))
+static void TPM_SHA1_LanesAVX2(unsigned char *md,
+			       const uint32_t h[5],
+			       const unsigned char *blocks,
+			       size_t n)
+{
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+					   11, 10, 9, 8, 15, 14, 13, 12,
+					   3, 2, 1, 0, 7, 6, 5, 4,
+					   11, 10, 9, 8, 15, 14, 13, 12);
+    __m256i		w[16];
+    __m256i		a, b, c, d, e, t, x, k;
+    __m256i		offsets;	/* block of each lane, in words */
+    uint32_t		out[5][TPM_SHA1_AVX2_LANES];
+    size_t		lanes;
+    size_t		i;
+    size_t		l;
+
+    for ( ; n > 0 ; n -= lanes, blocks += 64 * lanes, md += TPM_DIGEST_SIZE * lanes) {
+	lanes = (n < TPM_SHA1_AVX2_LANES) ? n : TPM_SHA1_AVX2_LANES;
+	offsets = _mm256_min_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+				   _mm256_set1_epi32((int)lanes - 1));
+	offsets = _mm256_slli_epi32(offsets, 4);
+	for (i = 0 ; i < 16 ; i++) {
+	    x = _mm256_i32gather_epi32((const int *)(blocks + (4 * i)), offsets, 4);
+	    w[i] = _mm256_shuffle_epi8(x, bswap);
+	}
+	a = _mm256_set1_epi32(h[0]);
+	b = _mm256_set1_epi32(h[1]);
+	c = _mm256_set1_epi32(h[2]);
+	d = _mm256_set1_epi32(h[3]);
+	e = _mm256_set1_epi32(h[4]);
+	k = _mm256_set1_epi32(0x5a827999);
+	for (i = 0 ; i < 16 ; i++) {
+	    TPM_SHA1_AVX2_ROUND(TPM_SHA1_AVX2_F1, k, i);
+	}
+	for ( ; i < 20 ; i++) {
+	    TPM_SHA1_AVX2_W(i);
+	    TPM_SHA1_AVX2_ROUND(TPM_SHA1_AVX2_F1, k, i);
+	}
+	k = _mm256_set1_epi32(0x6ed9eba1);
+	for ( ; i < 40 ; i++) {
+	    TPM_SHA1_AVX2_W(i);
+	    TPM_SHA1_AVX2_ROUND(TPM_SHA1_AVX2_F2, k, i);
+	}
+	k = _mm256_set1_epi32(0x8f1bbcdc);
+	for ( ; i < 60 ; i++) {
+	    TPM_SHA1_AVX2_W(i);
+	    TPM_SHA1_AVX2_ROUND(TPM_SHA1_AVX2_F3, k, i);
+	}
+	k = _mm256_set1_epi32(0xca62c1d6);
+	for ( ; i < 80 ; i++) {
+	    TPM_SHA1_AVX2_W(i);
+	    TPM_SHA1_AVX2_ROUND(TPM_SHA1_AVX2_F2, k, i);
+	}
+	_mm256_storeu_si256((__m256i *)out[0], _mm256_add_epi32(a, _mm256_set1_epi32(h[0])));
+	_mm256_storeu_si256((__m256i *)out[1], _mm256_add_epi32(b, _mm256_set1_epi32(h[1])));
+	_mm256_storeu_si256((__m256i *)out[2], _mm256_add_epi32(c, _mm256_set1_epi32(h[2])));
+	_mm256_storeu_si256((__m256i *)out[3], _mm256_add_epi32(d, _mm256_set1_epi32(h[3])));
+	_mm256_storeu_si256((__m256i *)out[4], _mm256_add_epi32(e, _mm256_set1_epi32(h[4])));
+	for (l = 0 ; l < lanes ; l++) {
+	    for (i = 0 ; i < 5 ; i++) {
+		TPM_SHA1_STORE32(md + (TPM_DIGEST_SIZE * l) + (4 * i), out[i][l]);
+	    }
+	}
+    }
+    _mm256_zeroupper();
+    return;
+}
+
+/* TPM_SHA1_CpuFeatures() returns the TPM_SHA1_CPU_ flags supported by the CPU and the OS
+ */
+
+static uint32_t TPM_SHA1_CpuFeatures(void)
+{
+    uint32_t		features = 0;
+    unsigned int	eax, ebx, ecx, edx;
+    unsigned int	xcr0_lo, xcr0_hi;
+    TPM_BOOL		sse = FALSE;	/* SSSE3 and SSE4.1 */
+    TPM_BOOL		ymm = FALSE;	/* OS saves the YMM registers */
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+	sse = ((ecx & bit_SSSE3) != 0) && ((ecx & bit_SSE4_1) != 0);
+	if (((ecx & bit_OSXSAVE) != 0) && ((ecx & bit_AVX) != 0)) {
+	    __asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+	    ymm = ((xcr0_lo & 0x6) == 0x6);	/* XMM and YMM state */
+	}
+    }
+    if (__get_cpuid_max(0, NULL) >= 7) {
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	if (sse && ((ebx & bit_SHA) != 0)) {
+	    features |= TPM_SHA1_CPU_SHANI;
+	}
+	if (ymm && ((ebx & bit_AVX2) != 0)) {
+	    features |= TPM_SHA1_CPU_AVX2;
+	}
+    }
+    return features;
+}
+
+#endif	/* TPM_SHA1_X86 */
+
+/*
+  Engine selection and self test
+*/
+
+/* TPM_SHA1Engine_Init() selects the fastest SHA-1 implementation supported by the CPU
+ */
+
+void TPM_SHA1Engine_Init(void)
+{
+    size_t	i;
+
+#ifdef TPM_SHA1_X86
+    tpm_sha1_cpu_features = TPM_SHA1_CpuFeatures();
+#endif
+    for (i = 0 ; i < TPM_SHA1_ENGINES ; i++) {
+	if ((tpm_sha1_engines[i].features & tpm_sha1_cpu_features) ==
+	    tpm_sha1_engines[i].features) {
+	    tpm_sha1_engine = &tpm_sha1_engines[i];
+	    break;
+	}
+    }
+    for (i = 0 ; i < TPM_SHA1_LANES_ENGINES ; i++) {
+	if ((tpm_sha1_lanes[i].features & tpm_sha1_cpu_features) ==
+	    tpm_sha1_lanes[i].features) {
+	    tpm_sha1_lane = &tpm_sha1_lanes[i];
+	    break;
+	}
+    }
+    printf(" TPM_SHA1Engine_Init: Using %s SHA-1, %s lanes\n",
+	   tpm_sha1_engine->name, tpm_sha1_lane->name);
+    return;
+}
+
+/* TPM_SHA1Engine_CpuFeatures() returns the TPM_SHA1_CPU_ flags found by TPM_SHA1Engine_Init(), 0
+   before it runs
+*/
+
+uint32_t TPM_SHA1Engine_CpuFeatures(void)
+{
+    return tpm_sha1_cpu_features;
+}
+
+/*
+  Context
+*/
+
+static void TPM_SHA1_Init(TPM_SHA1_CONTEXT *context)
+{
+    memset(context, 0, sizeof(TPM_SHA1_CONTEXT));
+    context->h[0] = 0x67452301;
+    context->h[1] = 0xefcdab89;
+    context->h[2] = 0x98badcfe;
+    context->h[3] = 0x10325476;
+    context->h[4] = 0xc3d2e1f0;
+    return;
+}
+
+static void TPM_SHA1_Update(TPM_SHA1_CONTEXT *context,
+			    const unsigned char *data,
+			    uint32_t length,
+			    TPM_SHA1_BLOCK_FUNCTION block)
+{
+    unsigned char	*buffer = (unsigned char *)context->data;
+    uint32_t		bits;
+    uint32_t		fill;
+    uint32_t		blocks;
+
+    /* nothing to hash, 'data' may be NULL */
+    if (length == 0) {
+	return;
+    }
+    /* message length in bits */
+    bits = context->Nl + (length << 3);
+    if (bits < context->Nl) {
+	context->Nh++;
+    }
+    context->Nh += length >> 29;
+    context->Nl = bits;
+    /* complete a partial block */
+    if (context->num != 0) {
+	fill = 64 - context->num;
+	if (length < fill) {
+	    memcpy(buffer + context->num, data, length);
+	    context->num += length;
+	    return;
+	}
+	memcpy(buffer + context->num, data, fill);
+	block(context->h, buffer, 1);
+	data += fill;
+	length -= fill;
+	context->num = 0;
+    }
+    /* whole blocks directly from the input */
+    blocks = length / 64;
+    if (blocks > 0) {
+	block(context->h, data, blocks);
+	data += blocks * 64;
+	length -= blocks * 64;
+    }
+    /* keep the rest */
+    if (length > 0) {
+	memcpy(buffer, data, length);
+	context->num = length;
+    }
+    return;
+}
+
+static void TPM_SHA1_Final(unsigned char *md,
+			   TPM_SHA1_CONTEXT *context,
+			   TPM_SHA1_BLOCK_FUNCTION block)
+{
+    unsigned char	*buffer = (unsigned char *)context->data;
+    uint32_t		num = context->num;
+    size_t		i;
+
+    buffer[num++] = 0x80;
+    if (num > 56) {
+	memset(buffer + num, 0, 64 - num);
+	block(context->h, buffer, 1);
+	num = 0;
+    }
+    memset(buffer + num, 0, 56 - num);
+    TPM_SHA1_STORE32(buffer + 56, context->Nh);
+    TPM_SHA1_STORE32(buffer + 60, context->Nl);
+    block(context->h, buffer, 1);
+    for (i = 0 ; i < 5 ; i++) {
+	TPM_SHA1_STORE32(md + (4 * i), context->h[i]);
+    }
+    context->num = 0;
+    return;
+}
+
+/* TPM_SHA1Engine_Test() runs known answer tests on each SHA-1 implementation supported by the CPU,
+   not just the selected one.
+
+   The test data is split so that the partial block and multiple block paths are exercised.
+*/
+
+TPM_RESULT TPM_SHA1Engine_Test(void)
+{
+    TPM_RESULT		rc = 0;
+    size_t		i;
+    size_t		j;
+    int			not_equal;
+    TPM_SHA1_CONTEXT	context;
+    TPM_DIGEST		actual;
+    const TPM_SHA1_ENGINE *engine;
+    /* FIPS 180 */
+    unsigned char buffer1[] = "abc";
+    unsigned char expect1[] = {0xa9,0x99,0x3e,0x36,0x47,0x06,0x81,0x6a,0xba,0x3e,
+			       0x25,0x71,0x78,0x50,0xc2,0x6c,0x9c,0xd0,0xd8,0x9d};
+    unsigned char buffer2[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    unsigned char expect2[] = {0x84,0x98,0x3e,0x44,0x1c,0x3b,0xd2,0x6e,0xba,0xae,
+			       0x4a,0xa1,0xf9,0x51,0x29,0xe5,0xe5,0x46,0x70,0xf1};
+    /* 1000 bytes of (i * 31 + 7), hashed in parts */
+    unsigned char buffer3[1000];
+    unsigned char expect3[] = {0x41,0x44,0x75,0x34,0x10,0x17,0xec,0x91,0x70,0x34,
+			       0x35,0xa6,0xf2,0x90,0x32,0x48,0x18,0xf9,0x83,0xe9};
+    uint32_t	parts3[] = {1, 62, 64, 129, 744};
+    uint32_t	offset;
+    /* lanes, compared to the portable block function */
+    const TPM_SHA1_LANE_ENGINE *lane;
+    unsigned char	lanes_actual[(TPM_SHA1_LANES + 1) * TPM_DIGEST_SIZE];
+    uint32_t		h[5];
+
+    printf(" TPM_SHA1Engine_Test:\n");
+    for (i = 0 ; i < sizeof(buffer3) ; i++) {
+	buffer3[i] = (unsigned char)((i * 31) + 7);
+    }
+    for (i = 0 ; (rc == 0) && (i < TPM_SHA1_ENGINES) ; i++) {
+	engine = &tpm_sha1_engines[i];
+	if ((engine->features & tpm_sha1_cpu_features) != engine->features) {
+	    continue;
+	}
+	printf("  TPM_SHA1Engine_Test: Testing %s SHA-1\n", engine->name);
+	/* Test 1 - one block */
+	if (rc == 0) {
+	    TPM_SHA1_Init(&context);
+	    TPM_SHA1_Update(&context, buffer1, sizeof(buffer1) - 1, engine->block);
+	    TPM_SHA1_Final(actual, &context, engine->block);
+	    not_equal = memcmp(expect1, actual, TPM_DIGEST_SIZE);
+	    if (not_equal) {
+		printf("TPM_SHA1Engine_Test: Error in test 1, %s\n", engine->name);
+		TPM_PrintFour("\texpect", expect1);
+		TPM_PrintFour("\tactual", actual);
+		rc = TPM_FAILEDSELFTEST;
+	    }
+	}
+	/* Test 2 - two parts, padding in a second block */
+	if (rc == 0) {
+	    TPM_SHA1_Init(&context);
+	    TPM_SHA1_Update(&context, buffer2, 16, engine->block);
+	    TPM_SHA1_Update(&context, buffer2 + 16, sizeof(buffer2) - 17, engine->block);
+	    TPM_SHA1_Final(actual, &context, engine->block);
+	    not_equal = memcmp(expect2, actual, TPM_DIGEST_SIZE);
+	    if (not_equal) {
+		printf("TPM_SHA1Engine_Test: Error in test 2, %s\n", engine->name);
+		TPM_PrintFour("\texpect", expect2);
+		TPM_PrintFour("\tactual", actual);
+		rc = TPM_FAILEDSELFTEST;
+	    }
+	}
+	/* Test 3 - multiple blocks, odd and even block counts */
+	if (rc == 0) {
+	    TPM_SHA1_Init(&context);
+	    for (j = 0, offset = 0 ; j < sizeof(parts3) / sizeof(parts3[0]) ; j++) {
+		TPM_SHA1_Update(&context, buffer3 + offset, parts3[j], engine->block);
+		offset += parts3[j];
+	    }
+	    TPM_SHA1_Final(actual, &context, engine->block);
+	    not_equal = memcmp(expect3, actual, TPM_DIGEST_SIZE);
+	    if (not_equal) {
+		printf("TPM_SHA1Engine_Test: Error in test 3, %s\n", engine->name);
+		TPM_PrintFour("\texpect", expect3);
+		TPM_PrintFour("\tactual", actual);
+		rc = TPM_FAILEDSELFTEST;
+	    }
+	}
+    }
+    /* Test 4 - lanes, one more block than the widest, so that a short group is exercised */
+    TPM_SHA1_Init(&context);
+    for (i = 0 ; (rc == 0) && (i < TPM_SHA1_LANES_ENGINES) ; i++) {
+	lane = &tpm_sha1_lanes[i];
+	if ((lane->features & tpm_sha1_cpu_features) != lane->features) {
+	    continue;
+	}
+	printf("  TPM_SHA1Engine_Test: Testing %s lanes\n", lane->name);
+	lane->lanes(lanes_actual, context.h, buffer3, TPM_SHA1_LANES + 1);
+	for (j = 0 ; (rc == 0) && (j < TPM_SHA1_LANES + 1) ; j++) {
+	    memcpy(h, context.h, sizeof(h));
+	    TPM_SHA1_BlockPortable(h, buffer3 + (64 * j), 1);
+	    for (offset = 0 ; offset < 5 ; offset++) {
+		TPM_SHA1_STORE32(actual + (4 * offset), h[offset]);
+	    }
+	    not_equal = memcmp(actual, lanes_actual + (TPM_DIGEST_SIZE * j), TPM_DIGEST_SIZE);
+	    if (not_equal) {
+		printf("TPM_SHA1Engine_Test: Error in test 4, %s lane %lu\n",
+		       lane->name, (unsigned long)j);
+		TPM_PrintFour("\texpect", actual);
+		TPM_PrintFour("\tactual", lanes_actual + (TPM_DIGEST_SIZE * j));
+		rc = TPM_FAILEDSELFTEST;
+	    }
+	}
+    }
+    memset(&context, 0, sizeof(TPM_SHA1_CONTEXT));
+    return rc;
+}
+
+/*
+  SHA-1 threads
+*/
+
+/* TPM_SHA1InitCmd() allocates and initializes a SHA-1 context.
+
+   The structure must be freed using TPM_SHA1Delete()
+
+   This allocated form is for the long lived SHA-1 threads in tpm_state_t.  One-shot hashes use the
+   caller owned TPM_SHA1_CONTEXT and TPM_Sha1Context_Init().
+*/
+
+TPM_RESULT TPM_SHA1InitCmd(void **context)
+{
+    TPM_RESULT  rc = 0;
+
+    printf(" TPM_SHA1InitCmd:\n");
+    if (rc== 0) {
+        rc = TPM_Malloc((unsigned char **)context, sizeof(TPM_SHA1_CONTEXT));
+    }
+    if (rc== 0) {
+        TPM_SHA1_Init(*context);
+    }
+    return rc;
+}
+
+/* TPM_SHA1UpdateCmd() adds 'data' of 'length' to the SHA-1 context
+ */
+
+TPM_RESULT TPM_SHA1UpdateCmd(void *context, const unsigned char *data, uint32_t length)
+{
+    TPM_RESULT  rc = 0;
+
+    printf(" TPM_SHA1Update: length %u\n", length);
+    if (context != NULL) {
+        TPM_SHA1_Update(context, data, length, tpm_sha1_engine->block);
+    }
+    else {
+        printf("TPM_SHA1Update: Error, no existing SHA1 thread\n");
+        rc = TPM_SHA_THREAD;
+    }
+    return rc;
+}
+
+/* TPM_SHA1FinalCmd() extracts the SHA-1 digest 'md' from the context
+ */
+
+TPM_RESULT TPM_SHA1FinalCmd(unsigned char *md, void *context)
+{
+    TPM_RESULT  rc = 0;
+
+    printf(" TPM_SHA1FinalCmd:\n");
+    if (context != NULL) {
+        TPM_SHA1_Final(md, context, tpm_sha1_engine->block);
+    }
+    else {
+        printf("TPM_SHA1FinalCmd: Error, no existing SHA1 thread\n");
+        rc = TPM_SHA_THREAD;
+    }
+    return rc;
+}
+
+/* TPM_SHA1Delete() zeros and frees the SHA1 context */
+
+void TPM_SHA1Delete(void **context)
+{
+    if (*context != NULL) {
+        printf(" TPM_SHA1Delete:\n");
+	/* zero because the SHA1 context might have data left from an HMAC */
+        memset(*context, 0, sizeof(TPM_SHA1_CONTEXT));
+        free(*context);
+        *context = NULL;
+    }
+    return;
+}
+
+/*
+  Caller owned contexts
+*/
+
+/* TPM_Sha1Context_Init() initializes a caller owned SHA-1 context.  Nothing is allocated, so there
+   is no matching delete.  TPM_Sha1Context_Final() zeros the context.
+*/
+
+TPM_RESULT TPM_Sha1Context_Init(TPM_SHA1_CONTEXT *context)
+{
+    TPM_SHA1_Init(context);
+    return 0;
+}
+
+/* TPM_Sha1Context_Update() adds 'data' of 'length' to the caller owned SHA-1 context
+ */
+
+TPM_RESULT TPM_Sha1Context_Update(TPM_SHA1_CONTEXT *context,
+				  const unsigned char *data,
+				  uint32_t length)
+{
+    TPM_SHA1_Update(context, data, length, tpm_sha1_engine->block);
+    return 0;
+}
+
+/* TPM_Sha1Context_Final() extracts the SHA-1 digest 'md' from the caller owned context and zeros
+   the context
+*/
+
+TPM_RESULT TPM_Sha1Context_Final(unsigned char *md,
+				 TPM_SHA1_CONTEXT *context)
+{
+    TPM_SHA1_Final(md, context, tpm_sha1_engine->block);
+    /* zero because the SHA1 context might have data left from an HMAC */
+    memset(context, 0, sizeof(TPM_SHA1_CONTEXT));
+    return 0;
+}
+
+/* TPM_Sha1Context_FinalCounters() extracts 'n' digests from the caller owned context, each one
+   continuing the context with a 4 byte big endian counter, 'counter', 'counter' + 1, ...  'md'
+   receives n * TPM_DIGEST_SIZE bytes.  This is the MGF1 inner loop with the seed already hashed.
+
+   The context is not changed, so it can be used again for the following counters.
+
+   When the counters and the padding fit in the last block, the last blocks of all counters differ
+   only in the counter bytes, and they are compressed together by the lane function.
+*/
+
+TPM_RESULT TPM_Sha1Context_FinalCounters(unsigned char *md,
+					 const TPM_SHA1_CONTEXT *context,
+					 uint32_t counter,
+					 uint32_t n)
+{
+    unsigned char	blocks[TPM_SHA1_LANES][64];
+    unsigned char	counter_n[4];
+    TPM_SHA1_CONTEXT	copy;
+    uint32_t		num = context->num;
+    uint32_t		bits;
+    uint32_t		lanes;
+    uint32_t		l;
+
+    /* data, counter, 0x80, 64 bit length */
+    if (num + 4 + 1 + 8 <= 64) {
+	memcpy(blocks[0], context->data, num);
+	blocks[0][num + 4] = 0x80;
+	memset(blocks[0] + num + 5, 0, 56 - (num + 5));
+	bits = context->Nl + 32;
+	TPM_SHA1_STORE32(blocks[0] + 56, context->Nh + ((bits < context->Nl) ? 1 : 0));
+	TPM_SHA1_STORE32(blocks[0] + 60, bits);
+	for (l = 1 ; l < TPM_SHA1_LANES ; l++) {
+	    memcpy(blocks[l], blocks[0], 64);
+	}
+	for ( ; n > 0 ; n -= lanes, md += TPM_DIGEST_SIZE * lanes) {
+	    lanes = (n < TPM_SHA1_LANES) ? n : TPM_SHA1_LANES;
+	    for (l = 0 ; l < lanes ; l++, counter++) {
+		TPM_SHA1_STORE32(blocks[l] + num, counter);
+	    }
+	    tpm_sha1_lane->lanes(md, context->h, blocks[0], lanes);
+	}
+    }
+    /* the padding needs another block, finish each counter separately */
+    else {
+	for ( ; n > 0 ; n--, md += TPM_DIGEST_SIZE, counter++) {
+	    copy = *context;
+	    TPM_SHA1_STORE32(counter_n, counter);
+	    TPM_SHA1_Update(&copy, counter_n, 4, tpm_sha1_engine->block);
+	    TPM_SHA1_Final(md, &copy, tpm_sha1_engine->block);
+	}
+    }
+    /* zero because the context might be from a secret seed */
+    memset(blocks, 0, sizeof(blocks));
+    memset(&copy, 0, sizeof(TPM_SHA1_CONTEXT));
+    return 0;
+}
@@ -0,0 +1,77 @@
+/********************************************************************************/
+/*										*/
+/*				SHA-1 Engine					*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+#ifndef TPM_SHA1_H
+#define TPM_SHA1_H
+
+#include "tpm_types.h"
+
+/* number of 32-bit words in a SHA-1 block */
+
+#define TPM_SHA1_LBLOCK		16
+
+/* most blocks compressed in parallel by TPM_Sha1Context_FinalCounters() */
+
+#define TPM_SHA1_LANES		8
+
+/* CPU features found by TPM_SHA1Engine_Init(), returned by TPM_SHA1Engine_CpuFeatures() */
+
+#define TPM_SHA1_CPU_SHANI	0x00000001	/* SHA, SSSE3, SSE4.1 */
+#define TPM_SHA1_CPU_AVX2	0x00000002	/* AVX2 and OS support for the YMM state */
+
+/* TPM_SHA1_CONTEXT is the state of the built-in SHA-1 engine.  It is used for the allocated SHA-1
+   threads and as caller owned storage for one-shot hashes.
+
+   The fields match the OpenSSL SHA_CTX, so that the serialized SHA-1 threads do not change.  'data'
+   holds the raw bytes of a partial block.
+*/
+
+typedef struct tdTPM_SHA1_CONTEXT {
+    uint32_t	h[5];			/* chaining value */
+    uint32_t	Nl;			/* message length in bits, low word */
+    uint32_t	Nh;			/* message length in bits, high word */
+    uint32_t	data[TPM_SHA1_LBLOCK];	/* partial block */
+    uint32_t	num;			/* bytes in data */
+} TPM_SHA1_CONTEXT;
+
+void       TPM_SHA1Engine_Init(void);
+TPM_RESULT TPM_SHA1Engine_Test(void);
+uint32_t   TPM_SHA1Engine_CpuFeatures(void);
+
+TPM_RESULT TPM_Sha1Context_FinalCounters(unsigned char *md,
+					 const TPM_SHA1_CONTEXT *context,
+					 uint32_t counter,
+					 uint32_t n);
+
+#endif
@@ -41,6 +41,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "tpm_arena.h"
 #include "tpm_cryptoh.h"
 #include "tpm_debug.h"
 #include "tpm_error.h"
@@ -54,6 +55,21 @@ void TPM_SizedBuffer_Init(TPM_SIZED_BUFFER *tpm_sized_buffer)
 {
     tpm_sized_buffer->size = 0;
     tpm_sized_buffer->buffer = NULL;
+    tpm_sized_buffer->arena = NULL;
+    return;
+}
+
+/* TPM_SizedBuffer_InitArena() initializes a sized buffer for a command temporary.  Its buffer is
+   allocated from 'tpm_arena' until TPM_SizedBuffer_Delete(), which does not free it.
+
+   It must not be moved into state that outlives the command.  See tpm_arena.c.
+*/
+
+void TPM_SizedBuffer_InitArena(TPM_SIZED_BUFFER *tpm_sized_buffer,
+                               TPM_ARENA *tpm_arena)
+{
+    TPM_SizedBuffer_Init(tpm_sized_buffer);
+    tpm_sized_buffer->arena = tpm_arena;
     return;
 }
 
@@ -86,7 +102,8 @@ TPM_RESULT TPM_SizedBuffer_Load(TPM_SIZED_BUFFER *tpm_sized_buffer,     /* resul
     if ((rc == 0) && (tpm_sized_buffer->size > 0)) {
         /* allocate memory for the buffer */
         if (rc == 0) {
-            rc = TPM_Malloc(&(tpm_sized_buffer->buffer), tpm_sized_buffer->size);
+            rc = TPM_Arena_Malloc(tpm_sized_buffer->arena,
+                                  &(tpm_sized_buffer->buffer), tpm_sized_buffer->size);
         }
         /* copy the buffer */
         if (rc == 0) {
@@ -115,8 +132,10 @@ TPM_RESULT TPM_SizedBuffer_Set(TPM_SIZED_BUFFER *tpm_sized_buffer,
     /* allocate memory for the buffer, and copy the buffer */
     if (rc == 0) {
         if (size > 0) {
-            rc = TPM_Realloc(&(tpm_sized_buffer->buffer),
-                             size);
+            rc = TPM_Arena_Realloc(tpm_sized_buffer->arena,
+                                   &(tpm_sized_buffer->buffer),
+                                   tpm_sized_buffer->size,
+                                   size);
             if (rc == 0) {
                 tpm_sized_buffer->size = size;
                 memcpy(tpm_sized_buffer->buffer, data, size);
@@ -212,7 +231,7 @@ void TPM_SizedBuffer_Delete(TPM_SIZED_BUFFER *tpm_sized_buffer)
 {
     printf("  TPM_SizedBuffer_Delete:\n");
     if (tpm_sized_buffer != NULL) {
-        free(tpm_sized_buffer->buffer);
+        TPM_Arena_Free(tpm_sized_buffer->arena, tpm_sized_buffer->buffer);
         TPM_SizedBuffer_Init(tpm_sized_buffer);
     }
     return;
@@ -231,7 +250,7 @@ TPM_RESULT TPM_SizedBuffer_Allocate(TPM_SIZED_BUFFER *tpm_sized_buffer,
 
     printf("  TPM_SizedBuffer_Allocate: Size %u\n", size);
     tpm_sized_buffer->size = size;
-    rc = TPM_Malloc(&(tpm_sized_buffer->buffer), size);
+    rc = TPM_Arena_Malloc(tpm_sized_buffer->arena, &(tpm_sized_buffer->buffer), size);
     return rc;
 }
 
@@ -297,8 +316,10 @@ TPM_RESULT TPM_SizedBuffer_Append32(TPM_SIZED_BUFFER *tpm_sized_buffer,
            tpm_sized_buffer->size, uint32);
     /* allocate space for another uint32_t */
     if (rc == 0) {
-        rc = TPM_Realloc(&(tpm_sized_buffer->buffer),
-                         tpm_sized_buffer->size + sizeof(uint32_t));
+        rc = TPM_Arena_Realloc(tpm_sized_buffer->arena,
+                               &(tpm_sized_buffer->buffer),
+                               tpm_sized_buffer->size,
+                               tpm_sized_buffer->size + sizeof(uint32_t));
     }
     if (rc == 0) {
         uint32_t ndata = htonl(uint32);           /* convert to network byte order */
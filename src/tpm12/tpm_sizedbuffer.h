@@ -44,6 +44,8 @@
 #include "tpm_store.h"
 
 void       TPM_SizedBuffer_Init(TPM_SIZED_BUFFER *tpm_sized_buffer);
+void       TPM_SizedBuffer_InitArena(TPM_SIZED_BUFFER *tpm_sized_buffer,
+                                     TPM_ARENA *tpm_arena);
 TPM_RESULT TPM_SizedBuffer_Load(TPM_SIZED_BUFFER *tpm_sized_buffer,
                                 unsigned char **stream,
                                 uint32_t *stream_size);
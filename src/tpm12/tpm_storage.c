@@ -318,7 +318,8 @@ TPM_RESULT TPM_SealedData_GenerateEncData(TPM_SIZED_BUFFER *enc_data,
     TPM_STORE_BUFFER	sbuffer;		/* TPM_SEALED_DATA serialization */
 
     printf(" TPM_SealedData_GenerateEncData\n");
-    TPM_Sbuffer_Init(&sbuffer);			/* freed @1 */
+    /* the serialization is a temporary in the same arena as the result, if any */
+    TPM_Sbuffer_InitArena(&sbuffer, enc_data->arena);	/* freed @1 */
     /* serialize the TPM_SEALED_DATA */
     if (rc == 0) {
 	rc = TPM_SealedData_Store(&sbuffer, tpm_sealed_data);
@@ -342,28 +343,34 @@ TPM_RESULT TPM_SealedData_DecryptEncData(TPM_SEALED_DATA *tpm_sealed_data,	/* re
 					 TPM_KEY *tpm_key)		/* key for decrypting */
 {
     TPM_RESULT		rc = 0;
-    unsigned char	*decryptData = NULL;	/* freed @1 */
+    TPM_SIZED_BUFFER	decryptData;		/* freed @1 */
     uint32_t		decryptDataLength = 0;	/* actual valid data */
     unsigned char	*stream;
     uint32_t		stream_size;
     
     printf(" TPM_SealedData_DecryptEncData:\n");
+    /* the decrypted stream is a temporary in the same arena as the result, if any */
+    TPM_SizedBuffer_InitArena(&decryptData, tpm_sealed_data->data.arena);	/* freed @1 */
     /* allocate space for the decrypted data */
     if (rc == 0) {
-	rc = TPM_RSAPrivateDecryptMalloc(&decryptData,		/* decrypted data */
-					 &decryptDataLength,	/* actual size of decrypted data */
-					 enc_data->buffer,	/* encrypted data */
-					 enc_data->size,	/* encrypted data size */
-					 tpm_key);
+	rc = TPM_SizedBuffer_Allocate(&decryptData, tpm_key->pubKey.size);
+    }
+    if (rc == 0) {
+	rc = TPM_RSAPrivateDecryptH(decryptData.buffer,	/* decrypted data */
+				    &decryptDataLength,	/* actual size of decrypted data */
+				    decryptData.size,	/* size of decrypted data buffer */
+				    enc_data->buffer,	/* encrypted data */
+				    enc_data->size,	/* encrypted data size */
+				    tpm_key);
     }
     /* load the TPM_SEALED_DATA structure from the decrypted data stream */
     if (rc == 0) {
 	/* use temporary variables, because TPM_SealedData_Load() moves the stream */
-	stream = decryptData;
+	stream = decryptData.buffer;
 	stream_size = decryptDataLength;
 	rc = TPM_SealedData_Load(tpm_sealed_data, &stream, &stream_size);
     }
-    free(decryptData);		/* @1 */
+    TPM_SizedBuffer_Delete(&decryptData);	/* @1 */
     return rc;
 }
 
@@ -602,10 +609,14 @@ TPM_RESULT TPM_StoredData_GenerateDigest(TPM_DIGEST tpm_digest,
 					 unsigned int version)
 {
     TPM_RESULT		rc = 0;
-    TPM_STORE_BUFFER	sbuffer;	/* TPM_STORED_DATA serialization */
+    TPM_SHA1_CONTEXT	context;	/* caller owned, nothing to free */
+    TPM_STORE_BUFFER	sbuffer;	/* digest sink of the TPM_STORED_DATA serialization */
     
     printf(" TPM_StoredData_GenerateDigest:\n");
-    TPM_Sbuffer_Init(&sbuffer);			/* freed @1 */
+    TPM_Sbuffer_InitDigest(&sbuffer, &context);	/* freed @1 */
+    if (rc == 0) {
+	rc = TPM_Sha1Context_Init(&context);
+    }
     /* serialize the TPM_STORED_DATA excluding the encData fields */
     if (rc == 0) {
 	rc = TPM_StoredData_StoreClearData(&sbuffer, tpm_stored_data, version);
@@ -637,11 +648,11 @@ static TPM_RESULT TPM_SealCryptCommon(BYTE **o1,	/* freed by caller */
 				      TPM_NONCE nonceOdd)
 {
     TPM_RESULT		rc = 0;
-    BYTE		*x1;			/* XOR string, MGF1 output */
+    TPM_MGF1_CONTEXT	x1;			/* XOR string, MGF1 output stream */
     TPM_DIGEST		ctr;			/* symmetric key algorithm CTR */
 
     printf(" TPM_SealCryptCommon:\n");
-    x1 = NULL;					/* freed @1 */
+    TPM_Mgf1Context_Init(&x1);			/* freed @1 */
 
     /* allocate for the output o1 */
     if (rc == TPM_SUCCESS) {
@@ -657,24 +668,22 @@ static TPM_RESULT TPM_SealCryptCommon(BYTE **o1,	/* freed by caller */
 	    /* i. Use MGF1 to create string X1 of length sealedDataSize. The inputs to MGF1 are;
 	       authLastnonceEven, nonceOdd, "XOR", and authHandle -> sharedSecret. The four
 	       concatenated values form the Z value that is the seed for MFG1. */
-	    rc = TPM_MGF1_GenerateArray(&x1,		/* MGF1 array */
-					inData->size,	/* MGF1 array length */
-					
-					TPM_NONCE_SIZE +
-					TPM_NONCE_SIZE +
-					sizeof("XOR") -1 +
-					TPM_DIGEST_SIZE, /* seed length */
-					
-					TPM_NONCE_SIZE, auth_session_data->nonceEven,
-					TPM_NONCE_SIZE, nonceOdd,
-					sizeof("XOR") -1, "XOR",
-					TPM_DIGEST_SIZE, auth_session_data->sharedSecret,
-					0, NULL);
+	    rc = TPM_Mgf1Context_Set(&x1,		/* MGF1 stream */
+				     
+				     TPM_NONCE_SIZE +
+				     TPM_NONCE_SIZE +
+				     sizeof("XOR") -1 +
+				     TPM_DIGEST_SIZE, /* seed length */
+				     
+				     TPM_NONCE_SIZE, auth_session_data->nonceEven,
+				     TPM_NONCE_SIZE, nonceOdd,
+				     sizeof("XOR") -1, "XOR",
+				     TPM_DIGEST_SIZE, auth_session_data->sharedSecret,
+				     0, NULL);
 	}
 	/* ii. Create o1 by XOR of d1 -> data and X1 */
 	if (rc == TPM_SUCCESS) {
-	    TPM_PrintFour("  TPM_SealCryptCommon: XOR key", x1);
-	    TPM_XOR(*o1, inData->buffer, x1, inData->size);
+	    rc = TPM_Mgf1Context_Xor(&x1, *o1, inData->buffer, inData->size);
 	}
 	break;
       case TPM_ET_AES128_CTR:
@@ -710,7 +719,7 @@ static TPM_RESULT TPM_SealCryptCommon(BYTE **o1,	/* freed by caller */
 	TPM_PrintFour("  TPM_SealCryptCommon: output data", *o1);
 	
     }
-    free(x1);				/* @1 */
+    TPM_Mgf1Context_Delete(&x1);	/* @1 */
     return rc;
 }
 
@@ -782,11 +791,13 @@ TPM_RESULT TPM_Process_Seal(tpm_state_t *tpm_state,
     
     printf("TPM_Process_Seal: Ordinal Entry\n");
     TPM_SizedBuffer_Init(&pcrInfo);			/* freed @1 */
-    TPM_SizedBuffer_Init(&inData);			/* freed @2 */
+    TPM_SizedBuffer_InitArena(&inData, &(tpm_state->tpm_arena));	/* freed @2 */
     TPM_StoredData_Init(&s1StoredData, v1PcrVersion);	/* freed @3, default is v1 */
     TPM_PCRInfo_Init(&tpm_pcr_info);			/* freed @4 */
     TPM_PCRInfoLong_Init(&tpm_pcr_info_long);		/* freed @5 */
     TPM_SealedData_Init(&s2SealedData);			/* freed @6 */
+    /* the copy of inData is only encrypted into s1StoredData */
+    TPM_SizedBuffer_InitArena(&(s2SealedData.data), &(tpm_state->tpm_arena));
     s1_12 = (TPM_STORED_DATA12 *)&s1StoredData;		/* to avoid casts */
     /*
       get inputs
@@ -943,6 +954,8 @@ TPM_RESULT TPM_Process_Seal(tpm_state_t *tpm_state,
 	/* 9. Set S1 -> encData to all zeros */
 	printf("TPM_Process_Seal: V%u\n", v1PcrVersion);
 	TPM_StoredData_Init(&s1StoredData, v1PcrVersion);
+	/* the encrypted S2 is only returned */
+	TPM_SizedBuffer_InitArena(&(s1StoredData.encData), &(tpm_state->tpm_arena));
 	/* 10. Set S1 -> sealInfoSize to pcrInfoSize */
 	/* NOTE This step is unnecessary.  If pcrInfoSize is 0, sealInfoSize is already initialized
 	   to 0.  If pcrInfoSize is non-zero, sealInfoSize is the result of serialization of the
@@ -1594,6 +1607,10 @@ TPM_RESULT TPM_Process_Unseal(tpm_state_t *tpm_state,
     printf("TPM_Process_Unseal: Ordinal Entry\n");
     TPM_StoredData_Init(&inData, v1StoredDataVersion);	/* freed @1, default is v1 */
     TPM_SealedData_Init(&d1SealedData); 		/* freed @2 */
+    /* the blob and the unsealed data are only used by this command */
+    TPM_SizedBuffer_InitArena(&(inData.sealInfo), &(tpm_state->tpm_arena));
+    TPM_SizedBuffer_InitArena(&(inData.encData), &(tpm_state->tpm_arena));
+    TPM_SizedBuffer_InitArena(&(d1SealedData.data), &(tpm_state->tpm_arena));
     o1Encrypted = NULL;					/* freed @3 */
     s2StoredData = (TPM_STORED_DATA12 *)&inData;	/* inData when it's a TPM_STORED_DATA12
 							   structure */
@@ -43,9 +43,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include "tpm_arena.h"
 #include "tpm_commands.h"
 #include "tpm_constants.h"
 #include "tpm_crypto.h"
+#include "tpm_cryptoh.h"
 #include "tpm_debug.h"
 #include "tpm_error.h"
 #include "tpm_memory.h"
@@ -57,6 +59,9 @@
   ->buffer;             beginning of buffer
   ->buffer_current;     first empty position in buffer
   ->buffer_end;         one past last valid position in buffer
+  ->sha1_context;       if not NULL, digest sink, appended bytes are hashed and not stored
+  ->fixed;              if TRUE, the buffer is owned by the caller and is not grown or freed
+  ->arena;              if not NULL, the buffer is grown from the command arena and not freed
 */
 
 /* local prototypes */
@@ -72,6 +77,54 @@ void TPM_Sbuffer_Init(TPM_STORE_BUFFER *sbuffer)
     sbuffer->buffer = NULL;
     sbuffer->buffer_current = NULL;
     sbuffer->buffer_end = NULL;
+    sbuffer->sha1_context = NULL;
+    sbuffer->fixed = FALSE;
+    sbuffer->arena = NULL;
+}
+
+/* TPM_Sbuffer_InitDigest() sets up a serialize buffer that is a digest sink.  Appended bytes are
+   hashed into the caller's started 'sha1_context' rather than stored, so a structure can be
+   digested through its _Store function without allocating a buffer.
+
+   TPM_Sbuffer_Get() returns an empty stream.  TPM_Sbuffer_Delete() does not touch the context.
+*/
+
+void TPM_Sbuffer_InitDigest(TPM_STORE_BUFFER *sbuffer,
+                            TPM_SHA1_CONTEXT *sha1_context)
+{
+    TPM_Sbuffer_Init(sbuffer);
+    sbuffer->sha1_context = sha1_context;
+}
+
+/* TPM_Sbuffer_InitFixed() sets up a serialize buffer over caller owned memory of 'size' bytes, so
+   that a structure can be serialized in place without allocating.
+
+   An append that does not fit returns TPM_SIZE rather than growing the buffer.
+   TPM_Sbuffer_Delete() does not free the buffer.
+*/
+
+void TPM_Sbuffer_InitFixed(TPM_STORE_BUFFER *sbuffer,
+                           unsigned char *buffer,
+                           uint32_t size)
+{
+    TPM_Sbuffer_Init(sbuffer);
+    sbuffer->buffer = buffer;
+    sbuffer->buffer_current = buffer;
+    sbuffer->buffer_end = buffer + size;
+    sbuffer->fixed = TRUE;
+}
+
+/* TPM_Sbuffer_InitArena() sets up a serialize buffer for a command temporary.  It grows from
+   'tpm_arena' rather than the heap, and TPM_Sbuffer_Delete() does not free it.
+
+   The buffer must not be moved into state that outlives the command.  See tpm_arena.c.
+*/
+
+void TPM_Sbuffer_InitArena(TPM_STORE_BUFFER *sbuffer,
+                           TPM_ARENA *tpm_arena)
+{
+    TPM_Sbuffer_Init(sbuffer);
+    sbuffer->arena = tpm_arena;
 }
 
 /* TPM_Sbuffer_Load() loads TPM_STORE_BUFFER that has been serialized using
@@ -115,7 +168,9 @@ TPM_RESULT TPM_Sbuffer_Load(TPM_STORE_BUFFER *sbuffer,
 
 void TPM_Sbuffer_Delete(TPM_STORE_BUFFER *sbuffer)
 {
-    free(sbuffer->buffer);
+    if (!sbuffer->fixed) {
+        TPM_Arena_Free(sbuffer->arena, sbuffer->buffer);
+    }
     TPM_Sbuffer_Init(sbuffer);
 }
 
@@ -188,12 +243,13 @@ TPM_RESULT TPM_Sbuffer_Set(TPM_STORE_BUFFER *sbuffer,
 		sbuffer->buffer = buffer;
 		sbuffer->buffer_current = buffer + length;
 		sbuffer->buffer_end = buffer + total;
+		sbuffer->sha1_context = NULL;
+		sbuffer->fixed = FALSE;
+		sbuffer->arena = NULL;
 	    }
 	}
 	else {	/* buffer == NULL */
-	    sbuffer->buffer = NULL;
-	    sbuffer->buffer_current = NULL;
-	    sbuffer->buffer_end = NULL;
+	    TPM_Sbuffer_Init(sbuffer);
 	}
     }
     return rc;
@@ -215,12 +271,22 @@ TPM_RESULT TPM_Sbuffer_Append(TPM_STORE_BUFFER *sbuffer,
     size_t current_length;      /* bytes in current buffer */
     size_t new_size;            /* size of new buffer */
     
+    /* a digest sink hashes the data, nothing is stored */
+    if ((rc == 0) && (sbuffer->sha1_context != NULL)) {
+        rc = TPM_Sha1Context_Update(sbuffer->sha1_context, data, data_length);
+    }
     /* can data fit? */
-    if (rc == 0) {
+    if ((rc == 0) && (sbuffer->sha1_context == NULL)) {
         /* cast safe as end is always greater than current */
         free_length = (size_t)(sbuffer->buffer_end - sbuffer->buffer_current);
         /* if data cannot fit in buffer as sized */
         if (free_length < data_length) {
+            /* a caller owned buffer cannot grow */
+            if (sbuffer->fixed) {
+                printf("TPM_Sbuffer_Append: Error, fixed buffer has %lu bytes free, needs %lu\n",
+                       (unsigned long)free_length, (unsigned long)data_length);
+                rc = TPM_SIZE;
+            }
             /* This test will fail long before the add uint32_t overflow */
             if (rc == 0) {
                 /* cast safe as current is always greater than start */
@@ -247,7 +313,8 @@ TPM_RESULT TPM_Sbuffer_Append(TPM_STORE_BUFFER *sbuffer,
                        (unsigned long)data_length,
                        (unsigned long)current_size,
                        (unsigned long)new_size);
-                rc = TPM_Realloc(&(sbuffer->buffer), new_size);
+                rc = TPM_Arena_Realloc(sbuffer->arena, &(sbuffer->buffer),
+                                       current_size, new_size);
             }
             if (rc == 0) {
                 sbuffer->buffer_end = sbuffer->buffer + new_size;       /* end */
@@ -256,7 +323,7 @@ TPM_RESULT TPM_Sbuffer_Append(TPM_STORE_BUFFER *sbuffer,
         }
     }
     /* append the data */
-    if (rc == 0) {
+    if ((rc == 0) && (sbuffer->sha1_context == NULL)) {
         memcpy(sbuffer->buffer_current, data, data_length);
         sbuffer->buffer_current += data_length;
     }
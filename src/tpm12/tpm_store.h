@@ -45,6 +45,13 @@
 #include "tpm_types.h"
 
 void       TPM_Sbuffer_Init(TPM_STORE_BUFFER *sbuffer);
+void       TPM_Sbuffer_InitDigest(TPM_STORE_BUFFER *sbuffer,
+                                  TPM_SHA1_CONTEXT *sha1_context);
+void       TPM_Sbuffer_InitFixed(TPM_STORE_BUFFER *sbuffer,
+                                 unsigned char *buffer,
+                                 uint32_t size);
+void       TPM_Sbuffer_InitArena(TPM_STORE_BUFFER *sbuffer,
+                                 TPM_ARENA *tpm_arena);
 TPM_RESULT TPM_Sbuffer_Load(TPM_STORE_BUFFER *sbuffer,
                             unsigned char **stream,
                             uint32_t *stream_size);
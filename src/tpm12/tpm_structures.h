@@ -44,6 +44,7 @@
 #include "tpm_constants.h"
 #include "tpm_types.h"
 #include "tpm_nvram_const.h"
+#include "tpm_sha1.h"
 
 /* Sanity check on build macros are centralized here, since any TPM will use this header */
 
@@ -92,22 +93,53 @@
 #error "Must define either TPM_DES or TPM_AES"
 #endif
 
+/* This structure is a per TPM instance bump allocator for the temporaries of one command.  See
+   tpm_arena.c.
+
+   Memory is handed out from 'buffer' in order and is never freed individually.  Allocations that
+   do not fit are taken from the heap and chained on 'overflow'.  All of it is cleared and released
+   by TPM_Arena_Reset() at the end of the command.
+*/
+
+typedef struct tdTPM_ARENA {
+    unsigned char *buffer;              /* block, allocated on first use */
+    uint32_t used;                      /* bytes of the block handed out */
+    unsigned char *last;                /* most recent allocation from the block */
+    struct tdTPM_ARENA_OVERFLOW *overflow;      /* heap allocations that did not fit */
+} TPM_ARENA;
+
 /* This structure is typically a cast from a subset of a larger TPM structure.  Two members - a 4
-   bytes size followed by a 4 bytes pointer to the data is a common TPM structure idiom. */
+   bytes size followed by a 4 bytes pointer to the data is a common TPM structure idiom.
+
+   If arena is not NULL, buffer is a command temporary drawn from that arena.  It is not freed by
+   TPM_SizedBuffer_Delete() and must not be kept past the end of the command.
+*/
 
 typedef struct tdTPM_SIZED_BUFFER {
     uint32_t size;
     BYTE *buffer;
+    TPM_ARENA *arena;                   /* command arena holding buffer, not owned */
 } TPM_SIZED_BUFFER;
 
 /* This structure implements a safe storage buffer, used throughout the code when serializing
    structures to a stream.
+
+   If sha1_context is not NULL, the buffer is a digest sink.  Appended bytes are hashed into the
+   context and not stored, and nothing is allocated.
+
+   If fixed is TRUE, the buffer is owned by the caller.  It is never grown or freed.
+
+   If arena is not NULL, the buffer is a command temporary grown from that arena.  It is not freed
+   by TPM_Sbuffer_Delete() and must not be kept past the end of the command.
 */
 
 typedef struct tdTPM_STORE_BUFFER {
     unsigned char *buffer;              /* beginning of buffer */
     unsigned char *buffer_current;      /* first empty position in buffer */
     unsigned char *buffer_end;          /* one past last valid position in buffer */
+    TPM_SHA1_CONTEXT *sha1_context;     /* digest sink, not owned */
+    TPM_BOOL fixed;                     /* caller owned buffer, not grown or freed */
+    TPM_ARENA *arena;                   /* command arena holding buffer, not owned */
 } TPM_STORE_BUFFER;
 
 /* 5.1 TPM_STRUCT_VER rev 100
@@ -701,6 +733,10 @@ typedef struct tdTPM_STORE_PRIVKEY {
     TPM_SIZED_BUFFER d_key;             /* private key */
     TPM_SIZED_BUFFER p_key;             /* private prime factor */
     TPM_SIZED_BUFFER q_key;             /* private prime factor */
+    /* NOTE: Added.  CRT parameters, calculated with q and d, never serialized */
+    TPM_SIZED_BUFFER dp_key;            /* d mod (p-1) */
+    TPM_SIZED_BUFFER dq_key;            /* d mod (q-1) */
+    TPM_SIZED_BUFFER qinv_key;          /* q^-1 mod p */
 } TPM_STORE_PRIVKEY; 
 
 /* 10.6 TPM_STORE_ASYMKEY rev 87
@@ -829,6 +865,11 @@ typedef struct tdTPM_KEY {
        these structures are always non-NULL. */
     TPM_STORE_ASYMKEY *tpm_store_asymkey;
     TPM_MIGRATE_ASYMKEY *tpm_migrate_asymkey;
+    /* NOTE: Added.  A cache of the crypto library private key token, constructed on the first
+       private key operation and freed with the key. */
+    void *tpm_rsa_pri_token;
+    /* NOTE: Added.  The same for the public key token, used by public key encryption. */
+    void *tpm_rsa_pub_token;
 } TPM_KEY; 
 
 /* 10.3 TPM_KEY12 rev 87
@@ -1592,6 +1633,10 @@ typedef struct tdTPM_DAA_CONTEXT {
 
                                    The TPM MUST set DAA_stage to 0 on TPM_Startup(ANY) */
     TPM_BOOL    DAA_scratch_null;       
+    /* added for performance */
+    TPM_BIGNUM  DAA_scratchBignum;      /* DAA_scratch kept as a bignum across stages.  When not
+                                           NULL, it supersedes the DAA_scratch bytes, which are
+                                           only written when the context is serialized. */
 } TPM_DAA_CONTEXT;
 
 /* 22.6 TPM_DAA_JOINDATA rev 91
@@ -2001,6 +2046,51 @@ typedef struct tdTPM_PERMANENT_DATA {
 
 /* NOTE: Vendor specific */
 
+/* TPM_HMAC_MIDSTATE holds the HMAC-SHA1 midstates for an authorization secret, the SHA-1 state
+   after compressing key XOR ipad and key XOR opad.  Each HMAC started from the midstates saves two
+   SHA-1 compressions.
+
+   This is vendor specific.  It is a cache and is never serialized.
+*/
+
+typedef struct tdTPM_HMAC_MIDSTATE {
+    TPM_SECRET key;             /* the HMAC key the midstates were calculated from */
+    TPM_SHA1_CONTEXT inner;     /* after key XOR ipad */
+    TPM_SHA1_CONTEXT outer;     /* after key XOR opad */
+    TPM_BOOL valid;             /* midstates match key */
+} TPM_HMAC_MIDSTATE;
+
+/* TPM_MGF1_CONTEXT generates an MGF1 mask as a stream.  'seed' is the SHA-1 state after the MGF1
+   seed, so each counter block costs only its final compression, and the counter blocks are
+   generated several at a time.
+
+   This is vendor specific.  It is never serialized.
+*/
+
+typedef struct tdTPM_MGF1_CONTEXT {
+    TPM_SHA1_CONTEXT seed;      /* SHA-1 state after the seed */
+    uint32_t counter;           /* counter of the next block to generate */
+    unsigned char mask[TPM_SHA1_LANES * TPM_DIGEST_SIZE];      /* generated mask */
+    uint32_t maskOffset;        /* first unused byte in mask */
+    uint32_t maskLength;        /* valid bytes in mask */
+} TPM_MGF1_CONTEXT;
+
+/* TPM_DRBG_CONTEXT is an HMAC_DRBG (SP 800-90A) using HMAC-SHA1.  The key K is kept as HMAC
+   midstates.  'buffer' holds prefetched output, which is zeroed as it is served.
+
+   This is vendor specific.  It is never serialized.
+*/
+
+typedef struct tdTPM_DRBG_CONTEXT {
+    TPM_HMAC_MIDSTATE key;      /* K and its midstates */
+    TPM_DIGEST value;           /* V */
+    uint32_t reseedCounter;     /* generate requests since the last (re)seed */
+    unsigned char buffer[TPM_DRBG_BUFFER_SIZE];        /* prefetched output */
+    uint32_t bufferOffset;      /* first unused byte in buffer */
+    uint32_t bufferLength;      /* valid bytes in buffer */
+    TPM_BOOL instantiated;      /* the DRBG has been seeded */
+} TPM_DRBG_CONTEXT;
+
 typedef struct tdTPM_AUTH_SESSION_DATA {
     /* vendor specific */
     TPM_AUTHHANDLE handle;      /* Handle for a session */
@@ -2013,6 +2103,8 @@ typedef struct tdTPM_AUTH_SESSION_DATA {
     TPM_DIGEST entityDigest;    /* OSAP tracks which entity established the OSAP session */
     TPM_DELEGATE_PUBLIC pub;    /* DSAP */
     TPM_BOOL valid;             /* added kgold: array entry is valid */
+    TPM_HMAC_MIDSTATE hmacMidstate;     /* HMAC key cache, the OSAP / DSAP sharedSecret or the last
+                                           OIAP entity usageAuth, not serialized */
 } TPM_AUTH_SESSION_DATA;
 
 
@@ -58,21 +58,21 @@
 
 #include "tpm_transport.h"
 
-/* TPM_Transport_CryptMgf1() takes a 'src', a preallocated 'dest', and an MGF1 'pad' of length
-   'len'.
+/* TPM_Transport_CryptMgf1() takes a 'src', a preallocated 'dest', and an MGF1 context
+   'tpm_mgf1_context' already seeded by TPM_Mgf1Context_Set().
 
    'size is the total length of 'src' and 'dest'.
    'index' is the start of the encrypt area
    'len' is the length of the encrypt area
    
    It copies 'src' to 'dest' up to 'index'.
-   It then copies 'src' XOR'ed with 'pad' for 'len'
+   It then copies 'src' XOR'ed with the next 'len' bytes of the MGF1 mask
    It then copies the remainder of 'src' to 'dest'
 */
 
 TPM_RESULT TPM_Transport_CryptMgf1(unsigned char *dest,
 				   const unsigned char *src,
-				   const unsigned char *pad,
+				   TPM_MGF1_CONTEXT *tpm_mgf1_context,
 				   uint32_t size,
 				   uint32_t index,
 				   uint32_t len)
@@ -93,7 +93,9 @@ TPM_RESULT TPM_Transport_CryptMgf1(unsigned char *dest,
 	dest += index;
 	src += index;
 	/* encrypt area */
-	TPM_XOR(dest, pad, src, len);
+	rc = TPM_Mgf1Context_Xor(tpm_mgf1_context, dest, src, len);
+    }
+    if (rc == 0) {
 	dest += len;
 	src += len;
 	/* trailing clear text area */
@@ -1824,6 +1826,7 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
     uint32_t			blockSize;		/* symmetric key block size, if needed */
     TPM_RESOURCE_TYPE		wrappedResourceType;   	/* for key handle special cases */
     TPM_COMMAND_CODE		ordw;			/* wrapped ORDW */
+    TPM_ORDINAL_TABLE		*ordwEntry = NULL;	/* ordinal table entry for ORDw */
     uint32_t			e1Dataw;		/* index into wrapped E1 */
     uint32_t			len1;			/* wrapped LEN1 */
     unsigned char		*g1Mgf1;		/* input MGF1 XOR string */
@@ -1857,6 +1860,7 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
     TPM_MODIFIER_INDICATOR	nLocality;		/* locality in nbo */
     uint32_t			nWrappedRspStreamSize;	/* wrappedRspStreamSize in nbo */
     unsigned char		*encryptRsp;		/* encrypted response */
+    TPM_MGF1_CONTEXT		mgf1Context;		/* MGF1 XOR stream */
     
     /* output parameters  */
     TPM_DIGEST			outParamDigest;
@@ -1877,6 +1881,7 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
     g2Mgf1 = NULL;					/* freed @9 */
     TPM_TransportInternal_Init(&t1TransportCopy);	/* freed @10 */
     encryptRsp = NULL;					/* freed @11 */
+    TPM_Mgf1Context_Init(&mgf1Context);			/* freed @12 */
     /*
       get inputs
     */
@@ -1966,6 +1971,7 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
 						      &keyHandle1Index, /* index into key handles */
 						      &keyHandle2Index,
 						      &ordw,
+						      &ordwEntry,
 						      &transportWrappable,
 						      &wrappedCmd);
 	if (returnCode != TPM_SUCCESS) {
@@ -1998,23 +2004,22 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
 	       concatenated together form the Z value that is the seed for the MGF1. */
 	    if (returnCode == TPM_SUCCESS) {
 		returnCode =
-		    TPM_MGF1_GenerateArray(&g1Mgf1,	/* G1 MGF1 array */
-					   len1,		/* G1 length */
-					   
-					   TPM_NONCE_SIZE + TPM_NONCE_SIZE + sizeof("in") - 1 +
-					   TPM_AUTHDATA_SIZE,	/* seed length */
+		    TPM_Mgf1Context_Set(&mgf1Context,	/* G1 MGF1 stream */
+					
+					TPM_NONCE_SIZE + TPM_NONCE_SIZE + sizeof("in") - 1 +
+					TPM_AUTHDATA_SIZE,	/* seed length */
 					   
-					   TPM_NONCE_SIZE, t1TransportCopy.transNonceEven, 
-					   TPM_NONCE_SIZE, transNonceOdd, 
-					   sizeof("in") - 1, "in", 
-					   TPM_AUTHDATA_SIZE, t1TransportCopy.authData, 
-					   0, NULL);
+					TPM_NONCE_SIZE, t1TransportCopy.transNonceEven, 
+					TPM_NONCE_SIZE, transNonceOdd, 
+					sizeof("in") - 1, "in", 
+					TPM_AUTHDATA_SIZE, t1TransportCopy.authData, 
+					0, NULL);
 	    }
 	    /* ii. Create C1 by performing an XOR of G1 and wrappedCmd starting at E1. */
 	    if (returnCode == TPM_SUCCESS) {
 		returnCode = TPM_Transport_CryptMgf1(decryptCmd,	/* output */
 						     wrappedCmd.buffer, /* input */
-						     g1Mgf1,		/* XOR pad */
+						     &mgf1Context,	/* XOR pad */
 						     wrappedCmd.size,	/* total size of buffers */
 						     e1Dataw,	/* start of encrypted part */
 						     len1);	/* length of encrypted part */
@@ -2293,7 +2298,7 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
 	returnCode = TPM_OrdinalTable_ParseWrappedRsp(&s2Dataw, 
 						      &len2,
 						      &rcw,
-						      ordw,
+						      ordwEntry,
 						      wrappedRspStream,
 						      wrappedRspStreamSize);
     }
@@ -2371,23 +2376,22 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
 	       concatenated together form the Z value that is the seed for the MGF1. */
 	    if (returnCode == TPM_SUCCESS) {
 		returnCode =
-		    TPM_MGF1_GenerateArray(&g2Mgf1,	/* G2 MGF1 array */
-					   len2,		/* G2 length */
+		    TPM_Mgf1Context_Set(&mgf1Context,	/* G2 MGF1 stream */
+					
+					TPM_NONCE_SIZE + TPM_NONCE_SIZE + sizeof("out") - 1 +
+					TPM_AUTHDATA_SIZE,	/* seed length */
 					   
-					   TPM_NONCE_SIZE + TPM_NONCE_SIZE + sizeof("out") - 1 +
-					   TPM_AUTHDATA_SIZE,	/* seed length */
-					   
-					   TPM_NONCE_SIZE, t1TransportCopy.transNonceEven, 
-					   TPM_NONCE_SIZE, transNonceOdd, 
-					   sizeof("out") - 1, "out", 
-					   TPM_AUTHDATA_SIZE, t1TransportCopy.authData, 
-					   0, NULL);
+					TPM_NONCE_SIZE, t1TransportCopy.transNonceEven, 
+					TPM_NONCE_SIZE, transNonceOdd, 
+					sizeof("out") - 1, "out", 
+					TPM_AUTHDATA_SIZE, t1TransportCopy.authData, 
+					0, NULL);
 	    }
 	    /* ii. Create E2 by performing an XOR of G2 and C2 starting at S2. */
 	    if (returnCode == TPM_SUCCESS) {
 		returnCode = TPM_Transport_CryptMgf1(encryptRsp,
 						     wrappedRspStream,
-						     g2Mgf1,
+						     &mgf1Context,
 						     wrappedRspStreamSize,
 						     s2Dataw,
 						     len2);
@@ -2544,6 +2548,7 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
     free(g2Mgf1);					/* @9 */
     TPM_TransportInternal_Delete(&t1TransportCopy);	/* @10 */
     free(encryptRsp);					/* @11 */
+    TPM_Mgf1Context_Delete(&mgf1Context);		/* @12 */
     return rcf;
 }
 
@@ -48,7 +48,7 @@
 
 TPM_RESULT TPM_Transport_CryptMgf1(unsigned char *dest,
                                    const unsigned char *src,
-                                   const unsigned char *pad,
+                                   TPM_MGF1_CONTEXT *tpm_mgf1_context,
                                    uint32_t size,
                                    uint32_t index,
                                    uint32_t len);
@@ -81,6 +81,9 @@ static int debug_fd = -1;
 static unsigned debug_level = 0;
 static char *debug_prefix = NULL;
 
+/* the debug level, or 0 if there is no debug fd, tested inline before calling TPMLIB_LogPrintf() */
+unsigned int tpmlib_log_level = 0;
+
 uint32_t TPMLIB_GetVersion(void)
 {
     return TPM_LIBRARY_VERSION;
@@ -113,6 +116,19 @@ TPM_RESULT TPMLIB_Process(unsigned char **respbuffer, uint32_t *resp_size,
                                  command, command_size);
 }
 
+/*
+ * Process a TPM command with a response buffer owned by the caller.
+ * The response is written directly into respbuffer, which is never
+ * reallocated. A response larger than respbufsize fails with TPM_SIZE.
+ */
+TPM_RESULT TPMLIB_ProcessInto(unsigned char *respbuffer, uint32_t respbufsize,
+                              uint32_t *resp_size,
+                              unsigned char *command, uint32_t command_size)
+{
+    return tpm_iface[0]->ProcessInto(respbuffer, respbufsize, resp_size,
+                                     command, command_size);
+}
+
 /*
  * Get the volatile state from the TPM. This function will return the
  * buffer and the length of the buffer to the caller in case everything
@@ -178,6 +194,15 @@ TPM_RESULT TPMLIB_ValidateState(enum TPMLIB_StateType st,
     return tpm_iface[0]->ValidateState(st, flags);
 }
 
+/*
+ * Configure the pool of pre-generated RSA key pairs. A depth of 0
+ * disables the pool, an exponent of 0 selects the default exponent.
+ */
+TPM_RESULT TPMLIB_SetRSAKeyPool(unsigned int depth, uint32_t exponent)
+{
+    return tpm_iface[0]->SetRSAKeyPool(depth, exponent);
+}
+
 static struct libtpms_callbacks libtpms_cbs;
 
 struct libtpms_callbacks *TPMLIB_GetCallbacks(void)
@@ -367,11 +392,13 @@ TPM_RESULT TPMLIB_DecodeBlob(const char *buffer, enum TPMLIB_BlobType type,
 void TPMLIB_SetDebugFD(int fd)
 {
     debug_fd = fd;
+    tpmlib_log_level = debug_fd ? debug_level : 0;
 }
 
 void TPMLIB_SetDebugLevel(unsigned level)
 {
     debug_level = level;
+    tpmlib_log_level = debug_fd ? debug_level : 0;
 }
 
 TPM_RESULT TPMLIB_SetDebugPrefix(const char *prefix)
@@ -67,6 +67,10 @@ struct tpm_interface {
     TPM_RESULT (*HashEnd)(void);
     TPM_RESULT (*ValidateState)(enum TPMLIB_StateType st,
                                 unsigned int flags);
+    TPM_RESULT (*SetRSAKeyPool)(unsigned int depth, uint32_t exponent);
+    TPM_RESULT (*ProcessInto)(unsigned char *respbuffer, uint32_t respbufsize,
+                              uint32_t *resp_size,
+                              unsigned char *command, uint32_t command_size);
 };
 
 extern const struct tpm_interface TPM12Interface;
@@ -81,6 +85,8 @@ TPM_RESULT TPM12_IO_TpmEstablished_Get(TPM_BOOL *tpmEstablished);
 uint32_t TPM12_GetBufferSize(void);
 
 /* internal logging function */
+extern unsigned int tpmlib_log_level;   /* 0 if logging is off */
+
 int TPMLIB_LogPrintf(const char *format, ...);
 void TPMLIB_LogPrintfA(unsigned int indent, const char *format, ...);
 
@@ -44,7 +44,12 @@
 
 #include "tpm12/tpm_debug.h"
 #include "tpm_error.h"
+#include "tpm12/tpm_crypto.h"
+#include "tpm12/tpm_cryptoh.h"
 #include "tpm12/tpm_init.h"
+#ifdef TPM_RSA_KEYPOOL
+#include "tpm12/tpm_keypool.h"
+#endif
 #include "tpm_library_intern.h"
 #include "tpm12/tpm_process.h"
 #include "tpm12/tpm_startup.h"
@@ -53,14 +58,26 @@
 
 TPM_RESULT TPM12_MainInit(void)
 {
-    return TPM_MainInit();
+    TPM_RESULT rc;
+
+    rc = TPM_MainInit();
+#ifdef TPM_RSA_KEYPOOL
+    if (rc == TPM_SUCCESS)
+        rc = TPM_RSAKeyPool_Start();
+#endif
+
+    return rc;
 }
 
 void TPM12_Terminate(void)
 {
+#ifdef TPM_RSA_KEYPOOL
+    TPM_RSAKeyPool_Stop();
+#endif
     TPM_Global_Delete(tpm_instances[0]);
     free(tpm_instances[0]);
     tpm_instances[0] = NULL;
+    TPM_Crypto_Terminate();
 }
 
 TPM_RESULT TPM12_Process(unsigned char **respbuffer, uint32_t *resp_size,
@@ -72,6 +89,14 @@ TPM_RESULT TPM12_Process(unsigned char **respbuffer, uint32_t *resp_size,
                         command, command_size);
 }
 
+TPM_RESULT TPM12_ProcessInto(unsigned char *respbuffer, uint32_t respbufsize,
+                             uint32_t *resp_size,
+                             unsigned char *command, uint32_t command_size)
+{
+    return TPM_ProcessInto(respbuffer, respbufsize, resp_size,
+                           command, command_size);
+}
+
 TPM_RESULT TPM12_VolatileAllStore(unsigned char **buffer,
                                   uint32_t *buflen)
 {
@@ -235,6 +260,19 @@ TPM_RESULT TPM12_ValidateState(enum TPMLIB_StateType st,
     return ret;
 }
 
+TPM_RESULT TPM12_SetRSAKeyPool(unsigned int depth, uint32_t exponent)
+{
+#ifdef TPM_RSA_KEYPOOL
+    return TPM_RSAKeyPool_SetParameters(depth, exponent);
+#else
+    if (depth != 0) {
+        printf("TPM12_SetRSAKeyPool: Error, built without RSA key pool support\n");
+        return TPM_BAD_PARAMETER;
+    }
+    return TPM_SUCCESS;
+#endif
+}
+
 const struct tpm_interface TPM12Interface = {
     .MainInit = TPM12_MainInit,
     .Terminate = TPM12_Terminate,
@@ -247,4 +285,6 @@ const struct tpm_interface TPM12Interface = {
     .HashEnd = TPM12_IO_Hash_End,
     .SetBufferSize = TPM12_SetBufferSize,
     .ValidateState = TPM12_ValidateState,
+    .SetRSAKeyPool = TPM12_SetRSAKeyPool,
+    .ProcessInto = TPM12_ProcessInto,
 };
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <libtpms/tpm_types.h>
+#include <libtpms/tpm_library.h>
+#include <libtpms/tpm_error.h>
+
+static unsigned char TPM_Startup_ST_CLEAR[] = {
+    0x00, 0xC1, 0x00, 0x00, 0x00, 0x0C, 0x00, 0x00, 0x00, 0x99,
+    0x00, 0x01
+};
+
+/* TPM_GetRandom for 20 bytes, the response is 34 bytes */
+static unsigned char TPM_GetRandom_20[] = {
+    0x00, 0xC1, 0x00, 0x00, 0x00, 0x0E, 0x00, 0x00, 0x00, 0x46,
+    0x00, 0x00, 0x00, 0x14
+};
+
+#define GETRANDOM_RESP_SIZE 34
+#define ERROR_RESP_SIZE     10
+
+static uint32_t get_returncode(const unsigned char *resp)
+{
+    return ((uint32_t)resp[6] << 24) | ((uint32_t)resp[7] << 16) |
+           ((uint32_t)resp[8] << 8) | (uint32_t)resp[9];
+}
+
+/* check that the 'len' bytes at 'buf' still hold the fill pattern */
+static int check_untouched(const unsigned char *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (buf[i] != 0xAA)
+            return 0;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    int res = EXIT_FAILURE;
+    TPM_RESULT rc;
+    unsigned char respbuffer[4096];
+    uint32_t resp_size;
+
+    rc = TPMLIB_MainInit();
+    if (rc != TPM_SUCCESS) {
+        printf("TPMLIB_MainInit() failed: 0x%02x\n", rc);
+        return EXIT_FAILURE;
+    }
+
+    rc = TPMLIB_ProcessInto(respbuffer, sizeof(respbuffer), &resp_size,
+                            TPM_Startup_ST_CLEAR, sizeof(TPM_Startup_ST_CLEAR));
+    if (rc != TPM_SUCCESS || resp_size != ERROR_RESP_SIZE ||
+        get_returncode(respbuffer) != TPM_SUCCESS) {
+        printf("TPM_Startup failed: 0x%02x\n", rc);
+        goto cleanup;
+    }
+
+    /* the response fits exactly */
+    memset(respbuffer, 0xAA, sizeof(respbuffer));
+    rc = TPMLIB_ProcessInto(respbuffer, GETRANDOM_RESP_SIZE, &resp_size,
+                            TPM_GetRandom_20, sizeof(TPM_GetRandom_20));
+    if (rc != TPM_SUCCESS || resp_size != GETRANDOM_RESP_SIZE ||
+        get_returncode(respbuffer) != TPM_SUCCESS) {
+        printf("Exact fit: unexpected result rc 0x%02x, size %u\n",
+               rc, resp_size);
+        goto cleanup;
+    }
+    if (!check_untouched(&respbuffer[GETRANDOM_RESP_SIZE], 64)) {
+        printf("Exact fit: bytes written past the buffer\n");
+        goto cleanup;
+    }
+
+    /* one byte short: the TPM returns a TPM_SIZE error response */
+    memset(respbuffer, 0xAA, sizeof(respbuffer));
+    rc = TPMLIB_ProcessInto(respbuffer, GETRANDOM_RESP_SIZE - 1, &resp_size,
+                            TPM_GetRandom_20, sizeof(TPM_GetRandom_20));
+    if (rc != TPM_SUCCESS || resp_size != ERROR_RESP_SIZE ||
+        get_returncode(respbuffer) != TPM_SIZE) {
+        printf("One byte short: unexpected result rc 0x%02x, size %u\n",
+               rc, resp_size);
+        goto cleanup;
+    }
+    /* no partial response remains behind the error response */
+    if (!check_untouched(&respbuffer[ERROR_RESP_SIZE], 64)) {
+        printf("One byte short: bytes written past the error response\n");
+        goto cleanup;
+    }
+
+    /* too small for even an error response */
+    memset(respbuffer, 0xAA, sizeof(respbuffer));
+    rc = TPMLIB_ProcessInto(respbuffer, ERROR_RESP_SIZE - 1, &resp_size,
+                            TPM_GetRandom_20, sizeof(TPM_GetRandom_20));
+    if (rc != TPM_SIZE || resp_size != 0) {
+        printf("9 byte buffer: unexpected result rc 0x%02x, size %u\n",
+               rc, resp_size);
+        goto cleanup;
+    }
+    if (!check_untouched(respbuffer, 64)) {
+        printf("9 byte buffer: bytes written to the buffer\n");
+        goto cleanup;
+    }
+
+    /* the TPM still works after the errors */
+    rc = TPMLIB_ProcessInto(respbuffer, sizeof(respbuffer), &resp_size,
+                            TPM_GetRandom_20, sizeof(TPM_GetRandom_20));
+    if (rc != TPM_SUCCESS || resp_size != GETRANDOM_RESP_SIZE ||
+        get_returncode(respbuffer) != TPM_SUCCESS) {
+        printf("TPM_GetRandom after errors failed: 0x%02x\n", rc);
+        goto cleanup;
+    }
+
+    res = EXIT_SUCCESS;
+
+cleanup:
+    TPMLIB_Terminate();
+
+    return res;
+}
@@ -0,0 +1,8 @@
+#!/bin/bash
+
+TPM_PATH=$(mktemp -d)
+export TPM_PATH
+
+trap "rm -rf $TPM_PATH" EXIT
+
+./processinto